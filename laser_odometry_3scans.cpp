@@ -5,7 +5,7 @@
 #include "laser_odometry_3scans.h"
 
 
-using namespace mrpt::utils;
+using namespace rf2o;
 using namespace Eigen;
 using namespace std;
 
@@ -22,6 +22,8 @@ void RF2O_3S::initialize(unsigned int size, float FOV_rad, bool is_test)
 	
     //Resize original range scan
     range_wf.resize(width);
+    range_wf_q.resize(width);
+    range_step = 0.f;
 
     //Resize the transformation matrices
     transformations.resize(ctf_levels);
@@ -31,39 +33,8 @@ void RF2O_3S::initialize(unsigned int size, float FOV_rad, bool is_test)
         transformations[i].setIdentity();
     }
 
-	//Resize pyramid
-	unsigned int s, cols_i;
+	//Number of levels of the pyramid
     const unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-    range_1.resize(pyr_levels); range_2.resize(pyr_levels); range_3.resize(pyr_levels);
-    range_12.resize(pyr_levels); range_13.resize(pyr_levels);
-    xx_1.resize(pyr_levels); xx_2.resize(pyr_levels); xx_3.resize(pyr_levels);
-    xx_12.resize(pyr_levels); xx_13.resize(pyr_levels);
-    yy_1.resize(pyr_levels); yy_2.resize(pyr_levels); yy_3.resize(pyr_levels);
-    yy_12.resize(pyr_levels); yy_13.resize(pyr_levels);
-    range_warped.resize(pyr_levels); xx_warped.resize(pyr_levels); yy_warped.resize(pyr_levels);
-    range_3_warpedTo2.resize(pyr_levels); xx_3_warpedTo2.resize(pyr_levels); yy_3_warpedTo2.resize(pyr_levels);
-
-	for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-
-        range_1[i].resize(cols_i); range_2[i].resize(cols_i); range_3[i].resize(cols_i);
-        range_12[i].resize(cols_i); range_13[i].resize(cols_i);
-        range_1[i].fill(0.f); range_2[i].fill(0.f); range_3[i].fill(0.f);
-        xx_1[i].resize(cols_i); xx_2[i].resize(cols_i); xx_3[i].resize(cols_i);
-        xx_12[i].resize(cols_i); xx_13[i].resize(cols_i);
-        xx_1[i].fill(0.f); xx_2[i].fill(0.f); xx_3[i].fill(0.f);
-        yy_1[i].resize(cols_i); yy_2[i].resize(cols_i); yy_3[i].resize(cols_i);
-        yy_12[i].resize(cols_i); yy_13[i].resize(cols_i);
-        yy_1[i].fill(0.f); yy_2[i].fill(0.f); yy_3[i].fill(0.f);
-
-		if (cols_i <= cols)
-		{
-            range_warped[i].resize(cols_i); xx_warped[i].resize(cols_i); yy_warped[i].resize(cols_i);
-            range_3_warpedTo2[i].resize(cols_i); xx_3_warpedTo2[i].resize(cols_i); yy_3_warpedTo2[i].resize(cols_i);
-		}
-    }
 
     //Resize aux variables
     dt_12.resize(cols); dt_13.resize(cols);
@@ -71,185 +42,44 @@ void RF2O_3S::initialize(unsigned int size, float FOV_rad, bool is_test)
     weights_12.resize(cols); weights_13.resize(cols);
     null_12.resize(cols); null_13.resize(cols);
     null_12.fill(false); null_13.fill(false);
-	cov_odo.assign(0.f);
+	cov_odo.fill(0.f);
     outliers.resize(cols);
     outliers.fill(false);
 
 
 	//Compute gaussian mask
 	g_mask[0] = 1.f/16.f; g_mask[1] = 0.25f; g_mask[2] = 6.f/16.f; g_mask[3] = g_mask[1]; g_mask[4] = g_mask[0];
+    pyramid.initialize(width, pyr_levels, fovh, g_mask, 0.3f, false, false);
+
+    //Lay out all the pyramid levels of every scan in a single aligned block
+    arena.initialize(pyramid.level_cols, 21);
+    arena.bind(range_1); arena.bind(range_2); arena.bind(range_3);
+    arena.bind(range_12); arena.bind(range_13); arena.bind(range_warped);
+    arena.bind(xx_1); arena.bind(xx_2); arena.bind(xx_3);
+    arena.bind(xx_12); arena.bind(xx_13); arena.bind(xx_warped);
+    arena.bind(yy_1); arena.bind(yy_2); arena.bind(yy_3);
+    arena.bind(yy_12); arena.bind(yy_13); arena.bind(yy_warped);
+    arena.bind(range_3_warpedTo2); arena.bind(xx_3_warpedTo2); arena.bind(yy_3_warpedTo2);
 
     //Initialize "last velocity" as zero
-	kai_abs.assign(0.f);
-	kai_loc_old.assign(0.f);
+	kai_abs.fill(0.f);
+	kai_loc_old.fill(0.f);
     overall_trans_prev.setIdentity();
 }
 
 
 void RF2O_3S::createScanPyramid()
 {
-	const float max_range_dif = 0.3f;
-	
     //Push scans back
     range_2.swap(range_3); xx_2.swap(xx_3); yy_2.swap(yy_3);
     range_1.swap(range_2); xx_1.swap(xx_2); yy_1.swap(yy_2);
 
-
-    //The number of levels of the pyramid does not match the number of levels used
-    //in the odometry computation (because we sometimes want to finish with lower resolutions)
-
-    unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-
-    //Generate levels
-    for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        unsigned int s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-		const unsigned int i_1 = i-1;
-
-        //              First level -> Filter, not downsample
-        //------------------------------------------------------------------------
-        if (i == 0)
-		{
-			for (unsigned int u = 0; u < cols_i; u++)
-            {	
-				const float dcenter = range_wf(u);
-					
-				//Inner pixels
-                if ((u>1)&&(u<cols_i-2))
-                {		
-					if (dcenter > 0.f)
-					{	
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)
-						{
-							const float abs_dif = abs(range_wf(u+l)-dcenter);
-							if (abs_dif < max_range_dif)
-							{
-								const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-								weight += aux_w;
-								sum += aux_w*range_wf(u+l);
-							}
-						}
-                        range_1[i](u) = sum/weight;
-					}
-					else
-                        range_1[i](u) = 0.f;
-
-                }
-
-                //Boundary
-                else
-                {
-                    if (dcenter > 0.f)
-					{						
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)	
-						{
-							const int indu = u+l;
-							if ((indu>=0)&&(indu<cols_i))
-							{
-								const float abs_dif = abs(range_wf(indu)-dcenter);										
-								if (abs_dif < max_range_dif)
-								{
-									const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-									weight += aux_w;
-									sum += aux_w*range_wf(indu);
-								}
-							}
-						}
-                        range_1[i](u) = sum/weight;
-					}
-					else
-                        range_1[i](u) = 0.f;
-
-                }
-            }
-		}
-
-        //                              Downsampling
-        //-----------------------------------------------------------------------------
-        else
-        {            
-			for (unsigned int u = 0; u < cols_i; u++)
-            {
-                const int u2 = 2*u;		
-                const float dcenter = range_1[i_1](u2);
-					
-				//Inner pixels
-                if ((u>0)&&(u<cols_i-1))
-                {		
-					if (dcenter > 0.f)
-					{	
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)
-						{
-                            const float abs_dif = abs(range_1[i_1](u2+l)-dcenter);
-							if (abs_dif < max_range_dif)
-							{
-								const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-								weight += aux_w;
-                                sum += aux_w*range_1[i_1](u2+l);
-							}
-						}
-                        range_1[i](u) = sum/weight;
-					}
-					else
-                        range_1[i](u) = 0.f;
-
-                }
-
-                //Boundary
-                else
-                {
-                    if (dcenter > 0.f)
-					{						
-                        float sum = 0.f, weight = 0.f;
-                        const unsigned int cols_i2 = range_1[i_1].rows();
-
-						for (int l=-2; l<3; l++)	
-						{
-							const int indu = u2+l;
-
-							if ((indu>=0)&&(indu<cols_i2))
-							{
-                                const float abs_dif = abs(range_1[i_1](indu)-dcenter);
-								if (abs_dif < max_range_dif)
-								{
-									const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-									weight += aux_w;
-                                    sum += aux_w*range_1[i_1](indu);
-								}
-							}
-						}
-                        range_1[i](u) = sum/weight;
-
-					}
-					else
-                        range_1[i](u) = 0.f;
-                }
-            }
-        }
-
-        //Calculate coordinates "xy" of the points
-        for (unsigned int u = 0; u < cols_i; u++) 
-		{
-            if (range_1[i](u) > 0.f)
-			{
-                const float tita = -0.5f*fovh + float(u)*fovh/float(cols_i-1);
-                xx_1[i](u) = range_1[i](u)*cos(tita);
-                yy_1[i](u) = range_1[i](u)*sin(tita);
-			}
-			else
-			{
-                xx_1[i](u) = 0.f;
-                yy_1[i](u) = 0.f;
-			}
-        }
-    }
+    //Filter, downsample and compute the coordinates of every level
+    if (range_step > 0.f)
+        pyramid.build(range_wf_q, range_step, range_1, xx_1, yy_1);
+    else
+        pyramid.build(range_wf, range_1, xx_1, yy_1);
+    cols_i = pyramid.level_cols.back();
 }
 
 void RF2O_3S::calculateCoord()
@@ -435,8 +265,8 @@ void RF2O_3S::solveSystemQuadResiduals3Scans()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
@@ -473,8 +303,8 @@ void RF2O_3S::solveSystemQuadResiduals3Scans()
 	
 //	//Solve the linear system of equations using a minimum least squares method
 //	MatrixXf AtA, AtB;
-//	AtA.multiply_AtA(A);
-//	AtB.multiply_AtB(A,B);
+//	AtA.noalias() = A.transpose()*A;
+//	AtB.noalias() = A.transpose()*B;
 //    kai_loc_level = AtA.ldlt().solve(AtB);
 //    VectorXf res = A*kai_loc_level - B;
 //	//cout << endl << "max res: " << res.maxCoeff();
@@ -517,8 +347,8 @@ void RF2O_3S::solveSystemQuadResiduals3Scans()
 //            }
 
 //        //Solve the linear system of equations using a minimum least squares method
-//        AtA.multiply_AtA(Aw);
-//        AtB.multiply_AtB(Aw,Bw);
+//        AtA.noalias() = Aw.transpose()*Aw;
+//        AtB.noalias() = Aw.transpose()*Bw;
 //        kai_loc_level = AtA.ldlt().solve(AtB);
 //        res = A*kai_loc_level - B;
 
@@ -561,8 +391,8 @@ void RF2O_3S::solveSystemQuadResiduals3Scans()
 
 //    //Solve the linear system of equations using a minimum least squares method
 //    MatrixXf AtA, AtB;
-//    AtA.multiply_AtA(A);
-//    AtB.multiply_AtB(A,B);
+//    AtA.noalias() = A.transpose()*A;
+//    AtB.noalias() = A.transpose()*B;
 //    kai_loc_level = AtA.ldlt().solve(AtB);
 //    VectorXf res = A*kai_loc_level - B;
 //    //cout << endl << "max res: " << res.maxCoeff();
@@ -613,8 +443,8 @@ void RF2O_3S::solveSystemQuadResiduals3Scans()
 //            }
 
 //        //Solve the linear system of equations using a minimum least squares method
-//        AtA.multiply_AtA(Aw);
-//        AtB.multiply_AtB(Aw,Bw);
+//        AtA.noalias() = Aw.transpose()*Aw;
+//        AtB.noalias() = Aw.transpose()*Bw;
 //        kai_loc_level = AtA.ldlt().solve(AtB);
 //        res = A*kai_loc_level - B;
 
@@ -689,8 +519,8 @@ void RF2O_3S::solveSystemQuadResiduals3Scans()
 
 //    //Solve the linear system of equations using a minimum least squares method
 //    MatrixXf AtA, AtB;
-//    AtA.multiply_AtA(A);
-//    AtB.multiply_AtB(A,B);
+//    AtA.noalias() = A.transpose()*A;
+//    AtB.noalias() = A.transpose()*B;
 //    kai_loc_level = AtA.ldlt().solve(AtB);
 //    VectorXf res = A*kai_loc_level - B;
 //    //cout << endl << "max res: " << res.maxCoeff();
@@ -741,8 +571,8 @@ void RF2O_3S::solveSystemQuadResiduals3Scans()
 //            }
 
 //        //Solve the linear system of equations using a minimum least squares method
-//        AtA.multiply_AtA(Aw);
-//        AtB.multiply_AtB(Aw,Bw);
+//        AtA.noalias() = Aw.transpose()*Aw;
+//        AtB.noalias() = Aw.transpose()*Bw;
 //        kai_loc_level = AtA.ldlt().solve(AtB);
 //        res = A*kai_loc_level - B;
 
@@ -837,8 +667,8 @@ void RF2O_3S::solveSystemSmoothTruncQuad3Scans()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -912,8 +742,8 @@ void RF2O_3S::solveSystemSmoothTruncQuad3Scans()
         }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -1002,8 +832,8 @@ void RF2O_3S::performWarping()
                 //Very close pixel
                 if (abs(round(uwarp) - uwarp) < 0.05f)
                 {
-                    range_warped[image_level](round(uwarp)) += range_w;
-                    wacu(round(uwarp)) += 1.f;
+                    range_warped[image_level](int(round(uwarp))) += range_w;
+                    wacu(int(round(uwarp))) += 1.f;
                 }
                 else
                 {
@@ -1081,8 +911,8 @@ void RF2O_3S::warpScan3To2()
                     //Very close pixel
                     if (abs(round(uwarp) - uwarp) < 0.05f)
                     {
-                        range_3_warpedTo2[image_level](round(uwarp)) += range_w;
-                        wacu(round(uwarp)) += 1.f;
+                        range_3_warpedTo2[image_level](int(round(uwarp))) += range_w;
+                        wacu(int(round(uwarp))) += 1.f;
                     }
                     else
                     {
@@ -1292,7 +1122,7 @@ void RF2O_3S::PoseUpdate()
     //						Update poses
     //-------------------------------------------------------
     laser_oldpose = laser_pose;
-    mrpt::poses::CPose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2)/fps);
+    RF2O_Pose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2)/fps);
     laser_pose = laser_pose + pose_aux_2D;
 
 
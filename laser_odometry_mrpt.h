@@ -0,0 +1,24 @@
+//====================================================
+//  Project: Laser odometry
+//  Conversions between the poses of the RF2O engines
+//  and MRPT (used by the MRPT-based harnesses)
+//====================================================
+
+#ifndef _LASER_ODOMETRY_MRPT_
+#define _LASER_ODOMETRY_MRPT_
+
+#include <mrpt/poses/CPose2D.h>
+#include "laser_odometry_types.h"
+
+
+inline mrpt::poses::CPose2D toMRPT(const RF2O_Pose2D &pose)
+{
+    return mrpt::poses::CPose2D(pose.x(), pose.y(), pose.phi());
+}
+
+inline RF2O_Pose2D fromMRPT(const mrpt::poses::CPose2D &pose)
+{
+    return RF2O_Pose2D(pose.x(), pose.y(), pose.phi());
+}
+
+#endif
@@ -5,7 +5,7 @@
 #include "laser_odometry_nosym.h"
 
 
-using namespace mrpt::utils;
+using namespace rf2o;
 using namespace Eigen;
 using namespace std;
 
@@ -17,49 +17,24 @@ void RF2O_nosym::initialize(unsigned int size, float FOV_rad, unsigned int odo_I
     width = size;
     fovh = FOV_rad*size/(size-1); //Exact for simulation, but I don't know how the datasets are given...
     ctf_levels = ceilf(log2(cols) - 4.3f);
-    iter_irls = 8;
+    num_iters = 0;
+    num_irls = 0;
     filter_velocity = true;
+    inverse_warping = false;
+    verbose = true;
 	
     //Resize original range scan
     range_wf.resize(width);
+    range_wf_q.resize(width);
+    range_step = 0.f;
 
     //Resize the transformation matrix
     transformations.resize(ctf_levels);
     for (unsigned int i = 0; i < ctf_levels; i++)
         transformations[i].resize(3,3);
 
-	//Resize pyramid
-	unsigned int s, cols_i;
+	//Number of levels of the pyramid
     const unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-    range.resize(pyr_levels);
-    range_old.resize(pyr_levels);
-    xx.resize(pyr_levels);
-    xx_old.resize(pyr_levels);
-    yy.resize(pyr_levels);
-    yy_old.resize(pyr_levels);
-	range_warped.resize(pyr_levels);
-	xx_warped.resize(pyr_levels);
-	yy_warped.resize(pyr_levels);
-
-	for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-
-        range[i].resize(cols_i); range_old[i].resize(cols_i);
-        range[i].fill(0.f); range_old[i].fill(0.f);
-        xx[i].resize(cols_i); xx_old[i].resize(cols_i);
-        xx[i].fill(0.f); xx_old[i].fill(0.f);
-        yy[i].resize(cols_i); yy_old[i].resize(cols_i);
-        yy[i].fill(0.f); yy_old[i].fill(0.f);
-
-		if (cols_i <= cols)
-		{
-            range_warped[i].resize(cols_i);
-            xx_warped[i].resize(cols_i);
-            yy_warped[i].resize(cols_i);
-		}
-    }
 
     //Resize aux variables
     dt.resize(cols);
@@ -67,206 +42,47 @@ void RF2O_nosym::initialize(unsigned int size, float FOV_rad, unsigned int odo_I
     weights.resize(cols);
     null.resize(cols);
     null.fill(false);
-	cov_odo.assign(0.f);
+	cov_odo.fill(0.f);
     outliers.resize(cols);
     outliers.fill(false);
 
 
 	//Compute gaussian mask
 	g_mask[0] = 1.f/16.f; g_mask[1] = 0.25f; g_mask[2] = 6.f/16.f; g_mask[3] = g_mask[1]; g_mask[4] = g_mask[0];
+    pyramid.initialize(width, pyr_levels, fovh, g_mask, params.max_range_dif, true, true);
+    projector.initialize(pyramid.level_cols, fovh);
+    selector.initialize(width);
+
+    //Lay out all the pyramid levels of every scan in a single aligned block
+    arena.initialize(pyramid.level_cols, 9);
+    arena.bind(range); arena.bind(range_old); arena.bind(range_warped);
+    arena.bind(xx); arena.bind(xx_old); arena.bind(xx_warped);
+    arena.bind(yy); arena.bind(yy_old); arena.bind(yy_warped);
 
     //Initialize "last velocity" as zero
-	kai_abs.assign(0.f);
-	kai_loc_old.assign(0.f);
+	kai_abs.fill(0.f);
+	kai_loc_old.fill(0.f);
 }
 
 
 void RF2O_nosym::createScanPyramid()
 {
-	const float max_range_dif = 0.3f;
-	
-	//Push the frames back
+    //Push the frames back
 	range_old.swap(range);
 	xx_old.swap(xx);
 	yy_old.swap(yy);
 
+    //The parameters can change between scans
+    pyramid.max_range_dif = params.max_range_dif;
+    projector.max_range_dif = params.max_range_dif;
+    selector.budget = params.pixel_budget;
 
-    //The number of levels of the pyramid does not match the number of levels used
-    //in the odometry computation (because we sometimes want to finish with lower resolutions)
-
-    unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-
-    //Generate levels
-    for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        unsigned int s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-		const unsigned int i_1 = i-1;
-
-        //              First level -> Filter, not downsample (I have tested it and it works better with this filtering)
-        //---------------------------------------------------------------------------------------------------------------
-        if (i == 0)
-		{
-            for (unsigned int u = 0; u < cols_i; u++)
-            {
-                const float dcenter = range_wf(u);
-
-                //Inner pixels
-                if ((u>1)&&(u<cols_i-2))
-                {
-                    if (dcenter > 0.f)
-                    {
-                        float sum = 0.f, weight = 0.f;
-
-                        for (int l=-2; l<3; l++)
-                        {
-                            const float abs_dif = abs(range_wf(u+l)-dcenter);
-                            if (abs_dif < max_range_dif)
-                            {
-                                const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                weight += aux_w;
-                                sum += aux_w*range_wf(u+l);
-                            }
-                        }
-                        range[i](u) = sum/weight;
-                    }
-                    else
-                        range[i](u) = 0.f;
-
-                }
-
-                //Boundary
-                else
-                {
-                    if (dcenter > 0.f)
-                    {
-                        float sum = 0.f, weight = 0.f;
-
-                        for (int l=-2; l<3; l++)
-                        {
-                            const int indu = u+l;
-                            if ((indu>=0)&&(indu<cols_i))
-                            {
-                                const float abs_dif = abs(range_wf(indu)-dcenter);
-                                if (abs_dif < max_range_dif)
-                                {
-                                    const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                    weight += aux_w;
-                                    sum += aux_w*range_wf(indu);
-                                }
-                            }
-                        }
-                        range[i](u) = sum/weight;
-                    }
-                    else
-                        range[i](u) = 0.f;
-
-                }
-            }
-		}
-
-        //                              Downsampling
-        //-----------------------------------------------------------------------------
-        else
-        {            
-            const unsigned int cols_prev_level = range[i_1].rows();
-
-            //Odd number of elements in the previous level
-            if ((cols_prev_level % 2) == 1)
-                for (unsigned int u = 0; u < cols_i; u++)
-                {
-                    const int u2 = 2*u;
-                    const float dcenter = range[i_1](u2);
-
-                    //Inner pixels
-                    if ((u>0)&&(u<cols_i-1))
-                    {
-                        if (dcenter > 0.f)
-                        {
-                            float sum = 0.f, weight = 0.f;
-
-                            for (int l=-2; l<3; l++)
-                            {
-                                const float abs_dif = abs(range[i_1](u2+l)-dcenter);
-                                if (abs_dif < max_range_dif)
-                                {
-                                    const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                    weight += aux_w;
-                                    sum += aux_w*range[i_1](u2+l);
-                                }
-                            }
-                            range[i](u) = sum/weight;
-                        }
-                        else
-                            range[i](u) = 0.f;
-                    }
-
-                    //Boundary
-                    else
-                    {
-                        if (dcenter > 0.f)
-                        {
-                            float sum = 0.f, weight = 0.f;
-                            const unsigned int cols_i2 = range[i_1].rows();
-
-                            for (int l=-2; l<3; l++)
-                            {
-                                const int indu = u2+l;
-
-                                if ((indu>=0)&&(indu<cols_i2))
-                                {
-                                    const float abs_dif = abs(range[i_1](indu)-dcenter);
-                                    if (abs_dif < max_range_dif)
-                                    {
-                                        const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                        weight += aux_w;
-                                        sum += aux_w*range[i_1](indu);
-                                    }
-                                }
-                            }
-                            range[i](u) = sum/weight;
-
-                        }
-                        else
-                            range[i](u) = 0.f;
-                    }
-                }
-
-            //Even number of elements in the previous level
-            else
-            {
-                for (unsigned int u = 0; u < cols_i; u++)
-                {
-                    const int u2 = 2*u;
-
-                    if ((range[i_1](u2) == 0.f)&&(range[i_1](u2+1) == 0.f))
-                        range[i](u) = 0.f;
-                    else if (range[i_1](u2) == 0.f)
-                        range[i](u) = range[i_1](u2+1);
-                    else if (range[i_1](u2+1) == 0.f)
-                        range[i](u) = range[i_1](u2);
-                    else
-                        range[i](u) = 0.5f*(range[i_1](u2) + range[i_1](u2+1));
-                }
-            }
-        }
-
-        //Calculate coordinates "xy" of the points
-        for (unsigned int u = 0; u < cols_i; u++) 
-		{
-            if (range[i](u) > 0.f)
-			{
-                const float tita = -0.5f*fovh + (float(u) + 0.5f)*fovh/float(cols_i);
-				xx[i](u) = range[i](u)*cos(tita);
-				yy[i](u) = range[i](u)*sin(tita);
-			}
-			else
-			{
-				xx[i](u) = 0.f;
-				yy[i](u) = 0.f;
-			}
-		}
-    }
+    //Filter, downsample and compute the coordinates of every level
+    if (range_step > 0.f)
+        pyramid.build(range_wf_q, range_step, range, xx, yy);
+    else
+        pyramid.build(range_wf, range, xx, yy);
+    cols_i = pyramid.level_cols.back();
 }
 
 void RF2O_nosym::calculateCoord()
@@ -323,9 +139,9 @@ void RF2O_nosym::computeWeights()
     weights.fill(0.f);
 	
 	//Parameters for error_linearization
-    const float kd = 0.01f; // 1.f
-    const float k2d = 2e-4f; //0.2f
-    const float sensor_sigma = 4e-4f;
+    const float kd = params.kd;
+    const float k2d = params.k2d;
+    const float sensor_sigma = params.sensor_sigma;
 	
 	for (unsigned int u = 1; u < cols_i-1; u++)
         if (null(u) == false)
@@ -347,6 +163,17 @@ void RF2O_nosym::computeWeights()
 }
 
 
+void RF2O_nosym::selectInformativeRows()
+{
+    if (!selector.active(num_valid_range, level, ctf_levels))
+        return;
+
+    //The kept rows are moved to the top of the storage of A and B, then they are shrunk to them
+    num_valid_range = selector.select(A.data(), B.data(), num_valid_range, null, cols_i);
+    A = Map<MatrixXf>(A.data(), num_valid_range, 3).eval();
+    B.conservativeResize(num_valid_range);
+}
+
 void RF2O_nosym::solveSystemQuadResiduals()
 {
 	A.resize(num_valid_range,3);
@@ -376,10 +203,13 @@ void RF2O_nosym::solveSystemQuadResiduals()
 			cont++;
 		}
 	
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows();
+
 	//Solve the linear system of equations using a minimum least squares method
 	MatrixXf AtA, AtB;
-	AtA.multiply_AtA(A);
-	AtB.multiply_AtB(A,B);
+	AtA.noalias() = A.transpose()*A;
+	AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
@@ -415,10 +245,13 @@ void RF2O_nosym::solveSystemQuadResidualsNoPreW()
             cont++;
         }
 
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows();
+
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
@@ -455,8 +288,8 @@ void RF2O_nosym::solveSystemMCauchy()
 	
 	//Solve the linear system of equations using a minimum least squares method
 	MatrixXf AtA, AtB;
-	AtA.multiply_AtA(A);
-	AtB.multiply_AtB(A,B);
+	AtA.noalias() = A.transpose()*A;
+	AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
 	//cout << endl << "max res: " << res.maxCoeff();
@@ -481,8 +314,9 @@ void RF2O_nosym::solveSystemMCauchy()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    for (unsigned int i=1; i<=iter_irls; i++)
+    for (unsigned int i=1; i<=params.iter_irls; i++)
     {
+        num_irls++;
         cont = 0;
 
         for (unsigned int u = 1; u < cols_i-1; u++)
@@ -499,8 +333,8 @@ void RF2O_nosym::solveSystemMCauchy()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -543,8 +377,8 @@ void RF2O_nosym::solveSystemTruncatedQuad()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -565,7 +399,7 @@ void RF2O_nosym::solveSystemTruncatedQuad()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    float c = 5.f*mad;
+    float c = params.trunc_mad*mad;
 
     ////Compute the energy
     //float energy = 0.f;
@@ -575,8 +409,9 @@ void RF2O_nosym::solveSystemTruncatedQuad()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    for (unsigned int i=1; i<=iter_irls; i++)
+    for (unsigned int i=1; i<=params.iter_irls; i++)
     {
+        num_irls++;
         cont = 0;
 
         for (unsigned int u = 1; u < cols_i-1; u++)
@@ -595,8 +430,8 @@ void RF2O_nosym::solveSystemTruncatedQuad()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -623,7 +458,7 @@ void RF2O_nosym::solveSystemTruncatedQuad()
         mad = aux_vector.at(res.rows()/2);
 
         //Find the m-estimator constant
-        c = 5.f*mad;
+        c = params.trunc_mad*mad;
 
     }
 
@@ -640,13 +475,14 @@ void RF2O_nosym::solveSystemTruncatedQuad()
                 num_outliers++;
             }
 
-    printf("\n Num_outliers = %d", num_outliers);
+    if (verbose)
+        printf("\n Num_outliers = %d", num_outliers);
 }
 
 void RF2O_nosym::solveSystemSmoothTruncQuad()
 {
-    A.resize(num_valid_range,3); Aw.resize(num_valid_range,3);
-    B.resize(num_valid_range); Bw.resize(num_valid_range);
+    A.resize(num_valid_range,3);
+    B.resize(num_valid_range);
     unsigned int cont = 0;
 
     const float kdtita = float(cols_i)/fovh;
@@ -673,10 +509,15 @@ void RF2O_nosym::solveSystemSmoothTruncQuad()
             cont++;
         }
 
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows();
+    Aw.resize(num_valid_range,3);
+    Bw.resize(num_valid_range);
+
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -697,7 +538,7 @@ void RF2O_nosym::solveSystemSmoothTruncQuad()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    const float c = 4.f*mad; //This seems to be the best (4) - 5
+    const float c = params.smooth_trunc_mad*mad; //This seems to be the best (4) - 5
     const float inv_c = 1.f/c;
     const float squared_c = square(c);
 
@@ -714,7 +555,7 @@ void RF2O_nosym::solveSystemSmoothTruncQuad()
 
     //Solve iteratively reweighted least squares
     //===================================================================
-    while ((new_energy < 0.995f*last_energy)&&(iter < 10))
+    while ((new_energy < 0.995f*last_energy)&&(iter < params.max_irls))
     {
         cont = 0;
         last_energy = new_energy;
@@ -735,8 +576,8 @@ void RF2O_nosym::solveSystemSmoothTruncQuad()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -749,6 +590,7 @@ void RF2O_nosym::solveSystemSmoothTruncQuad()
         }
         //printf("\nEnergy(%d) = %f", iter, new_energy);
         iter++;
+        num_irls++;
 
 
         //Recompute c
@@ -791,8 +633,8 @@ void RF2O_nosym::solveSystemSmoothTruncQuad()
 
 void RF2O_nosym::solveSystemSmoothTruncQuadNoPreW()
 {
-    A.resize(num_valid_range,3); Aw.resize(num_valid_range,3);
-    B.resize(num_valid_range); Bw.resize(num_valid_range);
+    A.resize(num_valid_range,3);
+    B.resize(num_valid_range);
     unsigned int cont = 0;
     const float kdtita = float(cols_i)/fovh;
     const float inv_kdtita = 1.f/kdtita;
@@ -817,10 +659,15 @@ void RF2O_nosym::solveSystemSmoothTruncQuadNoPreW()
             cont++;
         }
 
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows();
+    Aw.resize(num_valid_range,3);
+    Bw.resize(num_valid_range);
+
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
 
@@ -840,7 +687,7 @@ void RF2O_nosym::solveSystemSmoothTruncQuadNoPreW()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    const float c = 4.f*mad; //This seems to be the best (4)
+    const float c = params.smooth_trunc_mad*mad; //This seems to be the best (4)
     const float inv_c = 1.f/c;
 
     //Compute the energy
@@ -856,7 +703,7 @@ void RF2O_nosym::solveSystemSmoothTruncQuadNoPreW()
 
     //Solve iteratively reweighted least squares
     //===================================================================
-    while ((new_energy < 0.995f*last_energy)&&(iter < 10))
+    while ((new_energy < 0.995f*last_energy)&&(iter < params.max_irls))
     {
         cont = 0;
         last_energy = new_energy;
@@ -877,8 +724,8 @@ void RF2O_nosym::solveSystemSmoothTruncQuadNoPreW()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -891,6 +738,7 @@ void RF2O_nosym::solveSystemSmoothTruncQuadNoPreW()
         }
         //printf("\nEnergy(%d) = %f", iter, new_energy);
         iter++;
+        num_irls++;
 
 //        //Recompute c
 //        //-------------------------------------------------
@@ -964,7 +812,7 @@ void RF2O_nosym::solveSystemSmoothTruncQuadFromBeginning()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    float c = 5.f*mad;
+    float c = params.trunc_mad*mad;
 
     ////Compute the energy
     //float energy = 0.f;
@@ -974,8 +822,9 @@ void RF2O_nosym::solveSystemSmoothTruncQuadFromBeginning()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    for (unsigned int i=0; i<=iter_irls; i++)
+    for (unsigned int i=0; i<=params.iter_irls; i++)
     {
+        num_irls++;
         cont = 0;
 
         for (unsigned int u = 1; u < cols_i-1; u++)
@@ -994,8 +843,8 @@ void RF2O_nosym::solveSystemSmoothTruncQuadFromBeginning()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -1069,8 +918,8 @@ void RF2O_nosym::performWarping()
 				//Very close pixel
 				if (abs(round(uwarp) - uwarp) < 0.05f)
 				{
-					range_warped[image_level](round(uwarp)) += range_w;
-					wacu(round(uwarp)) += 1.f;
+					range_warped[image_level](int(round(uwarp))) += range_w;
+					wacu(int(round(uwarp))) += 1.f;
 				}
 				else
 				{
@@ -1112,123 +961,21 @@ void RF2O_nosym::performBestWarping()
     for (unsigned int i=0; i<=level; i++)
         acu_trans = transformations[i]*acu_trans;
 
-    ArrayXf x_trans(cols_i), y_trans(cols_i), u_trans(cols_i), range_trans(cols_i);
-    x_trans.fill(0.f); y_trans.fill(0.f); range_trans.fill(0.f);
-    range_warped[image_level].fill(0.f);
-
-    const float kdtita = float(cols_i)/fovh;
-
-    //Transform points to the reference frame of the old scan
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        if (range[image_level](u) != 0.f)
-        {
-            //Transform point to the warped reference frame
-            x_trans(u) = acu_trans(0,0)*xx[image_level](u) + acu_trans(0,1)*yy[image_level](u) + acu_trans(0,2);
-            y_trans(u) = acu_trans(1,0)*xx[image_level](u) + acu_trans(1,1)*yy[image_level](u) + acu_trans(1,2);
-            range_trans(u) = sqrtf(square(x_trans(u)) + square(y_trans(u)));
-            const float tita_trans = atan2(y_trans(u), x_trans(u));
-            u_trans(u) = kdtita*(tita_trans + 0.5f*fovh) - 0.5f;
-        }
-    }
-
-    //Check projection for each segment
-    for (unsigned int u = 0; u<cols_i-1; u++)
-    {
-        if ((range_trans(u) == 0.f) || (range_trans(u+1) == 0.f))
-            continue;
-        else if (floorf(u_trans(u)) != floorf(u_trans(u+1)))
-        {
-           const float range_l = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? range_trans(u+1) : range_trans(u);
-           const float range_r = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? range_trans(u) : range_trans(u+1);
-           const float u_trans_l = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? u_trans(u+1) : u_trans(u);
-           const float u_trans_r = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? u_trans(u) : u_trans(u+1);
-           const int u_l = min(floorf(u_trans(u)), floorf(u_trans(u+1)));
-           const int u_r = max(floorf(u_trans(u)), floorf(u_trans(u+1)));
-
-           for (unsigned int u_segment=u_l+1; (u_segment<=u_r)&&(u_segment<cols_i)&&(u_segment>=0); u_segment++)
-           {
-               const float range_interp = ((u_segment - u_trans_l)*range_r + (u_trans_r - u_segment)*range_l)/(u_trans_r - u_trans_l);
-               if ((range_warped[image_level](u_segment) == 0.f)||(range_interp < range_warped[image_level](u_segment)))
-                   range_warped[image_level](u_segment) = range_interp;
-           }
-        }
-    }
-
-    //Compute coordinates
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        const float tita = -0.5f*fovh + (float(u) + 0.5f)/kdtita;
-        xx_warped[image_level](u) = range_warped[image_level](u)*cos(tita);
-        yy_warped[image_level](u) = range_warped[image_level](u)*sin(tita);
-    }
+    //Transform the points, project every segment onto the warped scan keeping the closest range, and compute the coordinates
+    projector.project(acu_trans, range[image_level], xx[image_level], yy[image_level],
+                      range_warped[image_level], xx_warped[image_level], yy_warped[image_level]);
 }
 
 void RF2O_nosym::performFastWarping()
 {
-    //Warp the second image and count the amount of pixels projected to each of the pixels in the first image
-    //Camera parameters (which also depend on the level resolution)
-    Matrix3f acu_trans, acu_trans_inv;
+    Matrix3f acu_trans;
     acu_trans.setIdentity();
     for (unsigned int i=0; i<=level; i++)
         acu_trans = transformations[i]*acu_trans;
 
-    acu_trans_inv = acu_trans.inverse();
-    range_warped[image_level].fill(0.f);
-
-    const float kdtita = cols_i/fovh;
-
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        const float r = range_old[image_level](u);
-        if (r > 0.f)
-        {
-            //Transform point to the warped reference frame **********************************************
-            const float x_w = acu_trans_inv(0,0)*xx_old[image_level](u) + acu_trans_inv(0,1)*yy_old[image_level](u) + acu_trans_inv(0,2);
-            const float y_w = acu_trans_inv(1,0)*xx_old[image_level](u) + acu_trans_inv(1,1)*yy_old[image_level](u) + acu_trans_inv(1,2);
-            const float tita_w = atan2(y_w, x_w);
-
-            //Calculate warping
-            const float uwarp = kdtita*(tita_w + 0.5*fovh) - 0.5f;
-
-            float r_2;
-            interpolateRange(r_2, uwarp);
-
-            if (r_2 > 0.f)
-            {
-                float r_w = sqrtf(square(x_w) + square(y_w));
-                range_warped[image_level](u) = r_2 - (r_w-r);
-            }
-            else
-                range_warped[image_level](u) = 0.f;
-
-            //Transform point back to coordinates of the old scan -> xx_warped[image_level](u) and yy...
-            const float tita_original = -0.5f*fovh + (u + 0.5f)*fovh/cols_i;
-            xx_warped[image_level](u) = range_warped[image_level](u)*cos(tita_original);
-            yy_warped[image_level](u) = range_warped[image_level](u)*sin(tita_original);
-        }
-    }
-}
-
-void RF2O_nosym::interpolateRange(float &range_pixel, float uwarp)
-{
-    if ((uwarp <= 0.f)||(uwarp >= cols_i-1))
-    {
-        range_pixel = 0.f;
-        return;
-    }
-    else
-    {
-        const unsigned int u_l = floorf(uwarp);
-        const unsigned int u_r = ceilf(uwarp);
-        const float range_l = range[image_level](u_l);
-        const float range_r = range[image_level](u_r);
-
-        if (range_l*range_r == 0)
-            range_pixel = 0.f;
-        else
-            range_pixel = (uwarp - u_l)*range_r + (u_r - uwarp)*range_l;
-    }
+    //Gather instead of scatter: move the old points to the new scan with the inverse transformation and sample it
+    projector.sample(acu_trans, range[image_level], range_old[image_level], xx_old[image_level], yy_old[image_level],
+                     range_warped[image_level], xx_warped[image_level], yy_warped[image_level]);
 }
 
 void RF2O_nosym::odometryCalculation()
@@ -1238,6 +985,8 @@ void RF2O_nosym::odometryCalculation()
 	//==================================================================================
 
     clock.Tic();
+    num_iters = 0;
+    num_irls = 0;
     transf_acu_per_iteration.clear();
     transf_level.clear();
     acu_trans_overall.setIdentity();
@@ -1254,9 +1003,11 @@ void RF2O_nosym::odometryCalculation()
         cols_i = ceil(float(cols)/float(s));
         image_level = ctf_levels - i + round(log2(round(float(width)/float(cols)))) - 1;
 
-        const unsigned int nonlin_iters = 3;
+        const unsigned int nonlin_iters = params.nonlin_iters;
         for (unsigned int k = 0; k<nonlin_iters; k++)
         {
+            num_iters++;
+
             //1. Perform warping
             if ((i == 0)&&(k == 0))
             {
@@ -1264,6 +1015,8 @@ void RF2O_nosym::odometryCalculation()
                 xx_warped[image_level] = xx[image_level];
                 yy_warped[image_level] = yy[image_level];
             }
+            else if (inverse_warping)
+                performFastWarping();
             else
                 performBestWarping();
 
@@ -1301,7 +1054,7 @@ void RF2O_nosym::odometryCalculation()
             filterLevelSolution();
 
 
-            if (kai_loc_level.norm() < 0.05f)
+            if (kai_loc_level.norm() < params.min_update)
             {
                 //printf("\n Number of non-linear iterations: %d", k+1);
                 break;
@@ -1319,7 +1072,8 @@ void RF2O_nosym::odometryCalculation()
     }
 
     runtime = 1000.f*clock.Tac();
-    cout << endl << "Time odometry (ms): " << runtime;
+    if (verbose)
+        cout << endl << "Time odometry (ms): " << runtime;
 
     //Update poses
     PoseUpdate();
@@ -1367,7 +1121,7 @@ void RF2O_nosym::filterLevelSolution()
 
         //Filter speed
         //const float cf = 15e3f*expf(-int(level)), df = 0.05f*expf(-int(level));
-        const float cf = 5e3f*expf(-int(level)), df = 0.02f*expf(-int(level));
+        const float cf = params.cf*expf(-int(level)), df = params.df*expf(-int(level));
 
         Vector3f kai_b_fil;
         for (unsigned int i=0; i<3; i++)
@@ -1441,7 +1195,7 @@ void RF2O_nosym::PoseUpdate()
 	//						Update poses
 	//-------------------------------------------------------
 	laser_oldpose = laser_pose;
-    mrpt::poses::CPose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
+    RF2O_Pose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
 	laser_pose = laser_pose + pose_aux_2D;
 
 
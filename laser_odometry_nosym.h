@@ -6,10 +6,12 @@
 //====================================================
 
 
-#include <mrpt/poses/CPose2D.h>
-#include <mrpt/utils/CTicTac.h>
 #include <Eigen/Dense>
 #include <iostream>
+#include "laser_odometry_types.h"
+#include "laser_odometry_warping.h"
+#include "laser_odometry_selection.h"
+#include "laser_odometry_params.h"
 //#include <fstream>
 
 
@@ -24,9 +26,11 @@ public:
 
     //Scans and cartesian coordinates
     Eigen::ArrayXf range_wf;
-    std::vector<Eigen::ArrayXf> range, range_old, range_warped;
-    std::vector<Eigen::ArrayXf> xx, xx_old, xx_warped;
-    std::vector<Eigen::ArrayXf> yy, yy_old, yy_warped;
+    ArrayXq range_wf_q;           //Quantized input scan, used instead of range_wf if range_step > 0 (levels: pyramid.level_step)
+    float range_step;             //[m] Step of the quantized input (0 -> float input)
+    PyramidViews range, range_old, range_warped;
+    PyramidViews xx, xx_old, xx_warped;
+    PyramidViews yy, yy_old, yy_warped;
 
     //Rigid transformations and velocities (twists: vx, vy, w)
     std::vector<Eigen::MatrixXf> transformations;
@@ -54,19 +58,26 @@ public:
 	unsigned int ctf_levels;
 	unsigned int image_level, level;
 	unsigned int num_valid_range;
-	unsigned int iter_irls;
 	float g_mask[5];
+    RF2O_Pyramid pyramid;         //Shared gaussian pyramid builder
+    RF2O_ScanArena arena;         //Storage of all the pyramid levels
+    RF2O_ScanProjector projector; //Warping of the new scan (performBestWarping / performFastWarping)
+    RF2O_PixelSelector selector;  //Optional budget of pixels passed to the solvers (params.pixel_budget)
+    RF2O_Params params;           //Tuning parameters (they can be changed between scans)
 
 
     //Laser poses (most recent and previous)
-    mrpt::poses::CPose2D laser_pose;
-    mrpt::poses::CPose2D laser_oldpose;
+    RF2O_Pose2D laser_pose;
+    RF2O_Pose2D laser_oldpose;
     unsigned int ID;
     bool filter_velocity;
+    bool inverse_warping;         //Warp by sampling the new scan (performFastWarping) instead of projecting it
+    bool verbose;                 //Print the runtime of every scan and the outliers of the robust solver
 
     //To measure runtimes
-    mrpt::utils::CTicTac	clock;
+    RF2O_TicTac             clock;
     float                   runtime;
+    unsigned int            num_iters, num_irls;    //Non-linear iterations and reweightings of the solvers in the last odometryCalculation()
 
 
     //Methods
@@ -76,9 +87,9 @@ public:
 	void performWarping();
     void performFastWarping();
     void performBestWarping();
-    void interpolateRange(float &range_pixel, float uwarp);
 	void calculaterangeDerivativesSurface();
 	void computeWeights();
+    void selectInformativeRows();
     void solveSystemQuadResiduals();
     void solveSystemQuadResidualsNoPreW();
     void solveSystemMCauchy();
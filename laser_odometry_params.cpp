@@ -0,0 +1,125 @@
+/* Project: Laser odometry
+   Tuning parameters of the RF2O engines: access by name */
+
+#include "laser_odometry_params.h"
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+
+
+using namespace std;
+
+
+static const char *param_names[] = {"nonlin_iters", "min_update", "iter_irls", "max_irls", "trunc_mad", "smooth_trunc_mad",
+                                    "kd", "k2d", "sensor_sigma", "cf", "df", "max_range_dif", "pixel_budget"};
+static const unsigned int num_params = sizeof(param_names)/sizeof(param_names[0]);
+
+//Index of a name in param_names (num_params -> unknown)
+static unsigned int paramIndex(const char *param)
+{
+    for (unsigned int k=0; k<num_params; k++)
+        if (strcmp(param, param_names[k]) == 0)
+            return k;
+    return num_params;
+}
+
+
+unsigned int RF2O_Params::size()
+{
+    return num_params;
+}
+
+const char *RF2O_Params::name(unsigned int k)
+{
+    return (k < num_params) ? param_names[k] : "";
+}
+
+bool RF2O_Params::isInteger(const string &param) const
+{
+    const unsigned int k = paramIndex(param.c_str());
+    return (k == 0) || (k == 2) || (k == 3) || (k == 12);
+}
+
+bool RF2O_Params::set(const string &param, float value)
+{
+    return set(param.c_str(), value);
+}
+
+bool RF2O_Params::set(const char *param, float value)
+{
+    //All of them are positive (the iterations at least 1), except the pixel budget (0 -> no budget)
+    const unsigned int k = paramIndex(param);
+    if ((k == 12) ? !(value >= 0.f) : (!(value > 0.f) || (((k == 0) || (k == 2) || (k == 3)) && (value < 0.5f))))
+        return false;
+
+    const unsigned int iters = (unsigned int)floorf(value + 0.5f);
+    switch (k)
+    {
+    case 0:  nonlin_iters = iters; break;
+    case 1:  min_update = value; break;
+    case 2:  iter_irls = iters; break;
+    case 3:  max_irls = iters; break;
+    case 4:  trunc_mad = value; break;
+    case 5:  smooth_trunc_mad = value; break;
+    case 6:  kd = value; break;
+    case 7:  k2d = value; break;
+    case 8:  sensor_sigma = value; break;
+    case 9:  cf = value; break;
+    case 10: df = value; break;
+    case 11: max_range_dif = value; break;
+    case 12: pixel_budget = iters; break;
+    default: return false;
+    }
+    return true;
+}
+
+float RF2O_Params::get(const string &param) const
+{
+    switch (paramIndex(param.c_str()))
+    {
+    case 0:  return float(nonlin_iters);
+    case 1:  return min_update;
+    case 2:  return float(iter_irls);
+    case 3:  return float(max_irls);
+    case 4:  return trunc_mad;
+    case 5:  return smooth_trunc_mad;
+    case 6:  return kd;
+    case 7:  return k2d;
+    case 8:  return sensor_sigma;
+    case 9:  return cf;
+    case 10: return df;
+    case 11: return max_range_dif;
+    case 12: return float(pixel_budget);
+    default: return 0.f;
+    }
+}
+
+string RF2O_Params::toString() const
+{
+    string str;
+    char value[64];
+    for (unsigned int k=0; k<num_params; k++)
+    {
+        snprintf(value, sizeof(value), "%s%s=%g", k ? " " : "", param_names[k], get(param_names[k]));
+        str += value;
+    }
+    return str;
+}
+
+bool RF2O_Params::fromString(const string &text)
+{
+    istringstream stream(text);
+    string assignment;
+    while (stream >> assignment)
+    {
+        const size_t equal = assignment.find('=');
+        if ((equal == string::npos) || !set(assignment.substr(0, equal), float(atof(assignment.c_str() + equal + 1))))
+        {
+            printf("\n Invalid parameter: %s \n", assignment.c_str());
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,55 @@
+//====================================================
+//  Project: Laser odometry
+//  Tuning parameters of the RF2O engines, which can
+//  be changed at runtime (between two scans)
+//====================================================
+
+#ifndef _LASER_ODOMETRY_PARAMS_
+#define _LASER_ODOMETRY_PARAMS_
+
+#include <string>
+
+
+//Parameters shared by RF2O_standard, RF2O_nosym and RF2O_RefS. The defaults are the values that were hard-coded
+//in the engines. They can be set by name (the configuration files and the sweep tool use the same names).
+
+struct RF2O_Params {
+
+    //Coarse-to-fine scheme
+    unsigned int    nonlin_iters;       //Warping + solving iterations per level of the pyramid
+    float           min_update;         //The iterations of a level stop when the norm of its velocity update is smaller
+
+    //Robust solvers (IRLS)
+    unsigned int    iter_irls;          //Reweightings of the solvers with a fixed number of them (Cauchy, truncated quadratic)
+    unsigned int    max_irls;           //Max. reweightings of the smooth truncated quadratic solvers (they stop when the energy converges)
+    float           trunc_mad;          //Threshold of the Cauchy / truncated quadratic solvers = trunc_mad * MAD of the residuals
+    float           smooth_trunc_mad;   //Threshold of the smooth truncated quadratic solvers (the default ones) = smooth_trunc_mad * MAD
+
+    //Weights of the points: 1/sqrt(kd*(dt^2 + dtita^2) + k2d*dtita2^2 + sensor_sigma)
+    float           kd, k2d, sensor_sigma;
+
+    //Filter of the solution of every level (gains cf*exp(-level) and df*exp(-level))
+    float           cf, df;
+
+    float           max_range_dif;      //[m] Range jumps regarded as discontinuities by the pyramid and the warping
+
+    //Pixels passed to the solvers at the finest levels (0 -> all of them, see RF2O_PixelSelector; not used by RF2O_RefS)
+    unsigned int    pixel_budget;
+
+    RF2O_Params() :
+        nonlin_iters(3), min_update(0.05f), iter_irls(8), max_irls(10), trunc_mad(5.f), smooth_trunc_mad(4.f),
+        kd(0.01f), k2d(2e-4f), sensor_sigma(4e-4f), cf(5e3f), df(0.02f), max_range_dif(0.3f), pixel_budget(0) {}
+
+    //Access by name ("iter_irls", "kd"...). Integer parameters are rounded. false -> unknown name or invalid value.
+    static unsigned int size();
+    static const char *name(unsigned int k);
+    bool set(const std::string &param, float value);
+    bool set(const char *param, float value);       //Does not allocate (for the realtime C API)
+    float get(const std::string &param) const;
+    bool isInteger(const std::string &param) const;
+
+    std::string toString() const;       //"name=value name=value ..."
+    bool fromString(const std::string &text);   //The same format (any subset of the parameters)
+};
+
+#endif
@@ -0,0 +1,465 @@
+/* Project: Laser odometry
+   Shared range-scan pyramid builder */
+
+#include "laser_odometry_pyramid.h"
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+using namespace Eigen;
+using namespace std;
+
+
+//Arrays of the arena start on 64-byte boundaries
+static const unsigned int floats_per_line = 16;
+
+//Value used to pad the borders: it never passes the range-difference test, so it gets zero weight
+static const float pad_range = 1e20f;
+
+//Same for the quantized levels: no range is quantized to it, and the filter gives it zero weight explicitly
+static const uint16_t pad_range_q = 0xffff;
+
+
+void RF2O_Pyramid::initialize(unsigned int size, unsigned int num_levels, float fov, const float mask[5], float max_dif,
+                              bool average_even, bool centered)
+{
+    width = size;
+    pyr_levels = num_levels;
+    fovh = fov;
+    max_range_dif = max_dif;
+    level_step = 0.f;
+    average_even_levels = average_even;
+    centered_bearings = centered;
+    for (unsigned int l=0; l<5; l++)
+        g_mask[l] = mask[l];
+
+    //Bearings of every level (same expressions as the original per-engine loops)
+    level_cols.resize(pyr_levels);
+    cos_tita.resize(pyr_levels);
+    sin_tita.resize(pyr_levels);
+    for (unsigned int i = 0; i<pyr_levels; i++)
+    {
+        const unsigned int s = pow(2.f,int(i));
+        const unsigned int cols_i = ceil(float(width)/float(s));
+        level_cols[i] = cols_i;
+        cos_tita[i].resize(cols_i);
+        sin_tita[i].resize(cols_i);
+
+        for (unsigned int u = 0; u < cols_i; u++)
+        {
+            const float tita = centered_bearings ? -0.5f*fovh + (float(u) + 0.5f)*fovh/float(cols_i)
+                                                 : -0.5f*fovh + float(u)*fovh/float(cols_i-1);
+            cos_tita[i](u) = cos(tita);
+            sin_tita[i](u) = sin(tita);
+        }
+    }
+
+    //Scratch buffers, sized for the finest level so that build() never allocates
+    padded.resize(width + 4);
+    padded_even.resize(width/2 + 3);
+    padded_odd.resize(width/2 + 3);
+
+    //Quantized levels (only allocated, they are used if level_step > 0)
+    level_q.resize(pyr_levels);
+    for (unsigned int i = 1; i<pyr_levels; i++)
+        level_q[i].resize(level_cols[i]);
+    const unsigned int cols_q = (pyr_levels > 1) ? level_cols[1] : 0;
+    padded_q.resize(cols_q + 4);
+    padded_even_q.resize(cols_q/2 + 3);
+    padded_odd_q.resize(cols_q/2 + 3);
+}
+
+void RF2O_Pyramid::build(const ArrayXf &range_wf, PyramidViews &range, PyramidViews &xx, PyramidViews &yy)
+{
+    //First level -> Filter, not downsample
+    filterLevel(range_wf.data(), width, 1, range[0].data(), level_cols[0]);
+    buildLevels(range, xx, yy);
+}
+
+void RF2O_Pyramid::build(const ArrayXq &range_wf_q, float range_step, PyramidViews &range, PyramidViews &xx, PyramidViews &yy)
+{
+    //The input is widened straight into the padded copy that the filter of the first level reads
+    widenRanges(range_wf_q.data(), padded.data() + 2, width, range_step);
+    filterPadded(width, 1, range[0].data(), level_cols[0]);
+    buildLevels(range, xx, yy);
+}
+
+void RF2O_Pyramid::buildLevels(PyramidViews &range, PyramidViews &xx, PyramidViews &yy)
+{
+    for (unsigned int i = 0; i<pyr_levels; i++)
+    {
+        const unsigned int cols_i = level_cols[i];
+
+        //Downsampling (the first level is already filtered)
+        if (i > 0)
+        {
+            const unsigned int cols_prev_level = level_cols[i-1];
+            if (average_even_levels && ((cols_prev_level % 2) == 0))
+                averageLevel(range[i-1].data(), range[i].data(), cols_i);
+            else if ((level_step > 0.f) && (i > 1))
+                filterLevelQuantized(level_q[i-1].data(), cols_prev_level, range[i].data(), cols_i);
+            else
+                filterLevel(range[i-1].data(), cols_prev_level, 2, range[i].data(), cols_i);
+
+            if (level_step > 0.f)
+                storeQuantized(i, range[i].data());
+        }
+
+        //Calculate coordinates "xy" of the points
+        computeCoordinates(i, range[i].data(), xx[i].data(), yy[i].data());
+    }
+}
+
+void RF2O_Pyramid::filterLevel(const float *src, unsigned int cols_src, unsigned int step, float *dst, unsigned int cols_dst)
+{
+    float *pad = padded.data();
+    for (unsigned int u = 0; u < cols_src; u++)
+        pad[u+2] = src[u];
+
+    filterPadded(cols_src, step, dst, cols_dst);
+}
+
+void RF2O_Pyramid::filterPadded(unsigned int cols_src, unsigned int step, float *dst, unsigned int cols_dst)
+{
+    //Pad two samples at each side (the level is already in padded[2 .. cols_src+1])
+    float *pad = padded.data();
+    pad[0] = pad_range; pad[1] = pad_range;
+    pad[cols_src+2] = pad_range; pad[cols_src+3] = pad_range;
+
+    //The 5 taps of output pixel u are contiguous arrays starting at u
+    const float *taps[5];
+    if (step == 1)
+        for (unsigned int l=0; l<5; l++)
+            taps[l] = pad + l;
+    else
+    {
+        //pad[2u+l] -> even[u], odd[u], even[u+1], odd[u+1], even[u+2]
+        float *even = padded_even.data(), *odd = padded_odd.data();
+        for (unsigned int k = 0; k < cols_dst+2; k++)
+            even[k] = pad[2*k];
+        for (unsigned int k = 0; k < cols_dst+1; k++)
+            odd[k] = pad[2*k+1];
+
+        taps[0] = even; taps[1] = odd; taps[2] = even + 1; taps[3] = odd + 1; taps[4] = even + 2;
+    }
+
+    const float mrd = max_range_dif;
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_mrd = _mm_set1_ps(mrd);
+    const __m128 v_zero = _mm_setzero_ps();
+    const __m128 v_abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 v_g[5];
+    for (unsigned int l=0; l<5; l++)
+        v_g[l] = _mm_set1_ps(g_mask[l]);
+
+    for (; u + 4 <= cols_dst; u += 4)
+    {
+        const __m128 dcenter = _mm_loadu_ps(taps[2] + u);
+        __m128 sum = v_zero, weight = v_zero;
+
+        for (unsigned int l=0; l<5; l++)
+        {
+            const __m128 r = _mm_loadu_ps(taps[l] + u);
+            const __m128 abs_dif = _mm_and_ps(_mm_sub_ps(r, dcenter), v_abs);
+            const __m128 valid = _mm_cmplt_ps(abs_dif, v_mrd);
+            const __m128 aux_w = _mm_and_ps(valid, _mm_mul_ps(v_g[l], _mm_sub_ps(v_mrd, abs_dif)));
+            weight = _mm_add_ps(weight, aux_w);
+            sum = _mm_add_ps(sum, _mm_mul_ps(aux_w, r));
+        }
+
+        const __m128 valid_center = _mm_cmpgt_ps(dcenter, v_zero);
+        _mm_storeu_ps(dst + u, _mm_and_ps(valid_center, _mm_div_ps(sum, weight)));
+    }
+#endif
+
+    //Remaining pixels (or all of them without SSE2): same operations, one lane at a time
+    for (; u < cols_dst; u++)
+    {
+        const float dcenter = taps[2][u];
+        float sum = 0.f, weight = 0.f;
+
+        for (unsigned int l=0; l<5; l++)
+        {
+            const float r = taps[l][u];
+            const float abs_dif = fabsf(r - dcenter);
+            const float aux_w = (abs_dif < mrd) ? g_mask[l]*(mrd - abs_dif) : 0.f;
+            weight += aux_w;
+            sum += aux_w*r;
+        }
+
+        dst[u] = (dcenter > 0.f) ? sum/weight : 0.f;
+    }
+}
+
+void RF2O_Pyramid::filterLevelQuantized(const uint16_t *src, unsigned int cols_src, float *dst, unsigned int cols_dst)
+{
+    //Padded copy and even/odd split as in filterPadded (always downsampling), but of the 16-bit level
+    uint16_t *pad = padded_q.data();
+    pad[0] = pad_range_q; pad[1] = pad_range_q;
+    for (unsigned int u = 0; u < cols_src; u++)
+        pad[u+2] = src[u];
+    pad[cols_src+2] = pad_range_q; pad[cols_src+3] = pad_range_q;
+
+    uint16_t *even = padded_even_q.data(), *odd = padded_odd_q.data();
+    for (unsigned int k = 0; k < cols_dst+2; k++)
+        even[k] = pad[2*k];
+    for (unsigned int k = 0; k < cols_dst+1; k++)
+        odd[k] = pad[2*k+1];
+
+    const uint16_t *taps[5] = {even, odd, even + 1, odd + 1, even + 2};
+    const float mrd = max_range_dif, step = level_step;
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_mrd = _mm_set1_ps(mrd);
+    const __m128 v_step = _mm_set1_ps(step);
+    const __m128 v_zero = _mm_setzero_ps();
+    const __m128 v_abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128i v_zero_i = _mm_setzero_si128();
+    const __m128i v_pad = _mm_set1_epi32(pad_range_q);
+    __m128 v_g[5];
+    for (unsigned int l=0; l<5; l++)
+        v_g[l] = _mm_set1_ps(g_mask[l]);
+
+    //4 taps of 16 bits per load, widened to floats in the registers
+    for (; u + 4 <= cols_dst; u += 4)
+    {
+        const __m128i qcenter = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(taps[2] + u)), v_zero_i);
+        const __m128 dcenter = _mm_mul_ps(_mm_cvtepi32_ps(qcenter), v_step);
+        __m128 sum = v_zero, weight = v_zero;
+
+        for (unsigned int l=0; l<5; l++)
+        {
+            const __m128i q = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(taps[l] + u)), v_zero_i);
+            const __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(q), v_step);
+            const __m128 abs_dif = _mm_and_ps(_mm_sub_ps(r, dcenter), v_abs);
+            const __m128 valid = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(q, v_pad)), _mm_cmplt_ps(abs_dif, v_mrd));
+            const __m128 aux_w = _mm_and_ps(valid, _mm_mul_ps(v_g[l], _mm_sub_ps(v_mrd, abs_dif)));
+            weight = _mm_add_ps(weight, aux_w);
+            sum = _mm_add_ps(sum, _mm_mul_ps(aux_w, r));
+        }
+
+        const __m128 valid_center = _mm_cmpgt_ps(dcenter, v_zero);
+        _mm_storeu_ps(dst + u, _mm_and_ps(valid_center, _mm_div_ps(sum, weight)));
+    }
+#endif
+
+    for (; u < cols_dst; u++)
+    {
+        const float dcenter = float(taps[2][u])*step;
+        float sum = 0.f, weight = 0.f;
+
+        for (unsigned int l=0; l<5; l++)
+        {
+            const float r = float(taps[l][u])*step;
+            const float abs_dif = fabsf(r - dcenter);
+            const float aux_w = ((taps[l][u] != pad_range_q) && (abs_dif < mrd)) ? g_mask[l]*(mrd - abs_dif) : 0.f;
+            weight += aux_w;
+            sum += aux_w*r;
+        }
+
+        dst[u] = (dcenter > 0.f) ? sum/weight : 0.f;
+    }
+}
+
+void RF2O_Pyramid::storeQuantized(unsigned int level, float *range)
+{
+    //The engines work with exactly the ranges that are stored
+    quantizeRanges(range, level_q[level].data(), level_cols[level], level_step);
+    widenRanges(level_q[level].data(), range, level_cols[level], level_step);
+}
+
+void RF2O_Pyramid::averageLevel(const float *src, float *dst, unsigned int cols_dst)
+{
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_zero = _mm_setzero_ps();
+    const __m128 v_half = _mm_set1_ps(0.5f);
+
+    for (; u + 4 <= cols_dst; u += 4)
+    {
+        const __m128 v0 = _mm_loadu_ps(src + 2*u);
+        const __m128 v1 = _mm_loadu_ps(src + 2*u + 4);
+        const __m128 a = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2,0,2,0));
+        const __m128 b = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3,1,3,1));
+        const __m128 a_null = _mm_cmpeq_ps(a, v_zero);
+        const __m128 b_null = _mm_cmpeq_ps(b, v_zero);
+        const __m128 mean = _mm_mul_ps(v_half, _mm_add_ps(a, b));
+
+        //a == 0 -> b (which is 0 if both are null), b == 0 -> a, else the mean
+        const __m128 res_b = _mm_or_ps(_mm_and_ps(b_null, a), _mm_andnot_ps(b_null, mean));
+        const __m128 res = _mm_or_ps(_mm_and_ps(a_null, b), _mm_andnot_ps(a_null, res_b));
+        _mm_storeu_ps(dst + u, res);
+    }
+#endif
+
+    for (; u < cols_dst; u++)
+    {
+        const float a = src[2*u], b = src[2*u+1];
+        dst[u] = (a == 0.f) ? b : ((b == 0.f) ? a : 0.5f*(a + b));
+    }
+}
+
+void RF2O_Pyramid::computeCoordinates(unsigned int level, const float *range, float *xx, float *yy)
+{
+    const unsigned int cols_i = level_cols[level];
+    const float *co = cos_tita[level].data();
+    const float *si = sin_tita[level].data();
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_zero = _mm_setzero_ps();
+    for (; u + 4 <= cols_i; u += 4)
+    {
+        const __m128 r = _mm_loadu_ps(range + u);
+        const __m128 valid = _mm_cmpgt_ps(r, v_zero);
+        _mm_storeu_ps(xx + u, _mm_and_ps(valid, _mm_mul_ps(r, _mm_loadu_ps(co + u))));
+        _mm_storeu_ps(yy + u, _mm_and_ps(valid, _mm_mul_ps(r, _mm_loadu_ps(si + u))));
+    }
+#endif
+
+    for (; u < cols_i; u++)
+    {
+        const float r = range[u];
+        xx[u] = (r > 0.f) ? r*co[u] : 0.f;
+        yy[u] = (r > 0.f) ? r*si[u] : 0.f;
+    }
+}
+
+
+void quantizeRanges(const float *range, uint16_t *range_q, unsigned int n, float step)
+{
+    const float inv_step = 1.f/step;
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_inv = _mm_set1_ps(inv_step);
+    const __m128 v_half = _mm_set1_ps(0.5f);
+    const __m128 v_zero = _mm_setzero_ps();
+    const __m128 v_limit = _mm_set1_ps(65535.f);
+    const __m128i v_bias = _mm_set1_epi32(32768);
+    const __m128i v_flip = _mm_set1_epi16(short(0x8000));
+
+    for (; u + 8 <= n; u += 8)
+    {
+        //SSE2 only packs with signed saturation: shift to [-32768, 32767], pack and flip the sign bit back
+        __m128i q[2];
+        for (unsigned int h = 0; h<2; h++)
+        {
+            const __m128 r = _mm_loadu_ps(range + u + 4*h);
+            const __m128 s = _mm_add_ps(_mm_mul_ps(r, v_inv), v_half);
+            const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(r, v_zero), _mm_cmplt_ps(s, v_limit));
+            q[h] = _mm_sub_epi32(_mm_and_si128(_mm_castps_si128(valid), _mm_cvttps_epi32(s)), v_bias);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(range_q + u), _mm_xor_si128(_mm_packs_epi32(q[0], q[1]), v_flip));
+    }
+#endif
+
+    for (; u < n; u++)
+    {
+        const float s = range[u]*inv_step + 0.5f;
+        range_q[u] = ((range[u] > 0.f) && (s < 65535.f)) ? uint16_t(s) : 0;
+    }
+}
+
+void widenRanges(const uint16_t *range_q, float *range, unsigned int n, float step)
+{
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_step = _mm_set1_ps(step);
+    const __m128i v_zero = _mm_setzero_si128();
+
+    for (; u + 8 <= n; u += 8)
+    {
+        const __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(range_q + u));
+        _mm_storeu_ps(range + u, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(q, v_zero)), v_step));
+        _mm_storeu_ps(range + u + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(q, v_zero)), v_step));
+    }
+#endif
+
+    for (; u < n; u++)
+        range[u] = float(range_q[u])*step;
+}
+
+
+void RF2O_ScanArena::initialize(const vector<unsigned int> &level_cols, unsigned int roles)
+{
+    cols = level_cols;
+    num_roles = roles;
+    bound_roles = 0;
+    bound.clear();
+    bound.reserve(roles);
+
+    //Level-by-level layout: [level 0: role 0 | role 1 | ...][level 1: role 0 | role 1 | ...]...
+    level_offset.resize(cols.size());
+    role_stride.resize(cols.size());
+    num_floats = 0;
+    for (unsigned int i = 0; i<cols.size(); i++)
+    {
+        role_stride[i] = (cols[i] + floats_per_line - 1)/floats_per_line*floats_per_line;
+        level_offset[i] = num_floats;
+        num_floats += num_roles*role_stride[i];
+    }
+
+    //Over-allocate one line to align the start of the block
+    block.assign(num_floats + floats_per_line, 0.f);
+    const size_t misalign = (reinterpret_cast<size_t>(&block[0])/sizeof(float)) % floats_per_line;
+    base = &block[0] + (misalign ? floats_per_line - misalign : 0);
+}
+
+void RF2O_ScanArena::bind(PyramidViews &views)
+{
+    if (bound_roles >= num_roles)
+    {
+        printf("\n RF2O_ScanArena: more roles bound than reserved (%u) \n", num_roles);
+        return;
+    }
+
+    views.clear();
+    views.reserve(cols.size());
+    for (unsigned int i = 0; i<cols.size(); i++)
+        views.push_back(LevelView(base + level_offset[i] + bound_roles*role_stride[i], cols[i]));
+
+    bound.push_back(&views);
+    bound_roles++;
+}
+
+void RF2O_ScanArena::snapshot(vector<float> &state) const
+{
+    //Through the views: a role is saved as itself even if its storage was swapped with another one
+    state.resize(num_floats);
+    float *dst = state.empty() ? NULL : &state[0];
+    for (unsigned int r = 0; r<bound.size(); r++)
+        for (unsigned int i = 0; i<cols.size(); i++)
+        {
+            const float *src = (*bound[r])[i].data();
+            copy(src, src + cols[i], dst);
+            dst += cols[i];
+        }
+}
+
+void RF2O_ScanArena::restore(const vector<float> &state)
+{
+    if (state.size() != num_floats)
+    {
+        printf("\n RF2O_ScanArena: the snapshot does not belong to this arena \n");
+        return;
+    }
+
+    const float *src = state.empty() ? NULL : &state[0];
+    for (unsigned int r = 0; r<bound.size(); r++)
+        for (unsigned int i = 0; i<cols.size(); i++)
+        {
+            copy(src, src + cols[i], (*bound[r])[i].data());
+            src += cols[i];
+        }
+}
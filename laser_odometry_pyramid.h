@@ -0,0 +1,121 @@
+//====================================================
+//  Project: Laser odometry
+//  Shared range-scan pyramid builder for all the
+//  RF2O variants
+//====================================================
+
+#ifndef _LASER_ODOMETRY_PYRAMID_
+#define _LASER_ODOMETRY_PYRAMID_
+
+#include <Eigen/Dense>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+
+//Every level of every scan role (range, range_old, xx, ...) is a view into a single arena
+typedef Eigen::Map<Eigen::ArrayXf, Eigen::Aligned> LevelView;
+typedef std::vector<LevelView> PyramidViews;
+
+//Copies the content of every level (the views keep pointing to their own storage)
+inline void copyPyramid(const PyramidViews &src, PyramidViews &dst)
+{
+    for (unsigned int i = 0; i<src.size(); i++)
+        dst[i] = src[i];
+}
+
+
+//Ranges quantized to 16 bits: multiples of "step" meters (1 mm reaches 65 m, 2 mm 131 m), 0 -> no return.
+//Ranges that do not fit are stored as 0 (invalid) and 65535 is never stored: the quantized filter pads with it.
+//Widening is exact: range = float(q)*step. The input scans, the scan logs and (optionally, see level_step)
+//the downsampled levels of the pyramid builder are stored this way. The views of the engines stay float.
+typedef Eigen::Array<uint16_t, Eigen::Dynamic, 1> ArrayXq;
+
+void quantizeRanges(const float *range, uint16_t *range_q, unsigned int n, float step);
+void widenRanges(const uint16_t *range_q, float *range, unsigned int n, float step);
+
+
+//Builds the gaussian pyramid of a range scan (and the cartesian coordinates of every level) in one call.
+//The masked 5-tap filter is evaluated branch-free: invalid neighbours are discarded with compares and
+//blends instead of per-pixel conditionals, and the borders are handled by padding the input with values
+//that never pass the range-difference test. The output is identical to the former per-engine loops.
+
+class RF2O_Pyramid {
+public:
+
+    //Configuration
+    unsigned int width;             //Number of points of the original scan
+    unsigned int pyr_levels;
+    float fovh;
+    float max_range_dif;            //Neighbours farther than this from the central range are not averaged
+    float g_mask[5];
+    float level_step;               //[m] > 0 -> levels 1.. are stored as 16-bit multiples of it (0 -> float, set after initialize)
+    bool average_even_levels;       //Downsample levels with an even number of points by averaging pairs (standard, nosym, refscans)
+    bool centered_bearings;         //tita = (u+0.5)*fov/cols if true, u*fov/(cols-1) otherwise
+
+    //Precomputed bearings of every level
+    std::vector<unsigned int> level_cols;
+    std::vector<Eigen::ArrayXf> cos_tita, sin_tita;
+
+    //Padded copy of the level being filtered and its even/odd split (reserved at initialize)
+    Eigen::ArrayXf padded, padded_even, padded_odd;
+
+    //Quantized storage of the downsampled levels (level_step > 0): the filter of the next level reads them
+    //as they are and widens them in its kernel. The views of the engines get the widened values.
+    std::vector<ArrayXq> level_q;
+    ArrayXq padded_q, padded_even_q, padded_odd_q;
+
+
+    //Methods
+    void initialize(unsigned int size, unsigned int num_levels, float fov, const float mask[5], float max_dif,
+                    bool average_even, bool centered);
+    void build(const Eigen::ArrayXf &range_wf, PyramidViews &range, PyramidViews &xx, PyramidViews &yy);
+    void build(const ArrayXq &range_wf_q, float range_step, PyramidViews &range, PyramidViews &xx, PyramidViews &yy);    //Quantized input (widened into the input of the first filter)
+
+private:
+    void buildLevels(PyramidViews &range, PyramidViews &xx, PyramidViews &yy);
+    void filterLevel(const float *src, unsigned int cols_src, unsigned int step, float *dst, unsigned int cols_dst);
+    void filterPadded(unsigned int cols_src, unsigned int step, float *dst, unsigned int cols_dst);
+    void filterLevelQuantized(const uint16_t *src, unsigned int cols_src, float *dst, unsigned int cols_dst);
+    void averageLevel(const float *src, float *dst, unsigned int cols_dst);
+    void storeQuantized(unsigned int level, float *range);
+    void computeCoordinates(unsigned int level, const float *range, float *xx, float *yy);
+};
+
+
+//Single aligned block holding all the pyramid levels of all the scan roles of an odometry instance.
+//It is laid out level by level (level 0 of every role, then level 1, ...) and every array starts on
+//a cache line, so a coarse-to-fine iteration walks one compact region. Views are handed to the engines
+//through bind(), and swapping two roles (e.g. range <-> range_old) only swaps the views, so after a swap
+//the block no longer holds the roles in the order they were bound. The state of the scans is therefore
+//saved and restored through the bound views (snapshot/restore), role by role in the order of bind().
+//The arena is not copyable: the engines keep views into its block.
+
+class RF2O_ScanArena {
+public:
+
+    RF2O_ScanArena() : base(NULL), num_floats(0), num_roles(0), bound_roles(0) {}
+
+    void initialize(const std::vector<unsigned int> &level_cols, unsigned int roles);
+    void bind(PyramidViews &views);     //Binds the next role, level by level (the views must outlive the arena)
+
+    void snapshot(std::vector<float> &state) const;     //Content of every bound role, wherever its views point now
+    void restore(const std::vector<float> &state);
+    std::size_t size() const { return num_floats; }
+
+private:
+
+    std::vector<float> block;
+    float *base;                        //First cache-line aligned float of block
+    std::size_t num_floats;
+    unsigned int num_roles, bound_roles;
+    std::vector<unsigned int> cols;
+    std::vector<std::size_t> level_offset, role_stride;
+    std::vector<PyramidViews*> bound;   //Views of every role, in the order of bind()
+
+    //The engines keep views into the block: copying it would leave them pointing to the original
+    RF2O_ScanArena(const RF2O_ScanArena &);
+    RF2O_ScanArena &operator=(const RF2O_ScanArena &);
+};
+
+#endif
@@ -5,7 +5,7 @@
 #include "laser_odometry_refscans.h"
 
 
-using namespace mrpt::utils;
+using namespace rf2o;
 using namespace Eigen;
 using namespace std;
 
@@ -17,13 +17,17 @@ void RF2O_RefS::initialize(unsigned int size, float FOV_rad, unsigned int odo_me
     width = size;
     fovh = FOV_rad*size/(size-1); //Exact for simulation, but I don't know how the datasets are given...
     ctf_levels = ceilf(log2(cols) - 4.3f);
-    iter_irls = 8;
+    num_iters = 0;
+    num_irls = 0;
     no_ref_scan = true;
     new_ref_scan = true;
     method_ref_scan = 0;
+    verbose = true;
 	
     //Resize original range scan
     range_wf.resize(width);
+    range_wf_q.resize(width);
+    range_step = 0.f;
 
     //Resize the transformation matrices
     transformations.resize(ctf_levels);
@@ -33,39 +37,8 @@ void RF2O_RefS::initialize(unsigned int size, float FOV_rad, unsigned int odo_me
         transformations[i].setIdentity();
     }
 
-	//Resize pyramid
-	unsigned int s, cols_i;
+	//Number of levels of the pyramid
     const unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-    range_1.resize(pyr_levels); range_2.resize(pyr_levels); range_3.resize(pyr_levels);
-    range_12.resize(pyr_levels); range_13.resize(pyr_levels);
-    xx_1.resize(pyr_levels); xx_2.resize(pyr_levels); xx_3.resize(pyr_levels);
-    xx_12.resize(pyr_levels); xx_13.resize(pyr_levels);
-    yy_1.resize(pyr_levels); yy_2.resize(pyr_levels); yy_3.resize(pyr_levels);
-    yy_12.resize(pyr_levels); yy_13.resize(pyr_levels);
-    range_warped.resize(pyr_levels); xx_warped.resize(pyr_levels); yy_warped.resize(pyr_levels);
-    range_3_warpedTo2.resize(pyr_levels); xx_3_warpedTo2.resize(pyr_levels); yy_3_warpedTo2.resize(pyr_levels);
-
-	for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-
-        range_1[i].resize(cols_i); range_2[i].resize(cols_i); range_3[i].resize(cols_i);
-        range_12[i].resize(cols_i); range_13[i].resize(cols_i);
-        range_1[i].fill(0.f); range_2[i].fill(0.f); range_3[i].fill(0.f);
-        xx_1[i].resize(cols_i); xx_2[i].resize(cols_i); xx_3[i].resize(cols_i);
-        xx_12[i].resize(cols_i); xx_13[i].resize(cols_i);
-        xx_1[i].fill(0.f); xx_2[i].fill(0.f); xx_3[i].fill(0.f);
-        yy_1[i].resize(cols_i); yy_2[i].resize(cols_i); yy_3[i].resize(cols_i);
-        yy_12[i].resize(cols_i); yy_13[i].resize(cols_i);
-        yy_1[i].fill(0.f); yy_2[i].fill(0.f); yy_3[i].fill(0.f);
-
-		if (cols_i <= cols)
-		{
-            range_warped[i].resize(cols_i); xx_warped[i].resize(cols_i); yy_warped[i].resize(cols_i);
-            range_3_warpedTo2[i].resize(cols_i); xx_3_warpedTo2[i].resize(cols_i); yy_3_warpedTo2[i].resize(cols_i);
-		}
-    }
 
     //Resize aux variables
     dt_12.resize(cols); dt_13.resize(cols);
@@ -73,210 +46,54 @@ void RF2O_RefS::initialize(unsigned int size, float FOV_rad, unsigned int odo_me
     weights_12.resize(cols); weights_13.resize(cols);
     null_12.resize(cols); null_13.resize(cols);
     null_12.fill(false); null_13.fill(false);
-	cov_odo.assign(0.f);
+	cov_odo.fill(0.f);
     outliers.resize(cols);
     outliers.fill(false);
 
 
 	//Compute gaussian mask
 	g_mask[0] = 1.f/16.f; g_mask[1] = 0.25f; g_mask[2] = 6.f/16.f; g_mask[3] = g_mask[1]; g_mask[4] = g_mask[0];
+    pyramid.initialize(width, pyr_levels, fovh, g_mask, params.max_range_dif, true, true);
+    projector.initialize(pyramid.level_cols, fovh);
+
+    //Lay out all the pyramid levels of every scan in a single aligned block
+    arena.initialize(pyramid.level_cols, 21);
+    arena.bind(range_1); arena.bind(range_2); arena.bind(range_3);
+    arena.bind(range_12); arena.bind(range_13); arena.bind(range_warped);
+    arena.bind(xx_1); arena.bind(xx_2); arena.bind(xx_3);
+    arena.bind(xx_12); arena.bind(xx_13); arena.bind(xx_warped);
+    arena.bind(yy_1); arena.bind(yy_2); arena.bind(yy_3);
+    arena.bind(yy_12); arena.bind(yy_13); arena.bind(yy_warped);
+    arena.bind(range_3_warpedTo2); arena.bind(xx_3_warpedTo2); arena.bind(yy_3_warpedTo2);
 
     //Initialize "last velocity" as zero
-	kai_abs.assign(0.f);
-	kai_loc_old.assign(0.f);
+	kai_abs.fill(0.f);
+	kai_loc_old.fill(0.f);
     overall_trans_prev.setIdentity();
 }
 
 
 void RF2O_RefS::createScanPyramid()
 {
-	const float max_range_dif = 0.3f;
-	
     //Push scan back
     range_1.swap(range_2); xx_1.swap(xx_2); yy_1.swap(yy_2);
 
-    //The number of levels of the pyramid does not match the number of levels used
-    //in the odometry computation (because we sometimes want to finish with lower resolutions)
-
-    unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-
-    //Generate levels
-    for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        unsigned int s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-		const unsigned int i_1 = i-1;
-
-        //              First level -> Filter, not downsample
-        //------------------------------------------------------------------------
-        if (i == 0)
-		{
-			for (unsigned int u = 0; u < cols_i; u++)
-            {	
-				const float dcenter = range_wf(u);
-					
-				//Inner pixels
-                if ((u>1)&&(u<cols_i-2))
-                {		
-					if (dcenter > 0.f)
-					{	
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)
-						{
-							const float abs_dif = abs(range_wf(u+l)-dcenter);
-							if (abs_dif < max_range_dif)
-							{
-								const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-								weight += aux_w;
-								sum += aux_w*range_wf(u+l);
-							}
-						}
-                        range_1[i](u) = sum/weight;
-					}
-					else
-                        range_1[i](u) = 0.f;
-
-                }
-
-                //Boundary
-                else
-                {
-                    if (dcenter > 0.f)
-					{						
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)	
-						{
-							const int indu = u+l;
-							if ((indu>=0)&&(indu<cols_i))
-							{
-								const float abs_dif = abs(range_wf(indu)-dcenter);										
-								if (abs_dif < max_range_dif)
-								{
-									const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-									weight += aux_w;
-									sum += aux_w*range_wf(indu);
-								}
-							}
-						}
-                        range_1[i](u) = sum/weight;
-					}
-					else
-                        range_1[i](u) = 0.f;
-
-                }
-            }
-		}
-
-        //                              Downsampling
-        //-----------------------------------------------------------------------------
-        else
-        {            
-            const unsigned int cols_prev_level = range_1[i_1].rows();
-
-            //Odd number of elements in the previous level
-            if ((cols_prev_level % 2) == 1)
-                for (unsigned int u = 0; u < cols_i; u++)
-                {
-                    const int u2 = 2*u;
-                    const float dcenter = range_1[i_1](u2);
-
-                    //Inner pixels
-                    if ((u>0)&&(u<cols_i-1))
-                    {
-                        if (dcenter > 0.f)
-                        {
-                            float sum = 0.f, weight = 0.f;
-
-                            for (int l=-2; l<3; l++)
-                            {
-                                const float abs_dif = abs(range_1[i_1](u2+l)-dcenter);
-                                if (abs_dif < max_range_dif)
-                                {
-                                    const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                    weight += aux_w;
-                                    sum += aux_w*range_1[i_1](u2+l);
-                                }
-                            }
-                            range_1[i](u) = sum/weight;
-                        }
-                        else
-                            range_1[i](u) = 0.f;
-
-                    }
-
-                    //Boundary
-                    else
-                    {
-                        if (dcenter > 0.f)
-                        {
-                            float sum = 0.f, weight = 0.f;
-                            const unsigned int cols_i2 = range_1[i_1].rows();
-
-                            for (int l=-2; l<3; l++)
-                            {
-                                const int indu = u2+l;
-
-                                if ((indu>=0)&&(indu<cols_i2))
-                                {
-                                    const float abs_dif = abs(range_1[i_1](indu)-dcenter);
-                                    if (abs_dif < max_range_dif)
-                                    {
-                                        const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                        weight += aux_w;
-                                        sum += aux_w*range_1[i_1](indu);
-                                    }
-                                }
-                            }
-                            range_1[i](u) = sum/weight;
-
-                        }
-                        else
-                            range_1[i](u) = 0.f;
-                    }
-                }
-            //Even number of elements in the previous level
-            else
-            {
-                for (unsigned int u = 0; u < cols_i; u++)
-                {
-                    const int u2 = 2*u;
-
-                    if ((range_1[i_1](u2) == 0.f)&&(range_1[i_1](u2+1) == 0.f))
-                        range_1[i](u) = 0.f;
-                    else if (range_1[i_1](u2) == 0.f)
-                        range_1[i](u) = range_1[i_1](u2+1);
-                    else if (range_1[i_1](u2+1) == 0.f)
-                        range_1[i](u) = range_1[i_1](u2);
-                    else
-                        range_1[i](u) = 0.5f*(range_1[i_1](u2) + range_1[i_1](u2+1));
-                }
-            }
-        }
+    //The parameters can change between scans
+    pyramid.max_range_dif = params.max_range_dif;
+    projector.max_range_dif = params.max_range_dif;
 
-        //Calculate coordinates "xy" of the points
-        for (unsigned int u = 0; u < cols_i; u++) 
-		{
-            if (range_1[i](u) > 0.f)
-			{
-                const float tita = -0.5f*fovh + (float(u) + 0.5f)*fovh/float(cols_i);
-                xx_1[i](u) = range_1[i](u)*cos(tita);
-                yy_1[i](u) = range_1[i](u)*sin(tita);
-			}
-			else
-			{
-                xx_1[i](u) = 0.f;
-                yy_1[i](u) = 0.f;
-			}
-		}
-    }
+    //Filter, downsample and compute the coordinates of every level
+    if (range_step > 0.f)
+        pyramid.build(range_wf_q, range_step, range_1, xx_1, yy_1);
+    else
+        pyramid.build(range_wf, range_1, xx_1, yy_1);
+    cols_i = pyramid.level_cols.back();
 
     if (no_ref_scan)
     {
-        range_3 = range_1;
-        xx_3 = xx_1;
-        yy_3 = yy_1;
+        copyPyramid(range_1, range_3);
+        copyPyramid(xx_1, xx_3);
+        copyPyramid(yy_1, yy_3);
         no_ref_scan = false;
     }
 }
@@ -374,9 +191,9 @@ void RF2O_RefS::computeWeights()
     weights_13.fill(0.f);
 	
     //Parameters for error_linearization - (kd = 1.f, k2d = 0.02f, ssigma = 100*e-4f works!)
-    const float kd = 0.01f;
-    const float k2d = 2e-4f;
-    const float sensor_sigma = 4e-4f;
+    const float kd = params.kd;
+    const float k2d = params.k2d;
+    const float sensor_sigma = params.sensor_sigma;
 //    const float kd = 1.f;
 //    const float k2d = 0.02f; //0.5 no, 0.3 no, 0.1 no, 0.05 no, 0.02 no (better between 0.2 and 0.05)
 //    const float sensor_sigma = 100.f*4e-4f; //100.f*4e-4f, 200 is too much
@@ -462,8 +279,8 @@ void RF2O_RefS::solveSystemQuadResiduals3Scans()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
@@ -520,8 +337,8 @@ void RF2O_RefS::solveSystemSmoothTruncQuad3Scans()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
 
@@ -540,7 +357,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuad3Scans()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    const float c = 4.f*mad;
+    const float c = params.smooth_trunc_mad*mad;
     const float inv_c = 1.f/c;
     const float squared_c = square(c);
 
@@ -557,7 +374,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuad3Scans()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    while ((new_energy < 0.995f*last_energy)&&(iter < 10))
+    while ((new_energy < 0.995f*last_energy)&&(iter < params.max_irls))
     {
         cont = 0;
         last_energy = new_energy;
@@ -594,8 +411,8 @@ void RF2O_RefS::solveSystemSmoothTruncQuad3Scans()
         }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -608,6 +425,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuad3Scans()
         }
         //printf("\nEnergy(%d) = %f", iter, new_energy);
         iter++;
+        num_irls++;
 
         //Recompute c
         //-------------------------------------------------
@@ -675,8 +493,8 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly13()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -697,7 +515,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly13()
     const float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    const float c = 4.f*mad;
+    const float c = params.smooth_trunc_mad*mad;
     const float inv_c = 1.f/c;
     const float squared_c = square(c);
 
@@ -714,7 +532,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly13()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    while ((new_energy < 0.995f*last_energy)&&(iter < 10))
+    while ((new_energy < 0.995f*last_energy)&&(iter < params.max_irls))
     {
         cont = 0;
         last_energy = new_energy;
@@ -737,8 +555,8 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly13()
         }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -751,6 +569,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly13()
         }
         //printf("\nEnergy(%d) = %f", iter, new_energy);
         iter++;
+        num_irls++;
 
     }
 
@@ -799,8 +618,8 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly12()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -821,7 +640,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly12()
     const float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    const float c = 4.f*mad;
+    const float c = params.smooth_trunc_mad*mad;
     const float inv_c = 1.f/c;
     const float squared_c = square(c);
 
@@ -838,7 +657,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly12()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    while ((new_energy < 0.995f*last_energy)&&(iter < 10))
+    while ((new_energy < 0.995f*last_energy)&&(iter < params.max_irls))
     {
         cont = 0;
         last_energy = new_energy;
@@ -861,8 +680,8 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly12()
         }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -875,6 +694,7 @@ void RF2O_RefS::solveSystemSmoothTruncQuadOnly12()
         }
         //printf("\nEnergy(%d) = %f", iter, new_energy);
         iter++;
+        num_irls++;
     }
 
     //Covariance calculation
@@ -920,8 +740,8 @@ void RF2O_RefS::performWarping()
                 //Very close pixel
                 if (abs(round(uwarp) - uwarp) < 0.05f)
                 {
-                    range_warped[image_level](round(uwarp)) += range_w;
-                    wacu(round(uwarp)) += 1.f;
+                    range_warped[image_level](int(round(uwarp))) += range_w;
+                    wacu(int(round(uwarp))) += 1.f;
                 }
                 else
                 {
@@ -963,55 +783,9 @@ void RF2O_RefS::performBestWarping()
     for (unsigned int i=0; i<=level; i++)
         acu_trans = transformations[i]*acu_trans;
 
-    ArrayXf x_trans(cols_i), y_trans(cols_i), u_trans(cols_i), range_trans(cols_i);
-    x_trans.fill(0.f); y_trans.fill(0.f); range_trans.fill(0.f);
-    range_warped[image_level].fill(0.f);
-
-    const float kdtita = float(cols_i)/fovh;
-
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        if (range_1[image_level](u) != 0.f)
-        {
-            //Transform point to the warped reference frame
-            x_trans(u) = acu_trans(0,0)*xx_1[image_level](u) + acu_trans(0,1)*yy_1[image_level](u) + acu_trans(0,2);
-            y_trans(u) = acu_trans(1,0)*xx_1[image_level](u) + acu_trans(1,1)*yy_1[image_level](u) + acu_trans(1,2);
-            range_trans(u) = sqrtf(square(x_trans(u)) + square(y_trans(u)));
-            const float tita_trans = atan2(y_trans(u), x_trans(u));
-            u_trans(u) = kdtita*(tita_trans + 0.5f*fovh) - 0.5f;
-        }
-    }
-
-    //Check projection for each segment
-    for (unsigned int u = 0; u<cols_i-1; u++)
-    {
-        if ((range_trans(u) == 0.f) || (range_trans(u+1) == 0.f))
-            continue;
-        else if (floorf(u_trans(u)) != floorf(u_trans(u+1)))
-        {
-           const float range_l = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? range_trans(u+1) : range_trans(u);
-           const float range_r = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? range_trans(u) : range_trans(u+1);
-           const float u_trans_l = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? u_trans(u+1) : u_trans(u);
-           const float u_trans_r = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? u_trans(u) : u_trans(u+1);
-           const int u_l = min(floorf(u_trans(u)), floorf(u_trans(u+1)));
-           const int u_r = max(floorf(u_trans(u)), floorf(u_trans(u+1)));
-
-           for (unsigned int u_segment=u_l+1; (u_segment<=u_r)&&(u_segment<cols_i)&&(u_segment>=0); u_segment++)
-           {
-               const float range_interp = ((u_segment - u_trans_l)*range_r + (u_trans_r - u_segment)*range_l)/(u_trans_r - u_trans_l);
-               if ((range_warped[image_level](u_segment) == 0.f)||(range_interp < range_warped[image_level](u_segment)))
-                   range_warped[image_level](u_segment) = range_interp;
-           }
-        }
-    }
-
-    //Compute coordinates
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        const float tita = -0.5f*fovh + (float(u) + 0.5f)/kdtita;
-        xx_warped[image_level](u) = range_warped[image_level](u)*cos(tita);
-        yy_warped[image_level](u) = range_warped[image_level](u)*sin(tita);
-    }
+    //Transform the points, project every segment onto the warped scan keeping the closest range, and compute the coordinates
+    projector.project(acu_trans, range_1[image_level], xx_1[image_level], yy_1[image_level],
+                      range_warped[image_level], xx_warped[image_level], yy_warped[image_level]);
 }
 
 void RF2O_RefS::warpScan3To2()
@@ -1095,12 +869,14 @@ void RF2O_RefS::odometryCalculation()
     //==================================================================================
 
     clock.Tic();
+    num_iters = 0;
+    num_irls = 0;
     createScanPyramid();
     if (new_ref_scan)
     {
-        range_3_warpedTo2 = range_3;
-        xx_3_warpedTo2 = xx_3;
-        yy_3_warpedTo2 = yy_3;
+        copyPyramid(range_3, range_3_warpedTo2);
+        copyPyramid(xx_3, xx_3_warpedTo2);
+        copyPyramid(yy_3, yy_3_warpedTo2);
     }
     else
         warpScan3To2();
@@ -1116,8 +892,10 @@ void RF2O_RefS::odometryCalculation()
         cols_i = ceil(float(cols)/float(s));
         image_level = ctf_levels - i + round(log2(round(float(width)/float(cols)))) - 1;
 
-        for (unsigned int k=0; k<3; k++)
+        for (unsigned int k=0; k<params.nonlin_iters; k++)
         {
+            num_iters++;
+
             //1. Perform warping
             if ((i == 0)&&(k == 0))
             {
@@ -1158,7 +936,7 @@ void RF2O_RefS::odometryCalculation()
             //6. Filter solution
             filterLevelSolution();
 
-            if (kai_loc_level.norm() < 0.05f)
+            if (kai_loc_level.norm() < params.min_update)
             {
                 //printf("\n Number of non-linear iterations: %d", k+1);
                 break;
@@ -1171,7 +949,8 @@ void RF2O_RefS::odometryCalculation()
         new_ref_scan = false;
 
     runtime = 1000.f*clock.Tac();
-    cout << endl << "Time odometry (ms): " << runtime;
+    if (verbose)
+        cout << endl << "Time odometry (ms): " << runtime;
 
     //Update poses
     PoseUpdate();
@@ -1218,7 +997,7 @@ void RF2O_RefS::filterLevelSolution()
 
     //Filter speed
     //const float cf = 15e3f*expf(-int(level)), df = 0.05f*expf(-int(level));
-    const float cf = 5e3f*expf(-int(level)), df = 0.02f*expf(-int(level));
+    const float cf = params.cf*expf(-int(level)), df = params.df*expf(-int(level));
     //const float cf = 0*expf(-int(level)), df = 0.f*expf(-int(level));
 
     Vector3f kai_b_fil;
@@ -1288,7 +1067,7 @@ void RF2O_RefS::PoseUpdate()
     //						Update poses
     //-------------------------------------------------------
     laser_oldpose = laser_pose;
-    mrpt::poses::CPose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
+    RF2O_Pose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
     laser_pose = laser_pose + pose_aux_2D;
 
 
@@ -1325,7 +1104,7 @@ void RF2O_RefS::updateReferenceScan()
         if (keyscan_out_region < 0.f) //(trans + rot > threshold)
         {
             //ref_scan = old_scan
-            range_3 = range_1; xx_3 = xx_1; yy_3 = yy_1;
+            copyPyramid(range_1, range_3); copyPyramid(xx_1, xx_3); copyPyramid(yy_1, yy_3);
 
             //Overall_trans_prev = T12
             Matrix3f acu_trans = Matrix3f::Identity();
@@ -1333,7 +1112,8 @@ void RF2O_RefS::updateReferenceScan()
     //            acu_trans = transformations[i-1]*acu_trans;
             overall_trans_prev = acu_trans;
 
-            printf("\n New keyframe inserted!!!");
+            if (verbose)
+                printf("\n New keyframe inserted!!!");
             new_ref_scan = true;
         }
     }
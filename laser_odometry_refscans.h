@@ -6,10 +6,11 @@
 //====================================================
 
 
-#include <mrpt/poses/CPose2D.h>
-#include <mrpt/utils/CTicTac.h>
 #include <Eigen/Dense>
 #include <iostream>
+#include "laser_odometry_types.h"
+#include "laser_odometry_warping.h"
+#include "laser_odometry_params.h"
 
 
 //#define M_LOG2E 1.44269504088896340736 //log2(e)
@@ -23,11 +24,13 @@ public:
 
     //Scans and cartesian coordinates: 1 - New, 2 - Old, 3 - Ref
     Eigen::ArrayXf range_wf;
-    std::vector<Eigen::ArrayXf> range_1, range_2, range_3;
-    std::vector<Eigen::ArrayXf> range_12, range_13, range_warped;
-    std::vector<Eigen::ArrayXf> xx_1, xx_2, xx_3, xx_12, xx_13, xx_warped;
-    std::vector<Eigen::ArrayXf> yy_1, yy_2, yy_3, yy_12, yy_13, yy_warped;
-    std::vector<Eigen::ArrayXf> range_3_warpedTo2, xx_3_warpedTo2, yy_3_warpedTo2;
+    ArrayXq range_wf_q;           //Quantized input scan, used instead of range_wf if range_step > 0 (levels: pyramid.level_step)
+    float range_step;             //[m] Step of the quantized input (0 -> float input)
+    PyramidViews range_1, range_2, range_3;
+    PyramidViews range_12, range_13, range_warped;
+    PyramidViews xx_1, xx_2, xx_3, xx_12, xx_13, xx_warped;
+    PyramidViews yy_1, yy_2, yy_3, yy_12, yy_13, yy_warped;
+    PyramidViews range_3_warpedTo2, xx_3_warpedTo2, yy_3_warpedTo2;
 
     //Rigid transformations and velocities (twists: vx, vy, w)
     std::vector<Eigen::MatrixXf> transformations; //T13
@@ -53,22 +56,27 @@ public:
 	unsigned int ctf_levels;
 	unsigned int image_level, level;
 	unsigned int num_valid_range;
-	unsigned int iter_irls;
 	float g_mask[5];
+    RF2O_Pyramid pyramid;         //Shared gaussian pyramid builder
+    RF2O_ScanArena arena;         //Storage of all the pyramid levels
+    RF2O_ScanProjector projector; //Z-buffered projection used by performBestWarping
+    RF2O_Params params;           //Tuning parameters (they can be changed between scans)
     bool no_ref_scan;
     bool new_ref_scan;
     unsigned int method_ref_scan; //0 - ours, 1 - trans and rot thres, 2 - MAD(res)
+    bool verbose;                 //Print the runtime of every scan and the insertion of reference scans
 
 
     //Laser poses (most recent and previous)
-    mrpt::poses::CPose2D laser_pose;
-    mrpt::poses::CPose2D laser_oldpose;
+    RF2O_Pose2D laser_pose;
+    RF2O_Pose2D laser_oldpose;
 	bool test;
     unsigned int method; //0 - consecutive scan alignment, 1 - keyscan alignment, 2 - multi-scan (hybrid) alignment
 
     //To measure runtimes
-    mrpt::utils::CTicTac	clock;
+    RF2O_TicTac             clock;
     float                   runtime;
+    unsigned int            num_iters, num_irls;    //Non-linear iterations and reweightings of the solvers in the last odometryCalculation()
 
 
     //Methods
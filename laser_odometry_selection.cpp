@@ -0,0 +1,125 @@
+/* Project: Laser odometry
+   Informative-pixel selection */
+
+#include "laser_odometry_selection.h"
+#include <algorithm>
+
+
+using namespace Eigen;
+using namespace std;
+
+
+//Sorts indices by decreasing leverage
+struct LeverageGreater
+{
+    const vector<float> &leverage;
+    LeverageGreater(const vector<float> &lev) : leverage(lev) {}
+    bool operator()(unsigned int a, unsigned int b) const { return leverage[a] > leverage[b]; }
+};
+
+
+void RF2O_PixelSelector::initialize(unsigned int max_points)
+{
+    pixel.resize(max_points);
+    leverage.resize(max_points);
+    order.resize(max_points);
+    keep.resize(max_points);
+}
+
+unsigned int RF2O_PixelSelector::select(float *A, float *B, unsigned int num_rows, Array<bool, Dynamic, 1> &null, unsigned int cols_i)
+{
+    if ((budget == 0) || (num_rows <= budget))
+        return num_rows;
+
+    //Information matrix and leverage of every row
+    const Map<const MatrixXf> rows(A, num_rows, 3);
+    const Matrix3f info = rows.transpose()*rows;
+    if (!(info.determinant() > 0.f))
+        return num_rows;
+
+    const Matrix3f info_inv = info.inverse();
+    unsigned int k = 0;
+    for (unsigned int u = 1; (u < cols_i-1)&&(k < num_rows); u++)
+        if (null(u) == false)
+        {
+            const Vector3f a = rows.row(k).transpose();
+            leverage[k] = a.dot(info_inv*a);
+            pixel[k] = u;
+            order[k] = k;
+            keep[k] = false;
+            k++;
+        }
+
+    //Best pixels of every angular bucket (rows are sorted by pixel, so buckets are contiguous).
+    //There are never more buckets than pixels in the budget, so that every bucket keeps at least one.
+    const unsigned int buckets = min(num_buckets, budget);
+    const unsigned int quota = budget/buckets;
+    unsigned int first = 0;
+    for (unsigned int b = 0; b<buckets; b++)
+    {
+        const unsigned int u_end = 1 + (b+1)*(cols_i-2)/buckets;
+        unsigned int last = first;
+        while ((last < num_rows)&&(pixel[last] < u_end))
+            last++;
+
+        keepBest(first, last, quota);
+        first = last;
+    }
+
+    //Give the remaining budget to the best pixels not selected yet
+    unsigned int num_kept = 0, num_left = 0;
+    for (unsigned int k = 0; k<num_rows; k++)
+    {
+        if (keep[k])    num_kept++;
+        else            order[num_left++] = k;
+    }
+    if (num_kept < budget)
+    {
+        keepBest(0, num_left, budget - num_kept);
+        num_kept = min(budget, num_rows);
+    }
+
+    //Discard the rest
+    for (unsigned int k = 0; k<num_rows; k++)
+        if (!keep[k])
+            null(pixel[k]) = true;
+
+    return compact(A, B, num_rows);
+}
+
+unsigned int RF2O_PixelSelector::compact(float *A, float *B, unsigned int num_rows) const
+{
+    //Every kept row moves to a lower or equal position (in each column as well), so it can be done in place
+    unsigned int num_kept = 0;
+    for (unsigned int k = 0; k<num_rows; k++)
+        if (keep[k])
+            num_kept++;
+
+    for (unsigned int c = 0; c<3; c++)
+    {
+        unsigned int dst = c*num_kept;
+        for (unsigned int k = 0; k<num_rows; k++)
+            if (keep[k])
+                A[dst++] = A[c*num_rows + k];
+    }
+
+    unsigned int dst = 0;
+    for (unsigned int k = 0; k<num_rows; k++)
+        if (keep[k])
+            B[dst++] = B[k];
+
+    return num_kept;
+}
+
+void RF2O_PixelSelector::keepBest(unsigned int first, unsigned int last, unsigned int num)
+{
+    //Marks the 'num' rows of order[first, last) with the highest leverage
+    vector<unsigned int>::iterator begin = order.begin() + first, end = order.begin() + last;
+    if (last - first > num)
+        nth_element(begin, begin + num, end, LeverageGreater(leverage));
+    else
+        num = last - first;
+
+    for (unsigned int k = 0; k<num; k++)
+        keep[order[first + k]] = true;
+}
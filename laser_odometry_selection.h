@@ -0,0 +1,55 @@
+//====================================================
+//  Project: Laser odometry
+//  Selection of the most informative pixels before
+//  solving the odometry
+//====================================================
+
+#ifndef _LASER_ODOMETRY_SELECTION_
+#define _LASER_ODOMETRY_SELECTION_
+
+#include <Eigen/Dense>
+#include <vector>
+
+
+//Keeps at most 'budget' rows of the system built by a solver, choosing those with the highest leverage on the 3x3
+//information matrix (h = a^T (A^T A)^-1 a, with a the row of A of the pixel, as the solver weighted it). The scan is
+//divided in angular buckets with the same share of the budget so that the selected pixels stay spread over the
+//whole field of view; the budget left by sparse buckets is given to the best remaining pixels. It only applies to
+//the finest levels of the pyramid: their cost no longer grows with the resolution of the scanner, while the coarse
+//levels, which are cheap, keep all their pixels.
+
+class RF2O_PixelSelector {
+public:
+
+    //Configuration
+    unsigned int budget;            //Maximum number of pixels passed to the solver (0 -> all of them)
+    unsigned int num_buckets;       //Angular buckets sharing the budget (at most 'budget' of them are used)
+    unsigned int num_levels;        //Finest levels of the pyramid where the budget applies
+
+    //Pixel of every row and its leverage (reserved at initialize)
+    std::vector<unsigned int> pixel;
+    std::vector<float> leverage;
+    std::vector<unsigned int> order;
+    std::vector<bool> keep;
+
+
+    RF2O_PixelSelector() : budget(0), num_buckets(16), num_levels(2) {}
+
+    //Methods
+    void initialize(unsigned int max_points);
+    bool active(unsigned int num_valid, unsigned int level, unsigned int ctf_levels) const
+    {
+        return (budget > 3) && (num_valid > budget) && (level + num_levels >= ctf_levels);
+    }
+
+    //A (num_rows x 3, column-major) and B are the system of a solver, with one row per non-null pixel of [1, cols_i-1)
+    //in order. The pixels of the rows that are not kept are nulled, and the kept rows are moved to the top of the
+    //buffers: A is then (num_kept x 3, column-major) and B num_kept long. Returns num_kept.
+    unsigned int select(float *A, float *B, unsigned int num_rows, Eigen::Array<bool, Eigen::Dynamic, 1> &null, unsigned int cols_i);
+
+private:
+    void keepBest(unsigned int first, unsigned int last, unsigned int num);
+    unsigned int compact(float *A, float *B, unsigned int num_rows) const;
+};
+
+#endif
@@ -3,13 +3,23 @@
    Date: January 2015 */
 
 #include "laser_odometry_standard.h"
+#include <new>
 
 
-using namespace mrpt::utils;
+using namespace rf2o;
 using namespace Eigen;
 using namespace std;
 
 
+//acu = transf*acu evaluated on the stack (the per-scan path must not allocate)
+static inline void composeTransformation(const MatrixXf &transf, Matrix3f &acu)
+{
+    Matrix3f result;
+    result.noalias() = transf*acu;
+    acu = result;
+}
+
+
 void RF2O_standard::initialize(unsigned int size, float FOV_rad, unsigned int odo_ID)
 {
     ID = odo_ID;
@@ -17,52 +27,26 @@ void RF2O_standard::initialize(unsigned int size, float FOV_rad, unsigned int od
     width = size;
     fovh = FOV_rad*size/(size-1); //Exact for simulation, but I don't know how the datasets are given...
     ctf_levels = ceilf(log2(cols) - 4.3f);
-    iter_irls = 8;
+    num_iters = 0;
+    num_irls = 0;
     filter_velocity = true;
+    inverse_warping = false;
+    verbose = true;
 	
     //Resize original range scan
     range_wf.resize(width);
+    range_wf_q.resize(width);
+    range_step = 0.f;
 
     //Resize the transformation matrix
     transformations.resize(ctf_levels);
     for (unsigned int i = 0; i < ctf_levels; i++)
         transformations[i].resize(3,3);
+    transf_level.reserve(ctf_levels*params.nonlin_iters);
+    transf_acu_per_iteration.reserve(ctf_levels*params.nonlin_iters);
 
-	//Resize pyramid
-	unsigned int s, cols_i;
+	//Number of levels of the pyramid
     const unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-    range.resize(pyr_levels);
-    range_old.resize(pyr_levels);
-    range_inter.resize(pyr_levels);
-    xx.resize(pyr_levels);
-    xx_inter.resize(pyr_levels);
-    xx_old.resize(pyr_levels);
-    yy.resize(pyr_levels);
-    yy_inter.resize(pyr_levels);
-    yy_old.resize(pyr_levels);
-	range_warped.resize(pyr_levels);
-	xx_warped.resize(pyr_levels);
-	yy_warped.resize(pyr_levels);
-
-	for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-
-        range[i].resize(cols_i); range_inter[i].resize(cols_i); range_old[i].resize(cols_i);
-        range[i].fill(0.f); range_old[i].fill(0.f);
-        xx[i].resize(cols_i); xx_inter[i].resize(cols_i); xx_old[i].resize(cols_i);
-        xx[i].fill(0.f); xx_old[i].fill(0.f);
-        yy[i].resize(cols_i); yy_inter[i].resize(cols_i); yy_old[i].resize(cols_i);
-        yy[i].fill(0.f); yy_old[i].fill(0.f);
-
-		if (cols_i <= cols)
-		{
-            range_warped[i].resize(cols_i);
-            xx_warped[i].resize(cols_i);
-            yy_warped[i].resize(cols_i);
-		}
-    }
 
     //Resize aux variables
     dt.resize(cols);
@@ -70,206 +54,53 @@ void RF2O_standard::initialize(unsigned int size, float FOV_rad, unsigned int od
     weights.resize(cols);
     null.resize(cols);
     null.fill(false);
-	cov_odo.assign(0.f);
+	cov_odo.fill(0.f);
     outliers.resize(cols);
     outliers.fill(false);
+    rtita.resize(cols);
+
+    //Storage of the default solvers: A, Aw (cols x 3), B, Bw and the residuals, and their sorted copy
+    system_storage.resize(9*cols);
+    aux_residuals.reserve(cols);
 
 
 	//Compute gaussian mask
 	g_mask[0] = 1.f/16.f; g_mask[1] = 0.25f; g_mask[2] = 6.f/16.f; g_mask[3] = g_mask[1]; g_mask[4] = g_mask[0];
+    pyramid.initialize(width, pyr_levels, fovh, g_mask, params.max_range_dif, true, true);
+    projector.initialize(pyramid.level_cols, fovh);
+    selector.initialize(width);
+
+    //Lay out all the pyramid levels of every scan in a single aligned block
+    arena.initialize(pyramid.level_cols, 12);
+    arena.bind(range); arena.bind(range_old); arena.bind(range_inter);
+    arena.bind(range_warped); arena.bind(xx); arena.bind(xx_inter);
+    arena.bind(xx_old); arena.bind(xx_warped); arena.bind(yy);
+    arena.bind(yy_inter); arena.bind(yy_old); arena.bind(yy_warped);
 
     //Initialize "last velocity" as zero
-	kai_abs.assign(0.f);
-	kai_loc_old.assign(0.f);
+	kai_abs.fill(0.f);
+	kai_loc_old.fill(0.f);
 }
 
 
 void RF2O_standard::createScanPyramid()
 {
-	const float max_range_dif = 0.3f;
-	
-	//Push the frames back
+    //Push the frames back
 	range_old.swap(range);
 	xx_old.swap(xx);
 	yy_old.swap(yy);
 
+    //The parameters can change between scans
+    pyramid.max_range_dif = params.max_range_dif;
+    projector.max_range_dif = params.max_range_dif;
+    selector.budget = params.pixel_budget;
 
-    //The number of levels of the pyramid does not match the number of levels used
-    //in the odometry computation (because we sometimes want to finish with lower resolutions)
-
-    unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-
-    //Generate levels
-    for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        unsigned int s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-		const unsigned int i_1 = i-1;
-
-        //              First level -> Filter, not downsample (I have tested it and it works better with this filtering)
-        //---------------------------------------------------------------------------------------------------------------
-        if (i == 0)
-		{
-            for (unsigned int u = 0; u < cols_i; u++)
-            {
-                const float dcenter = range_wf(u);
-
-                //Inner pixels
-                if ((u>1)&&(u<cols_i-2))
-                {
-                    if (dcenter > 0.f)
-                    {
-                        float sum = 0.f, weight = 0.f;
-
-                        for (int l=-2; l<3; l++)
-                        {
-                            const float abs_dif = abs(range_wf(u+l)-dcenter);
-                            if (abs_dif < max_range_dif)
-                            {
-                                const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                weight += aux_w;
-                                sum += aux_w*range_wf(u+l);
-                            }
-                        }
-                        range[i](u) = sum/weight;
-                    }
-                    else
-                        range[i](u) = 0.f;
-
-                }
-
-                //Boundary
-                else
-                {
-                    if (dcenter > 0.f)
-                    {
-                        float sum = 0.f, weight = 0.f;
-
-                        for (int l=-2; l<3; l++)
-                        {
-                            const int indu = u+l;
-                            if ((indu>=0)&&(indu<cols_i))
-                            {
-                                const float abs_dif = abs(range_wf(indu)-dcenter);
-                                if (abs_dif < max_range_dif)
-                                {
-                                    const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                    weight += aux_w;
-                                    sum += aux_w*range_wf(indu);
-                                }
-                            }
-                        }
-                        range[i](u) = sum/weight;
-                    }
-                    else
-                        range[i](u) = 0.f;
-
-                }
-            }
-		}
-
-        //                              Downsampling
-        //-----------------------------------------------------------------------------
-        else
-        {            
-            const unsigned int cols_prev_level = range[i_1].rows();
-
-            //Odd number of elements in the previous level
-            if ((cols_prev_level % 2) == 1)
-                for (unsigned int u = 0; u < cols_i; u++)
-                {
-                    const int u2 = 2*u;
-                    const float dcenter = range[i_1](u2);
-
-                    //Inner pixels
-                    if ((u>0)&&(u<cols_i-1))
-                    {
-                        if (dcenter > 0.f)
-                        {
-                            float sum = 0.f, weight = 0.f;
-
-                            for (int l=-2; l<3; l++)
-                            {
-                                const float abs_dif = abs(range[i_1](u2+l)-dcenter);
-                                if (abs_dif < max_range_dif)
-                                {
-                                    const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                    weight += aux_w;
-                                    sum += aux_w*range[i_1](u2+l);
-                                }
-                            }
-                            range[i](u) = sum/weight;
-                        }
-                        else
-                            range[i](u) = 0.f;
-                    }
-
-                    //Boundary
-                    else
-                    {
-                        if (dcenter > 0.f)
-                        {
-                            float sum = 0.f, weight = 0.f;
-                            const unsigned int cols_i2 = range[i_1].rows();
-
-                            for (int l=-2; l<3; l++)
-                            {
-                                const int indu = u2+l;
-
-                                if ((indu>=0)&&(indu<cols_i2))
-                                {
-                                    const float abs_dif = abs(range[i_1](indu)-dcenter);
-                                    if (abs_dif < max_range_dif)
-                                    {
-                                        const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-                                        weight += aux_w;
-                                        sum += aux_w*range[i_1](indu);
-                                    }
-                                }
-                            }
-                            range[i](u) = sum/weight;
-
-                        }
-                        else
-                            range[i](u) = 0.f;
-                    }
-                }
-
-            //Even number of elements in the previous level
-            else
-            {
-                for (unsigned int u = 0; u < cols_i; u++)
-                {
-                    const int u2 = 2*u;
-
-                    if ((range[i_1](u2) == 0.f)&&(range[i_1](u2+1) == 0.f))
-                        range[i](u) = 0.f;
-                    else if (range[i_1](u2) == 0.f)
-                        range[i](u) = range[i_1](u2+1);
-                    else if (range[i_1](u2+1) == 0.f)
-                        range[i](u) = range[i_1](u2);
-                    else
-                        range[i](u) = 0.5f*(range[i_1](u2) + range[i_1](u2+1));
-                }
-            }
-        }
-
-        //Calculate coordinates "xy" of the points
-        for (unsigned int u = 0; u < cols_i; u++) 
-		{
-            if (range[i](u) > 0.f)
-			{
-                const float tita = -0.5f*fovh + (float(u) + 0.5f)*fovh/float(cols_i);
-				xx[i](u) = range[i](u)*cos(tita);
-				yy[i](u) = range[i](u)*sin(tita);
-			}
-			else
-			{
-				xx[i](u) = 0.f;
-				yy[i](u) = 0.f;
-			}
-		}
-    }
+    //Filter, downsample and compute the coordinates of every level
+    if (range_step > 0.f)
+        pyramid.build(range_wf_q, range_step, range, xx, yy);
+    else
+        pyramid.build(range_wf, range, xx, yy);
+    cols_i = pyramid.level_cols.back();
 }
 
 void RF2O_standard::calculateCoord()
@@ -301,7 +132,6 @@ void RF2O_standard::calculateCoord()
 void RF2O_standard::calculaterangeDerivativesSurface()
 {	
     //Compute distances between points
-    rtita.resize(cols_i);
     rtita.fill(1.f);
 
 	for (unsigned int u = 0; u < cols_i-1; u++)
@@ -332,9 +162,9 @@ void RF2O_standard::computeWeights()
     weights.fill(0.f);
 	
 	//Parameters for error_linearization
-    const float kd = 0.01f; // 1.f
-    const float k2d = 2e-4f; //0.2f
-    const float sensor_sigma = 4e-4f;
+    const float kd = params.kd;
+    const float k2d = params.k2d;
+    const float sensor_sigma = params.sensor_sigma;
 	
 	for (unsigned int u = 1; u < cols_i-1; u++)
         if (null(u) == false)
@@ -356,10 +186,23 @@ void RF2O_standard::computeWeights()
 }
 
 
+void RF2O_standard::selectInformativeRows(Map<MatrixXf> &A, Map<VectorXf> &B)
+{
+    if (!selector.active(num_valid_range, level, ctf_levels))
+        return;
+
+    //The kept rows are moved to the top of the buffers, which are mapped again with the new size
+    float *A_data = A.data(), *B_data = B.data();
+    num_valid_range = selector.select(A_data, B_data, num_valid_range, null, cols_i);
+    new (&A) Map<MatrixXf>(A_data, num_valid_range, 3);
+    new (&B) Map<VectorXf>(B_data, num_valid_range);
+}
+
 void RF2O_standard::solveSystemQuadResiduals()
 {
-	A.resize(num_valid_range,3);
-    B.resize(num_valid_range);
+    //The system is built in the buffers reserved by initialize() (no allocation per scan)
+    Map<MatrixXf> A(system_storage.data(), num_valid_range, 3);
+    Map<VectorXf> B(system_storage.data() + 6*cols, num_valid_range);
 	unsigned int cont = 0;
     const float kdtita = (cols_i)/fovh;
     const float inv_kdtita = 1.f/kdtita;
@@ -385,21 +228,28 @@ void RF2O_standard::solveSystemQuadResiduals()
 			cont++;
 		}
 	
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows(A, B);
+
 	//Solve the linear system of equations using a minimum least squares method
-	MatrixXf AtA, AtB;
-	AtA.multiply_AtA(A);
-	AtB.multiply_AtB(A,B);
+	Matrix3f AtA;
+	Vector3f AtB;
+	AtA.noalias() = A.transpose()*A;
+	AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
-    VectorXf res = A*kai_loc_level - B;
-	cov_odo = (1.f/float(num_valid_range-3))*AtA.inverse()*res.squaredNorm();
+    Map<VectorXf> res(system_storage.data() + 8*cols, num_valid_range);
+    res.noalias() = A*kai_loc_level;
+    res -= B;
+	cov_odo = (1.f/float(num_valid_range-3))*PartialPivLU<Matrix3f>(AtA).inverse()*res.squaredNorm();
 }
 
 void RF2O_standard::solveSystemQuadResidualsNoPreW()
 {
-    A.resize(num_valid_range,3);
-    B.resize(num_valid_range);
+    //The system is built in the buffers reserved by initialize() (no allocation per scan)
+    Map<MatrixXf> A(system_storage.data(), num_valid_range, 3);
+    Map<VectorXf> B(system_storage.data() + 6*cols, num_valid_range);
     unsigned int cont = 0;
     const float kdtita = (cols_i)/fovh;
     const float inv_kdtita = 1.f/kdtita;
@@ -424,15 +274,21 @@ void RF2O_standard::solveSystemQuadResidualsNoPreW()
             cont++;
         }
 
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows(A, B);
+
     //Solve the linear system of equations using a minimum least squares method
-    MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    Matrix3f AtA;
+    Vector3f AtB;
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
-    VectorXf res = A*kai_loc_level - B;
-    cov_odo = (1.f/float(num_valid_range-3))*AtA.inverse()*res.squaredNorm();
+    Map<VectorXf> res(system_storage.data() + 8*cols, num_valid_range);
+    res.noalias() = A*kai_loc_level;
+    res -= B;
+    cov_odo = (1.f/float(num_valid_range-3))*PartialPivLU<Matrix3f>(AtA).inverse()*res.squaredNorm();
 }
 
 
@@ -464,8 +320,8 @@ void RF2O_standard::solveSystemMCauchy()
 	
 	//Solve the linear system of equations using a minimum least squares method
 	MatrixXf AtA, AtB;
-	AtA.multiply_AtA(A);
-	AtB.multiply_AtB(A,B);
+	AtA.noalias() = A.transpose()*A;
+	AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
 	//cout << endl << "max res: " << res.maxCoeff();
@@ -490,8 +346,9 @@ void RF2O_standard::solveSystemMCauchy()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    for (unsigned int i=1; i<=iter_irls; i++)
+    for (unsigned int i=1; i<=params.iter_irls; i++)
     {
+        num_irls++;
         cont = 0;
 
         for (unsigned int u = 1; u < cols_i-1; u++)
@@ -508,8 +365,8 @@ void RF2O_standard::solveSystemMCauchy()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -552,8 +409,8 @@ void RF2O_standard::solveSystemTruncatedQuad()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -574,7 +431,7 @@ void RF2O_standard::solveSystemTruncatedQuad()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    float c = 5.f*mad;
+    float c = params.trunc_mad*mad;
 
     ////Compute the energy
     //float energy = 0.f;
@@ -584,8 +441,9 @@ void RF2O_standard::solveSystemTruncatedQuad()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    for (unsigned int i=1; i<=iter_irls; i++)
+    for (unsigned int i=1; i<=params.iter_irls; i++)
     {
+        num_irls++;
         cont = 0;
 
         for (unsigned int u = 1; u < cols_i-1; u++)
@@ -604,8 +462,8 @@ void RF2O_standard::solveSystemTruncatedQuad()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -632,7 +490,7 @@ void RF2O_standard::solveSystemTruncatedQuad()
         mad = aux_vector.at(res.rows()/2);
 
         //Find the m-estimator constant
-        c = 5.f*mad;
+        c = params.trunc_mad*mad;
 
     }
 
@@ -649,13 +507,15 @@ void RF2O_standard::solveSystemTruncatedQuad()
                 num_outliers++;
             }
 
-    printf("\n Num_outliers = %d", num_outliers);
+    if (verbose)
+        printf("\n Num_outliers = %d", num_outliers);
 }
 
 void RF2O_standard::solveSystemSmoothTruncQuad()
 {
-    A.resize(num_valid_range,3); Aw.resize(num_valid_range,3);
-    B.resize(num_valid_range); Bw.resize(num_valid_range);
+    //The system is built in the buffers reserved by initialize() (no allocation per scan)
+    Map<MatrixXf> A(system_storage.data(), num_valid_range, 3);
+    Map<VectorXf> B(system_storage.data() + 6*cols, num_valid_range);
     unsigned int cont = 0;
 
     const float kdtita = float(cols_i)/fovh;
@@ -682,17 +542,26 @@ void RF2O_standard::solveSystemSmoothTruncQuad()
             cont++;
         }
 
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows(A, B);
+    Map<MatrixXf> Aw(system_storage.data() + 3*cols, num_valid_range, 3);
+    Map<VectorXf> Bw(system_storage.data() + 7*cols, num_valid_range);
+
     //Solve the linear system of equations using a minimum least squares method
-    MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    Matrix3f AtA;
+    Vector3f AtB;
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
-    VectorXf res = A*kai_loc_level - B;
+    Map<VectorXf> res(system_storage.data() + 8*cols, num_valid_range);
+    res.noalias() = A*kai_loc_level;
+    res -= B;
     //cout << endl << "max res: " << res.maxCoeff();
     //cout << endl << "min res: " << res.minCoeff();
 
     //Compute the median of res
-    vector<float> aux_vector;
+    vector<float> &aux_vector = aux_residuals;
+    aux_vector.clear();
     for (unsigned int k = 0; k<res.rows(); k++)
         aux_vector.push_back(res(k));
     std::sort(aux_vector.begin(), aux_vector.end());
@@ -706,7 +575,7 @@ void RF2O_standard::solveSystemSmoothTruncQuad()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    const float c = 4.f*mad; //This seems to be the best (4) - 5
+    const float c = params.smooth_trunc_mad*mad; //This seems to be the best (4) - 5
     const float inv_c = 1.f/c;
     const float squared_c = square(c);
 
@@ -723,7 +592,7 @@ void RF2O_standard::solveSystemSmoothTruncQuad()
 
     //Solve iteratively reweighted least squares
     //===================================================================
-    while ((new_energy < 0.995f*last_energy)&&(iter < 10))
+    while ((new_energy < 0.995f*last_energy)&&(iter < params.max_irls))
     {
         cont = 0;
         last_energy = new_energy;
@@ -744,10 +613,11 @@ void RF2O_standard::solveSystemSmoothTruncQuad()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
-        res = A*kai_loc_level - B;
+        res.noalias() = A*kai_loc_level;
+        res -= B;
 
         //Compute the energy
         new_energy = 0.f;
@@ -758,6 +628,7 @@ void RF2O_standard::solveSystemSmoothTruncQuad()
         }
         //printf("\nEnergy(%d) = %f", iter, new_energy);
         iter++;
+        num_irls++;
 
 
         //Recompute c
@@ -782,7 +653,7 @@ void RF2O_standard::solveSystemSmoothTruncQuad()
     }
 
     //Covariance calculation
-    cov_odo = (1.f/float(num_valid_range-3))*AtA.inverse()*res.squaredNorm();
+    cov_odo = (1.f/float(num_valid_range-3))*PartialPivLU<Matrix3f>(AtA).inverse()*res.squaredNorm();
 
 
     //Update the outlier mask
@@ -800,8 +671,9 @@ void RF2O_standard::solveSystemSmoothTruncQuad()
 
 void RF2O_standard::solveSystemSmoothTruncQuadNoPreW()
 {
-    A.resize(num_valid_range,3); Aw.resize(num_valid_range,3);
-    B.resize(num_valid_range); Bw.resize(num_valid_range);
+    //The system is built in the buffers reserved by initialize() (no allocation per scan)
+    Map<MatrixXf> A(system_storage.data(), num_valid_range, 3);
+    Map<VectorXf> B(system_storage.data() + 6*cols, num_valid_range);
     unsigned int cont = 0;
     const float kdtita = float(cols_i)/fovh;
     const float inv_kdtita = 1.f/kdtita;
@@ -826,16 +698,25 @@ void RF2O_standard::solveSystemSmoothTruncQuadNoPreW()
             cont++;
         }
 
+    //Keep the most informative rows (only if a budget is set)
+    selectInformativeRows(A, B);
+    Map<MatrixXf> Aw(system_storage.data() + 3*cols, num_valid_range, 3);
+    Map<VectorXf> Bw(system_storage.data() + 7*cols, num_valid_range);
+
     //Solve the linear system of equations using a minimum least squares method
-    MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    Matrix3f AtA;
+    Vector3f AtB;
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
-    VectorXf res = A*kai_loc_level - B;
+    Map<VectorXf> res(system_storage.data() + 8*cols, num_valid_range);
+    res.noalias() = A*kai_loc_level;
+    res -= B;
 
 
     //Compute the median of res
-    vector<float> aux_vector;
+    vector<float> &aux_vector = aux_residuals;
+    aux_vector.clear();
     for (unsigned int k = 0; k<res.rows(); k++)
         aux_vector.push_back(res(k));
     std::sort(aux_vector.begin(), aux_vector.end());
@@ -849,7 +730,7 @@ void RF2O_standard::solveSystemSmoothTruncQuadNoPreW()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    const float c = 4.f*mad; //This seems to be the best (4)
+    const float c = params.smooth_trunc_mad*mad; //This seems to be the best (4)
     const float inv_c = 1.f/c;
 
     //Compute the energy
@@ -865,7 +746,7 @@ void RF2O_standard::solveSystemSmoothTruncQuadNoPreW()
 
     //Solve iteratively reweighted least squares
     //===================================================================
-    while ((new_energy < 0.995f*last_energy)&&(iter < 10))
+    while ((new_energy < 0.995f*last_energy)&&(iter < params.max_irls))
     {
         cont = 0;
         last_energy = new_energy;
@@ -886,10 +767,11 @@ void RF2O_standard::solveSystemSmoothTruncQuadNoPreW()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
-        res = A*kai_loc_level - B;
+        res.noalias() = A*kai_loc_level;
+        res -= B;
 
         //Compute the energy
         new_energy = 0.f;
@@ -900,6 +782,7 @@ void RF2O_standard::solveSystemSmoothTruncQuadNoPreW()
         }
         //printf("\nEnergy(%d) = %f", iter, new_energy);
         iter++;
+        num_irls++;
 
 //        //Recompute c
 //        //-------------------------------------------------
@@ -923,7 +806,7 @@ void RF2O_standard::solveSystemSmoothTruncQuadNoPreW()
     }
 
     //Covariance calculation
-    cov_odo = (1.f/float(num_valid_range-3))*AtA.inverse()*res.squaredNorm();
+    cov_odo = (1.f/float(num_valid_range-3))*PartialPivLU<Matrix3f>(AtA).inverse()*res.squaredNorm();
 }
 
 void RF2O_standard::solveSystemSmoothTruncQuadFromBeginning()
@@ -973,7 +856,7 @@ void RF2O_standard::solveSystemSmoothTruncQuadFromBeginning()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find the m-estimator constant
-    float c = 5.f*mad;
+    float c = params.trunc_mad*mad;
 
     ////Compute the energy
     //float energy = 0.f;
@@ -983,8 +866,9 @@ void RF2O_standard::solveSystemSmoothTruncQuadFromBeginning()
 
     //Solve iterative reweighted least squares
     //===================================================================
-    for (unsigned int i=0; i<=iter_irls; i++)
+    for (unsigned int i=0; i<=params.iter_irls; i++)
     {
+        num_irls++;
         cont = 0;
 
         for (unsigned int u = 1; u < cols_i-1; u++)
@@ -1003,8 +887,8 @@ void RF2O_standard::solveSystemSmoothTruncQuadFromBeginning()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -1098,7 +982,7 @@ void RF2O_standard::solveLiftedSmoothTruncQuad()
     float mad = aux_vector.at(res.rows()/2);
 
     //Find tau
-    float tau = 5.f*mad;
+    float tau = params.trunc_mad*mad;
 
 
     //Compute w - Do it properly with an if
@@ -1121,13 +1005,15 @@ void RF2O_standard::solveLiftedSmoothTruncQuad()
         else                     energy += 10000.f*0.25f*square(tau);
         energy_lifted += 10000.f*0.5f*(square(w(i)*res(i)) + 0.5f*square(tau*(square(w(i)) - 1.f)));
     }
-    printf("\n (initial) Energy = %f, Energy_lifted = %f", energy, energy_lifted);
+    if (verbose)
+        printf("\n (initial) Energy = %f, Energy_lifted = %f", energy, energy_lifted);
 
 
     //Solve the lifted energy
     //----------------------------------------------------------
     for (unsigned int iter=1; iter<=15; iter++)
     {
+        num_irls++;
         //Compute the Jacobian and the independent term
         cont = 0;
         const float kdtita = float(cols_i)/fovh;
@@ -1159,8 +1045,8 @@ void RF2O_standard::solveLiftedSmoothTruncQuad()
 
         //Solve the linear system of equations using a minimum least squares method
         MatrixXf JtJ, Jtb;
-        JtJ.multiply_AtA(J);
-        Jtb.multiply_AtB(J,b);
+        JtJ.noalias() = J.transpose()*J;
+        Jtb.noalias() = J.transpose()*b;
         Jtb = -Jtb;
 
         bool energy_increasing = true;
@@ -1222,10 +1108,11 @@ void RF2O_standard::solveLiftedSmoothTruncQuad()
         float mad = aux_vector.at(res.rows()/2);
 
         //Find tau
-        tau = 5.f*mad;
+        tau = params.trunc_mad*mad;
 
 
-        printf("\n (iteration = %d) Energy = %f, Energy_lifted = %f", iter, energy, energy_lifted);
+        if (verbose)
+            printf("\n (iteration = %d) Energy = %f, Energy_lifted = %f", iter, energy, energy_lifted);
 
     }
 
@@ -1244,7 +1131,8 @@ void RF2O_standard::solveLiftedSmoothTruncQuad()
                 num_outliers++;
             }
 
-    printf("\n Num_outliers = %d", num_outliers);
+    if (verbose)
+        printf("\n Num_outliers = %d", num_outliers);
 }
 
 void RF2O_standard::performWarping()
@@ -1252,7 +1140,7 @@ void RF2O_standard::performWarping()
 	Matrix3f acu_trans; 
 	acu_trans.setIdentity();
     for (unsigned int i=0; i<=level; i++)
-        acu_trans = transformations[i]*acu_trans;
+        composeTransformation(transformations[i], acu_trans);
 
     ArrayXf wacu(cols_i);
     wacu.fill(0.f);
@@ -1285,8 +1173,8 @@ void RF2O_standard::performWarping()
 				//Very close pixel
 				if (abs(round(uwarp) - uwarp) < 0.05f)
 				{
-					range_warped[image_level](round(uwarp)) += range_w;
-					wacu(round(uwarp)) += 1.f;
+					range_warped[image_level](int(round(uwarp))) += range_w;
+					wacu(int(round(uwarp))) += 1.f;
 				}
 				else
 				{
@@ -1326,125 +1214,23 @@ void RF2O_standard::performBestWarping()
     Matrix3f acu_trans;
     acu_trans.setIdentity();
     for (unsigned int i=0; i<=level; i++)
-        acu_trans = transformations[i]*acu_trans;
-
-    ArrayXf x_trans(cols_i), y_trans(cols_i), u_trans(cols_i), range_trans(cols_i);
-    x_trans.fill(0.f); y_trans.fill(0.f); range_trans.fill(0.f);
-    range_warped[image_level].fill(0.f);
-
-    const float kdtita = float(cols_i)/fovh;
-
-    //Transform points to the reference frame of the old scan
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        if (range[image_level](u) != 0.f)
-        {
-            //Transform point to the warped reference frame
-            x_trans(u) = acu_trans(0,0)*xx[image_level](u) + acu_trans(0,1)*yy[image_level](u) + acu_trans(0,2);
-            y_trans(u) = acu_trans(1,0)*xx[image_level](u) + acu_trans(1,1)*yy[image_level](u) + acu_trans(1,2);
-            range_trans(u) = sqrtf(square(x_trans(u)) + square(y_trans(u)));
-            const float tita_trans = atan2(y_trans(u), x_trans(u));
-            u_trans(u) = kdtita*(tita_trans + 0.5f*fovh) - 0.5f;
-        }
-    }
-
-    //Check projection for each segment
-    for (unsigned int u = 0; u<cols_i-1; u++)
-    {
-        if ((range_trans(u) == 0.f) || (range_trans(u+1) == 0.f))
-            continue;
-        else if (floorf(u_trans(u)) != floorf(u_trans(u+1)))
-        {
-           const float range_l = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? range_trans(u+1) : range_trans(u);
-           const float range_r = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? range_trans(u) : range_trans(u+1);
-           const float u_trans_l = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? u_trans(u+1) : u_trans(u);
-           const float u_trans_r = (floorf(u_trans(u)) > floorf(u_trans(u+1))) ? u_trans(u) : u_trans(u+1);
-           const int u_l = min(floorf(u_trans(u)), floorf(u_trans(u+1)));
-           const int u_r = max(floorf(u_trans(u)), floorf(u_trans(u+1)));
-
-           for (unsigned int u_segment=u_l+1; (u_segment<=u_r)&&(u_segment<cols_i)&&(u_segment>=0); u_segment++)
-           {
-               const float range_interp = ((u_segment - u_trans_l)*range_r + (u_trans_r - u_segment)*range_l)/(u_trans_r - u_trans_l);
-               if ((range_warped[image_level](u_segment) == 0.f)||(range_interp < range_warped[image_level](u_segment)))
-                   range_warped[image_level](u_segment) = range_interp;
-           }
-        }
-    }
+        composeTransformation(transformations[i], acu_trans);
 
-    //Compute coordinates
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        const float tita = -0.5f*fovh + (float(u) + 0.5f)/kdtita;
-        xx_warped[image_level](u) = range_warped[image_level](u)*cos(tita);
-        yy_warped[image_level](u) = range_warped[image_level](u)*sin(tita);
-    }
+    //Transform the points, project every segment onto the warped scan keeping the closest range, and compute the coordinates
+    projector.project(acu_trans, range[image_level], xx[image_level], yy[image_level],
+                      range_warped[image_level], xx_warped[image_level], yy_warped[image_level]);
 }
 
 void RF2O_standard::performFastWarping()
 {
-    //Warp the second image and count the amount of pixels projected to each of the pixels in the first image
-    //Camera parameters (which also depend on the level resolution)
-    Matrix3f acu_trans, acu_trans_inv;
+    Matrix3f acu_trans;
     acu_trans.setIdentity();
     for (unsigned int i=0; i<=level; i++)
-        acu_trans = transformations[i]*acu_trans;
-
-    acu_trans_inv = acu_trans.inverse();
-    range_warped[image_level].fill(0.f);
-
-    const float kdtita = cols_i/fovh;
-
-    for (unsigned int u = 0; u<cols_i; u++)
-    {
-        const float r = range_old[image_level](u);
-        if (r > 0.f)
-        {
-            //Transform point to the warped reference frame **********************************************
-            const float x_w = acu_trans_inv(0,0)*xx_old[image_level](u) + acu_trans_inv(0,1)*yy_old[image_level](u) + acu_trans_inv(0,2);
-            const float y_w = acu_trans_inv(1,0)*xx_old[image_level](u) + acu_trans_inv(1,1)*yy_old[image_level](u) + acu_trans_inv(1,2);
-            const float tita_w = atan2(y_w, x_w);
-
-            //Calculate warping
-            const float uwarp = kdtita*(tita_w + 0.5*fovh) - 0.5f;
+        composeTransformation(transformations[i], acu_trans);
 
-            float r_2;
-            interpolateRange(r_2, uwarp);
-
-            if (r_2 > 0.f)
-            {
-                float r_w = sqrtf(square(x_w) + square(y_w));
-                range_warped[image_level](u) = r_2 - (r_w-r);
-            }
-            else
-                range_warped[image_level](u) = 0.f;
-
-            //Transform point back to coordinates of the old scan -> xx_warped[image_level](u) and yy...
-            const float tita_original = -0.5f*fovh + (u + 0.5f)*fovh/cols_i;
-            xx_warped[image_level](u) = range_warped[image_level](u)*cos(tita_original);
-            yy_warped[image_level](u) = range_warped[image_level](u)*sin(tita_original);
-        }
-    }
-}
-
-void RF2O_standard::interpolateRange(float &range_pixel, float uwarp)
-{
-    if ((uwarp <= 0.f)||(uwarp >= cols_i-1))
-    {
-        range_pixel = 0.f;
-        return;
-    }
-    else
-    {
-        const unsigned int u_l = floorf(uwarp);
-        const unsigned int u_r = ceilf(uwarp);
-        const float range_l = range[image_level](u_l);
-        const float range_r = range[image_level](u_r);
-
-        if (range_l*range_r == 0)
-            range_pixel = 0.f;
-        else
-            range_pixel = (uwarp - u_l)*range_r + (u_r - uwarp)*range_l;
-    }
+    //Gather instead of scatter: move the old points to the new scan with the inverse transformation and sample it
+    projector.sample(acu_trans, range[image_level], range_old[image_level], xx_old[image_level], yy_old[image_level],
+                     range_warped[image_level], xx_warped[image_level], yy_warped[image_level]);
 }
 
 void RF2O_standard::odometryCalculation()
@@ -1454,8 +1240,12 @@ void RF2O_standard::odometryCalculation()
 	//==================================================================================
 
     clock.Tic();
+    num_iters = 0;
+    num_irls = 0;
     transf_acu_per_iteration.clear();
     transf_level.clear();
+    transf_level.reserve(ctf_levels*params.nonlin_iters);         //Only allocates if nonlin_iters was increased
+    transf_acu_per_iteration.reserve(ctf_levels*params.nonlin_iters);
     acu_trans_overall.setIdentity();
     createScanPyramid();
 
@@ -1470,9 +1260,11 @@ void RF2O_standard::odometryCalculation()
         cols_i = ceil(float(cols)/float(s));
         image_level = ctf_levels - i + round(log2(round(float(width)/float(cols)))) - 1;
 
-        const unsigned int nonlin_iters = 3;
+        const unsigned int nonlin_iters = params.nonlin_iters;
         for (unsigned int k = 0; k<nonlin_iters; k++)
         {
+            num_iters++;
+
             //1. Perform warping
             if ((i == 0)&&(k == 0))
             {
@@ -1480,6 +1272,8 @@ void RF2O_standard::odometryCalculation()
                 xx_warped[image_level] = xx[image_level];
                 yy_warped[image_level] = yy[image_level];
             }
+            else if (inverse_warping)
+                performFastWarping();
             else
                 performBestWarping();
 
@@ -1516,7 +1310,7 @@ void RF2O_standard::odometryCalculation()
             filterLevelSolution();
 
 
-            if (kai_loc_level.norm() < 0.05f)
+            if (kai_loc_level.norm() < params.min_update)
             {
                 //printf("\n Number of non-linear iterations: %d", k+1);
                 break;
@@ -1534,7 +1328,8 @@ void RF2O_standard::odometryCalculation()
     }
 
     runtime = 1000.f*clock.Tac();
-    cout << endl << "Time odometry (ms): " << runtime;
+    if (verbose)
+        cout << endl << "Time odometry (ms): " << runtime;
 
     //Update poses
     PoseUpdate();
@@ -1568,7 +1363,7 @@ void RF2O_standard::filterLevelSolution()
         //Important: we have to substract the solutions from previous levels
         Matrix3f acu_trans = Matrix3f::Identity();
         for (unsigned int i=0; i<=level; i++)
-            acu_trans = transformations[i]*acu_trans;
+            composeTransformation(transformations[i], acu_trans);
 
         kai_loc_sub(0) = -acu_trans(0,2);
         kai_loc_sub(1) = -acu_trans(1,2);
@@ -1582,7 +1377,7 @@ void RF2O_standard::filterLevelSolution()
 
         //Filter speed
         //const float cf = 15e3f*expf(-int(level)), df = 0.05f*expf(-int(level));
-        const float cf = 5e3f*expf(-int(level)), df = 0.02f*expf(-int(level));
+        const float cf = params.cf*expf(-int(level)), df = params.df*expf(-int(level));
 
         Vector3f kai_b_fil;
         for (unsigned int i=0; i<3; i++)
@@ -1620,7 +1415,9 @@ void RF2O_standard::filterLevelSolution()
     new_trans(1,2) = (V*incr)(1);
 
 
-    transformations[level] = new_trans*transformations[level];
+    Matrix3f level_trans;
+    level_trans.noalias() = new_trans*transformations[level];
+    transformations[level] = level_trans;
     acu_trans_overall = new_trans*acu_trans_overall;
 
     //To keep track of every single iteration
@@ -1634,7 +1431,7 @@ void RF2O_standard::PoseUpdate()
 	//---------------------------------------------------
     Matrix3f acu_trans = Matrix3f::Identity();
 	for (unsigned int i=1; i<=ctf_levels; i++)
-		acu_trans = transformations[i-1]*acu_trans;
+		composeTransformation(transformations[i-1], acu_trans);
 
 
 	//				Compute kai_loc and kai_abs
@@ -1656,7 +1453,7 @@ void RF2O_standard::PoseUpdate()
 	//						Update poses
 	//-------------------------------------------------------
 	laser_oldpose = laser_pose;
-    mrpt::poses::CPose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
+    RF2O_Pose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
 	laser_pose = laser_pose + pose_aux_2D;
 
 
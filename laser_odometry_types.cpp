@@ -0,0 +1,39 @@
+/* Project: Laser odometry
+   Wall-clock timer of the RF2O engines */
+
+#include "laser_odometry_types.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+
+//Monotonic time [s]
+static double monotonicTime()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return double(counter.QuadPart)/double(frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return double(now.tv_sec) + 1e-9*double(now.tv_nsec);
+#endif
+}
+
+void RF2O_TicTac::Tic()
+{
+    start = monotonicTime();
+}
+
+double RF2O_TicTac::Tac() const
+{
+    return monotonicTime() - start;
+}
@@ -0,0 +1,73 @@
+//====================================================
+//  Project: Laser odometry
+//  Pose, timer and math helpers of the RF2O engines,
+//  which only depend on Eigen (no MRPT)
+//====================================================
+
+#ifndef _LASER_ODOMETRY_TYPES_
+#define _LASER_ODOMETRY_TYPES_
+
+#include <cmath>
+
+
+//2D pose of the laser (x, y, phi), composed as mrpt::poses::CPose2D (phi is kept in [-pi, pi))
+class RF2O_Pose2D {
+public:
+
+    RF2O_Pose2D() : m_x(0.0), m_y(0.0), m_phi(0.0) {}
+    RF2O_Pose2D(double x, double y, double phi) : m_x(x), m_y(y), m_phi(wrapToPi(phi)) {}
+
+    double x() const { return m_x; }
+    double y() const { return m_y; }
+    double phi() const { return m_phi; }
+    double operator[](unsigned int i) const { return (i == 0) ? m_x : ((i == 1) ? m_y : m_phi); }
+
+    //Composition (this (+) b) and inverse composition (this (-) b)
+    RF2O_Pose2D operator+(const RF2O_Pose2D &b) const
+    {
+        const double c = cos(m_phi), s = sin(m_phi);
+        return RF2O_Pose2D(m_x + b.m_x*c - b.m_y*s, m_y + b.m_x*s + b.m_y*c, m_phi + b.m_phi);
+    }
+
+    RF2O_Pose2D operator-(const RF2O_Pose2D &b) const
+    {
+        const double c = cos(b.m_phi), s = sin(b.m_phi);
+        const double dx = m_x - b.m_x, dy = m_y - b.m_y;
+        return RF2O_Pose2D(dx*c + dy*s, -dx*s + dy*c, m_phi - b.m_phi);
+    }
+
+    static double wrapToPi(double a)
+    {
+        a = fmod(a + M_PI, 2.0*M_PI);
+        return (a < 0.0) ? a + M_PI : a - M_PI;
+    }
+
+private:
+
+    double m_x, m_y, m_phi;
+};
+
+
+//Wall-clock timer with the interface of mrpt::utils::CTicTac
+class RF2O_TicTac {
+public:
+
+    RF2O_TicTac() { Tic(); }
+
+    void Tic();
+    double Tac() const;     //[s] since the last Tic()
+
+private:
+
+    double start;
+};
+
+
+//Small math helpers used by the engines (as in mrpt::utils)
+namespace rf2o {
+
+    template <class T> inline T square(const T x) { return x*x; }
+    template <class T> inline int sign(const T x) { return (x < 0) ? -1 : 1; }
+}
+
+#endif
@@ -5,7 +5,7 @@
 #include "laser_odometry_v1.h"
 
 
-using namespace mrpt::utils;
+using namespace rf2o;
 using namespace Eigen;
 using namespace std;
 
@@ -26,41 +26,8 @@ void RF2O::initialize(unsigned int size, float FOV_rad, bool is_test)
     for (unsigned int i = 0; i < ctf_levels; i++)
         transformations[i].resize(3,3);
 
-	//Resize pyramid
-	unsigned int s, cols_i;
+	//Number of levels of the pyramid
     const unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-    range.resize(pyr_levels);
-    range_old.resize(pyr_levels);
-    range_inter.resize(pyr_levels);
-    xx.resize(pyr_levels);
-    xx_inter.resize(pyr_levels);
-    xx_old.resize(pyr_levels);
-    yy.resize(pyr_levels);
-    yy_inter.resize(pyr_levels);
-    yy_old.resize(pyr_levels);
-	range_warped.resize(pyr_levels);
-	xx_warped.resize(pyr_levels);
-	yy_warped.resize(pyr_levels);
-
-	for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-
-        range[i].resize(cols_i); range_inter[i].resize(cols_i); range_old[i].resize(cols_i);
-        range[i].fill(0.f); range_old[i].fill(0.f);
-        xx[i].resize(cols_i); xx_inter[i].resize(cols_i); xx_old[i].resize(cols_i);
-        xx[i].fill(0.f); xx_old[i].fill(0.f);
-        yy[i].resize(cols_i); yy_inter[i].resize(cols_i); yy_old[i].resize(cols_i);
-        yy[i].fill(0.f); yy_old[i].fill(0.f);
-
-		if (cols_i <= cols)
-		{
-            range_warped[i].resize(cols_i);
-            xx_warped[i].resize(cols_i);
-            yy_warped[i].resize(cols_i);
-		}
-    }
 
     //Resize aux variables
     dt.resize(cols);
@@ -68,184 +35,38 @@ void RF2O::initialize(unsigned int size, float FOV_rad, bool is_test)
     weights.resize(cols);
     null.resize(cols);
     null.fill(false);
-	cov_odo.assign(0.f);
+	cov_odo.fill(0.f);
     outliers.resize(cols);
     outliers.fill(false);
 
 
 	//Compute gaussian mask
 	g_mask[0] = 1.f/16.f; g_mask[1] = 0.25f; g_mask[2] = 6.f/16.f; g_mask[3] = g_mask[1]; g_mask[4] = g_mask[0];
+    pyramid.initialize(width, pyr_levels, fovh, g_mask, 0.3f, false, false);
+
+    //Lay out all the pyramid levels of every scan in a single aligned block
+    arena.initialize(pyramid.level_cols, 12);
+    arena.bind(range); arena.bind(range_old); arena.bind(range_inter);
+    arena.bind(range_warped); arena.bind(xx); arena.bind(xx_inter);
+    arena.bind(xx_old); arena.bind(xx_warped); arena.bind(yy);
+    arena.bind(yy_inter); arena.bind(yy_old); arena.bind(yy_warped);
 
     //Initialize "last velocity" as zero
-	kai_abs.assign(0.f);
-	kai_loc_old.assign(0.f);
+	kai_abs.fill(0.f);
+	kai_loc_old.fill(0.f);
 }
 
 
 void RF2O::createScanPyramid()
 {
-	const float max_range_dif = 0.3f;
-	
-	//Push the frames back
+    //Push the frames back
 	range_old.swap(range);
 	xx_old.swap(xx);
 	yy_old.swap(yy);
 
-    //The number of levels of the pyramid does not match the number of levels used
-    //in the odometry computation (because we sometimes want to finish with lower resolutions)
-
-    unsigned int pyr_levels = round(log2(round(float(width)/float(cols)))) + ctf_levels;
-
-    //Generate levels
-    for (unsigned int i = 0; i<pyr_levels; i++)
-    {
-        unsigned int s = pow(2.f,int(i));
-        cols_i = ceil(float(width)/float(s));
-		const unsigned int i_1 = i-1;
-
-        //              First level -> Filter, not downsample
-        //------------------------------------------------------------------------
-        if (i == 0)
-		{
-			for (unsigned int u = 0; u < cols_i; u++)
-            {	
-				const float dcenter = range_wf(u);
-					
-				//Inner pixels
-                if ((u>1)&&(u<cols_i-2))
-                {		
-					if (dcenter > 0.f)
-					{	
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)
-						{
-							const float abs_dif = abs(range_wf(u+l)-dcenter);
-							if (abs_dif < max_range_dif)
-							{
-								const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-								weight += aux_w;
-								sum += aux_w*range_wf(u+l);
-							}
-						}
-						range[i](u) = sum/weight;
-					}
-					else
-						range[i](u) = 0.f;
-
-                }
-
-                //Boundary
-                else
-                {
-                    if (dcenter > 0.f)
-					{						
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)	
-						{
-							const int indu = u+l;
-							if ((indu>=0)&&(indu<cols_i))
-							{
-								const float abs_dif = abs(range_wf(indu)-dcenter);										
-								if (abs_dif < max_range_dif)
-								{
-									const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-									weight += aux_w;
-									sum += aux_w*range_wf(indu);
-								}
-							}
-						}
-						range[i](u) = sum/weight;
-					}
-					else
-						range[i](u) = 0.f;
-
-                }
-            }
-		}
-
-        //                              Downsampling
-        //-----------------------------------------------------------------------------
-        else
-        {            
-			for (unsigned int u = 0; u < cols_i; u++)
-            {
-                const int u2 = 2*u;		
-				const float dcenter = range[i_1](u2);
-					
-				//Inner pixels
-                if ((u>0)&&(u<cols_i-1))
-                {		
-					if (dcenter > 0.f)
-					{	
-                        float sum = 0.f, weight = 0.f;
-
-						for (int l=-2; l<3; l++)
-						{
-							const float abs_dif = abs(range[i_1](u2+l)-dcenter);
-							if (abs_dif < max_range_dif)
-							{
-								const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-								weight += aux_w;
-								sum += aux_w*range[i_1](u2+l);
-							}
-						}
-						range[i](u) = sum/weight;
-					}
-					else
-						range[i](u) = 0.f;
-
-                }
-
-                //Boundary
-                else
-                {
-                    if (dcenter > 0.f)
-					{						
-                        float sum = 0.f, weight = 0.f;
-                        const unsigned int cols_i2 = range[i_1].rows();
-
-						for (int l=-2; l<3; l++)	
-						{
-							const int indu = u2+l;
-
-							if ((indu>=0)&&(indu<cols_i2))
-							{
-								const float abs_dif = abs(range[i_1](indu)-dcenter);										
-								if (abs_dif < max_range_dif)
-								{
-									const float aux_w = g_mask[2+l]*(max_range_dif - abs_dif);
-									weight += aux_w;
-									sum += aux_w*range[i_1](indu);
-								}
-							}
-						}
-						range[i](u) = sum/weight;
-
-					}
-					else
-						range[i](u) = 0.f;
-                }
-            }
-        }
-
-        //Calculate coordinates "xy" of the points
-        for (unsigned int u = 0; u < cols_i; u++) 
-		{
-            if (range[i](u) > 0.f)
-			{
-                const float tita = -0.5f*fovh + float(u)*fovh/float(cols_i-1);
-				xx[i](u) = range[i](u)*cos(tita);
-				yy[i](u) = range[i](u)*sin(tita);
-			}
-			else
-			{
-				xx[i](u) = 0.f;
-				yy[i](u) = 0.f;
-			}
-		}
-    }
+    //Filter, downsample and compute the coordinates of every level
+    pyramid.build(range_wf, range, xx, yy);
+    cols_i = pyramid.level_cols.back();
 }
 
 void RF2O::calculateCoord()
@@ -366,8 +187,8 @@ void RF2O::solveSystemQuadResiduals()
 	
 	//Solve the linear system of equations using a minimum least squares method
 	MatrixXf AtA, AtB;
-	AtA.multiply_AtA(A);
-	AtB.multiply_AtB(A,B);
+	AtA.noalias() = A.transpose()*A;
+	AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
@@ -403,8 +224,8 @@ void RF2O::solveSystemQuadResidualsNoPreW()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
 
     //Covariance matrix calculation
@@ -441,8 +262,8 @@ void RF2O::solveSystemMCauchy()
 	
 	//Solve the linear system of equations using a minimum least squares method
 	MatrixXf AtA, AtB;
-	AtA.multiply_AtA(A);
-	AtB.multiply_AtB(A,B);
+	AtA.noalias() = A.transpose()*A;
+	AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
 	//cout << endl << "max res: " << res.maxCoeff();
@@ -485,8 +306,8 @@ void RF2O::solveSystemMCauchy()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -529,8 +350,8 @@ void RF2O::solveSystemMTukey()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -581,8 +402,8 @@ void RF2O::solveSystemMTukey()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -657,8 +478,8 @@ void RF2O::solveSystemTruncatedQuad()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -709,8 +530,8 @@ void RF2O::solveSystemTruncatedQuad()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -785,8 +606,8 @@ void RF2O::solveSystemSmoothTruncQuad()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -843,8 +664,8 @@ void RF2O::solveSystemSmoothTruncQuad()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -923,8 +744,8 @@ void RF2O::solveSystemSmoothTruncQuadNoPreW()
 
     //Solve the linear system of equations using a minimum least squares method
     MatrixXf AtA, AtB;
-    AtA.multiply_AtA(A);
-    AtB.multiply_AtB(A,B);
+    AtA.noalias() = A.transpose()*A;
+    AtB.noalias() = A.transpose()*B;
     kai_loc_level = AtA.ldlt().solve(AtB);
     VectorXf res = A*kai_loc_level - B;
     //cout << endl << "max res: " << res.maxCoeff();
@@ -981,8 +802,8 @@ void RF2O::solveSystemSmoothTruncQuadNoPreW()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -1116,8 +937,8 @@ void RF2O::solveSystemSmoothTruncQuadNoPreW2()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -1233,8 +1054,8 @@ void RF2O::solveSystemSmoothTruncQuadFromBeginning()
             }
 
         //Solve the linear system of equations using a minimum least squares method
-        AtA.multiply_AtA(Aw);
-        AtB.multiply_AtB(Aw,Bw);
+        AtA.noalias() = Aw.transpose()*Aw;
+        AtB.noalias() = Aw.transpose()*Bw;
         kai_loc_level = AtA.ldlt().solve(AtB);
         res = A*kai_loc_level - B;
 
@@ -1389,8 +1210,8 @@ void RF2O::solveLiftedSmoothTruncQuad()
 
         //Solve the linear system of equations using a minimum least squares method
         MatrixXf JtJ, Jtb;
-        JtJ.multiply_AtA(J);
-        Jtb.multiply_AtB(J,b);
+        JtJ.noalias() = J.transpose()*J;
+        Jtb.noalias() = J.transpose()*b;
         Jtb = -Jtb;
 
         bool energy_increasing = true;
@@ -1515,8 +1336,8 @@ void RF2O::performWarping()
 				//Very close pixel
 				if (abs(round(uwarp) - uwarp) < 0.05f)
 				{
-					range_warped[image_level](round(uwarp)) += range_w;
-					wacu(round(uwarp)) += 1.f;
+					range_warped[image_level](int(round(uwarp))) += range_w;
+					wacu(int(round(uwarp))) += 1.f;
 				}
 				else
 				{
@@ -1722,7 +1543,7 @@ void RF2O::PoseUpdate()
 	//						Update poses
 	//-------------------------------------------------------
 	laser_oldpose = laser_pose;
-    mrpt::poses::CPose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
+    RF2O_Pose2D pose_aux_2D(acu_trans(0,2), acu_trans(1,2), kai_loc(2));
 	laser_pose = laser_pose + pose_aux_2D;
 
 
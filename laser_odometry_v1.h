@@ -6,10 +6,10 @@
 //====================================================
 
 
-#include <mrpt/poses/CPose2D.h>
-#include <mrpt/utils/CTicTac.h>
 #include <Eigen/Dense>
 #include <iostream>
+#include "laser_odometry_types.h"
+#include "laser_odometry_pyramid.h"
 //#include <fstream>
 
 
@@ -24,9 +24,9 @@ public:
 
     //Scans and cartesian coordinates
     Eigen::ArrayXf range_wf;
-    std::vector<Eigen::ArrayXf> range, range_old, range_inter, range_warped;
-    std::vector<Eigen::ArrayXf> xx, xx_inter, xx_old, xx_warped;
-    std::vector<Eigen::ArrayXf> yy, yy_inter, yy_old, yy_warped;
+    PyramidViews range, range_old, range_inter, range_warped;
+    PyramidViews xx, xx_inter, xx_old, xx_warped;
+    PyramidViews yy, yy_inter, yy_old, yy_warped;
 
     //Rigid transformations and velocities (twists: vx, vy, w)
     std::vector<Eigen::MatrixXf> transformations;
@@ -53,15 +53,17 @@ public:
 	unsigned int num_valid_range;
 	unsigned int iter_irls;
 	float g_mask[5];
+    RF2O_Pyramid pyramid;         //Shared gaussian pyramid builder
+    RF2O_ScanArena arena;         //Storage of all the pyramid levels
 
 
     //Laser poses (most recent and previous)
-    mrpt::poses::CPose2D laser_pose;
-    mrpt::poses::CPose2D laser_oldpose;
+    RF2O_Pose2D laser_pose;
+    RF2O_Pose2D laser_oldpose;
 	bool test;
 
     //To measure runtimes
-    mrpt::utils::CTicTac	clock;
+    RF2O_TicTac             clock;
     float                   runtime;
 
 
@@ -0,0 +1,246 @@
+/* Project: Laser odometry
+   Scan warping: z-buffered projection and inverse sampling */
+
+#include "laser_odometry_warping.h"
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+using namespace Eigen;
+using namespace std;
+
+
+void RF2O_ScanProjector::initialize(const vector<unsigned int> &cols_per_level, float fov)
+{
+    fovh = fov;
+    level_cols = cols_per_level;
+
+    //Bearings of the warped pixels (same expression as the original coordinate loop)
+    cos_tita.resize(level_cols.size());
+    sin_tita.resize(level_cols.size());
+    for (unsigned int i = 0; i<level_cols.size(); i++)
+    {
+        const unsigned int cols_i = level_cols[i];
+        const float kdtita = float(cols_i)/fovh;
+        cos_tita[i].resize(cols_i);
+        sin_tita[i].resize(cols_i);
+        for (unsigned int u = 0; u<cols_i; u++)
+        {
+            const float tita = -0.5f*fovh + (float(u) + 0.5f)/kdtita;
+            cos_tita[i](u) = cos(tita);
+            sin_tita[i](u) = sin(tita);
+        }
+    }
+
+    //Scratch, sized for the finest level
+    const unsigned int width = level_cols.empty() ? 0 : level_cols[0];
+    range_trans.resize(width);
+    u_trans.resize(width);
+    zbuffers.resize(width*(max_chunks - 1));
+}
+
+void RF2O_ScanProjector::project(const Matrix3f &acu_trans, const LevelView &range, const LevelView &xx, const LevelView &yy,
+                                 LevelView &range_warped, LevelView &xx_warped, LevelView &yy_warped)
+{
+    const unsigned int cols_i = range.size();
+    const unsigned int level = find(level_cols.begin(), level_cols.end(), cols_i) - level_cols.begin();
+
+    //Transform points to the reference frame of the old scan
+    transformPoints(acu_trans, range.data(), xx.data(), yy.data(), cols_i);
+
+    //Rasterize the segments: chunk 0 writes directly in range_warped, the others in their own z-buffer
+    unsigned int num_chunks = 1;
+#ifdef _OPENMP
+    if (cols_i >= parallel_min_cols)
+        num_chunks = min(max_chunks, (unsigned int)(omp_get_max_threads()));
+#endif
+
+    const unsigned int num_segments = cols_i - 1;
+    range_warped.fill(0.f);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) num_threads(num_chunks) if(num_chunks > 1)
+#endif
+    for (int c = 0; c < int(num_chunks); c++)
+    {
+        float *zbuffer = (c == 0) ? range_warped.data() : zbuffers.data() + (c-1)*cols_i;
+        if (c > 0)
+            fill(zbuffer, zbuffer + cols_i, 0.f);
+
+        const unsigned int first = c*num_segments/num_chunks;
+        const unsigned int last = (c+1)*num_segments/num_chunks;
+        rasterizeSegments(first, last, cols_i, zbuffer);
+    }
+
+    for (unsigned int c = 1; c < num_chunks; c++)
+        mergeZBuffer(zbuffers.data() + (c-1)*cols_i, range_warped.data(), cols_i);
+
+    //Compute coordinates
+    xx_warped = range_warped*cos_tita[level];
+    yy_warped = range_warped*sin_tita[level];
+}
+
+void RF2O_ScanProjector::sample(const Matrix3f &acu_trans, const LevelView &range, const LevelView &range_old,
+                                const LevelView &xx_old, const LevelView &yy_old,
+                                LevelView &range_warped, LevelView &xx_warped, LevelView &yy_warped)
+{
+    const unsigned int cols_i = range.size();
+    const unsigned int level = find(level_cols.begin(), level_cols.end(), cols_i) - level_cols.begin();
+    const float kdtita = float(cols_i)/fovh;
+
+    const Matrix3f acu_trans_inv = acu_trans.inverse();
+    const float t00 = acu_trans_inv(0,0), t01 = acu_trans_inv(0,1), t02 = acu_trans_inv(0,2);
+    const float t10 = acu_trans_inv(1,0), t11 = acu_trans_inv(1,1), t12 = acu_trans_inv(1,2);
+
+    for (unsigned int u = 0; u<cols_i; u++)
+    {
+        const float r = range_old(u);
+        float r_warped = 0.f;
+
+        if (r > 0.f)
+        {
+            //Old point seen from the new scan
+            const float x_w = t00*xx_old(u) + t01*yy_old(u) + t02;
+            const float y_w = t10*xx_old(u) + t11*yy_old(u) + t12;
+            const float r_w = sqrtf(x_w*x_w + y_w*y_w);
+            const float uwarp = kdtita*(atan2(y_w, x_w) + 0.5f*fovh) - 0.5f;
+
+            if ((uwarp >= 0.f)&&(uwarp < float(cols_i - 1)))
+            {
+                const unsigned int u_l = uwarp;
+                const float range_l = range(u_l), range_r = range(u_l+1);
+
+                if ((range_l > 0.f)&&(range_r > 0.f))
+                {
+                    //Do not interpolate across a depth discontinuity: the closest surface hides the other one
+                    const float r_new = (abs(range_l - range_r) < max_range_dif) ? (uwarp - float(u_l))*range_r + (float(u_l+1) - uwarp)*range_l
+                                                                                : min(range_l, range_r);
+
+                    //The old point is occluded in the new scan if a much closer surface is seen along its bearing
+                    if (r_new > r_w - max_range_dif)
+                        r_warped = max(r_new - (r_w - r), 0.f);
+                }
+            }
+        }
+
+        range_warped(u) = r_warped;
+    }
+
+    //Coordinates along the bearings of the old scan
+    xx_warped = range_warped*cos_tita[level];
+    yy_warped = range_warped*sin_tita[level];
+}
+
+void RF2O_ScanProjector::transformPoints(const Matrix3f &acu_trans, const float *range, const float *xx, const float *yy, unsigned int cols_i)
+{
+    const float t00 = acu_trans(0,0), t01 = acu_trans(0,1), t02 = acu_trans(0,2);
+    const float t10 = acu_trans(1,0), t11 = acu_trans(1,1), t12 = acu_trans(1,2);
+    const float kdtita = float(cols_i)/fovh;
+    float *r_trans = range_trans.data();
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_zero = _mm_setzero_ps();
+    const __m128 v00 = _mm_set1_ps(t00), v01 = _mm_set1_ps(t01), v02 = _mm_set1_ps(t02);
+    const __m128 v10 = _mm_set1_ps(t10), v11 = _mm_set1_ps(t11), v12 = _mm_set1_ps(t12);
+
+    for (; u + 4 <= cols_i; u += 4)
+    {
+        const __m128 x = _mm_loadu_ps(xx + u), y = _mm_loadu_ps(yy + u);
+        const __m128 x_trans = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v00, x), _mm_mul_ps(v01, y)), v02);
+        const __m128 y_trans = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v10, x), _mm_mul_ps(v11, y)), v12);
+        const __m128 r = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x_trans, x_trans), _mm_mul_ps(y_trans, y_trans)));
+        const __m128 valid = _mm_cmpneq_ps(_mm_loadu_ps(range + u), v_zero);
+        _mm_storeu_ps(r_trans + u, _mm_and_ps(valid, r));
+
+        //There is no vector atan2 giving the same result as the scalar one
+        float xt[4], yt[4];
+        _mm_storeu_ps(xt, x_trans);
+        _mm_storeu_ps(yt, y_trans);
+        const int valid_bits = _mm_movemask_ps(valid);
+        for (unsigned int k = 0; k < 4; k++)
+            if (valid_bits & (1 << k))
+                u_trans(u+k) = kdtita*(atan2(yt[k], xt[k]) + 0.5f*fovh) - 0.5f;
+    }
+#endif
+
+    for (; u < cols_i; u++)
+    {
+        if (range[u] != 0.f)
+        {
+            const float x_trans = t00*xx[u] + t01*yy[u] + t02;
+            const float y_trans = t10*xx[u] + t11*yy[u] + t12;
+            r_trans[u] = sqrtf(x_trans*x_trans + y_trans*y_trans);
+            u_trans(u) = kdtita*(atan2(y_trans, x_trans) + 0.5f*fovh) - 0.5f;
+        }
+        else
+            r_trans[u] = 0.f;
+    }
+}
+
+void RF2O_ScanProjector::rasterizeSegments(unsigned int first, unsigned int last, unsigned int cols_i, float *zbuffer)
+{
+    const float *r_trans = range_trans.data();
+    const float *u_tr = u_trans.data();
+
+    for (unsigned int u = first; u<last; u++)
+    {
+        if ((r_trans[u] == 0.f) || (r_trans[u+1] == 0.f))
+            continue;
+
+        const float floor_a = floorf(u_tr[u]), floor_b = floorf(u_tr[u+1]);
+        if (floor_a == floor_b)
+            continue;
+
+        const bool reversed = (floor_a > floor_b);
+        const float range_l = reversed ? r_trans[u+1] : r_trans[u];
+        const float range_r = reversed ? r_trans[u] : r_trans[u+1];
+        const float u_trans_l = reversed ? u_tr[u+1] : u_tr[u];
+        const float u_trans_r = reversed ? u_tr[u] : u_tr[u+1];
+        const int u_l = min(floor_a, floor_b);
+        const int u_r = max(floor_a, floor_b);
+
+        //The original loop ran over an unsigned index: segments starting left of pixel -1 were not drawn at all
+        if (u_l < -1)
+            continue;
+
+        const int u_end = min(u_r, int(cols_i) - 1);
+        const float den = u_trans_r - u_trans_l;
+        for (int u_segment = u_l+1; u_segment<=u_end; u_segment++)
+        {
+            const float range_interp = ((float(u_segment) - u_trans_l)*range_r + (u_trans_r - float(u_segment))*range_l)/den;
+            const float z = zbuffer[u_segment];
+            zbuffer[u_segment] = ((z == 0.f)||(range_interp < z)) ? range_interp : z;
+        }
+    }
+}
+
+void RF2O_ScanProjector::mergeZBuffer(const float *src, float *dst, unsigned int cols_i)
+{
+    //Keep the closest non-empty range (0 = empty pixel)
+    unsigned int u = 0;
+
+#ifdef __SSE2__
+    const __m128 v_zero = _mm_setzero_ps();
+    for (; u + 4 <= cols_i; u += 4)
+    {
+        const __m128 a = _mm_loadu_ps(dst + u), b = _mm_loadu_ps(src + u);
+        const __m128 take_b = _mm_or_ps(_mm_cmpeq_ps(a, v_zero), _mm_and_ps(_mm_cmplt_ps(b, a), _mm_cmpneq_ps(b, v_zero)));
+        _mm_storeu_ps(dst + u, _mm_or_ps(_mm_and_ps(take_b, b), _mm_andnot_ps(take_b, a)));
+    }
+#endif
+
+    for (; u < cols_i; u++)
+    {
+        const float a = dst[u], b = src[u];
+        dst[u] = ((a == 0.f)||((b < a)&&(b != 0.f))) ? b : a;
+    }
+}
@@ -0,0 +1,59 @@
+//====================================================
+//  Project: Laser odometry
+//  Warping of a scan onto the pixels of another one:
+//  z-buffered projection (performBestWarping) and
+//  inverse warping + sampling (performFastWarping)
+//====================================================
+
+#ifndef _LASER_ODOMETRY_WARPING_
+#define _LASER_ODOMETRY_WARPING_
+
+#include "laser_odometry_pyramid.h"
+
+
+//Transforms the points of a scan with a rigid transformation and rasterizes every segment between consecutive
+//points onto the pixels of the reference scan, keeping the closest range per pixel. The transformation stage is
+//vectorized, and the rasterization is split in chunks of segments with their own z-buffers that are merged with
+//a min-reduction (spread across threads with OpenMP for very large scans). Since the depth test keeps the minimum
+//range, the order in which segments are processed does not change the result: it is identical to the former loop.
+//
+//The inverse mode (sample) avoids the scatter altogether: every point of the old scan is moved to the frame of the
+//new one with the inverse transformation and the new scan is interpolated at its bearing. Samples are not blended
+//across depth discontinuities (the closest surface is taken), and old points hidden behind a closer surface of the
+//new scan are discarded.
+
+class RF2O_ScanProjector {
+public:
+
+    //Configuration
+    float fovh;
+    float max_range_dif;                //Depth jump regarded as an occlusion boundary (inverse mode)
+    unsigned int max_chunks;            //Maximum number of z-buffers (and threads) used to rasterize a scan
+    unsigned int parallel_min_cols;     //Scans with fewer points are rasterized by a single chunk
+
+    //Bearings of the warped pixels of every level, indexed by the number of points of the level
+    std::vector<unsigned int> level_cols;
+    std::vector<Eigen::ArrayXf> cos_tita, sin_tita;
+
+    //Transformed points and z-buffers of the additional chunks (reserved at initialize)
+    Eigen::ArrayXf range_trans, u_trans;
+    Eigen::ArrayXf zbuffers;
+
+
+    RF2O_ScanProjector() : fovh(0.f), max_range_dif(0.3f), max_chunks(8), parallel_min_cols(2048) {}
+
+    //Methods
+    void initialize(const std::vector<unsigned int> &cols_per_level, float fov);
+    void project(const Eigen::Matrix3f &acu_trans, const LevelView &range, const LevelView &xx, const LevelView &yy,
+                 LevelView &range_warped, LevelView &xx_warped, LevelView &yy_warped);
+    void sample(const Eigen::Matrix3f &acu_trans, const LevelView &range, const LevelView &range_old,
+                const LevelView &xx_old, const LevelView &yy_old,
+                LevelView &range_warped, LevelView &xx_warped, LevelView &yy_warped);
+
+private:
+    void transformPoints(const Eigen::Matrix3f &acu_trans, const float *range, const float *xx, const float *yy, unsigned int cols_i);
+    void rasterizeSegments(unsigned int first, unsigned int last, unsigned int cols_i, float *zbuffer);
+    static void mergeZBuffer(const float *src, float *dst, unsigned int cols_i);
+};
+
+#endif
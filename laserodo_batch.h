@@ -0,0 +1,747 @@
+/* Project: Laser odometry
+   Headless batch evaluation: runs the selected methods on a rawlog or on a simulated scenario
+   to completion, without any rendering, and saves the trajectories (as they are estimated) and the statistics */
+
+
+#include <mrpt/nav/reactive/CReactiveNavigationSystem3D.h>
+#include <mrpt/obs/CObservation2DRangeScan.h>
+#include <mrpt/obs/CObservationOdometry.h>
+#include <mrpt/maps/COccupancyGridMap2D.h>
+#include <mrpt/maps/CSimplePointsMap.h>
+#include <mrpt/utils/CRobotSimulator.h>
+#include <mrpt/utils/CConfigFileBase.h>
+#include <mrpt/utils/CImage.h>
+#include <mrpt/math/lightweight_geom_data.h>
+#include <mrpt/system/string_utils.h>
+#include <mrpt/system/datetime.h>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+
+#include "map_lab_rf2o.xpm"
+#include "laser_odometry_standard.h"
+#include "laser_odometry_refscans.h"
+#include "laser_odometry_nosym.h"
+#include "scan_matcher.h"
+#include "rawlog_stream.h"
+#include "scan_log.h"
+#include "results_writer.h"
+#include "trajectory_eval.h"
+
+
+using namespace mrpt;
+using namespace mrpt::utils;
+using namespace mrpt::nav;
+using namespace mrpt::maps;
+using namespace mrpt::obs;
+using namespace mrpt::poses;
+using namespace mrpt::math;
+using namespace std;
+
+
+
+//Parameters of a batch run (section [BATCH] of the configuration file)
+
+struct TBatchConfig {
+
+    string          source;                 //"rawlog", "scanlog" or "simulation"
+    string          rawlog_file;
+    string          scanlog_file;           //Binary scan log (see scan_log.h), its odometry is the ground truth
+    string          groundtruth_label;      //Sensor label of the odometry observations with the ground truth (rawlog)
+    string          map_file;               //Bitmap of the simulated environment (empty -> lab map)
+    float           map_resolution;         //[m/pixel]
+    unsigned int    num_scans;              //Scans processed in the simulation
+    unsigned int    sim_steps_per_scan;     //Navigation steps between two scans (simulation)
+    unsigned int    seed;                   //Seed of the initial pose and the targets (simulation)
+    float           laser_min_range;        //[m] Shorter ranges are discarded (scan logs are filtered when converted)
+    unsigned int    odo_freq;               //[Hz] Scans per second: the errors are measured over 1 second
+    string          eval_horizons;          //Other horizons of the relative errors (see parseHorizons())
+    unsigned int    decimation;             //One of every "decimation" scans is processed (rawlog, scanlog)
+    vector<string>  methods;                //rf2o, rf2o_refs, rf2o_nosym and/or psm
+    unsigned int    rf2o_id;                //Version of the RF2O engines (see their initialize())
+    RF2O_Params     rf2o_params;            //Tuning parameters of the RF2O engines (section [RF2O_PARAMS])
+    float           rf2o_range_step;        //[m] > 0 -> the RF2O engines take their input quantized to 16 bits
+    float           rf2o_level_step;        //[m] > 0 -> their pyramids store the downsampled levels quantized to 16 bits
+    bool            concurrent;             //One thread per method
+    string          output_prefix;          //Of the files with the trajectories and the statistics
+    unsigned int    results_formats;        //Of the trajectories (combination of TResultsFormat)
+
+    void loadFromConfigFile(const CConfigFileBase &ini)
+    {
+        const string section = "BATCH";
+        source = ini.read_string(section, "SOURCE", "simulation");
+        rawlog_file = ini.read_string(section, "RAWLOG_FILE", "");
+        scanlog_file = ini.read_string(section, "SCANLOG_FILE", "");
+        groundtruth_label = ini.read_string(section, "GROUNDTRUTH_LABEL", "LOCALIZATION");
+        map_file = ini.read_string(section, "MAP_FILE", "");
+        map_resolution = ini.read_float(section, "MAP_RESOLUTION", 0.04f);
+        num_scans = ini.read_int(section, "NUM_SCANS", 3000);
+        sim_steps_per_scan = ini.read_int(section, "SIM_STEPS_PER_SCAN", 2);
+        seed = ini.read_int(section, "SEED", 1);
+        laser_min_range = ini.read_float(section, "LASER_MIN_RANGE", 0.05f);
+        odo_freq = ini.read_int(section, "ODO_FREQ", 10);
+        eval_horizons = ini.read_string(section, "EVAL_HORIZONS", "1 5 10 50 1m 5m 10m");
+        decimation = max(ini.read_int(section, "DECIMATION", 1), 1);
+        rf2o_id = ini.read_int(section, "RF2O_ID", 3);
+        rf2o_range_step = ini.read_float(section, "RF2O_RANGE_STEP", 0.f);
+        rf2o_level_step = ini.read_float(section, "RF2O_LEVEL_STEP", 0.f);
+        concurrent = ini.read_bool(section, "CONCURRENT", true);
+        output_prefix = ini.read_string(section, "OUTPUT_PREFIX", "batch");
+
+        methods.clear();
+        mrpt::system::tokenize(ini.read_string(section, "METHODS", "rf2o psm"), " ,", methods);
+
+        vector<string> formats;
+        mrpt::system::tokenize(ini.read_string(section, "RESULTS_FORMATS", "text tum"), " ,", formats);
+        results_formats = 0;
+        for (unsigned int f=0; f<formats.size(); f++)
+            if (formats[f] == "binary")     results_formats |= RESULTS_BINARY;
+            else if (formats[f] == "text")  results_formats |= RESULTS_TEXT;
+            else if (formats[f] == "tum")   results_formats |= RESULTS_TUM;
+            else if (formats[f] == "kitti") results_formats |= RESULTS_KITTI;
+            else printf("\n Unknown results format: %s (binary, text, tum or kitti) \n", formats[f].c_str());
+
+        //The parameters that are not given keep their default values
+        rf2o_params = RF2O_Params();
+        for (unsigned int p=0; p<RF2O_Params::size(); p++)
+        {
+            const string name = RF2O_Params::name(p);
+            const float value = ini.read_float("RF2O_PARAMS", mrpt::system::upperCase(name), rf2o_params.get(name));
+            if (!rf2o_params.set(name, value))
+                printf("\n Invalid value of %s: %f (the default is kept) \n", name.c_str(), value);
+        }
+    }
+};
+
+
+class CLaserodoBatch;
+
+//Optional observer of a batch run (a GUI, a progress bar...). It is only notified, it does not drive the run.
+
+class CBatchObserver {
+public:
+
+    virtual ~CBatchObserver() {}
+    virtual void onScan(const CLaserodoBatch &batch) {}        //After every processed scan
+    virtual void onFinished(const CLaserodoBatch &batch) {}
+};
+
+
+
+class CLaserodoBatch : public CReactiveInterfaceImplementation
+{
+public:
+
+    TBatchConfig            config;
+    CBatchObserver          *observer;
+
+    //Last scan and its ground truth
+    CObservation2DRangeScan scan;
+    CPose2D                 gt_pose;
+    bool                    has_groundtruth;
+
+    //Methods
+    ScanBearings            bearings;
+    MatcherRunner           runner;
+
+    //Results: one entry per processed scan (the first one is the initial pose), runtimes of every match
+    vector<double>          timestamps;
+    vector<CPose2D>         gt_poses;
+    vector<vector<CPose2D> > est_poses;     //[method][scan]
+    vector<vector<float> >  runtimes;       //[method][match] (ms)
+    vector<unsigned int>    failures;       //[method]
+
+
+    CLaserodoBatch() : observer(NULL), has_groundtruth(false), laser_segments(0), nav(NULL), scanlog_index(0) {}
+    ~CLaserodoBatch()
+    {
+        delete nav;
+        clearMatchers();
+        closeWriters();
+    }
+
+    //Runs the whole experiment described in the configuration file
+    bool run(const CConfigFileBase &ini)
+    {
+        config.loadFromConfigFile(ini);
+        srand(config.seed);
+
+        bool success;
+        if (config.source == "rawlog")
+            success = runRawlog();
+        else if (config.source == "scanlog")
+            success = runScanlog();
+        else if (config.source == "simulation")
+            success = runSimulation(ini);
+        else
+        {
+            printf("\n Unknown source of scans: %s (it must be rawlog, scanlog or simulation) \n", config.source.c_str());
+            return false;
+        }
+
+        if (success && observer)
+            observer->onFinished(*this);
+        return success;
+    }
+
+    unsigned int numScans() const { return gt_poses.size(); }
+
+
+    //Simulation (reactive navigation towards random targets)
+    //--------------------------------------------------------------------------------------
+	bool getCurrentPoseAndSpeeds( poses::CPose2D &curPose, float &curV, float &curW)
+	{
+		robotSim.getRealPose( curPose );
+		curV = robotSim.getV();
+		curW = robotSim.getW();
+		return true;
+	}
+
+	bool changeSpeeds( float v, float w )
+	{
+		robotSim.movementCommand(v,w);
+		return true;
+	}
+
+	bool senseObstacles( CSimplePointsMap 	&obstacles )
+	{
+		robotSim.getRealPose(gt_pose);
+		obstacles.clear();
+
+		//Laser scans
+		map.laserScanSimulator(scan, gt_pose, 0.5f, laser_segments, scan.stdError, 1, 0);
+        filterRanges();
+		obstacles.insertObservation(&scan);
+		return true;
+	}
+
+
+    //Statistics and results
+    //--------------------------------------------------------------------------------------
+    void printStatistics() const
+    {
+        string stats;
+        writeStatistics(stats);
+        printf("\n%s", stats.c_str());
+        fflush(stdout);
+    }
+
+    //The trajectories are written while the methods run: this finishes them and saves the statistics
+    void saveResults()
+    {
+        closeWriters();
+
+        //Statistics
+        const string stats_name = config.output_prefix + "_stats.txt";
+        string stats;
+        writeStatistics(stats);
+        ofstream f_stats(stats_name.c_str());
+        f_stats << stats;
+        f_stats.close();
+
+        printf("\n Results saved in %s_*.txt/bin and %s \n", config.output_prefix.c_str(), stats_name.c_str());
+    }
+
+private:
+
+    vector<ScanMatcher*>    matchers;       //Owned (in the order of the runner)
+    vector<PSM_Matcher*>    psm_matchers;   //The PSM ones among them
+    unsigned int            laser_segments;
+
+    //Trajectories of the methods (with their runtimes) and the ground truth, written in the background
+    vector<CResultsWriter*> writers;        //[method], the ground truth is the last one
+
+    //Simulation
+    COccupancyGridMap2D     map;
+    CRobotSimulator         robotSim;
+    CReactiveNavigationSystem3D *nav;
+
+    //Rawlog
+    CRawlogStream           dataset;
+
+    //Scan log (its scans are not copied into "scan")
+    CScanLogReader          scanlog;
+    size_t                  scanlog_index;
+    vector<float>           widened;        //Float ranges of the current scan of a quantized log
+    static const unsigned int psm_block = 128;  //Scans of the log preprocessed at once for PSM (a PMScan takes 80 KB)
+
+
+    bool runRawlog()
+    {
+        dataset.odometry_label = config.groundtruth_label;
+        if (!dataset.open(config.rawlog_file))
+        {
+            printf("\n Couldn't open the rawlog %s \n", config.rawlog_file.c_str());
+            return false;
+        }
+
+        //The laser is described by its first scan
+        if (!readScanRawlog())
+        {
+            printf("\n The rawlog has no 2D scans \n");
+            return false;
+        }
+
+        laser_segments = scan.scan.size();
+        if (!initializeMethods())
+            return false;
+
+        unsigned int scan_count = 0;
+        while (readScanRawlog())
+            if (++scan_count % config.decimation == 0)
+                processScan();
+
+        return true;
+    }
+
+    //Reads the next scan (and the last ground truth before it). False when the rawlog is finished.
+    bool readScanRawlog()
+    {
+        TRawlogEvent event;
+        while (dataset.next(event))
+        {
+            if (event.type == TRawlogEvent::ODOMETRY)
+            {
+                gt_pose = CObservationOdometryPtr(event.obs)->odometry;
+                has_groundtruth = true;
+            }
+            else
+            {
+                scan = *CObservation2DRangeScanPtr(event.obs);
+                if (!gt_poses.empty() && (scan.scan.size() != laser_segments))
+                    continue;       //From another laser
+
+                filterRanges();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool runScanlog()
+    {
+        if (!scanlog.open(config.scanlog_file) || (scanlog.size() == 0))
+        {
+            printf("\n Couldn't read any scan from the scan log %s \n", config.scanlog_file.c_str());
+            return false;
+        }
+
+        //The laser is described by the header
+        laser_segments = scanlog.info().beams;
+        scan.aperture = scanlog.info().aperture;
+        scan.maxRange = scanlog.info().max_range;
+        widened.resize(laser_segments);
+
+        //The scans are accessed by index, so the decimated ones are not even read
+        for (scanlog_index = 0; scanlog_index < scanlog.size(); scanlog_index += config.decimation)
+        {
+            if (scanlog.hasOdometry(scanlog_index))
+            {
+                gt_pose = scanlog.odometry(scanlog_index);
+                has_groundtruth = true;
+            }
+
+            if (scanlog_index == 0)
+            {
+                if (!initializeMethods())
+                    return false;
+            }
+            else
+            {
+                if (scanlog_index % (psm_block*config.decimation) == config.decimation)
+                    preloadPSM();
+                processScan();
+            }
+        }
+
+        return true;
+    }
+
+    //The PSM matchers take the next block of scans of the log already preprocessed (over all the threads, and
+    //out of their timed matches). The views point to the mapped records, so they stay valid for the whole block.
+    void preloadPSM()
+    {
+        if (psm_matchers.empty())
+            return;
+
+        vector<ScanView> views;
+        for (size_t i = scanlog_index; (i < scanlog.size()) && (views.size() < psm_block); i += config.decimation)
+            views.push_back(scanlog.scan(i, bearings));
+        for (unsigned int k=0; k<psm_matchers.size(); k++)
+            psm_matchers[k]->preloadScans(views);
+    }
+
+    bool runSimulation(const CConfigFileBase &ini)
+    {
+        if (!loadSimulation(ini))
+            return false;
+
+        nav = new CReactiveNavigationSystem3D(*this, false, false);
+        nav->loadConfigFile(ini);
+        nav->initialize();
+
+        //First scan
+        CSimplePointsMap obstacles;
+        senseObstacles(obstacles);
+        has_groundtruth = true;
+        if (!initializeMethods())
+            return false;
+
+        //Simulated time, so that the targets do not depend on the speed of the methods
+        const float sim_period = 1.f/float(config.odo_freq*config.sim_steps_per_scan);
+        float time_to_new_target = 0.f;
+        unsigned int step_count = 0;
+
+        while (numScans() < config.num_scans)
+        {
+            //Create a new target if we have reached the previous one or we cannot reach it
+            if ((nav->IDLE == nav->getCurrentState())||(nav->SUSPENDED == nav->getCurrentState())||(time_to_new_target <= 0.f))
+            {
+                createNewTarget();
+                time_to_new_target = 4.f;
+            }
+
+            robotSim.simulateInterval(sim_period);
+            nav->navigationStep();
+            time_to_new_target -= sim_period;
+
+            if (++step_count % config.sim_steps_per_scan == 0)
+                processScan();
+        }
+
+        return true;
+    }
+
+    bool loadSimulation(const CConfigFileBase &ini)
+    {
+        //Map
+        CImage map_img;
+        if (config.map_file.empty())
+            map_img.loadFromXPM(map_lab_rf2o_xpm);
+        else if (!map_img.loadFromFile(config.map_file))
+        {
+            printf("\n Couldn't open the map %s \n", config.map_file.c_str());
+            return false;
+        }
+        map.loadFromBitmap(map_img, config.map_resolution);
+
+        //Laser
+        std::vector<float> lasercoord;
+        ini.read_vector("LASER_CONFIG","LASER_POSE", std::vector<float> (0), lasercoord , true);
+        scan.maxRange = ini.read_float("LASER_CONFIG","LASER_MAX_RANGE", 50, true);
+        scan.aperture = DEG2RAD(ini.read_float("LASER_CONFIG","LASER_APERTURE", 180, true));
+        scan.stdError = ini.read_float("LASER_CONFIG","LASER_STD_ERROR", 0.05, true);
+        scan.sensorPose.setFromValues(lasercoord[0],lasercoord[1],lasercoord[2],lasercoord[3],lasercoord[4],lasercoord[5]);
+        laser_segments = ini.read_int("LASER_CONFIG","LASER_SEGMENTS", 181, true);
+
+        //Robot model
+        const float tau = ini.read_float("NAVIGATION_CONFIG","ROBOTMODEL_TAU", 0, true);
+        const float delay = ini.read_float("NAVIGATION_CONFIG","ROBOTMODEL_DELAY", 0, true);
+        robotSim.setDelayModelParams(tau, delay);
+        robotSim.resetStatus();
+        robotSim.setOdometryErrors(0);
+
+        //Random initial pose within the free space of the map
+        bool valid_ini_pose = false;
+        float x_ini, y_ini;
+        while (!valid_ini_pose)
+        {
+            x_ini = map.getXMin() + float(std::rand()%1000)/1000.f*(map.getXMax() - map.getXMin());
+            y_ini = map.getYMin() + float(std::rand()%1000)/1000.f*(map.getYMax() - map.getYMin());
+            valid_ini_pose = isFree(x_ini, y_ini, 0.6f);
+        }
+        robotSim.setRealPose(CPose2D(x_ini, y_ini, 0.f));
+        return true;
+    }
+
+    bool isFree(float x, float y, float size) const
+    {
+        for (float u=-0.5f; u<=0.5f; u+= 0.1f)
+            for (float v=-0.5f; v<=0.5f; v+= 0.1f)
+                if (map.getPos(x + u*size, y + v*size) < 0.7f)
+                    return false;
+        return true;
+    }
+
+    void createNewTarget()
+    {
+        //Random target in a square of 10 meters around the robot
+        CPose2D robot_pose;
+        robotSim.getRealPose(robot_pose);
+        const float maxdist_next_target = 10.f;
+        TPoint2D target;
+        do {
+            target.x = maxdist_next_target*(0.5f - float(std::rand()%1000)/1000.f) + robot_pose[0];
+            target.y = maxdist_next_target*(0.5f - float(std::rand()%1000)/1000.f) + robot_pose[1];
+        } while (!isFree(target.x, target.y, 0.8f));
+
+		CAbstractReactiveNavigationSystem::TNavigationParams navparams;
+		navparams.target = target;
+		navparams.targetAllowedDistance = 0.3f;
+		navparams.targetIsRelative = false;
+        nav->navigate(&navparams);
+    }
+
+
+    //Methods
+    //--------------------------------------------------------------------------------------
+    bool initializeMethods()
+    {
+        clearMatchers();
+        runner.concurrent = config.concurrent;
+        bearings.initialize(laser_segments, scan.aperture);
+
+        for (unsigned int m=0; m<config.methods.size(); m++)
+        {
+            const string &method = config.methods[m];
+            //The RF2O engines run with verbose = false: their runtimes are part of the results
+            ScanMatcher *matcher;
+            if (method == "rf2o")
+            {
+                RF2O_Matcher<RF2O_standard> *rf2o = new RF2O_Matcher<RF2O_standard>("rf2o");
+                rf2o->initialize(laser_segments, scan.aperture, config.rf2o_id);
+                rf2o->odo.range_step = config.rf2o_range_step;
+                rf2o->odo.pyramid.level_step = config.rf2o_level_step;
+                rf2o->odo.params = config.rf2o_params;
+                rf2o->odo.verbose = false;
+                matcher = rf2o;
+            }
+            else if (method == "rf2o_refs")
+            {
+                RF2O_Matcher<RF2O_RefS> *rf2o = new RF2O_Matcher<RF2O_RefS>("rf2o_refs");
+                rf2o->initialize(laser_segments, scan.aperture, config.rf2o_id);
+                rf2o->odo.range_step = config.rf2o_range_step;
+                rf2o->odo.pyramid.level_step = config.rf2o_level_step;
+                rf2o->odo.params = config.rf2o_params;
+                rf2o->odo.verbose = false;
+                matcher = rf2o;
+            }
+            else if (method == "rf2o_nosym")
+            {
+                RF2O_Matcher<RF2O_nosym> *rf2o = new RF2O_Matcher<RF2O_nosym>("rf2o_nosym");
+                rf2o->initialize(laser_segments, scan.aperture, config.rf2o_id);
+                rf2o->odo.range_step = config.rf2o_range_step;
+                rf2o->odo.pyramid.level_step = config.rf2o_level_step;
+                rf2o->odo.params = config.rf2o_params;
+                rf2o->odo.verbose = false;
+                matcher = rf2o;
+            }
+            else if (method == "psm")
+            {
+                PSM_Matcher *psm = new PSM_Matcher;
+                try
+                {
+                    psm->initialize(laser_segments, scan.aperture, scan.maxRange);
+                }
+                catch(int)
+                {
+                    delete psm;
+                    return false;
+                }
+                matcher = psm;
+                psm_matchers.push_back(psm);
+            }
+            else
+            {
+                printf("\n Unknown method: %s \n", method.c_str());
+                return false;
+            }
+
+            matchers.push_back(matcher);
+            runner.add(*matcher);
+        }
+
+        if (matchers.empty())
+        {
+            printf("\n No method selected \n");
+            return false;
+        }
+
+        //The first scan is the reference of every method, and they start at its ground truth
+        runner.setFirstScan(currentScan());
+        est_poses.assign(matchers.size(), vector<CPose2D>());
+        runtimes.assign(matchers.size(), vector<float>());
+        failures.assign(matchers.size(), 0);
+        for (unsigned int k=0; k<matchers.size(); k++)
+        {
+            matchers[k]->resetPose(gt_pose);
+            est_poses[k].push_back(gt_pose);
+        }
+        timestamps.push_back(scanTime());
+        gt_poses.push_back(gt_pose);
+
+        if (!openWriters())
+            return false;
+        writeResults();
+        return true;
+    }
+
+    void clearMatchers()
+    {
+        runner.clear();
+        for (unsigned int k=0; k<matchers.size(); k++)
+            delete matchers[k];
+        matchers.clear();
+        psm_matchers.clear();
+    }
+
+    void processScan()
+    {
+        runner.match(currentScan());
+
+        timestamps.push_back(scanTime());
+        gt_poses.push_back(gt_pose);
+        for (unsigned int k=0; k<runner.size(); k++)
+        {
+            est_poses[k].push_back(runner[k].pose);
+            runtimes[k].push_back(runner.lastRuntime(k));
+            if (!runner.lastMatched(k))
+                failures[k]++;
+        }
+        writeResults();
+
+        if (observer)
+            observer->onScan(*this);
+    }
+
+    //Files prefix_<method> (timestamp, pose, runtime_ms, matched) and prefix_gt (timestamp, pose)
+    bool openWriters()
+    {
+        closeWriters();
+        if (config.results_formats == 0)
+            return true;
+
+        vector<string> columns;
+        columns.push_back("timestamp"); columns.push_back("x"); columns.push_back("y"); columns.push_back("phi");
+        vector<string> method_columns = columns;
+        method_columns.push_back("runtime_ms"); method_columns.push_back("matched");
+
+        for (unsigned int k=0; k<=runner.size(); k++)
+        {
+            const bool gt = (k == runner.size());
+            writers.push_back(new CResultsWriter);
+            if (!writers.back()->open(config.output_prefix + "_" + (gt ? string("gt") : string(runner[k].name())),
+                                      gt ? columns : method_columns, config.results_formats))
+                return false;
+        }
+        return true;
+    }
+
+    //Last pose of every method and the ground truth (the first ones are the initial pose)
+    void writeResults()
+    {
+        if (writers.empty())
+            return;
+
+        const unsigned int i = numScans() - 1;
+        for (unsigned int k=0; k<runner.size(); k++)
+        {
+            //The initial pose has no match
+            double diagnostics[2] = {0.0, 1.0};
+            if (i > 0)
+            {
+                diagnostics[0] = runtimes[k].back();
+                diagnostics[1] = runner.lastMatched(k) ? 1.0 : 0.0;
+            }
+            writers[k]->addPose(timestamps[i], est_poses[k][i], diagnostics);
+        }
+        if (has_groundtruth)
+            writers.back()->addPose(timestamps[i], gt_poses[i]);
+    }
+
+    void closeWriters()
+    {
+        for (unsigned int k=0; k<writers.size(); k++)
+            delete writers[k];      //It closes the files
+        writers.clear();
+    }
+
+    //Set the invalid points to 0 (as the harnesses do)
+    void filterRanges()
+    {
+        scan.validRange.resize(scan.scan.size());
+		for (unsigned int i=0; i<scan.scan.size(); i++)
+            if ((scan.scan[i] > 0.995f*scan.maxRange)||(scan.scan[i] < config.laser_min_range))
+            {
+				scan.scan[i] = 0.f;
+                scan.validRange[i] = false;
+            }
+            else
+            {
+                scan.validRange[i] = true;
+            }
+    }
+
+    ScanView currentScan()
+    {
+        if (config.source == "scanlog")
+            return scanlog.scan(scanlog_index, bearings, &widened[0]);
+        return ScanView(scan, bearings);
+    }
+
+    double scanTime() const
+    {
+        if (config.source == "simulation")
+            return double(numScans())/double(config.odo_freq);
+        if (config.source == "scanlog")
+            return scanlog.timestamp(scanlog_index);
+        return mrpt::system::timestampToDouble(scan.timestamp);
+    }
+
+    //Runtimes, failed matches and, with ground truth, the RMS errors of the motion over 1 second and the final drift,
+    //followed by the relative errors at the other horizons and the absolute errors
+    void writeStatistics(string &stats) const
+    {
+        const unsigned int size_v = numScans();
+        const unsigned int react_freq = config.odo_freq;
+
+        //All the methods are evaluated at once (the first horizon is 1 second)
+        vector<TEvalHorizon> eval_horizons(1, TEvalHorizon(TEvalHorizon::SCANS, react_freq)), horizons;
+        if (parseHorizons(config.eval_horizons, horizons))
+            for (unsigned int h=0; h<horizons.size(); h++)
+                if ((horizons[h].type != TEvalHorizon::SCANS) || (horizons[h].length != react_freq))
+                    eval_horizons.push_back(horizons[h]);
+
+        CTrajectoryEvaluator evaluator(eval_horizons);
+        vector<TEvalResult> results;
+        if (has_groundtruth && (size_v > react_freq))
+        {
+            vector<string> names;
+            vector<const vector<CPose2D>*> poses;
+            for (unsigned int k=0; k<runner.size(); k++)
+            {
+                names.push_back(runner[k].name());
+                poses.push_back(&est_poses[k]);
+            }
+            evaluator.setGroundTruth(gt_poses);
+            evaluator.evaluate(names, poses, results);
+        }
+
+        stats = format("Scans: %u (%s) \n", size_v, config.source.c_str());
+        for (unsigned int k=0; k<runner.size(); k++)
+        {
+            float aver_runtime = 0.f, max_runtime = 0.f;
+            for (unsigned int i=0; i<runtimes[k].size(); i++)
+            {
+                aver_runtime += runtimes[k][i];
+                max_runtime = max(max_runtime, runtimes[k][i]);
+            }
+            if (!runtimes[k].empty())
+                aver_runtime /= runtimes[k].size();
+
+            stats += format("%s: runtime = %f ms (max %f ms), failed matches = %u", runner[k].name(), aver_runtime, max_runtime, failures[k]);
+
+            if (!results.empty())
+                stats += format(", Aver_trans = %f m, Aver_rot = %f grad, Overall drift = %f m", results[k].rpe[0].rmse_trans,
+                                57.3*results[k].rpe[0].rmse_rot, results[k].ate.final_drift);
+            stats += "\n";
+        }
+
+        if (!results.empty())
+            stats += "\n" + evaluator.report(results);
+    }
+
+    //The matchers and the navigator are owned by the batch run
+    CLaserodoBatch(const CLaserodoBatch &);
+    CLaserodoBatch &operator=(const CLaserodoBatch &);
+};
@@ -22,9 +22,9 @@
 #include "laser_odometry_3scans.h"
 #include "laser_odometry_refscans.h"
 #include "laser_odometry_nosym.h"
-#include "polar_match.h"
-#include "csm/csm_all.h"
-//#include "csm/sm/csm/csm_all.h"
+#include "scan_matcher.h"
+#include "scan_matcher_csm.h"
+#include "results_writer.h"
 
 
 using namespace mrpt;
@@ -36,7 +36,6 @@ using namespace mrpt::obs;
 using namespace mrpt::gui;
 using namespace mrpt::poses;
 using namespace mrpt::math;
-using namespace CSM;
 using namespace std;
 
 
@@ -68,30 +67,29 @@ public:
 
 
     //RF2O
-    RF2O_standard   odo_a;
-    RF2O_RefS       odo_b;
-    RF2O_RefS       odo_c;
-    RF2O_standard   odo_d;
-    RF2O_nosym      odo_nosym;
+    RF2O_Matcher<RF2O_standard>     rf2o_a;
+    RF2O_Matcher<RF2O_RefS>         rf2o_b;
+    RF2O_Matcher<RF2O_RefS>         rf2o_c;
+    RF2O_Matcher<RF2O_standard>     rf2o_d;
+    RF2O_Matcher<RF2O_nosym>        rf2o_nosym;
     unsigned int experiment;
 
-    //Polar scan matcher
-    CPose2D     new_psm_pose, old_psm_pose;
-    PMScan      ls, ls_ref;
-    bool        matchFailed;
+    //Compared methods
+    PSM_Matcher     psm;            //Polar scan matcher
+    CSM_Matcher     csm;            //Canonical scan matcher (PL-ICP)
 
-    //Canonical scan matcher
-    sm_params params;               //Structure containing the input parameters
-    sm_result result;               //Output of the scan matching
-    LDP laser_ref, laser_sens;      //the laser scans to be matched (in the PL-ICP data structure)
-    int recover_from_error;
-    CPose2D new_csm_pose, old_csm_pose;
+    //Methods run on every scan (those of the experiment)
+    ScanBearings    bearings;
+    MatcherRunner   runner;
 
 
     //Results
     vector<CPose3D>	real_poses, poses_a, poses_b, poses_c, poses_d, poses_nosym, psm_poses, csm_poses;
+    CResultsWriter   results_writer;     //Of the last saved results (written in the background, closed by saveResults)
     float time_a, time_b, time_c, time_d, psm_time, csm_time;
 
+
+    CMyReactInterface() : rf2o_a("a"), rf2o_b("b"), rf2o_c("c"), rf2o_d("d"), rf2o_nosym("nosym") {}
 	
 	bool getCurrentPoseAndSpeeds( poses::CPose2D &curPose, float &curV, float &curW)
 	{
@@ -226,42 +224,54 @@ public:
 
         if (experiment == 1) //Different versions of the standard
         {
-            odo_a.initialize(laser.m_segments, laser.m_scan.aperture, 0);
-            odo_b.initialize(laser.m_segments, laser.m_scan.aperture, 1);
-            odo_c.initialize(laser.m_segments, laser.m_scan.aperture, 2);
-            odo_d.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+            rf2o_a.initialize(laser.m_segments, laser.m_scan.aperture, 0);
+            rf2o_b.initialize(laser.m_segments, laser.m_scan.aperture, 1);
+            rf2o_c.initialize(laser.m_segments, laser.m_scan.aperture, 2);
+            rf2o_d.initialize(laser.m_segments, laser.m_scan.aperture, 3);
         }
         else if (experiment == 2) //CA, KA y MA
         {
-            odo_a.initialize(laser.m_segments, laser.m_scan.aperture, 3);
-            odo_b.initialize(laser.m_segments, laser.m_scan.aperture, 1);
-            odo_c.initialize(laser.m_segments, laser.m_scan.aperture, 2);
-            odo_d.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
+            rf2o_a.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+            rf2o_b.initialize(laser.m_segments, laser.m_scan.aperture, 1);
+            rf2o_c.initialize(laser.m_segments, laser.m_scan.aperture, 2);
+            rf2o_d.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
         }
         else if (experiment == 3) //Comparisons with other methods
         {
-            odo_a.initialize(laser.m_segments, laser.m_scan.aperture, 3);
-            odo_b.initialize(laser.m_segments, laser.m_scan.aperture, 2);
-            odo_c.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
-            odo_d.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
+            rf2o_a.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+            rf2o_b.initialize(laser.m_segments, laser.m_scan.aperture, 2);
+            rf2o_c.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
+            rf2o_d.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
         }
         else if (experiment == 4) // Sym vs nosym
         {
-            odo_a.initialize(laser.m_segments, laser.m_scan.aperture, 3);
-            odo_b.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
-            odo_c.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
-            odo_d.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
-            odo_nosym.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+            rf2o_a.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+            rf2o_b.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
+            rf2o_c.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
+            rf2o_d.initialize(laser.m_segments, laser.m_scan.aperture, 3); //Not used
+            rf2o_nosym.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+        }
+
+        bearings.initialize(laser.m_segments, laser.m_scan.aperture);
+        if (experiment == 3)
+        {
+            psm.initialize();
+            csm.initialize(laser.m_segments, laser.m_scan.aperture, laser.m_scan.stdError);
         }
 
+        //The unused engines are not run
+        runner.clear();
+        runner.add(rf2o_a);
+        if (experiment < 4)     runner.add(rf2o_b);
+        if (experiment < 3)     {runner.add(rf2o_c); runner.add(rf2o_d);}
+        if (experiment == 3)    {runner.add(psm); runner.add(csm);}
+        if (experiment == 4)    runner.add(rf2o_nosym);
+
         initializeScene();
-        pm_init();          //Contains precomputed range bearings and their sines/cosines
-        Init_Params_csm();
-        loadFirstScanRF2O();
 
-        setRF2OPose(new_pose);
-        new_psm_pose = new_pose; old_psm_pose = new_pose;
-        new_csm_pose = new_pose; old_csm_pose = new_pose;
+        //The first scan is the reference of every method
+        runner.setFirstScan(ScanView(laser.m_scan, bearings));
+        setMatchersPose(new_pose);
         time_a = 0.f; time_b = 0.f; time_c = 0.f; time_d = 0.f;
         psm_time = 0.f; csm_time = 0.f;
     }
@@ -354,16 +364,6 @@ public:
 		CSimplePointsMap auxpoints;
 		senseObstacles( auxpoints );
         laser.m_scan_old = laser.m_scan;
-
-        //psm
-        pm_readScan(laser.m_scan, &ls);
-        pm_preprocessScan(&ls);
-        matchFailed = false;
-
-        //csm
-        laser_ref = cast_CObservation2DRangeScan_to_LDP(laser.m_scan);
-        // For the first scan, set estimate = odometry
-        copy_d(laser_ref->odometry, 3, laser_ref->estimate);
         //--------------------------------------------------------------------------
 
 		//The laserscan is inserted
@@ -436,30 +436,30 @@ public:
         obj->setPose(robotpose3d);
 
         obj = scene->getByName("robot_a");
-        obj->setPose(odo_a.laser_pose);
+        obj->setPose(rf2o_a.pose);
 
         obj = scene->getByName("robot_b");
-        obj->setPose(odo_b.laser_pose);
+        obj->setPose(rf2o_b.pose);
 
         obj = scene->getByName("robot_c");
-        obj->setPose(odo_c.laser_pose);
+        obj->setPose(rf2o_c.pose);
 
         obj = scene->getByName("robot_d");
-        obj->setPose(odo_d.laser_pose);
+        obj->setPose(rf2o_d.pose);
 
         obj = scene->getByName("robot_nosym");
-        obj->setPose(odo_nosym.laser_pose);
+        obj->setPose(rf2o_nosym.pose);
 
         if (experiment == 3)
         {
             obj = scene->getByName("robot_psm");
-            obj->setPose(new_psm_pose);
+            obj->setPose(psm.pose);
 
             obj = scene->getByName("robot_csm");
-            obj->setPose(new_csm_pose);
+            obj->setPose(csm.pose);
         }
 
-        const unsigned int repr_level = round(log2(round(float(odo_a.width)/float(odo_a.cols))));
+        const unsigned int repr_level = round(log2(round(float(rf2o_a.odo.width)/float(rf2o_a.odo.cols))));
 
         //Laser
         CPose3D laserpose;
@@ -467,12 +467,12 @@ public:
         CPointCloudColouredPtr gl_laser;
         gl_laser = scene->getByClass<CPointCloudColoured> (0);
         gl_laser->clear();
-        for (unsigned int i=0; i<odo_a.cols; i++)
+        for (unsigned int i=0; i<rf2o_a.odo.cols; i++)
         {
-            if (odo_a.outliers(i) == true)
-                gl_laser->push_back(odo_a.xx[repr_level](i), odo_a.yy[repr_level](i), 0.1, 0, 0, 1);
+            if (rf2o_a.odo.outliers(i) == true)
+                gl_laser->push_back(rf2o_a.odo.xx[repr_level](i), rf2o_a.odo.yy[repr_level](i), 0.1, 0, 0, 1);
             else
-                gl_laser->push_back(odo_a.xx[repr_level](i), odo_a.yy[repr_level](i), 0.1, 1-sqrt(odo_a.weights(i)), sqrt(odo_a.weights(i)), 0);
+                gl_laser->push_back(rf2o_a.odo.xx[repr_level](i), rf2o_a.odo.yy[repr_level](i), 0.1, 1-sqrt(rf2o_a.odo.weights(i)), sqrt(rf2o_a.odo.weights(i)), 0);
         }
 
         gl_laser->setPose(robotpose3d);
@@ -483,12 +483,12 @@ public:
             gl_laser->clear();
 
             unsigned int level = 0;
-            unsigned int s = pow(2.f,int(odo_a.ctf_levels-(level+1)));
-            unsigned int cols_coarse = ceil(float(odo_a.cols)/float(s));
-            const unsigned int image_level = odo_a.ctf_levels - level + round(log2(round(float(odo_a.width)/float(odo_a.cols)))) - 1;
+            unsigned int s = pow(2.f,int(rf2o_a.odo.ctf_levels-(level+1)));
+            unsigned int cols_coarse = ceil(float(rf2o_a.odo.cols)/float(s));
+            const unsigned int image_level = rf2o_a.odo.ctf_levels - level + round(log2(round(float(rf2o_a.odo.width)/float(rf2o_a.odo.cols)))) - 1;
 
             for (unsigned int i=0; i<cols_coarse; i++)
-                gl_laser->push_back(odo_a.xx[image_level](i), odo_a.yy[image_level](i), 0.1, 0.f, 0.f, 1.f);
+                gl_laser->push_back(rf2o_a.odo.xx[image_level](i), rf2o_a.odo.yy[image_level](i), 0.1, 0.f, 0.f, 1.f);
 
             gl_laser->setPose(robotpose3d);
         }
@@ -500,33 +500,33 @@ public:
 
         opengl::CSetOfLinesPtr traj_lines_a;
         traj_lines_a = scene->getByClass<CSetOfLines> (1);
-        traj_lines_a->appendLine(odo_a.laser_oldpose[0], odo_a.laser_oldpose[1], 0.2, odo_a.laser_pose[0], odo_a.laser_pose[1], 0.2);
+        traj_lines_a->appendLine(rf2o_a.old_pose[0], rf2o_a.old_pose[1], 0.2, rf2o_a.pose[0], rf2o_a.pose[1], 0.2);
 
         opengl::CSetOfLinesPtr traj_lines_b;
         traj_lines_b = scene->getByClass<CSetOfLines> (2);
-        traj_lines_b->appendLine(odo_b.laser_oldpose[0], odo_b.laser_oldpose[1], 0.2, odo_b.laser_pose[0], odo_b.laser_pose[1], 0.2);
+        traj_lines_b->appendLine(rf2o_b.old_pose[0], rf2o_b.old_pose[1], 0.2, rf2o_b.pose[0], rf2o_b.pose[1], 0.2);
 
         opengl::CSetOfLinesPtr traj_lines_c;
         traj_lines_c = scene->getByClass<CSetOfLines> (3);
-        traj_lines_c->appendLine(odo_c.laser_oldpose[0], odo_c.laser_oldpose[1], 0.2, odo_c.laser_pose[0], odo_c.laser_pose[1], 0.2);
+        traj_lines_c->appendLine(rf2o_c.old_pose[0], rf2o_c.old_pose[1], 0.2, rf2o_c.pose[0], rf2o_c.pose[1], 0.2);
 
         opengl::CSetOfLinesPtr traj_lines_d;
         traj_lines_d = scene->getByClass<CSetOfLines> (4);
-        traj_lines_d->appendLine(odo_d.laser_oldpose[0], odo_d.laser_oldpose[1], 0.2, odo_d.laser_pose[0], odo_d.laser_pose[1], 0.2);
+        traj_lines_d->appendLine(rf2o_d.old_pose[0], rf2o_d.old_pose[1], 0.2, rf2o_d.pose[0], rf2o_d.pose[1], 0.2);
 
         opengl::CSetOfLinesPtr traj_lines_nosym;
         traj_lines_nosym = scene->getByClass<CSetOfLines> (5);
-        traj_lines_nosym->appendLine(odo_nosym.laser_oldpose[0], odo_nosym.laser_oldpose[1], 0.2, odo_nosym.laser_pose[0], odo_nosym.laser_pose[1], 0.2);
+        traj_lines_nosym->appendLine(rf2o_nosym.old_pose[0], rf2o_nosym.old_pose[1], 0.2, rf2o_nosym.pose[0], rf2o_nosym.pose[1], 0.2);
 
         if (experiment == 3)
         {
             opengl::CSetOfLinesPtr traj_lines_psm;
             traj_lines_psm = scene->getByClass<CSetOfLines> (6);
-            traj_lines_psm->appendLine(old_psm_pose[0], old_psm_pose[1], 0.2, new_psm_pose[0], new_psm_pose[1], 0.2);
+            traj_lines_psm->appendLine(psm.old_pose[0], psm.old_pose[1], 0.2, psm.pose[0], psm.pose[1], 0.2);
 
             opengl::CSetOfLinesPtr traj_lines_csm;
             traj_lines_csm = scene->getByClass<CSetOfLines> (7);
-            traj_lines_csm->appendLine(old_csm_pose[0], old_csm_pose[1], 0.2, new_csm_pose[0], new_csm_pose[1], 0.2);
+            traj_lines_csm->appendLine(csm.old_pose[0], csm.old_pose[1], 0.2, csm.pose[0], csm.pose[1], 0.2);
         }
 
 		window.unlockAccess3DScene();
@@ -542,71 +542,47 @@ public:
         robotpose3d.y(robotSim.getY());
         robotpose3d.setYawPitchRoll(robotSim.getPHI(),0,0);
 
-        odo_a.laser_pose = CPose2D(robotpose3d);
-        odo_a.laser_oldpose = CPose2D(robotpose3d);
-        odo_a.kai_abs.assign(0.f); odo_a.kai_loc.assign(0.f); odo_a.kai_loc_old.assign(0.f);
-
-        odo_b.laser_pose = CPose2D(robotpose3d);
-        odo_b.laser_oldpose = CPose2D(robotpose3d);
-        odo_b.kai_abs.assign(0.f); odo_b.kai_loc.assign(0.f); odo_b.kai_loc_old.assign(0.f);
-
-        odo_c.laser_pose = CPose2D(robotpose3d);
-        odo_c.laser_oldpose = CPose2D(robotpose3d);
-        odo_c.kai_abs.assign(0.f); odo_c.kai_loc.assign(0.f); odo_c.kai_loc_old.assign(0.f);
-
-        odo_d.laser_pose = CPose2D(robotpose3d);
-        odo_d.laser_oldpose = CPose2D(robotpose3d);
-        odo_d.kai_abs.assign(0.f); odo_d.kai_loc.assign(0.f); odo_d.kai_loc_old.assign(0.f);
-
-        odo_nosym.laser_pose = CPose2D(robotpose3d);
-        odo_nosym.laser_oldpose = CPose2D(robotpose3d);
-        odo_nosym.kai_abs.assign(0.f); odo_nosym.kai_loc.assign(0.f); odo_nosym.kai_loc_old.assign(0.f);
-
-        new_psm_pose = CPose2D(robotpose3d);
-        old_psm_pose = CPose2D(robotpose3d);
-
-        new_csm_pose = CPose2D(robotpose3d);
-        old_csm_pose = CPose2D(robotpose3d);
+        setMatchersPose(CPose2D(robotpose3d));
 
         //Robots
         obj = scene->getByName("robot_real");
         obj->setPose(robotpose3d);
 
         obj = scene->getByName("robot_a");
-        obj->setPose(odo_a.laser_pose);
+        obj->setPose(rf2o_a.pose);
 
         obj = scene->getByName("robot_b");
-        obj->setPose(odo_b.laser_pose);
+        obj->setPose(rf2o_b.pose);
 
         obj = scene->getByName("robot_c");
-        obj->setPose(odo_c.laser_pose);
+        obj->setPose(rf2o_c.pose);
 
         obj = scene->getByName("robot_d");
-        obj->setPose(odo_d.laser_pose);
+        obj->setPose(rf2o_d.pose);
 
         obj = scene->getByName("robot_nosym");
-        obj->setPose(odo_nosym.laser_pose);
+        obj->setPose(rf2o_nosym.pose);
 
         if (experiment == 3)
         {
             obj = scene->getByName("robot_psm");
-            obj->setPose(new_psm_pose);
+            obj->setPose(psm.pose);
 
             obj = scene->getByName("robot_csm");
-            obj->setPose(new_csm_pose);
+            obj->setPose(csm.pose);
         }
 
 
         //Laser
-        const unsigned int repr_level = round(log2(round(float(odo_a.width)/float(odo_a.cols))));
+        const unsigned int repr_level = round(log2(round(float(rf2o_a.odo.width)/float(rf2o_a.odo.cols))));
 
         CPose3D laserpose;
         laser.m_scan.getSensorPose(laserpose);
         CPointCloudColouredPtr gl_laser;
         gl_laser = scene->getByClass<CPointCloudColoured> (0);
         gl_laser->clear();
-        for (unsigned int i=0; i<odo_a.cols; i++)
-            gl_laser->push_back(odo_a.xx[repr_level](i), odo_a.yy[repr_level](i), 0.1, 1-sqrt(odo_a.weights(i)), sqrt(odo_a.weights(i)), 0);
+        for (unsigned int i=0; i<rf2o_a.odo.cols; i++)
+            gl_laser->push_back(rf2o_a.odo.xx[repr_level](i), rf2o_a.odo.yy[repr_level](i), 0.1, 1-sqrt(rf2o_a.odo.weights(i)), sqrt(rf2o_a.odo.weights(i)), 0);
 
         gl_laser->setPose(robotpose3d + laserpose);
 
@@ -669,96 +645,37 @@ public:
 		return navparams;
 	}
 
-    void runRF2O()
+    //Runs the methods of the experiment on the last scan (concurrently unless runner.concurrent is false)
+    void runMatchers()
     {
-        //Run the first version
-        for (unsigned int i=0; i<odo_a.width; i++)
-            odo_a.range_wf(i) = laser.m_scan.scan[i];
-
-        odo_a.odometryCalculation();
-        time_a += odo_a.runtime;
-
-        //Run the second version
-        if (experiment < 4)
-        {
-            for (unsigned int i=0; i<odo_b.width; i++)
-                odo_b.range_wf(i) = laser.m_scan.scan[i];
-
-            odo_b.odometryCalculation();
-            time_b += odo_b.runtime;
-        }
+        runner.match(ScanView(laser.m_scan, bearings));
 
-        if (experiment < 3)
+        for (unsigned int k=0; k<runner.size(); k++)
         {
-            //Run the third version
-            for (unsigned int i=0; i<odo_c.width; i++)
-                odo_c.range_wf(i) = laser.m_scan.scan[i];
-
-            odo_c.odometryCalculation();
-            time_c += odo_c.runtime;
+            const ScanMatcher *matcher = &runner[k];
+            const float runtime = runner.lastRuntime(k);
 
-            //Run the fourth version
-            for (unsigned int i=0; i<odo_d.width; i++)
-                odo_d.range_wf(i) = laser.m_scan.scan[i];
-
-            odo_d.odometryCalculation();
-            time_d += odo_d.runtime;
-        }
-        else if (experiment == 4)
-        {
-            //Run the nonsymmetric version
-            for (unsigned int i=0; i<odo_nosym.width; i++)
-                odo_nosym.range_wf(i) = laser.m_scan.scan[i];
+            if (matcher == &rf2o_a)         time_a += runtime;
+            else if (matcher == &rf2o_b)    time_b += runtime;
+            else if (matcher == &rf2o_c)    time_c += runtime;
+            else if (matcher == &rf2o_d)    time_d += runtime;
+            else if (matcher == &psm)       psm_time += runtime;
+            else if (matcher == &csm)       csm_time += runtime;
 
-            odo_nosym.odometryCalculation();
+            printf("\n%s runtime = %f ms", matcher->name(), runtime);
         }
+        fflush(stdout);
     }
 
-    void loadFirstScanRF2O()
+    void setMatchersPose(const CPose2D &reset_pose)
     {
-        //First version
-        for (unsigned int i=0; i<odo_a.width; i++)
-            odo_a.range_wf(i) = laser.m_scan.scan[i];
-        odo_a.createScanPyramid();
-
-        //Second version
-        for (unsigned int i=0; i<odo_b.width; i++)
-            odo_b.range_wf(i) = laser.m_scan.scan[i];
-        odo_b.createScanPyramid();
-
-        //Third version
-        for (unsigned int i=0; i<odo_c.width; i++)
-            odo_c.range_wf(i) = laser.m_scan.scan[i];
-        odo_c.createScanPyramid();
-
-        //Fourth version
-        for (unsigned int i=0; i<odo_d.width; i++)
-            odo_d.range_wf(i) = laser.m_scan.scan[i];
-        odo_d.createScanPyramid();
-
-        //Nonsymmetric version
-        for (unsigned int i=0; i<odo_nosym.width; i++)
-            odo_nosym.range_wf(i) = laser.m_scan.scan[i];
-        odo_nosym.createScanPyramid();
-
-    }
-
-    void setRF2OPose(const CPose2D &reset_pose)
-    {
-        odo_a.laser_pose = reset_pose;
-        odo_a.laser_oldpose = reset_pose;
-
-        odo_b.laser_pose = reset_pose;
-        odo_b.laser_oldpose = reset_pose;
-
-        odo_c.laser_pose = reset_pose;
-        odo_c.laser_oldpose = reset_pose;
-
-        odo_d.laser_pose = reset_pose;
-        odo_d.laser_oldpose = reset_pose;
-
-        odo_nosym.laser_pose = reset_pose;
-        odo_nosym.laser_oldpose = reset_pose;
+        rf2o_a.resetPose(reset_pose);
+        rf2o_b.resetPose(reset_pose);
+        rf2o_c.resetPose(reset_pose);
+        rf2o_d.resetPose(reset_pose);
+        rf2o_nosym.resetPose(reset_pose);
+        psm.resetPose(reset_pose);
+        csm.resetPose(reset_pose);
     }
 
 	void computeErrors(unsigned int react_freq)
@@ -864,316 +781,52 @@ public:
         fflush(stdout);
 	}
 
-    //One of the compared methods (PSM)
-    void runPolarScanMatching()
-    {
-        //Read scans (ls and ls_ref)
-        //pm_readScan(laser.m_scan_old, &ls_ref);
-        ls_ref = ls;
-        pm_readScan(laser.m_scan, &ls);
-
-        CTicTac clock; clock.Tic();
-
-        //preprocess the new scan
-        pm_preprocessScan(&ls);
-
-
-        //Initial seed
-        if (matchFailed)
-        {
-            ls.rx = 0.f; ls_ref.rx = 0.f;
-            ls.ry = 0.f; ls_ref.ry = 0.f;
-            ls.th = 0.f; ls_ref.th = 0.f;
-        }
-        else
-        {
-            ls.rx = 100.f*new_psm_pose[1]; ls_ref.rx = 100.f*old_psm_pose[1];
-            ls.ry = 100.f*new_psm_pose[0]; ls_ref.ry = 100.f*old_psm_pose[0];
-            ls.th = new_psm_pose[2]; ls_ref.th = old_psm_pose[2];
-        }
-
-        //printf("\n Initial motion: (%f, %f, %f), (%f, %f, %f)", 0.01f*ls.rx, 0.01f*ls.ry, ls.th, 0.01f*ls_ref.rx, 0.01f*ls_ref.ry, ls_ref.th);
-
-        matchFailed = false;
-        try
-        {
-          pm_psm(&ls_ref,&ls);
-        }catch(int err)
-        {
-          cerr << "Error caught: failed match." << endl;
-          matchFailed = true;
-        }
-
-        PM_TYPE err_idx = pm_error_index2(&ls_ref,&ls);
-        //cout <<" err: "<<err_idx;
-
-        if (abs(ls.ry) > 80.f) ls.ry = 0.f;
-        if (abs(ls.rx) > 80.f) ls.rx = 0.f;
-        if (abs(ls.th) > DEG2RAD(70.f)) ls.th = 0.f;
-
-        const float psm_t = 1000.f*clock.Tac();
-        psm_time += psm_t;
-
-        printf("\nPSM runtime = %f ms", psm_t);
-        fflush(stdout);
-
-        old_psm_pose = new_psm_pose;
-        new_psm_pose = old_psm_pose + CPose2D(0.01f*ls.ry,0.01f*ls.rx,ls.th);
-    }
-
-    void Init_Params_csm()
-    {
-        params.max_angular_correction_deg = 60;             //"Maximum angular displacement between scans"
-        params.max_linear_correction = 1.0;                 //"Maximum translation between scans (m)"
-        params.max_iterations = 100;                       //"When we had enough"
-
-        params.epsilon_xy = 0.0001;                         //"A threshold for stopping (m)"
-        params.epsilon_theta = 0.0001;                      //"A threshold for stopping (rad)"
-
-        params.max_correspondence_dist = 2.0;
-        params.sigma = 0.01;                                //Noise in the scan
-
-        params.use_corr_tricks = 1;                         //"Use smart tricks for finding correspondences."
-        params.restart = 0;                                 //"Restart: Restart if error is over threshold"
-        params.restart_threshold_mean_error = 0.01;
-        params.restart_dt= 0.01;
-        params.restart_dtheta = 1.5 * 3.14 /180;
-
-        params.clustering_threshold = 0.05;                 //"Max distance for staying in the same clustering"
-        params.orientation_neighbourhood = 3;               //"Number of neighbour rays used to estimate the orientation."
-
-        params.use_point_to_line_distance = 1;              //"If 0, it's vanilla ICP."
-        params.do_alpha_test = 0;                           //"Discard correspondences based on the angles"
-        params.do_alpha_test_thresholdDeg = 20.0;           //
-
-        params.outliers_maxPerc = 0.95;
-        params.outliers_adaptive_order =0.7;
-        params.outliers_adaptive_mult=2.0;
-        params.do_visibility_test = 0;
-
-        params.outliers_remove_doubles = 1;                 //"no two points in laser_sens can have the same corr."
-        params.do_compute_covariance = 0;                   //"If 1, computes the covariance of ICP using the method http://purl.org/censi/2006/icpcov ."
-        params.debug_verify_tricks = 0;                     //"Checks that find_correspondences_tricks gives the right answer.
-
-        params.laser[0] = 0.0;                              //Pose of sensor with respect to robot: used for computing the first estimate given the odometry.
-        params.laser[1] = 0.0;
-        params.laser[2] = 0.0;
-
-        params.min_reading = 0.0;                           //Don't use readings less than min_reading (m)
-        params.max_reading = 1000.0;                        //Don't use readings longer than max_reading (m)
-
-        params.use_ml_weights = 0;                          //"If 1, the field 'true_alpha' (or 'alpha') in the first scan is used to compute the incidence beta, and the factor (1/cos^2(beta)) used to weight the correspondence.");
-        params.use_sigma_weights = 0;                       //"If 1, the field 'readings_sigma' in the second scan is used to weight the correspondence by 1/sigma^2"
-        recover_from_error = 0;
-        printf("[Init_Params]: Params structure sucessfully initialized.\n\n");
-    }
-
-    LDP cast_CObservation2DRangeScan_to_LDP(CObservation2DRangeScan &laser_obj)
-    {
-        int n;
-        n = laser_obj.scan.size();		//Num of samples (rays) of the scan laser
-
-        LDP ld = ld_alloc_new(n);       //create new structure initialized with "n" rays
-
-        ld->min_theta = -laser_obj.aperture/2;			//rad
-        ld->max_theta = laser_obj.aperture/2;			//rad
-        float angle_ray = laser_obj.aperture/(n-1);    //rad
-
-        double index_cero_angle = floor( (n-1)/2);
-
-        //scan readings
-        for (int i=0; i<n; i++)
-        {
-            if (laser_obj.validRange[i] == false)
-            {
-                ld->readings[i] = NAN;                  //*(ld->readings+i)
-                ld->valid[i] = 0;
-            }
-            else
-            {
-                ld->readings[i] = static_cast<double>(laser_obj.scan[i]);   //m
-                ld->valid[i] = 1;                       //int
-            }
-
-            ld->theta[i] = (i-index_cero_angle)*angle_ray;             //rad
-            ld->readings_sigma[i] = laser_obj.stdError;
-            ld->cluster[i] = -1;                        //No cluster selected
-        }
-
-        //To avoid failure due to precission, copy min and max theta (see ld_valid_fields)
-        ld->theta[0] = ld->min_theta;
-        ld->theta[n-1] = ld->max_theta;
-
-        //Set initial guess (odometry) to 0 (mandatory for proper funtionality)
-        ld->odometry[0] = 0.0;
-        ld->odometry[1] = 0.0;
-        ld->odometry[2] = 0.0;
-
-    /*
-        mrpt::poses::CPose3D LaserPoseOnTheRobot;
-        laser_obj.getSensorPose(LaserPoseOnTheRobot);
-        //Set the initial pose
-        laser_pose = LaserPoseOnTheRobot;
-        laser_oldpose = LaserPoseOnTheRobot;
-
-        jo_read_double_array(jo, "odometry", ld->odometry, 3, NAN);
-        jo_read_double_array(jo, "estimate", ld->estimate, 3, NAN);
-        jo_read_double_array(jo, "true_pose", ld->true_pose, 3, NAN);
-    */
-
-        double time_seconds = mrpt::system::timestampToDouble(laser_obj.timestamp);
-        double fractpart, intpart;
-        fractpart = modf(time_seconds, &intpart);
-        ld->tv.tv_sec = intpart;
-        ld->tv.tv_usec = fractpart;
-
-        if(!ld_valid_fields(ld))
-        {
-            sm_error("[Init] Invalid laser data in first scan.\n");
-            return ld;
-        }
-
-        //Structure is ready!
-        return ld;
-    }
-
-    /* Runs the PL-ICP */
-    bool runCanonicalScanMatching()
+    void saveResults(unsigned int freq)
     {
-        laser_sens = cast_CObservation2DRangeScan_to_LDP(laser.m_scan);
-        CTicTac clock; clock.Tic();
-
-        try
-        {
-            //set the scan data into the input structure
-            params.laser_ref  = laser_ref;
-            params.laser_sens = laser_sens;
-
-            // Set first guess as the difference in odometry
-            if (any_nan(params.laser_ref->odometry,3) || any_nan(params.laser_sens->odometry,3) )
-            {
-                sm_error("The 'odometry' field is set to NaN so I don't know how to get an initial guess. I usually use the difference in the odometry fields to obtain the initial guess.\n");
-                sm_error("  laser_ref->odometry = %s \n",  friendly_pose(params.laser_ref->odometry) );
-                sm_error("  laser_sens->odometry = %s \n", friendly_pose(params.laser_sens->odometry) );
-                sm_error(" I will quit it here. \n");
-                return false;
-            }
-
-            double odometry[3];
-            pose_diff_d(laser_sens->odometry, laser_ref->odometry, odometry);
-            double ominus_laser[3], temp[3];
-            ominus_d(params.laser, ominus_laser);
-            oplus_d(ominus_laser, odometry, temp);
-            oplus_d(temp, params.laser, params.first_guess);
-
-            // Do the actual work
-            sm_icp(&params, &result);
-
-        }
-        catch(exception &e)
-        {
-            cerr << "[Matching] Returning false due to exception: " << endl;
-            cerr << e.what() << endl;
-            return false;
-        }
-        catch(...)
+        //Save freq, real_pose (x,y,theta) and the poses of the methods of the experiment (x,y,theta)
+        vector<const vector<CPose3D>*> poses;
+        string columns = "freq gt_x gt_y gt_theta";
+        poses.push_back(&real_poses);
+        if (experiment == 1)
         {
-            cerr << "[Matching] Returning false due to unknown exception: " << endl;
-            return false;
+            poses.push_back(&poses_a); poses.push_back(&poses_b); poses.push_back(&poses_c); poses.push_back(&poses_d);
+            columns += " a_x a_y a_theta b_x b_y b_theta c_x c_y c_theta d_x d_y d_theta";
         }
-
-        if(!result.valid)
+        else if (experiment == 2)
         {
-            if(recover_from_error)
-            {
-                sm_info("One ICP matching failed. Because you passed  -recover_from_error, I will try to recover."
-                " Note, however, that this might not be good in some cases. \n");
-                sm_info("The recover is that the displacement is set to 0. No result stats is output. \n");
-
-                /* For the first scan, set estimate = odometry */
-                copy_d(laser_ref->estimate, 3, laser_sens->estimate);
-                ld_free(laser_ref); laser_ref = laser_sens;
-            }
-            else
-            {
-                sm_error("One ICP matching failed. Because I process recursively, I will stop here.\n");
-                sm_error("Use the option -recover_from_error if you want to try to recover.\n");
-                ld_free(laser_ref);
-                return 2;
-            }
+            poses.push_back(&poses_a); poses.push_back(&poses_b); poses.push_back(&poses_c);
+            columns += " a_x a_y a_theta b_x b_y b_theta c_x c_y c_theta";
         }
-        else
+        else if (experiment == 3)
         {
-            /* Add the result to the previous estimate */
-            oplus_d(laser_ref->estimate, result.x, laser_sens->estimate);
-
-            old_csm_pose = new_csm_pose;
-            new_csm_pose = old_csm_pose + CPose2D(result.x[0],result.x[1],result.x[2]);
-
-            //Free reference scan, and update with the sensed one.
-            ld_free(laser_ref); laser_ref = laser_sens;
+            poses.push_back(&poses_a); poses.push_back(&poses_b); poses.push_back(&csm_poses); poses.push_back(&psm_poses);
+            columns += " a_x a_y a_theta b_x b_y b_theta csm_x csm_y csm_theta psm_x psm_y psm_theta";
         }
-
-        const float csm_t = 1000.f*clock.Tac();
-        csm_time += csm_t;
-        printf("\nCSM runtime = %f ms \n", csm_t);
-    }
-
-    void saveResults(unsigned int freq)
-    {
-        ofstream	m_fres;
-        char        aux[100];
-        int         nFile = 0;
-        bool        free_name = false;
-        string      name;
-
-        while (!free_name)
+        else if (experiment == 4)
         {
-            nFile++;
-            sprintf(aux, "results_%03u.txt", nFile );
-            name = aux;
-            free_name = !system::fileExists(name);
+            poses.push_back(&poses_a); poses.push_back(&poses_nosym);
+            columns += " a_x a_y a_theta nosym_x nosym_y nosym_theta";
         }
-        m_fres.open(aux);
 
+        const string name = CResultsWriter::freeName("results_%03u");
+        if (!results_writer.open(name, columns, RESULTS_TEXT))
+            return;
 
-        //Save freq, real_pose (x,y,theta), est_pose (x,y,theta)
+        vector<double> row(1 + 3*poses.size());
+        row[0] = freq;
         for (unsigned int i=0; i<real_poses.size(); i++)
         {
-            m_fres << freq << " ";
-            m_fres << real_poses[i][0] << " " << real_poses[i][1] << " " << real_poses[i][3] << " ";
-
-            if (experiment == 1)
+            for (unsigned int p=0; p<poses.size(); p++)
             {
-                m_fres << poses_a[i][0] << " " << poses_a[i][1] << " " << poses_a[i][3] << " ";
-                m_fres << poses_b[i][0] << " " << poses_b[i][1] << " " << poses_b[i][3] << " ";
-                m_fres << poses_c[i][0] << " " << poses_c[i][1] << " " << poses_c[i][3] << " ";
-                m_fres << poses_d[i][0] << " " << poses_d[i][1] << " " << poses_d[i][3] << " ";
+                row[1+3*p] = (*poses[p])[i][0];
+                row[2+3*p] = (*poses[p])[i][1];
+                row[3+3*p] = (*poses[p])[i][3];
             }
-            else if (experiment == 2)
-            {
-                m_fres << poses_a[i][0] << " " << poses_a[i][1] << " " << poses_a[i][3] << " ";
-                m_fres << poses_b[i][0] << " " << poses_b[i][1] << " " << poses_b[i][3] << " ";
-                m_fres << poses_c[i][0] << " " << poses_c[i][1] << " " << poses_c[i][3] << " ";
-            }
-            else if (experiment == 3)
-            {
-                m_fres << poses_a[i][0] << " " << poses_a[i][1] << " " << poses_a[i][3] << " ";
-                m_fres << poses_b[i][0] << " " << poses_b[i][1] << " " << poses_b[i][3] << " ";
-                m_fres << csm_poses[i][0] << " " << csm_poses[i][1] << " " << csm_poses[i][3] << " ";
-                m_fres << psm_poses[i][0] << " " << psm_poses[i][1] << " " << psm_poses[i][3] << " ";
-            }
-            else if (experiment == 4)
-            {
-                m_fres << poses_a[i][0] << " " << poses_a[i][1] << " " << poses_a[i][3] << " ";
-                m_fres << poses_nosym[i][0] << " " << poses_nosym[i][1] << " " << poses_nosym[i][3] << " ";
-            }
-            m_fres << "\n";
+            results_writer.add(&row[0]);
         }
+        results_writer.close();
 
-        m_fres.close();
-
-        printf("\n Results saved in file \n");
+        printf("\n Results saved in %s.txt \n", name.c_str());
     }
 
 };
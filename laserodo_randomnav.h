@@ -21,6 +21,8 @@
 #include "laser_odometry_standard.h"
 #include "laser_odometry_3scans.h"
 #include "laser_odometry_refscans.h"
+#include "laser_odometry_mrpt.h"
+#include "results_writer.h"
 
 
 using namespace mrpt;
@@ -66,6 +68,7 @@ public:
 
     //Results
     vector<CPose3D>	real_poses, est_poses, test_poses;
+    CResultsWriter   results_writer;     //Of the last saved results (written in the background, closed by saveResults)
     vector<float> aver_res, trunc_aver_res, median_res;
     float est_time, test_time;
 
@@ -377,14 +380,14 @@ public:
 		robotpose3d.y(robotSim.getY());
 		robotpose3d.setYawPitchRoll(robotSim.getPHI(),0,0);
 
-		odo.laser_pose = CPose2D(robotpose3d);
-		odo.laser_oldpose = CPose2D(robotpose3d);
+		odo.laser_pose = fromMRPT(CPose2D(robotpose3d));
+		odo.laser_oldpose = fromMRPT(CPose2D(robotpose3d));
 		odo.kai_abs.assign(0.f);
 		odo.kai_loc.assign(0.f);
 		odo.kai_loc_old.assign(0.f);
 
-		odo_test.laser_pose = CPose2D(robotpose3d);
-		odo_test.laser_oldpose = CPose2D(robotpose3d);
+		odo_test.laser_pose = fromMRPT(CPose2D(robotpose3d));
+		odo_test.laser_oldpose = fromMRPT(CPose2D(robotpose3d));
 		odo_test.kai_abs.assign(0.f);
 		odo_test.kai_loc.assign(0.f);
 		odo_test.kai_loc_old.assign(0.f);
@@ -395,10 +398,10 @@ public:
 		obj->setPose(robotpose3d);
 
         obj = scene->getByName("robot_est");
-        obj->setPose(odo.laser_pose);
+        obj->setPose(toMRPT(odo.laser_pose));
 
 		obj = scene->getByName("robot_test");
-		obj->setPose(odo_test.laser_pose);
+		obj->setPose(toMRPT(odo_test.laser_pose));
 
 
 		//Laser
@@ -489,11 +492,11 @@ public:
 
     void setRF2OPose(const CPose2D &reset_pose)
     {
-        odo.laser_pose = reset_pose;
-        odo.laser_oldpose = reset_pose;
+        odo.laser_pose = fromMRPT(reset_pose);
+        odo.laser_oldpose = fromMRPT(reset_pose);
 
-        odo_test.laser_pose = reset_pose;
-        odo_test.laser_oldpose = reset_pose;
+        odo_test.laser_pose = fromMRPT(reset_pose);
+        odo_test.laser_oldpose = fromMRPT(reset_pose);
     }
 
 	void computeErrors(unsigned int react_freq)
@@ -531,35 +534,26 @@ public:
 
     void saveResults(unsigned int freq)
     {
-        ofstream	m_fres;
-        char        aux[100];
-        int         nFile = 0;
-        bool        free_name = false;
-        string      name;
-
-        while (!free_name)
-        {
-            nFile++;
-            sprintf(aux, "results_%03u.txt", nFile );
-            name = aux;
-            free_name = !system::fileExists(name);
-        }
-        m_fres.open(aux);
-
-
         //Save freq, real_pose (x,y,theta), est_pose (x,y,theta)
+        const string name = CResultsWriter::freeName("results_%03u");
+        if (!results_writer.open(name, "freq gt_x gt_y gt_theta est_x est_y est_theta", RESULTS_TEXT))
+            return;
+
+        const vector<CPose3D> *poses[2] = {&real_poses, &est_poses};
         for (unsigned int i=0; i<real_poses.size(); i++)
         {
-            m_fres << freq << " ";
-            m_fres << real_poses[i][0] << " " << real_poses[i][1] << " " << real_poses[i][3] << " ";
-            m_fres << est_poses[i][0] << " " << est_poses[i][1] << " " << est_poses[i][3] << " ";
-           //m_fres << aver_res[i] << " " << trunc_aver_res[i] << " " << median_res[i] << " ";
-            m_fres << "\n";
+            double row[7] = {double(freq)};
+            for (unsigned int p=0; p<2; p++)
+            {
+                row[1+3*p] = (*poses[p])[i][0];
+                row[2+3*p] = (*poses[p])[i][1];
+                row[3+3*p] = (*poses[p])[i][3];
+            }
+            results_writer.add(row);
         }
+        results_writer.close();
 
-        m_fres.close();
-
-        printf("\n Results saved in file \n");
+        printf("\n Results saved in %s.txt \n", name.c_str());
     }
 };
 
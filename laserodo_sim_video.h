@@ -22,9 +22,10 @@
 #include "laser_odometry_standard.h"
 #include "laser_odometry_3scans.h"
 #include "laser_odometry_refscans.h"
-#include "polar_match.h"
-#include "csm/csm_all.h"
-//#include "csm/sm/csm/csm_all.h"
+#include "laser_odometry_mrpt.h"
+#include "scan_matcher.h"
+#include "scan_matcher_csm.h"
+#include "results_writer.h"
 
 
 using namespace mrpt;
@@ -83,27 +84,25 @@ public:
     bool draw_vp1;
 
 
-    //RF2O
-    RF2O_standard        odo;
-    RF2O_RefS       odo_test;
-
-    //Polar scan matcher
-    CPose2D     new_psm_pose, old_psm_pose;
-    PMScan      ls, ls_ref;
-    bool        matchFailed;
-
-    //Canonical scan matcher
-    sm_params params;               //Structure containing the input parameters
-    sm_result result;               //Output of the scan matching
-    LDP laser_ref, laser_sens;      //the laser scans to be matched (in the PL-ICP data structure)
-    int recover_from_error;
-    CPose2D new_csm_pose, old_csm_pose;
+    //Scan matchers (all of them get the same view of every scan)
+    ScanBearings                    bearings;
+    RF2O_Matcher<RF2O_standard>     rf2o;
+    RF2O_Matcher<RF2O_RefS>         rf2o_test;
+    PSM_Matcher                     psm;        //Its scans and workspace are allocated on the heap
+    CSM_Matcher                     csm;
+    RF2O_standard                   &odo;       //Engines of rf2o and rf2o_test (the scene draws their scans)
+    RF2O_RefS                       &odo_test;
+    MatcherRunner                   runner;
+    vector<float*>                  runner_time;    //Accumulated runtime of every matcher of the runner
 
 
     //Results
     vector<CPose3D>	real_poses, est_poses, test_poses, psm_poses, csm_poses;
+    CResultsWriter   results_writer;     //Of the last saved results (written in the background, closed by saveResults)
     float est_time, test_time, psm_time, csm_time;
 
+    CMyReactInterface() : rf2o("rf2o"), rf2o_test("rf2o_test"), odo(rf2o.odo), odo_test(rf2o_test.odo) {}
+
 	
 	bool getCurrentPoseAndSpeeds( poses::CPose2D &curPose, float &curV, float &curW)
 	{
@@ -242,15 +241,25 @@ public:
         draw_vp1 = false;
 
 
-        odo.initialize(laser.m_segments, laser.m_scan.aperture, 3);
-        odo_test.initialize(laser.m_segments, laser.m_scan.aperture, 2);
+        //Scan matchers (PSM and CSM only if they are drawn)
+        bearings.initialize(laser.m_segments, laser.m_scan.aperture);
+        rf2o.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+        rf2o_test.initialize(laser.m_segments, laser.m_scan.aperture, 2);
+        psm.initialize();
+        csm.initialize(laser.m_segments, laser.m_scan.aperture, laser.m_scan.stdError);
+        csm.params.max_iterations = 200;
+
+        runner.clear(); runner_time.clear();
+        addMatcher(rf2o, est_time);
+        addMatcher(rf2o_test, test_time);
+        if (draw_psm)   addMatcher(psm, psm_time);
+        if (draw_csm)   addMatcher(csm, csm_time);
+
+        //The scene simulates the first scan, which is the reference of every matcher
         initializeScene();
-        pm_init();          //Contains precomputed range bearings and their sines/cosines
-        Init_Params_csm();
-        loadFirstScanRF2O();
-        setRF2OPose(new_pose);
-        new_psm_pose = new_pose; old_psm_pose = new_pose;
-        new_csm_pose = new_pose; old_csm_pose = new_pose;
+        runner.setFirstScan(ScanView(laser.m_scan, bearings));
+        for (unsigned int k=0; k<runner.size(); k++)
+            runner[k].resetPose(new_pose);
         est_time = 0.f; test_time = 0.f; psm_time = 0.f; csm_time = 0.f;
     }
 
@@ -378,16 +387,6 @@ public:
 		CSimplePointsMap auxpoints;
 		senseObstacles( auxpoints );
         laser.m_scan_old = laser.m_scan;
-
-        //psm
-        pm_readScan(laser.m_scan, &ls);
-        pm_preprocessScan(&ls);
-        matchFailed = false;
-
-        //csm
-        laser_ref = cast_CObservation2DRangeScan_to_LDP(laser.m_scan);
-        // For the first scan, set estimate = odometry
-        copy_d(laser_ref->odometry, 3, laser_ref->estimate);
         //--------------------------------------------------------------------------
 
 		//The laserscan is inserted
@@ -453,7 +452,7 @@ public:
         if (draw_srf_ca)
         {
             obj = scene->getByName("robot_srf_ca");
-            obj->setPose(odo.laser_pose);
+            obj->setPose(toMRPT(odo.laser_pose));
 
             CSetOfLinesPtr traj_lines_est = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ca") );
             traj_lines_est->appendLine(odo.laser_oldpose[0], odo.laser_oldpose[1], 0.02, odo.laser_pose[0], odo.laser_pose[1], 0.02);
@@ -464,7 +463,7 @@ public:
         if (draw_srf_ma)
         {
             obj = scene->getByName("robot_srf_ma");
-            obj->setPose(odo_test.laser_pose);
+            obj->setPose(toMRPT(odo_test.laser_pose));
 
             CSetOfLinesPtr traj_lines_test = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ma") );
             traj_lines_test->appendLine(odo_test.laser_oldpose[0], odo_test.laser_oldpose[1], 0.02, odo_test.laser_pose[0], odo_test.laser_pose[1], 0.02);
@@ -475,10 +474,10 @@ public:
         if (draw_psm)
         {
             obj = scene->getByName("robot_psm");
-            obj->setPose(new_psm_pose);
+            obj->setPose(psm.pose);
 
             CSetOfLinesPtr traj_lines_psm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_psm") );
-            traj_lines_psm->appendLine(old_psm_pose[0], old_psm_pose[1], 0.02, new_psm_pose[0], new_psm_pose[1], 0.02);
+            traj_lines_psm->appendLine(psm.old_pose[0], psm.old_pose[1], 0.02, psm.pose[0], psm.pose[1], 0.02);
 //            if (traj_lines_psm->size() > max_number_lines)
 //                traj_lines_psm->removeFirstLine();
         }
@@ -486,10 +485,10 @@ public:
         if (draw_csm)
         {
             obj = scene->getByName("robot_csm");
-            obj->setPose(new_csm_pose);
+            obj->setPose(csm.pose);
 
             CSetOfLinesPtr traj_lines_csm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_csm") );
-            traj_lines_csm->appendLine(old_csm_pose[0], old_csm_pose[1], 0.02, new_csm_pose[0], new_csm_pose[1], 0.02);
+            traj_lines_csm->appendLine(csm.old_pose[0], csm.old_pose[1], 0.02, csm.pose[0], csm.pose[1], 0.02);
 //            if (traj_lines_csm->size() > max_number_lines)
 //                traj_lines_csm->removeFirstLine();
         }
@@ -546,22 +545,8 @@ public:
         robotpose3d.y(robotSim.getY());
         robotpose3d.setYawPitchRoll(robotSim.getPHI(),0,0);
 
-        odo.laser_pose = CPose2D(robotpose3d);
-        odo.laser_oldpose = CPose2D(robotpose3d);
-        odo.kai_abs.assign(0.f);
-        odo.kai_loc.assign(0.f);
-        odo.kai_loc_old.assign(0.f);
-
-        odo_test.laser_pose = CPose2D(robotpose3d);
-        odo_test.laser_oldpose = CPose2D(robotpose3d);
-        odo_test.kai_abs.assign(0.f);
-        odo_test.kai_loc.assign(0.f);
-        odo_test.kai_loc_old.assign(0.f);
-
-        new_psm_pose = CPose2D(robotpose3d);
-        old_psm_pose = CPose2D(robotpose3d);
-        new_csm_pose = CPose2D(robotpose3d);
-        old_csm_pose = CPose2D(robotpose3d);
+        for (unsigned int k=0; k<runner.size(); k++)
+            runner[k].resetPose(CPose2D(robotpose3d));
 
         //Robots
         obj = scene->getByName("robot_real");
@@ -573,7 +558,7 @@ public:
         if (draw_srf_ca)
         {
             obj = scene->getByName("robot_srf_ca");
-            obj->setPose(odo.laser_pose);
+            obj->setPose(toMRPT(odo.laser_pose));
 
             CSetOfLinesPtr traj_lines_est = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ca") );
             traj_lines_est->clear();
@@ -582,7 +567,7 @@ public:
         if (draw_srf_ma)
         {
             obj = scene->getByName("robot_srf_ma");
-            obj->setPose(odo_test.laser_pose);
+            obj->setPose(toMRPT(odo_test.laser_pose));
 
             CSetOfLinesPtr traj_lines_test = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ma") );
             traj_lines_test->clear();
@@ -591,7 +576,7 @@ public:
         if (draw_psm)
         {
             obj = scene->getByName("robot_psm");
-            obj->setPose(new_psm_pose);
+            obj->setPose(psm.pose);
 
             CSetOfLinesPtr traj_lines_psm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_psm") );
             traj_lines_psm->clear();
@@ -600,7 +585,7 @@ public:
         if (draw_csm)
         {
             obj = scene->getByName("robot_csm");
-            obj->setPose(new_csm_pose);
+            obj->setPose(csm.pose);
 
             CSetOfLinesPtr traj_lines_csm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_csm") );
             traj_lines_csm->clear();
@@ -650,43 +635,23 @@ public:
 		return navparams;
 	}
 
-    void runRF2O()
-    {
-        //Run the linear version
-        for (unsigned int i=0; i<odo.width; i++)
-            odo.range_wf(i) = laser.m_scan.scan[i];
-
-        odo.odometryCalculation();
-        est_time += odo.runtime;
-
-        //Run the robust nonlinear version
-        for (unsigned int i=0; i<odo_test.width; i++)
-            odo_test.range_wf(i) = laser.m_scan.scan[i];
-
-        odo_test.odometryCalculation();
-        test_time += odo_test.runtime;
-    }
-
-    void loadFirstScanRF2O()
+    void addMatcher(ScanMatcher &matcher, float &time)
     {
-        //Linear version
-        for (unsigned int i=0; i<odo.width; i++)
-            odo.range_wf(i) = laser.m_scan.scan[i];
-        odo.createScanPyramid();
-
-        //Nonlinear version
-        for (unsigned int i=0; i<odo_test.width; i++)
-            odo_test.range_wf(i) = laser.m_scan.scan[i];
-        odo_test.createScanPyramid();
+        runner.add(matcher);
+        runner_time.push_back(&time);
     }
 
-    void setRF2OPose(const CPose2D &reset_pose)
+    //Runs every matcher on the last scan (the new poses are read after it)
+    void runMatchers()
     {
-        odo.laser_pose = reset_pose;
-        odo.laser_oldpose = reset_pose;
+        runner.match(ScanView(laser.m_scan, bearings));
 
-        odo_test.laser_pose = reset_pose;
-        odo_test.laser_oldpose = reset_pose;
+        for (unsigned int k=0; k<runner.size(); k++)
+        {
+            *runner_time[k] += runner.lastRuntime(k);
+            printf("\n%s runtime = %f ms", runner[k].name(), runner.lastRuntime(k));
+        }
+        fflush(stdout);
     }
 
 	void computeErrors(unsigned int react_freq)
@@ -733,282 +698,22 @@ public:
         fflush(stdout);
 	}
 
-    //One of the compared methods (PSM)
-    void runPolarScanMatching()
-    {
-        //Read scans (ls and ls_ref)
-        //pm_readScan(laser.m_scan_old, &ls_ref);
-        ls_ref = ls;
-        pm_readScan(laser.m_scan, &ls);
-
-        CTicTac clock; clock.Tic();
-
-        //preprocess the new scan
-        pm_preprocessScan(&ls);
-
-
-        //Initial seed
-        if (matchFailed)
-        {
-            ls.rx = 0.f; ls_ref.rx = 0.f;
-            ls.ry = 0.f; ls_ref.ry = 0.f;
-            ls.th = 0.f; ls_ref.th = 0.f;
-        }
-        else
-        {
-            ls.rx = 100.f*new_psm_pose[1]; ls_ref.rx = 100.f*old_psm_pose[1];
-            ls.ry = 100.f*new_psm_pose[0]; ls_ref.ry = 100.f*old_psm_pose[0];
-            ls.th = new_psm_pose[2]; ls_ref.th = old_psm_pose[2];
-        }
-
-        //printf("\n Initial motion: (%f, %f, %f), (%f, %f, %f)", 0.01f*ls.rx, 0.01f*ls.ry, ls.th, 0.01f*ls_ref.rx, 0.01f*ls_ref.ry, ls_ref.th);
-
-        matchFailed = false;
-        try
-        {
-          pm_psm(&ls_ref,&ls);
-        }catch(int err)
-        {
-          cerr << "Error caught: failed match." << endl;
-          matchFailed = true;
-        }
-
-        PM_TYPE err_idx = pm_error_index2(&ls_ref,&ls);
-        //cout <<" err: "<<err_idx;
-
-        if (abs(ls.ry) > 80.f) ls.ry = 0.f;
-        if (abs(ls.rx) > 80.f) ls.rx = 0.f;
-        if (abs(ls.th) > DEG2RAD(70.f)) ls.th = 0.f;
-
-        const float psm_t = 1000.f*clock.Tac();
-        psm_time += psm_t;
-
-        printf("\nPSM runtime = %f ms", psm_t);
-        fflush(stdout);
-
-        old_psm_pose = new_psm_pose;
-        new_psm_pose = old_psm_pose + CPose2D(0.01f*ls.ry,0.01f*ls.rx,ls.th);
-    }
-
-    void Init_Params_csm()
-    {
-        params.max_angular_correction_deg = 60;             //"Maximum angular displacement between scans"
-        params.max_linear_correction = 1.0;                 //"Maximum translation between scans (m)"
-        params.max_iterations = 200;                         //"When we had enough"
-
-        params.epsilon_xy = 0.0001;                         //"A threshold for stopping (m)"
-        params.epsilon_theta = 0.0001;                      //"A threshold for stopping (rad)"
-
-        params.max_correspondence_dist = 2.0;
-        params.sigma = 0.01;                                //Noise in the scan
-
-        params.use_corr_tricks = 1;                         //"Use smart tricks for finding correspondences."
-        params.restart = 0;                                 //"Restart: Restart if error is over threshold"
-        params.restart_threshold_mean_error = 0.01;
-        params.restart_dt= 0.01;
-        params.restart_dtheta = 1.5 * 3.14 /180;
-
-        params.clustering_threshold = 0.05;                 //"Max distance for staying in the same clustering"
-        params.orientation_neighbourhood = 3;               //"Number of neighbour rays used to estimate the orientation."
-
-        params.use_point_to_line_distance = 1;              //"If 0, it's vanilla ICP."
-        params.do_alpha_test = 0;                           //"Discard correspondences based on the angles"
-        params.do_alpha_test_thresholdDeg = 20.0;           //
-
-        params.outliers_maxPerc = 0.95;
-        params.outliers_adaptive_order =0.7;
-        params.outliers_adaptive_mult=2.0;
-        params.do_visibility_test = 0;
-
-        params.outliers_remove_doubles = 1;                 //"no two points in laser_sens can have the same corr."
-        params.do_compute_covariance = 0;                   //"If 1, computes the covariance of ICP using the method http://purl.org/censi/2006/icpcov ."
-        params.debug_verify_tricks = 0;                     //"Checks that find_correspondences_tricks gives the right answer.
-
-        params.laser[0] = 0.0;                              //Pose of sensor with respect to robot: used for computing the first estimate given the odometry.
-        params.laser[1] = 0.0;
-        params.laser[2] = 0.0;
-
-        params.min_reading = 0.0;                           //Don't use readings less than min_reading (m)
-        params.max_reading = 1000.0;                        //Don't use readings longer than max_reading (m)
-
-        params.use_ml_weights = 0;                          //"If 1, the field 'true_alpha' (or 'alpha') in the first scan is used to compute the incidence beta, and the factor (1/cos^2(beta)) used to weight the correspondence.");
-        params.use_sigma_weights = 0;                       //"If 1, the field 'readings_sigma' in the second scan is used to weight the correspondence by 1/sigma^2"
-        recover_from_error = 0;
-        printf("[Init_Params]: Params structure sucessfully initialized.\n\n");
-    }
-
-    LDP cast_CObservation2DRangeScan_to_LDP(CObservation2DRangeScan &laser_obj)
-    {
-        int n;
-        n = laser_obj.scan.size();		//Num of samples (rays) of the scan laser
-
-        LDP ld = ld_alloc_new(n);       //create new structure initialized with "n" rays
-
-        ld->min_theta = -laser_obj.aperture/2;			//rad
-        ld->max_theta = laser_obj.aperture/2;			//rad
-        float angle_ray = laser_obj.aperture/(n-1);    //rad
-
-        double index_cero_angle = floor( (n-1)/2);
-
-        //scan readings
-        for (int i=0; i<n; i++)
-        {
-            if (laser_obj.validRange[i] == false)
-            {
-                ld->readings[i] = NAN;                  //*(ld->readings+i)
-                ld->valid[i] = 0;
-            }
-            else
-            {
-                ld->readings[i] = static_cast<double>(laser_obj.scan[i]);   //m
-                ld->valid[i] = 1;                       //int
-            }
-
-            ld->theta[i] = (i-index_cero_angle)*angle_ray;             //rad
-            ld->readings_sigma[i] = laser_obj.stdError;
-            ld->cluster[i] = -1;                        //No cluster selected
-        }
-
-        //To avoid failure due to precission, copy min and max theta (see ld_valid_fields)
-        ld->theta[0] = ld->min_theta;
-        ld->theta[n-1] = ld->max_theta;
-
-        //Set initial guess (odometry) to 0 (mandatory for proper funtionality)
-        ld->odometry[0] = 0.0;
-        ld->odometry[1] = 0.0;
-        ld->odometry[2] = 0.0;
-
-    /*
-        mrpt::poses::CPose3D LaserPoseOnTheRobot;
-        laser_obj.getSensorPose(LaserPoseOnTheRobot);
-        //Set the initial pose
-        laser_pose = LaserPoseOnTheRobot;
-        laser_oldpose = LaserPoseOnTheRobot;
-
-        jo_read_double_array(jo, "odometry", ld->odometry, 3, NAN);
-        jo_read_double_array(jo, "estimate", ld->estimate, 3, NAN);
-        jo_read_double_array(jo, "true_pose", ld->true_pose, 3, NAN);
-    */
-
-        double time_seconds = mrpt::system::timestampToDouble(laser_obj.timestamp);
-        double fractpart, intpart;
-        fractpart = modf(time_seconds, &intpart);
-        ld->tv.tv_sec = intpart;
-        ld->tv.tv_usec = fractpart;
-
-        if(!ld_valid_fields(ld))
-        {
-            sm_error("[Init] Invalid laser data in first scan.\n");
-            return ld;
-        }
-
-        //Structure is ready!
-        return ld;
-    }
-
-    /* Runs the PL-ICP */
-    bool runCanonicalScanMatching()
-    {
-        laser_sens = cast_CObservation2DRangeScan_to_LDP(laser.m_scan);
-        CTicTac clock; clock.Tic();
-
-        try
-        {
-            //set the scan data into the input structure
-            params.laser_ref  = laser_ref;
-            params.laser_sens = laser_sens;
-
-            // Set first guess as the difference in odometry
-            if (any_nan(params.laser_ref->odometry,3) || any_nan(params.laser_sens->odometry,3) )
-            {
-                sm_error("The 'odometry' field is set to NaN so I don't know how to get an initial guess. I usually use the difference in the odometry fields to obtain the initial guess.\n");
-                sm_error("  laser_ref->odometry = %s \n",  friendly_pose(params.laser_ref->odometry) );
-                sm_error("  laser_sens->odometry = %s \n", friendly_pose(params.laser_sens->odometry) );
-                sm_error(" I will quit it here. \n");
-                return false;
-            }
-
-            double odometry[3];
-            pose_diff_d(laser_sens->odometry, laser_ref->odometry, odometry);
-            double ominus_laser[3], temp[3];
-            ominus_d(params.laser, ominus_laser);
-            oplus_d(ominus_laser, odometry, temp);
-            oplus_d(temp, params.laser, params.first_guess);
-
-            // Do the actual work
-            sm_icp(&params, &result);
-
-        }
-        catch(exception &e)
-        {
-            cerr << "[Matching] Returning false due to exception: " << endl;
-            cerr << e.what() << endl;
-            return false;
-        }
-        catch(...)
-        {
-            cerr << "[Matching] Returning false due to unknown exception: " << endl;
-            return false;
-        }
-
-        if(!result.valid)
-        {
-            if(recover_from_error)
-            {
-                sm_info("One ICP matching failed. Because you passed  -recover_from_error, I will try to recover."
-                " Note, however, that this might not be good in some cases. \n");
-                sm_info("The recover is that the displacement is set to 0. No result stats is output. \n");
-
-                /* For the first scan, set estimate = odometry */
-                copy_d(laser_ref->estimate, 3, laser_sens->estimate);
-                ld_free(laser_ref); laser_ref = laser_sens;
-            }
-            else
-            {
-                sm_error("One ICP matching failed. Because I process recursively, I will stop here.\n");
-                sm_error("Use the option -recover_from_error if you want to try to recover.\n");
-                ld_free(laser_ref);
-                return 2;
-            }
-        }
-        else
-        {
-            /* Add the result to the previous estimate */
-            oplus_d(laser_ref->estimate, result.x, laser_sens->estimate);
-
-            old_csm_pose = new_csm_pose;
-            new_csm_pose = old_csm_pose + CPose2D(result.x[0],result.x[1],result.x[2]);
-
-            //Free reference scan, and update with the sensed one.
-            ld_free(laser_ref); laser_ref = laser_sens;
-        }
-
-        const float csm_t = 1000.f*clock.Tac();
-        csm_time += csm_t;
-        printf("\nCSM runtime = %f ms \n", csm_t);
-    }
-
     void saveScans()
     {
-        ofstream	m_fres;
-
-        m_fres.open("./scan_first.txt");
-
+        //Beam and range of the last two scans (two small files, written right away)
+        vector<double> first, second;
         for (unsigned int i=0; i<laser.m_segments; i++)
-            m_fres << i << " " << laser.m_scan.scan[i] << "\n";
-
-        m_fres.close();
-
-        m_fres.open("./scan_second.txt");
-
-        for (unsigned int i=0; i<laser.m_segments; i++)
-            m_fres << i << " " << laser.m_scan_old.scan[i] << "\n";
+        {
+            first.push_back(i); first.push_back(laser.m_scan.scan[i]);
+            second.push_back(i); second.push_back(laser.m_scan_old.scan[i]);
+        }
 
-        m_fres.close();
+        if (!CResultsWriter::saveText("./scan_first", "beam range", first) || !CResultsWriter::saveText("./scan_second", "beam range", second))
+            return;
 
         printf("\n Scans saved");
 
-        CPose2D psm_sol = new_psm_pose - old_psm_pose;
+        CPose2D psm_sol = psm.pose - psm.old_pose;
         CPose2D real_sol = new_pose - last_pose;
         cout << "\n estimated motion = " << psm_sol;
         cout << "\n real motion = " << real_sol;
@@ -1017,34 +722,26 @@ public:
 
     void saveResults(unsigned int freq)
     {
-        ofstream	m_fres;
-        char        aux[100];
-        int         nFile = 0;
-        bool        free_name = false;
-        string      name;
-
-        while (!free_name)
-        {
-            nFile++;
-            sprintf(aux, "results_%03u.txt", nFile );
-            name = aux;
-            free_name = !system::fileExists(name);
-        }
-        m_fres.open(aux);
-
-
         //Save freq, real_pose (x,y,theta), est_pose (x,y,theta)
+        const string name = CResultsWriter::freeName("results_%03u");
+        if (!results_writer.open(name, "freq gt_x gt_y gt_theta est_x est_y est_theta", RESULTS_TEXT))
+            return;
+
+        const vector<CPose3D> *poses[2] = {&real_poses, &est_poses};
         for (unsigned int i=0; i<real_poses.size(); i++)
         {
-            m_fres << freq << " ";
-            m_fres << real_poses[i][0] << " " << real_poses[i][1] << " " << real_poses[i][3] << " ";
-            m_fres << est_poses[i][0] << " " << est_poses[i][1] << " " << est_poses[i][3] << " ";
-            m_fres << "\n";
+            double row[7] = {double(freq)};
+            for (unsigned int p=0; p<2; p++)
+            {
+                row[1+3*p] = (*poses[p])[i][0];
+                row[2+3*p] = (*poses[p])[i][1];
+                row[3+3*p] = (*poses[p])[i][3];
+            }
+            results_writer.add(row);
         }
+        results_writer.close();
 
-        m_fres.close();
-
-        printf("\n Results saved in file \n");
+        printf("\n Results saved in %s.txt \n", name.c_str());
     }
 
 };
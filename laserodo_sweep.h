@@ -0,0 +1,479 @@
+/* Project: Laser odometry
+   Parameter sweep of the RF2O engines: every configuration of a grid or a random search is run on recorded
+   scan logs, in parallel on all the cores, and the configurations are ranked by their accuracy and runtime */
+
+
+#include <mrpt/utils/CConfigFileBase.h>
+#include <mrpt/poses/CPose2D.h>
+#include <mrpt/utils/CTicTac.h>
+#include <mrpt/system/string_utils.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#include "laser_odometry_standard.h"
+#include "laser_odometry_refscans.h"
+#include "laser_odometry_nosym.h"
+#include "scan_matcher.h"
+#include "scan_log.h"
+#include "results_writer.h"
+#include "trajectory_eval.h"
+
+
+using namespace mrpt;
+using namespace mrpt::utils;
+using namespace mrpt::poses;
+using namespace std;
+
+
+
+//Parameters of a sweep (section [SWEEP] of the configuration file). The configuration that is not swept is
+//read from [RF2O_PARAMS], as in the batch. The swept parameters are given in [SWEEP] with their names
+//(NONLIN_ITERS, KD...) and a list of values:
+//  - grid: all the combinations of the values
+//  - random: "num_samples" configurations with every parameter drawn between the min. and max. of its values
+//    (log-uniform if they span a factor of 10 or more). The iterations are rounded.
+
+struct TSweepConfig {
+
+    vector<string>  scanlog_files;          //Scan logs with the ground truth (see Rawlog-to-scanlog)
+    string          method;                 //rf2o, rf2o_refs or rf2o_nosym
+    unsigned int    rf2o_id;                //Version of the RF2O engines (see their initialize())
+    float           rf2o_range_step;        //[m] > 0 -> the engines take their input quantized to 16 bits
+    float           rf2o_level_step;        //[m] > 0 -> their pyramids store the downsampled levels quantized to 16 bits
+    unsigned int    decimation;             //One of every "decimation" scans is processed
+    unsigned int    odo_freq;               //[Hz] Processed scans per second: the ranking uses the errors over 1 second
+    string          search;                 //"grid" or "random"
+    unsigned int    num_samples;            //Configurations of the random search
+    unsigned int    seed;                   //Of the random search
+    unsigned int    threads;                //0 -> all the cores
+    unsigned int    top;                    //Configurations printed in every ranking
+    string          output_prefix;          //Of the table with all the configurations
+    RF2O_Params     base_params;
+    vector<string>  swept;                  //Names of the swept parameters
+    vector<vector<float> > values;          //[swept][value]
+
+    bool loadFromConfigFile(const CConfigFileBase &ini)
+    {
+        const string section = "SWEEP";
+        scanlog_files.clear();
+        mrpt::system::tokenize(ini.read_string(section, "SCANLOG_FILES", ""), " ,", scanlog_files);
+        method = ini.read_string(section, "METHOD", "rf2o");
+        rf2o_id = ini.read_int(section, "RF2O_ID", 3);
+        rf2o_range_step = ini.read_float(section, "RF2O_RANGE_STEP", 0.f);
+        rf2o_level_step = ini.read_float(section, "RF2O_LEVEL_STEP", 0.f);
+        decimation = max(ini.read_int(section, "DECIMATION", 1), 1);
+        odo_freq = max(ini.read_int(section, "ODO_FREQ", 10), 1);
+        search = ini.read_string(section, "SEARCH", "grid");
+        num_samples = ini.read_int(section, "NUM_SAMPLES", 50);
+        seed = ini.read_int(section, "SEED", 1);
+        threads = ini.read_int(section, "THREADS", 0);
+        top = ini.read_int(section, "TOP", 10);
+        output_prefix = ini.read_string(section, "OUTPUT_PREFIX", "sweep");
+
+        if ((search != "grid") && (search != "random"))
+        {
+            printf("\n Unknown search: %s (grid or random) \n", search.c_str());
+            return false;
+        }
+
+        //The parameters that are not given keep their default values
+        base_params = RF2O_Params();
+        swept.clear();
+        values.clear();
+        for (unsigned int p=0; p<RF2O_Params::size(); p++)
+        {
+            const string name = RF2O_Params::name(p);
+            const float value = ini.read_float("RF2O_PARAMS", mrpt::system::upperCase(name), base_params.get(name));
+            if (!base_params.set(name, value))
+                printf("\n Invalid value of %s: %f (the default is kept) \n", name.c_str(), value);
+
+            vector<string> tokens;
+            mrpt::system::tokenize(ini.read_string(section, mrpt::system::upperCase(name), ""), " ,", tokens);
+            if (tokens.empty())
+                continue;
+
+            //Check the values with a copy of the parameters
+            vector<float> param_values;
+            RF2O_Params check;
+            for (unsigned int v=0; v<tokens.size(); v++)
+            {
+                const float sweep_value = float(atof(tokens[v].c_str()));
+                if (!check.set(name, sweep_value))
+                {
+                    printf("\n Invalid value of the swept parameter %s: %s \n", name.c_str(), tokens[v].c_str());
+                    return false;
+                }
+                param_values.push_back(sweep_value);
+            }
+            swept.push_back(name);
+            values.push_back(param_values);
+        }
+        return true;
+    }
+};
+
+
+//Results of one configuration (averages over the scan logs)
+
+struct TSweepResult {
+
+    RF2O_Params     params;
+    double          ms_per_scan;
+    double          rpe_trans, rpe_rot;     //[m], [rad] RMSE over 1 second
+    double          ate_rmse;               //[m]
+    double          final_drift;            //[m]
+    bool            pareto;                 //No other configuration is more accurate and faster
+
+    TSweepResult() : ms_per_scan(0.0), rpe_trans(0.0), rpe_rot(0.0), ate_rmse(0.0), final_drift(0.0), pareto(false) {}
+};
+
+
+
+//Every scan log is mapped once and shared (read-only) by all the threads, as is its ground truth. The jobs (one
+//configuration on one scan log) are spread over the threads, and each job has its own engine. The runtimes are
+//measured with all the cores busy, so they are comparable between configurations but slower than those of a
+//single run.
+
+class CLaserodoSweep
+{
+public:
+
+    TSweepConfig            config;
+    vector<TSweepResult>    results;        //[configuration]
+
+    CLaserodoSweep() {}
+    ~CLaserodoSweep() { closeLogs(); }
+
+    bool run(const CConfigFileBase &ini)
+    {
+        if (!config.loadFromConfigFile(ini) || !openLogs())
+            return false;
+
+        if ((config.method != "rf2o") && (config.method != "rf2o_refs") && (config.method != "rf2o_nosym"))
+        {
+            printf("\n Unknown method: %s (rf2o, rf2o_refs or rf2o_nosym) \n", config.method.c_str());
+            return false;
+        }
+
+        buildConfigurations();
+        if (results.empty())
+            return false;
+
+        const unsigned int num_logs = logs.size();
+        const int num_jobs = int(results.size()*num_logs);
+        vector<TSweepResult> job_results(num_jobs);
+        printf("\n [Sweep] %u configurations x %u scan logs", unsigned(results.size()), num_logs);
+        fflush(stdout);
+
+#ifdef _OPENMP
+        if (config.threads > 0)
+            omp_set_num_threads(config.threads);
+        #pragma omp parallel for schedule(dynamic, 1)
+#endif
+        for (int j = 0; j < num_jobs; j++)
+            runJob(results[j/num_logs].params, j%num_logs, job_results[j]);
+
+        //Average over the scan logs
+        for (unsigned int c=0; c<results.size(); c++)
+        {
+            TSweepResult &res = results[c];
+            for (unsigned int l=0; l<num_logs; l++)
+            {
+                const TSweepResult &job = job_results[c*num_logs + l];
+                res.ms_per_scan += job.ms_per_scan/num_logs;
+                res.rpe_trans += job.rpe_trans/num_logs;
+                res.rpe_rot += job.rpe_rot/num_logs;
+                res.ate_rmse += job.ate_rmse/num_logs;
+                res.final_drift += job.final_drift/num_logs;
+            }
+        }
+
+        //Pareto front of accuracy (RPE) and runtime
+        for (unsigned int c=0; c<results.size(); c++)
+        {
+            results[c].pareto = true;
+            for (unsigned int d=0; d<results.size(); d++)
+                if ((results[d].rpe_trans <= results[c].rpe_trans) && (results[d].ms_per_scan <= results[c].ms_per_scan)
+                    && ((results[d].rpe_trans < results[c].rpe_trans) || (results[d].ms_per_scan < results[c].ms_per_scan)))
+                {
+                    results[c].pareto = false;
+                    break;
+                }
+        }
+
+        return true;
+    }
+
+    //Rankings by accuracy (RPE over 1 second, then ATE) and by runtime, and the Pareto front
+    void printRankings() const
+    {
+        vector<unsigned int> by_accuracy, by_runtime;
+        rankings(by_accuracy, by_runtime);
+
+        const unsigned int top = min<unsigned int>(config.top, results.size());
+        printf("\n\n Most accurate configurations (RPE over 1 second): \n");
+        for (unsigned int r=0; r<top; r++)
+            printConfiguration(r, by_accuracy[r]);
+
+        printf("\n Fastest configurations: \n");
+        for (unsigned int r=0; r<top; r++)
+            printConfiguration(r, by_runtime[r]);
+
+        printf("\n Pareto front (accuracy vs runtime): \n");
+        for (unsigned int r=0, k=0; r<by_runtime.size(); r++)
+            if (results[by_runtime[r]].pareto)
+                printConfiguration(k++, by_runtime[r]);
+        printf("\n");
+    }
+
+    //Table with all the configurations (most accurate first): index, all the parameters and the results
+    bool saveResults() const
+    {
+        vector<unsigned int> by_accuracy, by_runtime;
+        rankings(by_accuracy, by_runtime);
+
+        vector<string> columns(1, "config");
+        for (unsigned int p=0; p<RF2O_Params::size(); p++)
+            columns.push_back(RF2O_Params::name(p));
+        columns.push_back("ms_per_scan");
+        columns.push_back("rpe_trans");
+        columns.push_back("rpe_rot_deg");
+        columns.push_back("ate_rmse");
+        columns.push_back("final_drift");
+        columns.push_back("pareto");
+
+        CResultsWriter writer;
+        if (!writer.open(config.output_prefix, columns, RESULTS_TEXT))
+        {
+            printf("\n The results could not be saved in %s.txt \n", config.output_prefix.c_str());
+            return false;
+        }
+
+        vector<double> row(columns.size());
+        for (unsigned int r=0; r<by_accuracy.size(); r++)
+        {
+            const TSweepResult &res = results[by_accuracy[r]];
+            unsigned int col = 0;
+            row[col++] = by_accuracy[r];
+            for (unsigned int p=0; p<RF2O_Params::size(); p++)
+                row[col++] = res.params.get(RF2O_Params::name(p));
+            row[col++] = res.ms_per_scan;
+            row[col++] = res.rpe_trans;
+            row[col++] = 57.3*res.rpe_rot;
+            row[col++] = res.ate_rmse;
+            row[col++] = res.final_drift;
+            row[col++] = res.pareto ? 1.0 : 0.0;
+            writer.add(&row[0]);
+        }
+        writer.close();
+        printf(" Results saved in %s.txt \n", config.output_prefix.c_str());
+        return true;
+    }
+
+private:
+
+    vector<CScanLogReader*>         logs;
+    vector<ScanBearings>            bearings;       //[log]
+    vector<vector<CPose2D> >        gt_poses;       //[log][processed scan]
+    vector<CTrajectoryEvaluator>    evaluators;     //[log]
+
+    bool openLogs()
+    {
+        closeLogs();
+        if (config.scanlog_files.empty())
+        {
+            printf("\n No scan log given (SCANLOG_FILES) \n");
+            return false;
+        }
+
+        for (unsigned int l=0; l<config.scanlog_files.size(); l++)
+        {
+            const string &filename = config.scanlog_files[l];
+            logs.push_back(new CScanLogReader);
+            CScanLogReader &log = *logs.back();
+            if (!log.open(filename) || (log.size() == 0))
+            {
+                printf("\n Couldn't read any scan from the scan log %s \n", filename.c_str());
+                return false;
+            }
+
+            //Ground truth of the processed scans (the last one given, as in the batch)
+            vector<CPose2D> gt;
+            bool has_groundtruth = false;
+            CPose2D gt_pose;
+            for (size_t i = 0; i < log.size(); i++)
+            {
+                if (log.hasOdometry(i))
+                {
+                    gt_pose = log.odometry(i);
+                    has_groundtruth = true;
+                }
+                if (i % config.decimation == 0)
+                    gt.push_back(gt_pose);
+            }
+
+            if (!has_groundtruth || (gt.size() <= config.odo_freq))
+            {
+                printf("\n The scan log %s has no ground truth or less than 1 second of scans \n", filename.c_str());
+                return false;
+            }
+
+            bearings.push_back(ScanBearings());
+            bearings.back().initialize(log.info().beams, log.info().aperture);
+            gt_poses.push_back(gt);
+            evaluators.push_back(CTrajectoryEvaluator(vector<TEvalHorizon>(1, TEvalHorizon(TEvalHorizon::SCANS, config.odo_freq))));
+            evaluators.back().setGroundTruth(gt_poses.back());
+        }
+        return true;
+    }
+
+    void closeLogs()
+    {
+        for (unsigned int l=0; l<logs.size(); l++)
+            delete logs[l];
+        logs.clear();
+        bearings.clear();
+        gt_poses.clear();
+        evaluators.clear();
+    }
+
+    void buildConfigurations()
+    {
+        results.clear();
+        if (config.search == "grid")
+        {
+            //All the combinations (the first parameter changes fastest)
+            size_t num_configs = 1;
+            for (unsigned int s=0; s<config.swept.size(); s++)
+                num_configs *= config.values[s].size();
+
+            for (size_t c=0; c<num_configs; c++)
+            {
+                TSweepResult res;
+                res.params = config.base_params;
+                size_t index = c;
+                for (unsigned int s=0; s<config.swept.size(); s++)
+                {
+                    res.params.set(config.swept[s], config.values[s][index % config.values[s].size()]);
+                    index /= config.values[s].size();
+                }
+                results.push_back(res);
+            }
+        }
+        else
+        {
+            std::srand(config.seed);
+            for (unsigned int c=0; c<config.num_samples; c++)
+            {
+                TSweepResult res;
+                res.params = config.base_params;
+                for (unsigned int s=0; s<config.swept.size(); s++)
+                {
+                    const float min_value = *min_element(config.values[s].begin(), config.values[s].end());
+                    const float max_value = *max_element(config.values[s].begin(), config.values[s].end());
+                    const float t = float(std::rand())/float(RAND_MAX);
+                    const float value = (max_value >= 10.f*min_value) ? min_value*powf(max_value/min_value, t)
+                                                                      : min_value + t*(max_value - min_value);
+                    res.params.set(config.swept[s], value);
+                }
+                results.push_back(res);
+            }
+        }
+
+        if (results.empty())
+            printf("\n No configuration to run \n");
+    }
+
+    ScanMatcher *newMatcher(const TScanLogHeader &info, const RF2O_Params &params) const
+    {
+        if (config.method == "rf2o_refs")
+            return newRF2O<RF2O_RefS>("rf2o_refs", info, params);
+        else if (config.method == "rf2o_nosym")
+            return newRF2O<RF2O_nosym>("rf2o_nosym", info, params);
+        else
+            return newRF2O<RF2O_standard>("rf2o", info, params);
+    }
+
+    template <class Engine>
+    ScanMatcher *newRF2O(const char *name, const TScanLogHeader &info, const RF2O_Params &params) const
+    {
+        RF2O_Matcher<Engine> *rf2o = new RF2O_Matcher<Engine>(name);
+        rf2o->initialize(info.beams, info.aperture, config.rf2o_id);
+        rf2o->odo.range_step = config.rf2o_range_step;
+        rf2o->odo.pyramid.level_step = config.rf2o_level_step;
+        rf2o->odo.params = params;
+        rf2o->odo.verbose = false;    //Jobs run in parallel and their runtimes are ranked: no prints
+        return rf2o;
+    }
+
+    //Runs one configuration on one scan log (called from several threads: it only reads the shared members)
+    void runJob(const RF2O_Params &params, unsigned int l, TSweepResult &res) const
+    {
+        const CScanLogReader &log = *logs[l];
+        ScanMatcher *matcher = newMatcher(log.info(), params);
+
+        //The quantized ranges are only widened if the engine does not take them as they are
+        vector<float> widened(log.info().beams);
+        float *widen = (config.rf2o_range_step == log.info().range_step) ? NULL : &widened[0];
+
+        vector<CPose2D> poses;
+        poses.reserve(gt_poses[l].size());
+        matcher->setFirstScan(log.scan(0, bearings[l], widen));
+        matcher->resetPose(gt_poses[l][0]);
+        poses.push_back(matcher->pose);
+
+        CTicTac clock;
+        double runtime = 0.0;
+        for (size_t i = config.decimation; i < log.size(); i += config.decimation)
+        {
+            const ScanView scan = log.scan(i, bearings[l], widen);
+            clock.Tic();
+            matcher->match(scan);
+            runtime += clock.Tac();
+            poses.push_back(matcher->pose);
+        }
+        delete matcher;
+
+        const TEvalResult eval = evaluators[l].evaluate(config.method, poses);
+        res.ms_per_scan = 1000.0*runtime/max<size_t>(poses.size() - 1, 1);
+        res.rpe_trans = eval.rpe[0].rmse_trans;
+        res.rpe_rot = eval.rpe[0].rmse_rot;
+        res.ate_rmse = eval.ate.rmse;
+        res.final_drift = eval.ate.final_drift;
+    }
+
+    void rankings(vector<unsigned int> &by_accuracy, vector<unsigned int> &by_runtime) const
+    {
+        vector<pair<pair<double, double>, unsigned int> > accuracy, runtime;
+        for (unsigned int c=0; c<results.size(); c++)
+        {
+            accuracy.push_back(make_pair(make_pair(results[c].rpe_trans, results[c].ate_rmse), c));
+            runtime.push_back(make_pair(make_pair(results[c].ms_per_scan, results[c].rpe_trans), c));
+        }
+        sort(accuracy.begin(), accuracy.end());
+        sort(runtime.begin(), runtime.end());
+
+        by_accuracy.clear();
+        by_runtime.clear();
+        for (unsigned int c=0; c<results.size(); c++)
+        {
+            by_accuracy.push_back(accuracy[c].second);
+            by_runtime.push_back(runtime[c].second);
+        }
+    }
+
+    void printConfiguration(unsigned int rank, unsigned int c) const
+    {
+        const TSweepResult &res = results[c];
+        printf(" %3u. [%u] RPE = %f m, %f deg, ATE = %f m, drift = %f m, %f ms/scan |", rank + 1, c, res.rpe_trans, 57.3*res.rpe_rot,
+               res.ate_rmse, res.final_drift, res.ms_per_scan);
+        for (unsigned int s=0; s<config.swept.size(); s++)
+            printf(" %s=%g", config.swept[s].c_str(), res.params.get(config.swept[s]));
+        printf("\n");
+    }
+};
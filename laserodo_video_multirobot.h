@@ -25,9 +25,10 @@
 #include "laser_odometry_standard.h"
 #include "laser_odometry_3scans.h"
 #include "laser_odometry_refscans.h"
-#include "polar_match.h"
-#include "csm/csm_all.h"
-//#include "csm/sm/csm/csm_all.h"
+#include "scan_matcher.h"
+#include "scan_matcher_csm.h"
+#include "rawlog_stream.h"
+#include "results_writer.h"
 
 
 using namespace mrpt;
@@ -39,7 +40,6 @@ using namespace mrpt::obs;
 using namespace mrpt::gui;
 using namespace mrpt::poses;
 using namespace mrpt::math;
-using namespace CSM;
 using namespace std;
 
 
@@ -67,7 +67,7 @@ public:
 
     //Rawlog
     unsigned int num_robots;
-    CRawlog  dataset[8];
+    CRawlogStream  dataset[8];     //All the robots are streamed at once
     unsigned int rawlog_count[8];
     unsigned int rawlog_ini, rawlog_end;
     bool dataset_finished[8];
@@ -86,28 +86,28 @@ public:
 
 
     //RF2O
-    RF2O_standard       odo;
-    RF2O_RefS           odo_test;
-    RF2O_RefS           odo_KA;
+    RF2O_Matcher<RF2O_standard>     rf2o;           //CA
+    RF2O_Matcher<RF2O_RefS>         rf2o_test;      //MA
+    RF2O_Matcher<RF2O_RefS>         rf2o_KA;        //KA
 
-    //Polar scan matcher
-    CPose2D     new_psm_pose, old_psm_pose;
-    PMScan      ls, ls_ref;
-    bool        matchFailed;
+    //Compared methods
+    PSM_Matcher     psm;            //Polar scan matcher
+    CSM_Matcher     csm;            //Canonical scan matcher (PL-ICP)
 
-    //Canonical scan matcher
-    sm_params params;               //Structure containing the input parameters
-    sm_result result;               //Output of the scan matching
-    LDP laser_ref, laser_sens;      //the laser scans to be matched (in the PL-ICP data structure)
-    int recover_from_error;
-    CPose2D new_csm_pose, old_csm_pose;
+    //All the methods are run on every scan
+    ScanBearings    bearings;
+    MatcherRunner   runner;
 
 
     //Results
     vector<CPose3D>	real_poses, est_poses, test_poses, KA_poses, psm_poses, csm_poses;
+    CResultsWriter   results_writer;     //Of the last saved results (written in the background, closed by saveResults)
     float est_time, test_time, KA_time, psm_time, csm_time;
 
 
+    CMyReactInterface() : rf2o("rf2o"), rf2o_test("rf2o_test"), rf2o_KA("rf2o_KA") {}
+
+
     void openRawlogs()
     {
         string folder;
@@ -129,8 +129,12 @@ public:
 
             rawlog_count[r] = rawlog_ini;
             dataset_finished[r] = false;
-            if (!dataset[r].loadFromRawLogFile(filename[r]))
+            dataset[r].first_entry = rawlog_ini;
+            if (!dataset[r].open(filename[r]))
+            {
                 printf("\nCouldn't open rawlog file %d...", r);
+                dataset_finished[r] = true;
+            }
         }
     }
 
@@ -141,14 +145,19 @@ public:
             if (dataset_finished[r])
                 continue;
 
-            CObservationPtr alfa = dataset[r].getAsObservation(rawlog_count[r]);
+            TRawlogEvent event;
+            if (!dataset[r].next(event))
+            {
+                dataset_finished[r] = true;
+                continue;
+            }
 
-            if (IS_CLASS(alfa, CObservation2DRangeScan))
+            if (event.type == TRawlogEvent::SCAN)
             {
                 //Read the laser for the first robot
                 if (r == 0)
                 {
-//                    CObservation2DRangeScanPtr obs2D = CObservation2DRangeScanPtr(alfa);
+//                    CObservation2DRangeScanPtr obs2D = CObservation2DRangeScanPtr(event.obs);
 
 //                    laser.m_scan_old = laser.m_scan;
 //                    laser.m_scan = *obs2D;
@@ -161,31 +170,20 @@ public:
 //                        else
 //                            laser.m_scan.validRange[i] = true;
                 }
-
-
-                rawlog_count[r]++;
-                if ((rawlog_end <= rawlog_count[r])||(dataset[r].size() <= rawlog_count[r]))
-                {
-                    dataset_finished[r] = true;
-                    return;
-                }
-
-                //alfa = dataset[r].getAsObservation(rawlog_count[r]);
             }
 
 
-            if (IS_CLASS(alfa, CObservationOdometry))
+            if (event.type == TRawlogEvent::ODOMETRY)
             {
-                CObservationOdometryPtr obs_odo = CObservationOdometryPtr(alfa);
+                CObservationOdometryPtr obs_odo = CObservationOdometryPtr(event.obs);
 
                 //robot_pose[r] = ini_pose[r] + obs_odo->odometry;
                 robot_pose[r] = map_disp + obs_odo->odometry;
-
-                rawlog_count[r]++;
-
-                if ((rawlog_end <= rawlog_count[r])||(dataset[r].size() <= rawlog_count[r]))
-                    dataset_finished[r] = true;
             }
+
+            rawlog_count[r] = dataset[r].entriesRead();
+            if ((rawlog_end <= rawlog_count[r])||(dataset[r].finished()))
+                dataset_finished[r] = true;
         }
 
         new_pose = robot_pose[0];
@@ -349,19 +347,27 @@ public:
 //        }
 
 
-        odo.initialize(laser.m_segments, laser.m_scan.aperture, 3);
-        odo_test.initialize(laser.m_segments, laser.m_scan.aperture, 2);
-        odo_KA.initialize(laser.m_segments, laser.m_scan.aperture, 1);
-        pm_init();          //Contains precomputed range bearings and their sines/cosines
-        Init_Params_csm();
+        bearings.initialize(laser.m_segments, laser.m_scan.aperture);
+        rf2o.initialize(laser.m_segments, laser.m_scan.aperture, 3);
+        rf2o_test.initialize(laser.m_segments, laser.m_scan.aperture, 2);
+        rf2o_KA.initialize(laser.m_segments, laser.m_scan.aperture, 1);
+        psm.initialize();
+        csm.initialize(laser.m_segments, laser.m_scan.aperture, laser.m_scan.stdError);
+
+        runner.clear();
+        runner.add(rf2o);
+        runner.add(rf2o_test);
+        runner.add(rf2o_KA);
+        runner.add(psm);
+        runner.add(csm);
 
 
         //Reset poses
         new_pose = robot_pose[0];
         last_pose = robot_pose[0];
-        setRF2OPose(new_pose);
-        new_psm_pose = new_pose; old_psm_pose = new_pose;
-        new_csm_pose = new_pose; old_csm_pose = new_pose;
+        setMatchersPose(new_pose);
+        est_time = 0.f; test_time = 0.f; KA_time = 0.f;
+        psm_time = 0.f; csm_time = 0.f;
 
         //Scene
         initializeScene();
@@ -521,17 +527,7 @@ public:
         CSimplePointsMap auxpoints;
         senseObstacles( auxpoints );
         laser.m_scan_old = laser.m_scan;
-        loadFirstScanRF2O();
-
-        //psm
-        pm_readScan(laser.m_scan, &ls);
-        pm_preprocessScan(&ls);
-        matchFailed = false;
-
-        //csm
-        laser_ref = cast_CObservation2DRangeScan_to_LDP(laser.m_scan);
-        // For the first scan, set estimate = odometry
-        copy_d(laser_ref->odometry, 3, laser_ref->estimate);
+        runner.setFirstScan(ScanView(laser.m_scan, bearings));
         //--------------------------------------------------------------------------
 
 		//The laserscan is inserted
@@ -575,10 +571,10 @@ public:
         if (draw_srf_ca)
         {
             obj = scene->getByName("robot_srf_ca");
-            obj->setPose(odo.laser_pose);
+            obj->setPose(rf2o.pose);
 
             CSetOfLinesPtr traj_lines_est = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ca") );
-            traj_lines_est->appendLine(odo.laser_oldpose[0], odo.laser_oldpose[1], 0.02, odo.laser_pose[0], odo.laser_pose[1], 0.02);
+            traj_lines_est->appendLine(rf2o.old_pose[0], rf2o.old_pose[1], 0.02, rf2o.pose[0], rf2o.pose[1], 0.02);
 //            if (traj_lines_est->size() > max_number_lines)
 //                traj_lines_est->removeFirstLine();
         }
@@ -586,10 +582,10 @@ public:
         if (draw_srf_ma)
         {
             obj = scene->getByName("robot_srf_ma");
-            obj->setPose(odo_test.laser_pose);
+            obj->setPose(rf2o_test.pose);
 
             CSetOfLinesPtr traj_lines_test = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ma") );
-            traj_lines_test->appendLine(odo_test.laser_oldpose[0], odo_test.laser_oldpose[1], 0.02, odo_test.laser_pose[0], odo_test.laser_pose[1], 0.02);
+            traj_lines_test->appendLine(rf2o_test.old_pose[0], rf2o_test.old_pose[1], 0.02, rf2o_test.pose[0], rf2o_test.pose[1], 0.02);
 //            if (traj_lines_test->size() > max_number_lines)
 //                traj_lines_test->removeFirstLine();
         }
@@ -597,10 +593,10 @@ public:
         if (draw_srf_ka)
         {
             obj = scene->getByName("robot_srf_ka");
-            obj->setPose(odo_KA.laser_pose);
+            obj->setPose(rf2o_KA.pose);
 
             CSetOfLinesPtr traj_lines_ka = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ka") );
-            traj_lines_ka->appendLine(odo_KA.laser_oldpose[0], odo_KA.laser_oldpose[1], 0.02, odo_KA.laser_pose[0], odo_KA.laser_pose[1], 0.02);
+            traj_lines_ka->appendLine(rf2o_KA.old_pose[0], rf2o_KA.old_pose[1], 0.02, rf2o_KA.pose[0], rf2o_KA.pose[1], 0.02);
 //            if (traj_lines_test->size() > max_number_lines)
 //                traj_lines_test->removeFirstLine();
         }
@@ -608,10 +604,10 @@ public:
         if (draw_psm)
         {
             obj = scene->getByName("robot_psm");
-            obj->setPose(new_psm_pose);
+            obj->setPose(psm.pose);
 
             CSetOfLinesPtr traj_lines_psm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_psm") );
-            traj_lines_psm->appendLine(old_psm_pose[0], old_psm_pose[1], 0.02, new_psm_pose[0], new_psm_pose[1], 0.02);
+            traj_lines_psm->appendLine(psm.old_pose[0], psm.old_pose[1], 0.02, psm.pose[0], psm.pose[1], 0.02);
 //            if (traj_lines_psm->size() > max_number_lines)
 //                traj_lines_psm->removeFirstLine();
         }
@@ -619,15 +615,15 @@ public:
         if (draw_csm)
         {
             obj = scene->getByName("robot_csm");
-            obj->setPose(new_csm_pose);
+            obj->setPose(csm.pose);
 
             CSetOfLinesPtr traj_lines_csm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_csm") );
-            traj_lines_csm->appendLine(old_csm_pose[0], old_csm_pose[1], 0.02, new_csm_pose[0], new_csm_pose[1], 0.02);
+            traj_lines_csm->appendLine(csm.old_pose[0], csm.old_pose[1], 0.02, csm.pose[0], csm.pose[1], 0.02);
 //            if (traj_lines_csm->size() > max_number_lines)
 //                traj_lines_csm->removeFirstLine();
         }
 
-        const unsigned int repr_level = round(log2(round(float(odo.width)/float(odo.cols))));
+        const unsigned int repr_level = round(log2(round(float(rf2o.odo.width)/float(rf2o.odo.cols))));
 
         //Laser
         CPose3D laserpose(0, 0, 0, 0, 0, 0);
@@ -635,9 +631,9 @@ public:
         CPointCloudColouredPtr gl_laser;
         gl_laser = scene->getByClass<CPointCloudColoured> (0);
         gl_laser->clear();
-        for (unsigned int u=0; u<odo.cols; u++)
-            if (odo.null(u) == false)
-                gl_laser->push_back(odo.xx[repr_level](u), odo.yy[repr_level](u), 0.f, 1.f, 0.f, 0.f);
+        for (unsigned int u=0; u<rf2o.odo.cols; u++)
+            if (rf2o.odo.null(u) == false)
+                gl_laser->push_back(rf2o.odo.xx[repr_level](u), rf2o.odo.yy[repr_level](u), 0.f, 1.f, 0.f, 0.f);
 
         gl_laser->setPose(robot_pose[0] + laserpose);
 
@@ -655,28 +651,7 @@ public:
         robotpose3d.y(robotSim.getY());
         robotpose3d.setYawPitchRoll(robotSim.getPHI(),0,0);
 
-        odo.laser_pose = CPose2D(robotpose3d);
-        odo.laser_oldpose = CPose2D(robotpose3d);
-        odo.kai_abs.assign(0.f);
-        odo.kai_loc.assign(0.f);
-        odo.kai_loc_old.assign(0.f);
-
-        odo_test.laser_pose = CPose2D(robotpose3d);
-        odo_test.laser_oldpose = CPose2D(robotpose3d);
-        odo_test.kai_abs.assign(0.f);
-        odo_test.kai_loc.assign(0.f);
-        odo_test.kai_loc_old.assign(0.f);
-
-        odo_KA.laser_pose = CPose2D(robotpose3d);
-        odo_KA.laser_oldpose = CPose2D(robotpose3d);
-        odo_KA.kai_abs.assign(0.f);
-        odo_KA.kai_loc.assign(0.f);
-        odo_KA.kai_loc_old.assign(0.f);
-
-        new_psm_pose = CPose2D(robotpose3d);
-        old_psm_pose = CPose2D(robotpose3d);
-        new_csm_pose = CPose2D(robotpose3d);
-        old_csm_pose = CPose2D(robotpose3d);
+        setMatchersPose(CPose2D(robotpose3d));
 
         //Robots
         obj = scene->getByName("robot_real");
@@ -688,7 +663,7 @@ public:
         if (draw_srf_ca)
         {
             obj = scene->getByName("robot_srf_ca");
-            obj->setPose(odo.laser_pose);
+            obj->setPose(rf2o.pose);
 
             CSetOfLinesPtr traj_lines_est = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ca") );
             traj_lines_est->clear();
@@ -697,7 +672,7 @@ public:
         if (draw_srf_ma)
         {
             obj = scene->getByName("robot_srf_ma");
-            obj->setPose(odo_test.laser_pose);
+            obj->setPose(rf2o_test.pose);
 
             CSetOfLinesPtr traj_lines_test = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ma") );
             traj_lines_test->clear();
@@ -706,7 +681,7 @@ public:
         if (draw_srf_ka)
         {
             obj = scene->getByName("robot_srf_ka");
-            obj->setPose(odo_KA.laser_pose);
+            obj->setPose(rf2o_KA.pose);
 
             CSetOfLinesPtr traj_lines_ka = static_cast<CSetOfLinesPtr>( scene->getByName("traj_srf_ka") );
             traj_lines_ka->clear();
@@ -715,7 +690,7 @@ public:
         if (draw_psm)
         {
             obj = scene->getByName("robot_psm");
-            obj->setPose(new_psm_pose);
+            obj->setPose(psm.pose);
 
             CSetOfLinesPtr traj_lines_psm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_psm") );
             traj_lines_psm->clear();
@@ -724,7 +699,7 @@ public:
         if (draw_csm)
         {
             obj = scene->getByName("robot_csm");
-            obj->setPose(new_csm_pose);
+            obj->setPose(csm.pose);
 
             CSetOfLinesPtr traj_lines_csm = static_cast<CSetOfLinesPtr>( scene->getByName("traj_csm") );
             traj_lines_csm->clear();
@@ -732,15 +707,15 @@ public:
 
 
         //Laser
-        const unsigned int repr_level = round(log2(round(float(odo.width)/float(odo.cols))));
+        const unsigned int repr_level = round(log2(round(float(rf2o.odo.width)/float(rf2o.odo.cols))));
 
         CPose3D laserpose;
         laser.m_scan.getSensorPose(laserpose);
         CPointCloudColouredPtr gl_laser;
         gl_laser = scene->getByClass<CPointCloudColoured> (0);
         gl_laser->clear();
-        for (unsigned int i=0; i<odo.cols; i++)
-            gl_laser->push_back(odo.xx[repr_level](i), odo.yy[repr_level](i), 0.1, 1-sqrt(odo.weights(i)), sqrt(odo.weights(i)), 0);
+        for (unsigned int i=0; i<rf2o.odo.cols; i++)
+            gl_laser->push_back(rf2o.odo.xx[repr_level](i), rf2o.odo.yy[repr_level](i), 0.1, 1-sqrt(rf2o.odo.weights(i)), sqrt(rf2o.odo.weights(i)), 0);
 
         gl_laser->setPose(robotpose3d + laserpose);
 
@@ -768,58 +743,31 @@ public:
 //		return navparams;
 //	}
 
-    void runRF2O()
+    //Runs all the methods on the last scan (concurrently unless runner.concurrent is false)
+    void runMatchers()
     {
-        //Run CA
-        for (unsigned int i=0; i<odo.width; i++)
-            odo.range_wf(i) = laser.m_scan.scan[i];
-
-        odo.odometryCalculation();
-        est_time += odo.runtime;
-
-        //Run MA
-        for (unsigned int i=0; i<odo_test.width; i++)
-            odo_test.range_wf(i) = laser.m_scan.scan[i];
-
-        odo_test.odometryCalculation();
-        test_time += odo_test.runtime;
+        runner.match(ScanView(laser.m_scan, bearings));
 
-        //Run KA
-        for (unsigned int i=0; i<odo.width; i++)
-            odo_KA.range_wf(i) = laser.m_scan.scan[i];
+        for (unsigned int k=0; k<runner.size(); k++)
+        {
+            const ScanMatcher *matcher = &runner[k];
+            const float runtime = runner.lastRuntime(k);
 
-        odo_KA.odometryCalculation();
-        KA_time += odo.runtime;
-    }
+            if (matcher == &rf2o)               est_time += runtime;
+            else if (matcher == &rf2o_test)     test_time += runtime;
+            else if (matcher == &rf2o_KA)       KA_time += runtime;
+            else if (matcher == &psm)           psm_time += runtime;
+            else if (matcher == &csm)           csm_time += runtime;
 
-    void loadFirstScanRF2O()
-    {
-        //CA
-        for (unsigned int i=0; i<odo.width; i++)
-            odo.range_wf(i) = laser.m_scan.scan[i];
-        odo.createScanPyramid();
-
-        //MA
-        for (unsigned int i=0; i<odo_test.width; i++)
-            odo_test.range_wf(i) = laser.m_scan.scan[i];
-        odo_test.createScanPyramid();
-
-        //KA
-        for (unsigned int i=0; i<odo_test.width; i++)
-            odo_KA.range_wf(i) = laser.m_scan.scan[i];
-        odo_KA.createScanPyramid();
+            printf("\n%s runtime = %f ms", matcher->name(), runtime);
+        }
+        fflush(stdout);
     }
 
-    void setRF2OPose(const CPose2D &reset_pose)
+    void setMatchersPose(const CPose2D &reset_pose)
     {
-        odo.laser_pose = reset_pose;
-        odo.laser_oldpose = reset_pose;
-
-        odo_test.laser_pose = reset_pose;
-        odo_test.laser_oldpose = reset_pose;
-
-        odo_KA.laser_pose = reset_pose;
-        odo_KA.laser_oldpose = reset_pose;
+        for (unsigned int k=0; k<runner.size(); k++)
+            runner[k].resetPose(reset_pose);
     }
 
 	void computeErrors(unsigned int react_freq)
@@ -887,282 +835,22 @@ public:
         fflush(stdout);
 	}
 
-    //One of the compared methods (PSM)
-    void runPolarScanMatching()
-    {
-        //Read scans (ls and ls_ref)
-        //pm_readScan(laser.m_scan_old, &ls_ref);
-        ls_ref = ls;
-        pm_readScan(laser.m_scan, &ls);
-
-        CTicTac clock; clock.Tic();
-
-        //preprocess the new scan
-        pm_preprocessScan(&ls);
-
-
-        //Initial seed
-        if (matchFailed)
-        {
-            ls.rx = 0.f; ls_ref.rx = 0.f;
-            ls.ry = 0.f; ls_ref.ry = 0.f;
-            ls.th = 0.f; ls_ref.th = 0.f;
-        }
-        else
-        {
-            ls.rx = 100.f*new_psm_pose[1]; ls_ref.rx = 100.f*old_psm_pose[1];
-            ls.ry = 100.f*new_psm_pose[0]; ls_ref.ry = 100.f*old_psm_pose[0];
-            ls.th = new_psm_pose[2]; ls_ref.th = old_psm_pose[2];
-        }
-
-        //printf("\n Initial motion: (%f, %f, %f), (%f, %f, %f)", 0.01f*ls.rx, 0.01f*ls.ry, ls.th, 0.01f*ls_ref.rx, 0.01f*ls_ref.ry, ls_ref.th);
-
-        matchFailed = false;
-        try
-        {
-          pm_psm(&ls_ref,&ls);
-        }catch(int err)
-        {
-          cerr << "Error caught: failed match." << endl;
-          matchFailed = true;
-        }
-
-        PM_TYPE err_idx = pm_error_index2(&ls_ref,&ls);
-        //cout <<" err: "<<err_idx;
-
-        if (abs(ls.ry) > 80.f) ls.ry = 0.f;
-        if (abs(ls.rx) > 80.f) ls.rx = 0.f;
-        if (abs(ls.th) > DEG2RAD(70.f)) ls.th = 0.f;
-
-        const float psm_t = 1000.f*clock.Tac();
-        psm_time += psm_t;
-
-        printf("\nPSM runtime = %f ms", psm_t);
-        fflush(stdout);
-
-        old_psm_pose = new_psm_pose;
-        new_psm_pose = old_psm_pose + CPose2D(0.01f*ls.ry,0.01f*ls.rx,ls.th);
-    }
-
-    void Init_Params_csm()
-    {
-        params.max_angular_correction_deg = 60;             //"Maximum angular displacement between scans"
-        params.max_linear_correction = 1.0;                 //"Maximum translation between scans (m)"
-        params.max_iterations = 200;                         //"When we had enough"
-
-        params.epsilon_xy = 0.0001;                         //"A threshold for stopping (m)"
-        params.epsilon_theta = 0.0001;                      //"A threshold for stopping (rad)"
-
-        params.max_correspondence_dist = 2.0;
-        params.sigma = 0.01;                                //Noise in the scan
-
-        params.use_corr_tricks = 1;                         //"Use smart tricks for finding correspondences."
-        params.restart = 0;                                 //"Restart: Restart if error is over threshold"
-        params.restart_threshold_mean_error = 0.01;
-        params.restart_dt= 0.01;
-        params.restart_dtheta = 1.5 * 3.14 /180;
-
-        params.clustering_threshold = 0.05;                 //"Max distance for staying in the same clustering"
-        params.orientation_neighbourhood = 3;               //"Number of neighbour rays used to estimate the orientation."
-
-        params.use_point_to_line_distance = 1;              //"If 0, it's vanilla ICP."
-        params.do_alpha_test = 0;                           //"Discard correspondences based on the angles"
-        params.do_alpha_test_thresholdDeg = 20.0;           //
-
-        params.outliers_maxPerc = 0.95;
-        params.outliers_adaptive_order =0.7;
-        params.outliers_adaptive_mult=2.0;
-        params.do_visibility_test = 0;
-
-        params.outliers_remove_doubles = 1;                 //"no two points in laser_sens can have the same corr."
-        params.do_compute_covariance = 0;                   //"If 1, computes the covariance of ICP using the method http://purl.org/censi/2006/icpcov ."
-        params.debug_verify_tricks = 0;                     //"Checks that find_correspondences_tricks gives the right answer.
-
-        params.laser[0] = 0.0;                              //Pose of sensor with respect to robot: used for computing the first estimate given the odometry.
-        params.laser[1] = 0.0;
-        params.laser[2] = 0.0;
-
-        params.min_reading = 0.0;                           //Don't use readings less than min_reading (m)
-        params.max_reading = 1000.0;                        //Don't use readings longer than max_reading (m)
-
-        params.use_ml_weights = 0;                          //"If 1, the field 'true_alpha' (or 'alpha') in the first scan is used to compute the incidence beta, and the factor (1/cos^2(beta)) used to weight the correspondence.");
-        params.use_sigma_weights = 0;                       //"If 1, the field 'readings_sigma' in the second scan is used to weight the correspondence by 1/sigma^2"
-        recover_from_error = 0;
-        printf("[Init_Params]: Params structure sucessfully initialized.\n\n");
-    }
-
-    LDP cast_CObservation2DRangeScan_to_LDP(CObservation2DRangeScan &laser_obj)
-    {
-        int n;
-        n = laser_obj.scan.size();		//Num of samples (rays) of the scan laser
-
-        LDP ld = ld_alloc_new(n);       //create new structure initialized with "n" rays
-
-        ld->min_theta = -laser_obj.aperture/2;			//rad
-        ld->max_theta = laser_obj.aperture/2;			//rad
-        float angle_ray = laser_obj.aperture/(n-1);    //rad
-
-        double index_cero_angle = floor( (n-1)/2);
-
-        //scan readings
-        for (int i=0; i<n; i++)
-        {
-            if (laser_obj.validRange[i] == false)
-            {
-                ld->readings[i] = NAN;                  //*(ld->readings+i)
-                ld->valid[i] = 0;
-            }
-            else
-            {
-                ld->readings[i] = static_cast<double>(laser_obj.scan[i]);   //m
-                ld->valid[i] = 1;                       //int
-            }
-
-            ld->theta[i] = (i-index_cero_angle)*angle_ray;             //rad
-            ld->readings_sigma[i] = laser_obj.stdError;
-            ld->cluster[i] = -1;                        //No cluster selected
-        }
-
-        //To avoid failure due to precission, copy min and max theta (see ld_valid_fields)
-        ld->theta[0] = ld->min_theta;
-        ld->theta[n-1] = ld->max_theta;
-
-        //Set initial guess (odometry) to 0 (mandatory for proper funtionality)
-        ld->odometry[0] = 0.0;
-        ld->odometry[1] = 0.0;
-        ld->odometry[2] = 0.0;
-
-    /*
-        mrpt::poses::CPose3D LaserPoseOnTheRobot;
-        laser_obj.getSensorPose(LaserPoseOnTheRobot);
-        //Set the initial pose
-        laser_pose = LaserPoseOnTheRobot;
-        laser_oldpose = LaserPoseOnTheRobot;
-
-        jo_read_double_array(jo, "odometry", ld->odometry, 3, NAN);
-        jo_read_double_array(jo, "estimate", ld->estimate, 3, NAN);
-        jo_read_double_array(jo, "true_pose", ld->true_pose, 3, NAN);
-    */
-
-        double time_seconds = mrpt::system::timestampToDouble(laser_obj.timestamp);
-        double fractpart, intpart;
-        fractpart = modf(time_seconds, &intpart);
-        ld->tv.tv_sec = intpart;
-        ld->tv.tv_usec = fractpart;
-
-        if(!ld_valid_fields(ld))
-        {
-            sm_error("[Init] Invalid laser data in first scan.\n");
-            return ld;
-        }
-
-        //Structure is ready!
-        return ld;
-    }
-
-    /* Runs the PL-ICP */
-    bool runCanonicalScanMatching()
-    {
-        laser_sens = cast_CObservation2DRangeScan_to_LDP(laser.m_scan);
-        CTicTac clock; clock.Tic();
-
-        try
-        {
-            //set the scan data into the input structure
-            params.laser_ref  = laser_ref;
-            params.laser_sens = laser_sens;
-
-            // Set first guess as the difference in odometry
-            if (any_nan(params.laser_ref->odometry,3) || any_nan(params.laser_sens->odometry,3) )
-            {
-                sm_error("The 'odometry' field is set to NaN so I don't know how to get an initial guess. I usually use the difference in the odometry fields to obtain the initial guess.\n");
-                sm_error("  laser_ref->odometry = %s \n",  friendly_pose(params.laser_ref->odometry) );
-                sm_error("  laser_sens->odometry = %s \n", friendly_pose(params.laser_sens->odometry) );
-                sm_error(" I will quit it here. \n");
-                return false;
-            }
-
-            double odometry[3];
-            pose_diff_d(laser_sens->odometry, laser_ref->odometry, odometry);
-            double ominus_laser[3], temp[3];
-            ominus_d(params.laser, ominus_laser);
-            oplus_d(ominus_laser, odometry, temp);
-            oplus_d(temp, params.laser, params.first_guess);
-
-            // Do the actual work
-            sm_icp(&params, &result);
-
-        }
-        catch(exception &e)
-        {
-            cerr << "[Matching] Returning false due to exception: " << endl;
-            cerr << e.what() << endl;
-            return false;
-        }
-        catch(...)
-        {
-            cerr << "[Matching] Returning false due to unknown exception: " << endl;
-            return false;
-        }
-
-        if(!result.valid)
-        {
-            if(recover_from_error)
-            {
-                sm_info("One ICP matching failed. Because you passed  -recover_from_error, I will try to recover."
-                " Note, however, that this might not be good in some cases. \n");
-                sm_info("The recover is that the displacement is set to 0. No result stats is output. \n");
-
-                /* For the first scan, set estimate = odometry */
-                copy_d(laser_ref->estimate, 3, laser_sens->estimate);
-                ld_free(laser_ref); laser_ref = laser_sens;
-            }
-            else
-            {
-                sm_error("One ICP matching failed. Because I process recursively, I will stop here.\n");
-                sm_error("Use the option -recover_from_error if you want to try to recover.\n");
-                ld_free(laser_ref);
-                return 2;
-            }
-        }
-        else
-        {
-            /* Add the result to the previous estimate */
-            oplus_d(laser_ref->estimate, result.x, laser_sens->estimate);
-
-            old_csm_pose = new_csm_pose;
-            new_csm_pose = old_csm_pose + CPose2D(result.x[0],result.x[1],result.x[2]);
-
-            //Free reference scan, and update with the sensed one.
-            ld_free(laser_ref); laser_ref = laser_sens;
-        }
-
-        const float csm_t = 1000.f*clock.Tac();
-        csm_time += csm_t;
-        printf("\nCSM runtime = %f ms \n", csm_t);
-    }
-
     void saveScans()
     {
-        ofstream	m_fres;
-
-        m_fres.open("./scan_first.txt");
-
-        for (unsigned int i=0; i<laser.m_segments; i++)
-            m_fres << i << " " << laser.m_scan.scan[i] << "\n";
-
-        m_fres.close();
-
-        m_fres.open("./scan_second.txt");
-
+        //Beam and range of the last two scans (two small files, written right away)
+        vector<double> first, second;
         for (unsigned int i=0; i<laser.m_segments; i++)
-            m_fres << i << " " << laser.m_scan_old.scan[i] << "\n";
+        {
+            first.push_back(i); first.push_back(laser.m_scan.scan[i]);
+            second.push_back(i); second.push_back(laser.m_scan_old.scan[i]);
+        }
 
-        m_fres.close();
+        if (!CResultsWriter::saveText("./scan_first", "beam range", first) || !CResultsWriter::saveText("./scan_second", "beam range", second))
+            return;
 
         printf("\n Scans saved");
 
-        CPose2D psm_sol = new_psm_pose - old_psm_pose;
+        CPose2D psm_sol = psm.pose - psm.old_pose;
         CPose2D real_sol = new_pose - last_pose;
         cout << "\n estimated motion = " << psm_sol;
         cout << "\n real motion = " << real_sol;
@@ -1171,36 +859,26 @@ public:
 
     void saveResults(unsigned int freq)
     {
-        ofstream	m_fres;
-        char        aux[100];
-        int         nFile = 0;
-        bool        free_name = false;
-        string      name;
-
-        while (!free_name)
-        {
-            nFile++;
-            sprintf(aux, "results_%03u.txt", nFile );
-            name = aux;
-            free_name = !system::fileExists(name);
-        }
-        m_fres.open(aux);
-
-
         //Save freq, real_pose (x,y,theta), est_pose (CA), test_pose(MA), KA_pose(KA)
+        const string name = CResultsWriter::freeName("results_%03u");
+        if (!results_writer.open(name, "freq gt_x gt_y gt_theta est_x est_y est_theta test_x test_y test_theta KA_x KA_y KA_theta", RESULTS_TEXT))
+            return;
+
+        const vector<CPose3D> *poses[4] = {&real_poses, &est_poses, &test_poses, &KA_poses};
         for (unsigned int i=0; i<real_poses.size(); i++)
         {
-            m_fres << freq << " ";
-            m_fres << real_poses[i][0] << " " << real_poses[i][1] << " " << real_poses[i][3] << " ";
-            m_fres << est_poses[i][0] << " " << est_poses[i][1] << " " << est_poses[i][3] << " ";
-            m_fres << test_poses[i][0] << " " << test_poses[i][1] << " " << test_poses[i][3] << " ";
-            m_fres << KA_poses[i][0] << " " << KA_poses[i][1] << " " << KA_poses[i][3] << " ";
-            m_fres << "\n";
+            double row[13] = {double(freq)};
+            for (unsigned int p=0; p<4; p++)
+            {
+                row[1+3*p] = (*poses[p])[i][0];
+                row[2+3*p] = (*poses[p])[i][1];
+                row[3+3*p] = (*poses[p])[i][3];
+            }
+            results_writer.add(row);
         }
+        results_writer.close();
 
-        m_fres.close();
-
-        printf("\n Results saved in file \n");
+        printf("\n Results saved in %s.txt \n", name.c_str());
     }
 
 };
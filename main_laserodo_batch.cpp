@@ -0,0 +1,251 @@
+/* Project: Laser odometry
+   Headless batch evaluation (no window): Laser-odometry-batch [config_file]
+   Without a configuration file the default simulated scenario is run */
+
+#include <iostream>
+#include <mrpt/utils/CConfigFile.h>
+#include <mrpt/utils/CConfigFileMemory.h>
+#include <mrpt/system/filesystem.h>
+#include "laserodo_batch.h"
+
+
+const char *default_cfg_txt =
+	"; ---------------------------------------------------------------\n"
+	"; FILE: Reactive Parameters.txt\n"
+	";\n"
+	";  MJT @ JUIN-2013\n"
+	"; ---------------------------------------------------------------\n\n\n"
+
+	"[ROBOT_CONFIG]\n"
+
+	"Name = MyRobot\n\n"
+
+	"HEIGHT_LEVELS = 1 \n\n"	//Only one level works with this simulator + odometry!!!!!
+
+	";Indicate the geometry of each level \n\n"
+
+	";Type: Polyhedric 	(LEVELX_HEIGHT, LEVELX_VECTORX, LEVELX_VECTORY) \n\n"
+
+	"LEVEL1_HEIGHT = 0.6 \n"
+	"LEVEL1_VECTORX = -0.2 0.4 -0.2 \n"
+	"LEVEL1_VECTORY = -0.3 0 0.3 \n\n"
+
+	"[LASER_CONFIG] \n\n"
+
+	";Indicate the laser parameters. This information must be consistent with that included before \n"
+	";Laser pose is relative to the robot coordinate system. \n"
+	";Information required: 	LASERX_POSE, LASERY_POSE, LASERX_MAX_RANGE, LASERX_APERTURE \n"
+	";							LASERX_STD_ERROR, LASERX_LEVEL, LASERX_SEGMENTS \n\n"
+
+    "LASER_POSE = 0 0 0.1 0 0 0 \n"
+    "LASER_MAX_RANGE = 30.0 \n"
+    "LASER_APERTURE = 270 \n"
+    "LASER_STD_ERROR = 0.1 \n" //0.01
+	"LASER_LEVEL = 1 \n"
+    "LASER_SEGMENTS = 1080 \n\n"
+
+
+	"[NAVIGATION_CONFIG] \n\n"
+
+	"; 0: VFF,  1: ND \n"
+	"HOLONOMIC_METHOD = 1 \n\n"
+
+
+	";	Parameters for the navigation \n"
+	"; ---------------------------------------------------- \n\n"
+
+	"weights = 0.5 0.05 0.5 2.0 0.5 0.3 \n\n"
+
+	"; 1: Free space \n"
+	"; 2: Dist. in sectors \n"
+	"; 3: Heading toward target \n"
+	"; 4: Closer to target (euclidean) \n"
+	"; 5: Hysteresis \n"
+	"; 6: Security Distance \n\n"
+
+	"DIST_TO_TARGET_FOR_SENDING_EVENT = 0.5	; Minimum distance to target for sending the end event. Set to 0 to send it just on navigation end \n\n"
+
+    "VMAX_MPS = 0.70			; Speed limits - mps \n"
+    "WMAX_DEGPS = 60			; dps \n"
+    "SPEEDFILTER_TAU = 0		; The 'TAU' time constant of a first order lowpass filter for speed commands (s) \n"
+	"ROBOTMODEL_DELAY = 0		; The delay until motor reaction (s) \n"
+    "ROBOTMODEL_TAU = 0 		; The 'TAU' time constant of a first order robot model (s) \n"
+	"MAX_DISTANCE_PTG = 2		; Marks the maximum distance regarded by the reactive navigator (m) \n"
+	"GRID_RESOLUTION = 0.02 	; Resolutions used to build the collision_grid \n\n\n"
+
+
+
+	";	PTGs	.All of them has the same fields to fill, but they don't use all of them. \n"
+	";----------------------------------------------------------------------------------- \n"
+	";	Types:	1 - Circular arcs \n"
+	";			2 - alpha - A, Trajectories with asymptotical heading \n"
+	";			3 - C|C,S, R = vmax/wmax, Trajectories to move backward and then forward \n"
+	";			4 - C|C,s, like PTG 3, but if t > threshold -> v = w = 0 \n"
+	";			5 - CS, Trajectories with a minimum turning radius \n"
+	";			6 - alpha - SP, Trajectories built upon a spiral segment \n"
+	";			7 - \n\n"
+
+
+	"PTG_COUNT = 3			;Number of path models used \n\n"
+
+	"PTG1_TYPE = 1 \n"
+	"PTG1_NALFAS = 121 \n"
+    "PTG1_VMAX = 0.5 \n"
+    "PTG1_WMAX = 45 \n"
+	"PTG1_K = 1 \n"
+	"PTG1_AV = 57.3 \n"
+	"PTG1_AW = 57.3 \n\n"
+
+	"PTG2_TYPE = 2 \n"
+	"PTG2_NALFAS = 121 \n"
+    "PTG2_VMAX = 0.5 \n"
+    "PTG2_WMAX = 45 \n"
+	"PTG2_K = 1.0 \n"
+	"PTG2_AV = 57.3 \n"
+	"PTG2_AW = 57.3 \n\n"
+
+	"PTG3_TYPE = 5 \n"
+	"PTG3_NALFAS = 121 \n"
+    "PTG3_VMAX = 0.5 \n"
+    "PTG3_WMAX = 45 \n"
+	"PTG3_K = 1.0 \n"
+	"PTG3_AV = 57.3 \n"
+	"PTG3_AW = 57.3 \n\n"
+
+
+	";	Parameters for the 'Nearness diagram' Holonomic method \n"
+	"; ------------------------------------------------------------ \n\n"
+
+	"[ND_CONFIG] \n"
+	"factorWeights = 1.0 2.0 0.5 1.0 \n"
+	"; 1: Free space \n"
+	"; 2: Dist. in sectors \n"
+	"; 3: Closer to target (euclidean) \n"
+	"; 4: Hysteresis \n"
+
+    "WIDE_GAP_SIZE_PERCENT = 0.25			; The robot travels nearer to obstacles if this parameter is small. \n" // 0.25
+	"										; The smaller it is, the closer the selected direction is respect to \n"
+	"										; the Target direction in TP-Space (under some conditions) \n"
+	"MAX_SECTOR_DIST_FOR_D2_PERCENT = 0.25	; \n"
+	"RISK_EVALUATION_SECTORS_PERCENT = 0.25	; \n"
+	"RISK_EVALUATION_DISTANCE = 0.7			; Parameter used to decrease speed if obstacles are closer than this threshold \n"
+	"										; in normalized ps-meters [0,1] \n"
+	"TARGET_SLOW_APPROACHING_DISTANCE = 0.8	; Used to decrease speed gradually when the target is going to be reached \n"
+	"TOO_CLOSE_OBSTACLE = 0.03				; In normalized ps-meters [0,1] \n\n\n"
+
+
+	";	Parameters for the VFF Holonomic method \n"
+	"; ------------------------------------------------------------ \n\n"
+
+	"[VFF_CONFIG] \n\n"
+
+	"TARGET_SLOW_APPROACHING_DISTANCE = 0.8	; Used to decrease speed gradually when the target is going to be reached \n"
+	"TARGET_ATTRACTIVE_FORCE = 7.5			; Use it to control the relative weight of the target respect to the obstacles \n\n\n"
+
+	"[BATCH] \n\n"
+
+	";Source of the scans: rawlog, scanlog or simulation \n"
+	"SOURCE = simulation \n"
+	"RAWLOG_FILE = \n"
+	";Binary scan log made by Rawlog-to-scanlog \n"
+	"SCANLOG_FILE = \n"
+	"GROUNDTRUTH_LABEL = LOCALIZATION	; Odometry observations of the rawlog with the ground truth \n"
+	";Bitmap of the simulated environment (empty -> lab map) \n"
+	"MAP_FILE = \n"
+	"MAP_RESOLUTION = 0.04 \n"
+	"NUM_SCANS = 3000 \n"
+	"SIM_STEPS_PER_SCAN = 2 \n"
+	"SEED = 1 \n"
+	"LASER_MIN_RANGE = 0.5 \n\n"
+
+	";Methods: rf2o, rf2o_refs, rf2o_nosym, psm \n"
+	"METHODS = rf2o psm \n"
+	"RF2O_ID = 3 \n"
+	";Step [m] of the 16-bit ranges given to the RF2O engines (0 -> float ranges) \n"
+	"RF2O_RANGE_STEP = 0 \n"
+	";Step [m] of the 16-bit storage of the downsampled pyramid levels of the RF2O engines (0 -> float levels) \n"
+	"RF2O_LEVEL_STEP = 0 \n"
+	"CONCURRENT = true \n"
+	"ODO_FREQ = 5 \n"
+	";Other horizons of the relative errors: scans (10) or meters of the path (5m) \n"
+	"EVAL_HORIZONS = 1 5 10 50 1m 5m 10m \n"
+	"DECIMATION = 1 \n"
+	"OUTPUT_PREFIX = batch \n"
+	";Files of the trajectories: binary, text, tum and/or kitti \n"
+	"RESULTS_FORMATS = text tum \n\n"
+
+	"[RF2O_PARAMS] \n\n"
+
+	";Tuning parameters of the RF2O engines (see laser_odometry_params.h) \n"
+	"NONLIN_ITERS = 3			; Iterations per level of the pyramid \n"
+	"MIN_UPDATE = 0.05			; A level stops when its update is smaller \n"
+	"ITER_IRLS = 8				; Reweightings of the Cauchy / truncated quadratic solvers \n"
+	"MAX_IRLS = 10				; Max. reweightings of the smooth truncated quadratic solvers \n"
+	"TRUNC_MAD = 5				; Truncation (x MAD of the residuals) of the Cauchy / truncated quadratic solvers \n"
+	"SMOOTH_TRUNC_MAD = 4		; Truncation (x MAD) of the smooth truncated quadratic solvers \n"
+	"KD = 0.01					; Weights of the points \n"
+	"K2D = 0.0002 \n"
+	"SENSOR_SIGMA = 0.0004 \n"
+	"CF = 5000					; Gains of the filter of the solution of every level \n"
+	"DF = 0.02 \n"
+	"MAX_RANGE_DIF = 0.3			; Range jumps [m] regarded as discontinuities \n"
+	"PIXEL_BUDGET = 0			; Pixels passed to the solvers at the finest levels (0 -> all) \n";
+
+
+
+//Prints the progress of the run every "period" scans
+class CBatchProgress : public CBatchObserver {
+public:
+
+    CBatchProgress(unsigned int print_period) : period(print_period) {}
+
+    void onScan(const CLaserodoBatch &batch)
+    {
+        if (batch.numScans() % period == 0)
+        {
+            printf("\n [Batch] %u scans processed", batch.numScans());
+            fflush(stdout);
+        }
+    }
+
+private:
+
+    unsigned int period;
+};
+
+
+// ------------------------------------------------------
+//						MAIN
+// ------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    //Load the configuration from the file given or the default one
+    //-------------------------------------------------------------
+    CConfigFileMemory default_config(default_cfg_txt);
+    CConfigFile file_config;
+    if (argc > 1)
+    {
+        if (!mrpt::system::fileExists(argv[1]))
+        {
+            printf("\n Couldn't open the configuration file %s \n", argv[1]);
+            return 1;
+        }
+        file_config.setFileName(argv[1]);
+    }
+    const CConfigFileBase &config = (argc > 1) ? static_cast<const CConfigFileBase &>(file_config) : default_config;
+
+
+    //Run the experiment to completion and save the results
+    //-------------------------------------------------------------
+    CLaserodoBatch batch;
+    CBatchProgress progress(100);
+    batch.observer = &progress;
+
+    if (!batch.run(config))
+        return 1;
+
+    batch.printStatistics();
+    batch.saveResults();
+    return 0;
+}
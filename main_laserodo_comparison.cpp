@@ -169,6 +169,7 @@ int main()
     ReactInterface.use_PSM = 0;
     ReactInterface.use_CSM = 0;
     ReactInterface.use_NDT = 1;
+    ReactInterface.runner.concurrent = true;        //One thread per method (false -> one after another)
     ReactInterface.initializeEverything();
     rn3d.initialize();
 
@@ -233,11 +234,7 @@ int main()
         case 'c':
             //Reset pose estimation
             ReactInterface.resetScene();
-            ReactInterface.real_poses.clear();
-            ReactInterface.est_poses.clear(); ReactInterface.est_time = 0.f;
-            ReactInterface.test_poses.clear(); ReactInterface.test_time = 0.f;
-            ReactInterface.psm_poses.clear(); ReactInterface.psm_time = 0.f;
-            ReactInterface.csm_poses.clear(); ReactInterface.csm_time = 0.f;
+            ReactInterface.clearResults();
             break;
 
         case 'x':
@@ -291,27 +288,11 @@ int main()
 
             if (iter_count % react_sim_per_est == 0)
             {
-                //Execute odometry
-                ReactInterface.runRF2O();
-
-                //Execute PSM
-                if (ReactInterface.use_PSM)
-                    ReactInterface.runPolarScanMatching();
-
-                //Execute CSM
-                if (ReactInterface.use_CSM)
-                    ReactInterface.runCanonicalScanMatching();
-
-                //Execute NDT
-                if (ReactInterface.use_NDT)
-                    ReactInterface.runNDT();
+                //Execute odometry (RF2O and the compared methods in use)
+                ReactInterface.runMatchers();
 
                 //Add the new poses
                 ReactInterface.real_poses.push_back(CPose3D(ReactInterface.new_pose));
-                ReactInterface.est_poses.push_back(CPose3D(ReactInterface.odo.laser_pose));
-                ReactInterface.test_poses.push_back(CPose3D(ReactInterface.odo_test.laser_pose));
-                ReactInterface.psm_poses.push_back((CPose3D(ReactInterface.new_psm_pose)));
-                ReactInterface.csm_poses.push_back((CPose3D(ReactInterface.new_csm_pose)));
 
             }
 
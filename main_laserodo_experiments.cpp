@@ -168,6 +168,7 @@ int main()
     //Experiment 3 - our method against CSM and PSM
     //Experiment 4 - symmetric vs nonsymmetric formulation
     ReactInterface.experiment = 2;
+    ReactInterface.runner.concurrent = true;        //One thread per method (false -> one after another)
     ReactInterface.initializeEverything();
     rn3d.initialize();
 
@@ -262,27 +263,18 @@ int main()
 
             if (iter_count % react_sim_per_est == 0)
             {
-                //Execute odometry
-                ReactInterface.runRF2O();
-
-                if (ReactInterface.experiment == 3)
-                {
-                    //Execute PSM
-                    ReactInterface.runPolarScanMatching();
-
-                    //Execute CSM
-                    ReactInterface.runCanonicalScanMatching();
-                }
+                //Execute odometry (the RF2O versions and the compared methods of the experiment)
+                ReactInterface.runMatchers();
 
                 //Add the new poses
                 ReactInterface.real_poses.push_back(CPose3D(ReactInterface.new_pose));
-                ReactInterface.poses_a.push_back(CPose3D(ReactInterface.odo_a.laser_pose));
-                ReactInterface.poses_b.push_back(CPose3D(ReactInterface.odo_b.laser_pose));
-                ReactInterface.poses_c.push_back(CPose3D(ReactInterface.odo_c.laser_pose));
-                ReactInterface.poses_d.push_back(CPose3D(ReactInterface.odo_d.laser_pose));
-                ReactInterface.poses_nosym.push_back(CPose3D(ReactInterface.odo_nosym.laser_pose));
-                ReactInterface.psm_poses.push_back((CPose3D(ReactInterface.new_psm_pose)));
-                ReactInterface.csm_poses.push_back((CPose3D(ReactInterface.new_csm_pose)));
+                ReactInterface.poses_a.push_back(CPose3D(ReactInterface.rf2o_a.pose));
+                ReactInterface.poses_b.push_back(CPose3D(ReactInterface.rf2o_b.pose));
+                ReactInterface.poses_c.push_back(CPose3D(ReactInterface.rf2o_c.pose));
+                ReactInterface.poses_d.push_back(CPose3D(ReactInterface.rf2o_d.pose));
+                ReactInterface.poses_nosym.push_back(CPose3D(ReactInterface.rf2o_nosym.pose));
+                ReactInterface.psm_poses.push_back((CPose3D(ReactInterface.psm.pose)));
+                ReactInterface.csm_poses.push_back((CPose3D(ReactInterface.csm.pose)));
 
             }
 
@@ -317,8 +317,8 @@ int main()
 
                 //Add the new poses
                 ReactInterface.real_poses.push_back(CPose3D(ReactInterface.new_pose));
-                ReactInterface.est_poses.push_back(CPose3D(ReactInterface.odo.laser_pose));
-                ReactInterface.test_poses.push_back(CPose3D(ReactInterface.odo_test.laser_pose));
+                ReactInterface.est_poses.push_back(CPose3D(toMRPT(ReactInterface.odo.laser_pose)));
+                ReactInterface.test_poses.push_back(CPose3D(toMRPT(ReactInterface.odo_test.laser_pose)));
             }
 
 
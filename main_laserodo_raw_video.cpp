@@ -94,21 +94,15 @@ int main()
 
             if (iter_count % decimate == 0)
             {
-                //Execute odometry
-                odoInterface.runRF2O();
-
-                //Execute PSM
-                odoInterface.runPolarScanMatching();
-
-                //Execute CSM
-                odoInterface.runCanonicalScanMatching();
+                //Execute the scan matchers
+                odoInterface.runMatchers();
 
                 //Add the new poses
                 odoInterface.real_poses.push_back(CPose3D(odoInterface.new_gt_pose));
-                odoInterface.est_poses.push_back(CPose3D(odoInterface.odo.laser_pose));
-                odoInterface.test_poses.push_back(CPose3D(odoInterface.odo_test.laser_pose));
-                odoInterface.psm_poses.push_back(CPose3D(odoInterface.new_psm_pose));
-                odoInterface.csm_poses.push_back(CPose3D(odoInterface.new_csm_pose));
+                odoInterface.est_poses.push_back(CPose3D(toMRPT(odoInterface.odo.laser_pose)));
+                odoInterface.test_poses.push_back(CPose3D(toMRPT(odoInterface.odo_test.laser_pose)));
+                odoInterface.psm_poses.push_back(CPose3D(odoInterface.psm.pose));
+                odoInterface.csm_poses.push_back(CPose3D(odoInterface.csm.pose));
             }
 
             odoInterface.updateScene(iter_count);
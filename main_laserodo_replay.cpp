@@ -0,0 +1,389 @@
+/* Project: Laser odometry
+   Deterministic replay of an RF2O engine (or PSM) over a scan log, compared with a golden run:
+   Laser-odometry-replay <scanlog> [-method rf2o] [-id 3] [-params "kd=0.01 nonlin_iters=3"] [-range_step 0] [-decimation 1]
+                         [-repeat 1] [-save <prefix>] [-golden <run.bin>] [-baseline <run.bin>]
+                         [-tol_trans 1e-4] [-tol_rot 1e-4] [-tol_iters 0] [-max_slowdown <fraction>]
+   -save writes the run (timestamp x y phi runtime_ms iters irls of every scan), to be used as the golden run or the
+   baseline of later runs. The poses and the iterations are compared with the golden run, and the runtimes with the
+   baseline (the golden run if none is given). Every scan keeps the fastest of the "repeat" runs, which must be identical.
+   Exit code: 0 -> accepted, 2 -> rejected, 1 -> the replay could not be run */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <mrpt/poses/CPose2D.h>
+#include <mrpt/utils/CTicTac.h>
+#include "laser_odometry_standard.h"
+#include "laser_odometry_refscans.h"
+#include "laser_odometry_nosym.h"
+#include "scan_matcher.h"
+#include "scan_log.h"
+#include "results_writer.h"
+
+using namespace mrpt::poses;
+using namespace mrpt::utils;
+using namespace std;
+
+
+struct TReplayOptions {
+
+    string          method;
+    unsigned int    id;
+    RF2O_Params     params;
+    float           range_step;
+    unsigned int    decimation;
+};
+
+//Result of a run: one entry per processed scan (the first one is the reference, with no runtime nor iterations)
+struct TReplayRun {
+
+    vector<double>  timestamps;
+    vector<CPose2D> poses;
+    vector<double>  runtime;        //[ms]
+    vector<double>  iters, irls;    //Non-linear iterations and reweightings of the solvers
+
+    size_t size() const { return poses.size(); }
+};
+
+static const char *replay_columns = "timestamp x y phi runtime_ms iters irls";
+
+
+template <class Engine>
+static void replayEngine(const CScanLogReader &log, const TReplayOptions &opt, TReplayRun &run)
+{
+    RF2O_Matcher<Engine> matcher(opt.method.c_str());
+    matcher.initialize(log.info().beams, log.info().aperture, opt.id);
+    matcher.odo.range_step = opt.range_step;
+    matcher.odo.params = opt.params;
+    matcher.odo.verbose = false;    //The runtimes are recorded: no prints while timing
+
+    ScanBearings bearings;
+    bearings.initialize(log.info().beams, log.info().aperture);
+    vector<float> widened(log.info().beams);
+    float *widen = (opt.range_step == log.info().range_step) ? NULL : &widened[0];
+
+    run = TReplayRun();
+    matcher.setFirstScan(log.scan(0, bearings, widen));
+    matcher.resetPose(log.hasOdometry(0) ? log.odometry(0) : CPose2D());
+    run.timestamps.push_back(log.timestamp(0));
+    run.poses.push_back(matcher.pose);
+    run.runtime.push_back(0.0);
+    run.iters.push_back(0.0);
+    run.irls.push_back(0.0);
+
+    CTicTac clock;
+    for (size_t i = opt.decimation; i < log.size(); i += opt.decimation)
+    {
+        const ScanView scan = log.scan(i, bearings, widen);
+        clock.Tic();
+        matcher.match(scan);
+        run.runtime.push_back(1000.0*clock.Tac());
+        run.timestamps.push_back(scan.timestamp);
+        run.poses.push_back(matcher.pose);
+        run.iters.push_back(matcher.odo.num_iters);
+        run.irls.push_back(matcher.odo.num_irls);
+    }
+}
+
+//PSM has no iterations to record. Its scans are read and preprocessed a block at a time over all the threads,
+//out of the timed matches (the views point to the mapped records of the log).
+static bool replayPSM(const CScanLogReader &log, const TReplayOptions &opt, TReplayRun &run)
+{
+    const unsigned int block = 128;     //A PMScan takes 80 KB
+    PSM_Matcher matcher;
+    try
+    {
+        matcher.initialize(log.info().beams, log.info().aperture, log.info().max_range);
+    }
+    catch(int)
+    {
+        return false;
+    }
+
+    ScanBearings bearings;
+    bearings.initialize(log.info().beams, log.info().aperture);
+
+    run = TReplayRun();
+    matcher.setFirstScan(log.scan(0, bearings));
+    matcher.resetPose(log.hasOdometry(0) ? log.odometry(0) : CPose2D());
+    run.timestamps.push_back(log.timestamp(0));
+    run.poses.push_back(matcher.pose);
+    run.runtime.push_back(0.0);
+    run.iters.push_back(0.0);
+    run.irls.push_back(0.0);
+
+    CTicTac clock;
+    vector<ScanView> views;
+    for (size_t i = opt.decimation; i < log.size(); i += opt.decimation)
+    {
+        if (i % (block*opt.decimation) == opt.decimation)
+        {
+            views.clear();
+            for (size_t j = i; (j < log.size()) && (views.size() < block); j += opt.decimation)
+                views.push_back(log.scan(j, bearings));
+            matcher.preloadScans(views);
+        }
+
+        const ScanView scan = log.scan(i, bearings);
+        clock.Tic();
+        matcher.match(scan);
+        run.runtime.push_back(1000.0*clock.Tac());
+        run.timestamps.push_back(scan.timestamp);
+        run.poses.push_back(matcher.pose);
+        run.iters.push_back(0.0);
+        run.irls.push_back(0.0);
+    }
+    return true;
+}
+
+static bool replay(const CScanLogReader &log, const TReplayOptions &opt, TReplayRun &run)
+{
+    if (opt.method == "rf2o")               replayEngine<RF2O_standard>(log, opt, run);
+    else if (opt.method == "rf2o_refs")     replayEngine<RF2O_RefS>(log, opt, run);
+    else if (opt.method == "rf2o_nosym")    replayEngine<RF2O_nosym>(log, opt, run);
+    else if (opt.method == "psm")           return replayPSM(log, opt, run);
+    else
+    {
+        printf("\n Unknown method: %s (rf2o, rf2o_refs, rf2o_nosym or psm) \n", opt.method.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool sameRun(const TReplayRun &a, const TReplayRun &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i=0; i<a.size(); i++)
+        if ((a.poses[i].x() != b.poses[i].x()) || (a.poses[i].y() != b.poses[i].y()) || (a.poses[i].phi() != b.poses[i].phi())
+            || (a.iters[i] != b.iters[i]) || (a.irls[i] != b.irls[i]))
+            return false;
+    return true;
+}
+
+static bool saveRun(const string &prefix, const TReplayRun &run)
+{
+    CResultsWriter writer;
+    if (!writer.open(prefix, replay_columns, RESULTS_BINARY | RESULTS_TEXT))
+        return false;
+    for (size_t i=0; i<run.size(); i++)
+    {
+        const double extra[3] = {run.runtime[i], run.iters[i], run.irls[i]};
+        writer.addPose(run.timestamps[i], run.poses[i], extra);
+    }
+    writer.close();
+    return true;
+}
+
+static bool loadRun(const string &filename, TReplayRun &run)
+{
+    CResultsTable table;
+    int col[7];
+    bool valid = table.load(filename);
+    for (unsigned int c=0; valid && (c<7); c++)
+    {
+        static const char *names[7] = {"timestamp", "x", "y", "phi", "runtime_ms", "iters", "irls"};
+        col[c] = table.column(names[c]);
+        valid = (col[c] >= 0);
+    }
+    if (!valid)
+    {
+        printf("\n Couldn't read the run %s (columns: %s) \n", filename.c_str(), replay_columns);
+        return false;
+    }
+
+    run = TReplayRun();
+    for (size_t i=0; i<table.rows(); i++)
+    {
+        run.timestamps.push_back(table.at(i, col[0]));
+        run.poses.push_back(CPose2D(table.at(i, col[1]), table.at(i, col[2]), table.at(i, col[3])));
+        run.runtime.push_back(table.at(i, col[4]));
+        run.iters.push_back(table.at(i, col[5]));
+        run.irls.push_back(table.at(i, col[6]));
+    }
+    return true;
+}
+
+//Poses and iterations within the tolerances of those of the golden run
+static bool compareWithGolden(const TReplayRun &run, const TReplayRun &golden, double tol_trans, double tol_rot, double tol_iters)
+{
+    if (run.size() != golden.size())
+    {
+        printf("\n Golden run: %u scans, this run: %u scans \n", unsigned(golden.size()), unsigned(run.size()));
+        return false;
+    }
+
+    double max_trans = 0.0, max_rot = 0.0, max_iters = 0.0;
+    unsigned int pose_errors = 0, iter_errors = 0;
+    int first_pose_error = -1, first_iter_error = -1;
+    for (size_t i=0; i<run.size(); i++)
+    {
+        const double dtrans = sqrt(pow(run.poses[i].x() - golden.poses[i].x(), 2) + pow(run.poses[i].y() - golden.poses[i].y(), 2));
+        double drot = fabs(run.poses[i].phi() - golden.poses[i].phi());
+        if (drot > M_PI)
+            drot = 2.0*M_PI - drot;
+        const double diters = max(fabs(run.iters[i] - golden.iters[i]), fabs(run.irls[i] - golden.irls[i]));
+        max_trans = max(max_trans, dtrans);
+        max_rot = max(max_rot, drot);
+        max_iters = max(max_iters, diters);
+
+        if ((dtrans > tol_trans) || (drot > tol_rot))
+        {
+            if (first_pose_error < 0) first_pose_error = int(i);
+            pose_errors++;
+        }
+        if (diters > tol_iters)
+        {
+            if (first_iter_error < 0) first_iter_error = int(i);
+            iter_errors++;
+        }
+    }
+
+    printf("\n Poses: max. difference = %g m, %g rad (tolerances %g m, %g rad)", max_trans, max_rot, tol_trans, tol_rot);
+    if (pose_errors)
+        printf(" -> %u scans out of tolerance, the first one is %d", pose_errors, first_pose_error);
+    printf("\n Iterations: max. difference = %g (tolerance %g)", max_iters, tol_iters);
+    if (iter_errors)
+        printf(" -> %u scans out of tolerance, the first one is %d", iter_errors, first_iter_error);
+    printf("\n");
+    return (pose_errors == 0) && (iter_errors == 0);
+}
+
+//Runtimes of the scans matched in both runs. Rejected if the mean is slower than (1 + max_slowdown) times that of
+//the baseline (max_slowdown < 0 -> only reported)
+static bool compareRuntimes(const TReplayRun &run, const TReplayRun &baseline, double max_slowdown)
+{
+    const size_t size = min(run.size(), baseline.size());
+    vector<double> delta;
+    double mean_run = 0.0, mean_base = 0.0;
+    for (size_t i=1; i<size; i++)
+    {
+        delta.push_back(run.runtime[i] - baseline.runtime[i]);
+        mean_run += run.runtime[i];
+        mean_base += baseline.runtime[i];
+    }
+    if (delta.empty())
+    {
+        printf("\n Runtimes: no scan to compare with the baseline \n");
+        return false;
+    }
+
+    mean_run /= delta.size();
+    mean_base /= delta.size();
+    sort(delta.begin(), delta.end());
+    const double slowdown = mean_run/max(mean_base, 1e-9) - 1.0;
+
+    printf("\n Runtimes: %f ms/scan, baseline %f ms/scan (%+.1f%%)", mean_run, mean_base, 100.0*slowdown);
+    printf("\n Per-scan deltas: median %+f ms, p10 %+f ms, p90 %+f ms, max %+f ms \n", delta[delta.size()/2],
+           delta[delta.size()/10], delta[(9*delta.size())/10], delta.back());
+    return (max_slowdown < 0.0) || (slowdown <= max_slowdown);
+}
+
+
+
+// ------------------------------------------------------
+//						MAIN
+// ------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    TReplayOptions opt;
+    opt.method = "rf2o";
+    opt.id = 3;
+    opt.range_step = 0.f;
+    opt.decimation = 1;
+    unsigned int repeat = 1;
+    string scanlog_file, save_prefix, golden_file, baseline_file;
+    double tol_trans = 1e-4, tol_rot = 1e-4, tol_iters = 0.0, max_slowdown = -1.0;
+
+    for (int i=1; i<argc; i++)
+    {
+        const bool has_value = (i+1 < argc);
+        if ((strcmp(argv[i], "-method") == 0) && has_value)             opt.method = argv[++i];
+        else if ((strcmp(argv[i], "-id") == 0) && has_value)            opt.id = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-params") == 0) && has_value)
+        {
+            if (!opt.params.fromString(argv[++i]))
+                return 1;
+        }
+        else if ((strcmp(argv[i], "-range_step") == 0) && has_value)    opt.range_step = float(atof(argv[++i]));
+        else if ((strcmp(argv[i], "-decimation") == 0) && has_value)    opt.decimation = max(atoi(argv[++i]), 1);
+        else if ((strcmp(argv[i], "-repeat") == 0) && has_value)        repeat = max(atoi(argv[++i]), 1);
+        else if ((strcmp(argv[i], "-save") == 0) && has_value)          save_prefix = argv[++i];
+        else if ((strcmp(argv[i], "-golden") == 0) && has_value)        golden_file = argv[++i];
+        else if ((strcmp(argv[i], "-baseline") == 0) && has_value)      baseline_file = argv[++i];
+        else if ((strcmp(argv[i], "-tol_trans") == 0) && has_value)     tol_trans = atof(argv[++i]);
+        else if ((strcmp(argv[i], "-tol_rot") == 0) && has_value)       tol_rot = atof(argv[++i]);
+        else if ((strcmp(argv[i], "-tol_iters") == 0) && has_value)     tol_iters = atof(argv[++i]);
+        else if ((strcmp(argv[i], "-max_slowdown") == 0) && has_value)  max_slowdown = atof(argv[++i]);
+        else if (argv[i][0] != '-')                                     scanlog_file = argv[i];
+        else
+        {
+            printf("\n Unknown option: %s \n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (scanlog_file.empty())
+    {
+        printf("\n Usage: Laser-odometry-replay <scanlog> [-method rf2o] [-id 3] [-params \"kd=0.01 nonlin_iters=3\"] [-range_step 0] [-decimation 1]"
+               "\n                             [-repeat 1] [-save <prefix>] [-golden <run.bin>] [-baseline <run.bin>]"
+               "\n                             [-tol_trans 1e-4] [-tol_rot 1e-4] [-tol_iters 0] [-max_slowdown <fraction>] \n");
+        return 1;
+    }
+
+    CScanLogReader log;
+    if (!log.open(scanlog_file) || (log.size() == 0))
+    {
+        printf("\n Couldn't read any scan from the scan log %s \n", scanlog_file.c_str());
+        return 1;
+    }
+
+    //Replay (all the repetitions must give the same poses and iterations)
+    TReplayRun run, repetition;
+    if (!replay(log, opt, run))
+        return 1;
+
+    bool deterministic = true;
+    for (unsigned int r=1; r<repeat; r++)
+    {
+        replay(log, opt, repetition);
+        deterministic = deterministic && sameRun(run, repetition);
+        for (size_t i=0; i<min(run.size(), repetition.size()); i++)
+            run.runtime[i] = min(run.runtime[i], repetition.runtime[i]);
+    }
+
+    printf("\n\n Replay of %s: %s, %u scans, %s \n", scanlog_file.c_str(), opt.method.c_str(), unsigned(run.size()),
+           (opt.method == "psm") ? "its own parameters" : opt.params.toString().c_str());
+    if (!deterministic)
+        printf("\n The %u repetitions of the replay gave different poses or iterations \n", repeat);
+
+    if (!save_prefix.empty() && saveRun(save_prefix, run))
+        printf(" Run saved in %s.bin \n", save_prefix.c_str());
+
+    //Regression checks
+    bool accepted = deterministic;
+    if (!golden_file.empty())
+    {
+        TReplayRun golden;
+        if (!loadRun(golden_file, golden))
+            return 1;
+        accepted = compareWithGolden(run, golden, tol_trans, tol_rot, tol_iters) && accepted;
+    }
+
+    if (baseline_file.empty())
+        baseline_file = golden_file;
+    if (!baseline_file.empty())
+    {
+        TReplayRun baseline;
+        if (!loadRun(baseline_file, baseline))
+            return 1;
+        accepted = compareRuntimes(run, baseline, max_slowdown) && accepted;
+    }
+
+    if (!golden_file.empty() || !baseline_file.empty() || (repeat > 1))
+        printf("\n %s \n", accepted ? "ACCEPTED" : "REJECTED");
+    return accepted ? 0 : 2;
+}
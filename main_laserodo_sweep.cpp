@@ -0,0 +1,46 @@
+/* Project: Laser odometry
+   Parameter sweep of the RF2O engines on recorded scan logs: Laser-odometry-sweep <config_file>
+   Example of the configuration file (see TSweepConfig):
+       [SWEEP]
+       SCANLOG_FILES = lab.scans corridor.scans
+       METHOD = rf2o
+       ODO_FREQ = 10
+       SEARCH = grid            ; or random (NUM_SAMPLES, SEED)
+       NONLIN_ITERS = 2 3 4
+       SMOOTH_TRUNC_MAD = 3 4 5
+       KD = 0.005 0.01 0.02
+       [RF2O_PARAMS]            ; The parameters that are not swept (as in Laser-odometry-batch) */
+
+#include <iostream>
+#include <mrpt/utils/CConfigFile.h>
+#include <mrpt/system/filesystem.h>
+#include "laserodo_sweep.h"
+
+
+
+// ------------------------------------------------------
+//						MAIN
+// ------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("\n Usage: Laser-odometry-sweep <config_file> \n");
+        return 1;
+    }
+    if (!mrpt::system::fileExists(argv[1]))
+    {
+        printf("\n Couldn't open the configuration file %s \n", argv[1]);
+        return 1;
+    }
+    CConfigFile config(argv[1]);
+
+    CLaserodoSweep sweep;
+    if (!sweep.run(config))
+        return 1;
+
+    sweep.printRankings();
+    sweep.saveResults();
+    return 0;
+}
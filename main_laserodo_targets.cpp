@@ -270,21 +270,15 @@ int main()
 
             if (iter_count % react_sim_per_est == 0)
             {
-                //Execute odometry
-                ReactInterface.runRF2O();
-
-                //Execute PSM
-                ReactInterface.runPolarScanMatching();
-
-                //Execute CSM
-                ReactInterface.runCanonicalScanMatching();
+                //Execute the scan matchers
+                ReactInterface.runMatchers();
 
                 //Add the new poses
                 ReactInterface.real_poses.push_back(CPose3D(ReactInterface.new_pose));
-                ReactInterface.est_poses.push_back(CPose3D(ReactInterface.odo.laser_pose));
-                ReactInterface.test_poses.push_back(CPose3D(ReactInterface.odo_test.laser_pose));
-                ReactInterface.psm_poses.push_back((CPose3D(ReactInterface.new_psm_pose)));
-                ReactInterface.csm_poses.push_back((CPose3D(ReactInterface.new_csm_pose)));
+                ReactInterface.est_poses.push_back(CPose3D(toMRPT(ReactInterface.odo.laser_pose)));
+                ReactInterface.test_poses.push_back(CPose3D(toMRPT(ReactInterface.odo_test.laser_pose)));
+                ReactInterface.psm_poses.push_back((CPose3D(ReactInterface.psm.pose)));
+                ReactInterface.csm_poses.push_back((CPose3D(ReactInterface.csm.pose)));
 
             }
 
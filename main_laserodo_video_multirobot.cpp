@@ -167,6 +167,7 @@ int main()
 
     //Initialize all methods
     ReactInterface.sequence_id = 2; // 0 - 3 robots, 1 - 5 robots, 2 - 7 robots
+    ReactInterface.runner.concurrent = true;        //One thread per method (false -> one after another)
     ReactInterface.initializeEverything();
     rn3d.initialize();
 
@@ -248,22 +249,16 @@ int main()
                 //UpdateMap and sense obstacles
                 ReactInterface.updateMapWithRobotsAndScan();
 
-                //Execute odometry
-                ReactInterface.runRF2O();
-
-                //Execute PSM
-                ReactInterface.runPolarScanMatching();
-
-                //Execute CSM
-                ReactInterface.runCanonicalScanMatching();
+                //Execute odometry (RF2O, PSM and CSM)
+                ReactInterface.runMatchers();
 
                 //Add the new poses
                 ReactInterface.real_poses.push_back(CPose3D(ReactInterface.new_pose));
-                ReactInterface.est_poses.push_back(CPose3D(ReactInterface.odo.laser_pose));
-                ReactInterface.test_poses.push_back(CPose3D(ReactInterface.odo_test.laser_pose));
-                ReactInterface.KA_poses.push_back(CPose3D(ReactInterface.odo_KA.laser_pose));
-                ReactInterface.psm_poses.push_back((CPose3D(ReactInterface.new_psm_pose)));
-                ReactInterface.csm_poses.push_back((CPose3D(ReactInterface.new_csm_pose)));
+                ReactInterface.est_poses.push_back(CPose3D(ReactInterface.rf2o.pose));
+                ReactInterface.test_poses.push_back(CPose3D(ReactInterface.rf2o_test.pose));
+                ReactInterface.KA_poses.push_back(CPose3D(ReactInterface.rf2o_KA.pose));
+                ReactInterface.psm_poses.push_back((CPose3D(ReactInterface.psm.pose)));
+                ReactInterface.csm_poses.push_back((CPose3D(ReactInterface.csm.pose)));
             }
 
             count++;
@@ -0,0 +1,98 @@
+/* Project: Laser odometry
+   Converts a rawlog into a flat binary scan log (see scan_log.h):
+   Rawlog-to-scanlog <input.rawlog> <output.scanlog> [laser_min_range] [scan_label] [odometry_label] [range_step]
+   Every scan is stored with the last odometry observation read before it, and with range_step > 0 (in meters,
+   e.g. 0.001 or 0.002) its ranges are quantized to 16 bits */
+
+#include <mrpt/obs/CObservation2DRangeScan.h>
+#include <mrpt/obs/CObservationOdometry.h>
+#include <mrpt/system/datetime.h>
+#include <mrpt/utils/bits.h>
+#include <cstdio>
+#include <cstdlib>
+#include "rawlog_stream.h"
+#include "scan_log.h"
+
+using namespace mrpt::utils;
+using namespace mrpt::obs;
+using namespace mrpt::poses;
+using namespace std;
+
+
+
+// ------------------------------------------------------
+//						MAIN
+// ------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        printf("\n Usage: Rawlog-to-scanlog <input.rawlog> <output.scanlog> [laser_min_range] [scan_label] [odometry_label] [range_step] \n");
+        return 1;
+    }
+
+    const float laser_min_range = (argc > 3) ? float(atof(argv[3])) : 0.05f;
+    const float range_step = (argc > 6) ? float(atof(argv[6])) : 0.f;
+
+    CRawlogStream dataset;
+    if (argc > 4) dataset.scan_label = argv[4];
+    if (argc > 5) dataset.odometry_label = argv[5];
+    if (!dataset.open(argv[1]))
+    {
+        printf("\n Couldn't open the rawlog %s \n", argv[1]);
+        return 1;
+    }
+
+    CScanLogWriter scan_log;
+    CPose2D odometry;
+    bool has_odometry = false;
+    unsigned int skipped = 0;
+
+    TRawlogEvent event;
+    while (dataset.next(event))
+    {
+        if (event.type == TRawlogEvent::ODOMETRY)
+        {
+            odometry = CObservationOdometryPtr(event.obs)->odometry;
+            has_odometry = true;
+            continue;
+        }
+
+        //The geometry of the laser is that of the first scan
+        const CObservation2DRangeScanPtr obs2D = CObservation2DRangeScanPtr(event.obs);
+        if (!scan_log.isOpen())
+        {
+            if (!scan_log.open(argv[2], obs2D->scan.size(), obs2D->aperture, obs2D->maxRange, laser_min_range, obs2D->sensorLabel, range_step))
+            {
+                printf("\n Couldn't create the scan log %s \n", argv[2]);
+                return 1;
+            }
+            printf("\n Laser %s: %u beams, aperture = %f deg, max range = %f m", obs2D->sensorLabel.c_str(), (unsigned int)obs2D->scan.size(),
+                   RAD2DEG(obs2D->aperture), obs2D->maxRange);
+            if ((range_step > 0.f) && (obs2D->maxRange > 65534.f*range_step))
+                printf("\n Warning: the ranges longer than %f m do not fit in 16 bits with a step of %f m and will be discarded", 65534.f*range_step, range_step);
+        }
+
+        if ((obs2D->scan.size() != scan_log.info().beams) || !scan_log.write(mrpt::system::timestampToDouble(obs2D->timestamp), &obs2D->scan[0], has_odometry ? &odometry : NULL))
+        {
+            skipped++;
+            continue;
+        }
+
+        if (scan_log.size() % 1000 == 0)
+        {
+            printf("\n %u scans converted", (unsigned int)scan_log.size());
+            fflush(stdout);
+        }
+    }
+
+    if (!scan_log.isOpen())
+    {
+        printf("\n The rawlog has no 2D scans \n");
+        return 1;
+    }
+
+    printf("\n %u scans written in %s (%u skipped from other lasers) \n", (unsigned int)scan_log.size(), argv[2], skipped);
+    return 0;
+}
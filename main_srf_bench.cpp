@@ -0,0 +1,490 @@
+/* Project: Laser odometry
+   Micro-benchmarks of the stages of RF2O_standard on synthetic and recorded scans:
+   srf_bench [-beams "181 360 682 1080 1440 4096"] [-scanlog <file>] [-scans 50] [-time 0.2] [-id 3] [-csv <file>]
+             [-max_lifted_beams 1080] [-level_steps "0.001 0.002"]
+   Every stage is timed at the finest level of the pyramid, on the state left by the odometry of a sequence of
+   scans, and the whole odometryCalculation() on the sequence. The scans of the scan log are resampled to every
+   number of beams. The best of several batches of calls is reported, in ns per call, ns per pixel and scans/s.
+   The odometry of every scene is also run with the downsampled pyramid levels stored as 16-bit ranges of every
+   level step, and its drift is compared with the one of the float levels. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+#include <mrpt/poses/CPose2D.h>
+#include <mrpt/utils/CTicTac.h>
+#include "laser_odometry_standard.h"
+#include "scan_log.h"
+
+
+using namespace mrpt::poses;
+using namespace mrpt::utils;
+using namespace std;
+
+
+//Scenes
+//--------------------------------------------------------------------------------------
+
+//Sequence of scans of a laser with "beams" beams (0 -> no return)
+struct TBenchScene {
+
+    string                  name;
+    float                   fov;            //[rad]
+    vector<vector<float> >  scans;
+    vector<RF2O_Pose2D>     poses;          //Of the laser at every scan (synthetic scenes only)
+};
+
+//Range of a ray against a circle (center (cx,cy), radius r), or -1
+static float rayCircle(float x, float y, float dx, float dy, float cx, float cy, float r)
+{
+    const float ox = x - cx, oy = y - cy;
+    const float b = ox*dx + oy*dy;
+    const float c = ox*ox + oy*oy - r*r;
+    const float disc = b*b - c;
+    if (disc < 0.f)
+        return -1.f;
+    const float t = -b - sqrt(disc);
+    return (t > 0.f) ? t : -1.f;
+}
+
+//A 12 x 8 m room with a corridor, some pillars and a box, seen from a path that moves and turns
+static void syntheticScene(unsigned int beams, unsigned int num_scans, TBenchScene &scene)
+{
+    static const float pillars[4][3] = {{2.f, 1.5f, 0.3f}, {-2.5f, -1.f, 0.5f}, {3.5f, -2.f, 0.2f}, {-4.f, 2.5f, 0.25f}};
+    static const float box[4] = {0.5f, -3.f, 1.5f, -2.2f};      //xmin, ymin, xmax, ymax
+    const float max_range = 30.f;
+
+    scene.name = "synthetic";
+    scene.fov = float(270.0*M_PI/180.0);
+    scene.scans.assign(num_scans, vector<float>(beams));
+    scene.poses.resize(num_scans);
+
+    unsigned int seed = 12345;
+    for (unsigned int k=0; k<num_scans; k++)
+    {
+        const float px = -2.f + 0.04f*k, py = 0.3f*sin(0.1f*k), phi = 0.3f*sin(0.05f*k);
+        scene.poses[k] = RF2O_Pose2D(px, py, phi);
+        for (unsigned int u=0; u<beams; u++)
+        {
+            const float tita = phi - 0.5f*scene.fov + u*scene.fov/(beams - 1);
+            const float dx = cos(tita), dy = sin(tita);
+            float range = max_range;
+
+            //Walls (the one at x = 6 has a 2 m wide corridor that leads nowhere within the range)
+            if (dx > 1e-6f) { const float t = (6.f - px)/dx; if (fabs(py + t*dy) > 1.f) range = min(range, t); }
+            if (dx < -1e-6f) range = min(range, (-6.f - px)/dx);
+            if (dy > 1e-6f) range = min(range, (4.f - py)/dy);
+            if (dy < -1e-6f) range = min(range, (-4.f - py)/dy);
+
+            for (unsigned int p=0; p<4; p++)
+            {
+                const float t = rayCircle(px, py, dx, dy, pillars[p][0], pillars[p][1], pillars[p][2]);
+                if (t > 0.f) range = min(range, t);
+            }
+
+            //Box (slab test)
+            float t_near = -1e9f, t_far = 1e9f;
+            for (unsigned int a=0; a<2; a++)
+            {
+                const float o = a ? py : px, d = a ? dy : dx, lo = box[a], hi = box[a+2];
+                if (fabs(d) < 1e-6f) { if ((o < lo) || (o > hi)) t_near = 1e9f; continue; }
+                const float t1 = (lo - o)/d, t2 = (hi - o)/d;
+                t_near = max(t_near, min(t1, t2));
+                t_far = min(t_far, max(t1, t2));
+            }
+            if ((t_near <= t_far) && (t_near > 0.f))
+                range = min(range, t_near);
+
+            //Noise of 5 mm (deterministic)
+            seed = seed*1103515245u + 12345u;
+            const float noise = 0.01f*(float((seed >> 16) & 0x7fff)/32767.f - 0.5f);
+            scene.scans[k][u] = (range < max_range) ? range + noise : 0.f;
+        }
+    }
+}
+
+//Consecutive scans of a scan log resampled to "beams" beams (nearest one)
+static void recordedScene(const CScanLogReader &log, unsigned int beams, unsigned int num_scans, TBenchScene &scene)
+{
+    const unsigned int src_beams = log.info().beams;
+    ScanBearings bearings;
+    bearings.initialize(src_beams, log.info().aperture);
+    vector<float> widened(src_beams);
+
+    scene.name = "recorded";
+    scene.fov = log.info().aperture;
+    scene.poses.clear();
+    scene.scans.assign(min<size_t>(num_scans, log.size()), vector<float>(beams));
+    for (unsigned int k=0; k<scene.scans.size(); k++)
+    {
+        const ScanView view = log.scan(k, bearings, &widened[0]);
+        for (unsigned int u=0; u<beams; u++)
+            scene.scans[k][u] = view.range[(u*(src_beams - 1) + (beams - 1)/2)/(beams - 1)];
+    }
+}
+
+
+//Timing
+//--------------------------------------------------------------------------------------
+
+typedef void (RF2O_standard::*TStageMethod)();
+
+struct TStage {
+
+    const char      *name;
+    TStageMethod    method;
+};
+
+//Warping variants, coordinates, derivatives, weights and solvers: they only depend on the state of the finest level
+static const TStage level_stages[] = {
+    {"performWarping",                          &RF2O_standard::performWarping},
+    {"performFastWarping",                      &RF2O_standard::performFastWarping},
+    {"performBestWarping",                      &RF2O_standard::performBestWarping},
+    {"calculateCoord",                          &RF2O_standard::calculateCoord},
+    {"calculaterangeDerivativesSurface",        &RF2O_standard::calculaterangeDerivativesSurface},
+    {"computeWeights",                          &RF2O_standard::computeWeights},
+    {"solveSystemQuadResiduals",                &RF2O_standard::solveSystemQuadResiduals},
+    {"solveSystemQuadResidualsNoPreW",          &RF2O_standard::solveSystemQuadResidualsNoPreW},
+    {"solveSystemMCauchy",                      &RF2O_standard::solveSystemMCauchy},
+    {"solveSystemTruncatedQuad",                &RF2O_standard::solveSystemTruncatedQuad},
+    {"solveSystemSmoothTruncQuad",              &RF2O_standard::solveSystemSmoothTruncQuad},
+    {"solveSystemSmoothTruncQuadNoPreW",        &RF2O_standard::solveSystemSmoothTruncQuadNoPreW},
+    {"solveSystemSmoothTruncQuadFromBeginning", &RF2O_standard::solveSystemSmoothTruncQuadFromBeginning},
+    {"solveLiftedSmoothTruncQuad",              &RF2O_standard::solveLiftedSmoothTruncQuad}};
+
+//Called before every batch of 'calls' calls, out of the timed region
+typedef void (*TBatchSetup)(RF2O_standard &odo, unsigned int calls);
+
+//filterLevelSolution records every iteration: the records are emptied and reserved before every batch
+static void resetIterationRecords(RF2O_standard &odo, unsigned int calls)
+{
+    odo.transf_level.clear();
+    odo.transf_level.reserve(calls);
+    odo.transf_acu_per_iteration.clear();
+    odo.transf_acu_per_iteration.reserve(calls);
+}
+
+//Best time of a call [s]: batches of calls of about 1/10 of min_time, the best of 5 after the calibration
+static double timeStage(RF2O_standard &odo, TStageMethod method, double min_time, TBatchSetup setup = NULL)
+{
+    CTicTac clock;
+    unsigned int calls = 1;
+    double batch_time;
+    for (;;)
+    {
+        if (setup)
+            setup(odo, calls);
+        clock.Tic();
+        for (unsigned int c=0; c<calls; c++)
+            (odo.*method)();
+        batch_time = clock.Tac();
+        if ((batch_time >= 0.1*min_time) || (calls >= (1u << 20)))
+            break;
+        calls *= 2;
+    }
+
+    //A single call longer than the whole budget is not repeated
+    if (batch_time >= min_time)
+        return batch_time;
+
+    double best = batch_time/calls;
+    for (unsigned int b=0; b<5; b++)
+    {
+        if (setup)
+            setup(odo, calls);
+        clock.Tic();
+        for (unsigned int c=0; c<calls; c++)
+            (odo.*method)();
+        best = min(best, clock.Tac()/calls);
+    }
+    return best;
+}
+
+struct TBenchResult {
+
+    string          scene, stage;
+    unsigned int    beams;
+    double          ns_per_call;
+};
+
+static void addResult(vector<TBenchResult> &results, const TBenchScene &scene, const char *stage, unsigned int beams, double seconds)
+{
+    TBenchResult res;
+    res.scene = scene.name;
+    res.stage = stage;
+    res.beams = beams;
+    res.ns_per_call = 1e9*seconds;
+    results.push_back(res);
+}
+
+//Runs the odometry on the scans back and forth (consecutive scans are always neighbours). Returns the time [s].
+static double runSequence(RF2O_standard &odo, const TBenchScene &scene, unsigned int matches, unsigned int &next, int &step)
+{
+    const unsigned int beams = scene.scans[0].size();
+    CTicTac clock;
+    double time = 0.0;
+    for (unsigned int m=0; m<matches; m++)
+    {
+        if ((next + step >= scene.scans.size()) || (int(next) + step < 0))
+            step = -step;
+        next += step;
+        odo.range_wf = Eigen::Map<const Eigen::ArrayXf>(&scene.scans[next][0], beams);
+        clock.Tic();
+        odo.odometryCalculation();
+        time += clock.Tac();
+    }
+    return time;
+}
+
+static void benchmarkScene(const TBenchScene &scene, unsigned int id, double min_time, unsigned int max_lifted_beams, vector<TBenchResult> &results)
+{
+    const unsigned int beams = scene.scans[0].size();
+    RF2O_standard odo;
+    odo.initialize(beams, scene.fov, id);
+    odo.verbose = false;
+    odo.range_wf = Eigen::Map<const Eigen::ArrayXf>(&scene.scans[0][0], beams);
+    odo.createScanPyramid();
+
+    //Whole odometry: at least min_time and one pass over the scans
+    unsigned int next = 0, matches = 0;
+    int step = 1;
+    double time = runSequence(odo, scene, 1, next, step);
+    matches = 1;
+    while ((time < min_time) || (matches + 1 < scene.scans.size()))
+    {
+        time += runSequence(odo, scene, 1, next, step);
+        matches++;
+    }
+    addResult(results, scene, "odometryCalculation", beams, time/matches);
+
+    //The stages at the finest level, on the state of the last match
+    for (unsigned int s=0; s<sizeof(level_stages)/sizeof(level_stages[0]); s++)
+    {
+        //The lifted solver builds a dense system (cubic in the number of beams)
+        if ((level_stages[s].method == &RF2O_standard::solveLiftedSmoothTruncQuad) && (beams > max_lifted_beams))
+            continue;
+
+        const Eigen::Vector3f kai_loc_level = odo.kai_loc_level;
+        const Eigen::Matrix3f cov_odo = odo.cov_odo;
+        addResult(results, scene, level_stages[s].name, beams, timeStage(odo, level_stages[s].method, min_time));
+        odo.kai_loc_level = kai_loc_level;
+        odo.cov_odo = cov_odo;
+    }
+
+    //The filter accumulates its solution in the transformations, which are restored
+    const Eigen::MatrixXf transformation = odo.transformations[odo.level];
+    const Eigen::Matrix3f acu_trans_overall = odo.acu_trans_overall;
+    addResult(results, scene, "filterLevelSolution", beams, timeStage(odo, &RF2O_standard::filterLevelSolution, min_time, resetIterationRecords));
+    odo.transformations[odo.level] = transformation;
+    odo.acu_trans_overall = acu_trans_overall;
+    odo.transf_level.clear();
+    odo.transf_acu_per_iteration.clear();
+
+    //The pyramid of the new scan (the last one, built again every time)
+    addResult(results, scene, "createScanPyramid", beams, timeStage(odo, &RF2O_standard::createScanPyramid, min_time));
+}
+
+
+//Drift of the quantized pyramid levels
+//--------------------------------------------------------------------------------------
+
+struct TDriftResult {
+
+    string          scene;
+    unsigned int    beams;
+    float           level_step;     //[m] (0 -> float levels)
+    double          end_trans, end_rot;     //Error of the last pose [m, rad] (synthetic scenes, -1 otherwise)
+    double          dev_trans, dev_rot;     //Largest difference with the poses of the float levels [m, rad]
+};
+
+//Poses of the laser estimated over one pass of the scans, relative to the first one
+static void runTrajectory(const TBenchScene &scene, unsigned int id, float level_step, vector<RF2O_Pose2D> &poses)
+{
+    const unsigned int beams = scene.scans[0].size();
+    RF2O_standard odo;
+    odo.initialize(beams, scene.fov, id);
+    odo.pyramid.level_step = level_step;
+    odo.verbose = false;
+    odo.range_wf = Eigen::Map<const Eigen::ArrayXf>(&scene.scans[0][0], beams);
+    odo.createScanPyramid();
+
+    poses.assign(1, odo.laser_pose);
+    for (unsigned int k=1; k<scene.scans.size(); k++)
+    {
+        odo.range_wf = Eigen::Map<const Eigen::ArrayXf>(&scene.scans[k][0], beams);
+        odo.odometryCalculation();
+        poses.push_back(odo.laser_pose - poses[0]);
+    }
+    poses[0] = RF2O_Pose2D();
+}
+
+static void compareLevelSteps(const TBenchScene &scene, unsigned int id, const vector<float> &level_steps, double min_time,
+                              vector<TBenchResult> &results, vector<TDriftResult> &drifts)
+{
+    const unsigned int beams = scene.scans[0].size();
+    vector<RF2O_Pose2D> float_poses, poses;
+    runTrajectory(scene, id, 0.f, float_poses);
+
+    for (unsigned int s=0; s<=level_steps.size(); s++)
+    {
+        TDriftResult drift;
+        drift.scene = scene.name;
+        drift.beams = beams;
+        drift.level_step = (s == 0) ? 0.f : level_steps[s-1];
+        drift.end_trans = drift.end_rot = -1.0;
+        drift.dev_trans = drift.dev_rot = 0.0;
+
+        if (s == 0)
+            poses = float_poses;
+        else
+            runTrajectory(scene, id, drift.level_step, poses);
+
+        for (unsigned int k=0; k<poses.size(); k++)
+        {
+            const RF2O_Pose2D dif = poses[k] - float_poses[k];
+            drift.dev_trans = max(drift.dev_trans, sqrt(dif.x()*dif.x() + dif.y()*dif.y()));
+            drift.dev_rot = max(drift.dev_rot, fabs(dif.phi()));
+        }
+        if (!scene.poses.empty())
+        {
+            const RF2O_Pose2D error = poses.back() - (scene.poses.back() - scene.poses[0]);
+            drift.end_trans = sqrt(error.x()*error.x() + error.y()*error.y());
+            drift.end_rot = fabs(error.phi());
+        }
+        drifts.push_back(drift);
+
+        //The pyramid with the quantized levels
+        if (s > 0)
+        {
+            RF2O_standard odo;
+            odo.initialize(beams, scene.fov, id);
+            odo.pyramid.level_step = drift.level_step;
+            odo.verbose = false;
+            odo.range_wf = Eigen::Map<const Eigen::ArrayXf>(&scene.scans.back()[0], beams);
+            char stage[64];
+            sprintf(stage, "createScanPyramid (levels %.1f mm)", 1e3f*drift.level_step);
+            addResult(results, scene, stage, beams, timeStage(odo, &RF2O_standard::createScanPyramid, min_time));
+        }
+    }
+}
+
+
+
+// ------------------------------------------------------
+//						MAIN
+// ------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    string beams_text = "181 360 682 1080 1440 4096", scanlog_file, csv_file, level_steps_text = "0.001 0.002";
+    unsigned int num_scans = 50, id = 3, max_lifted_beams = 1080;
+    double min_time = 0.2;
+
+    for (int i=1; i<argc; i++)
+    {
+        const bool has_value = (i+1 < argc);
+        if ((strcmp(argv[i], "-beams") == 0) && has_value)              beams_text = argv[++i];
+        else if ((strcmp(argv[i], "-scanlog") == 0) && has_value)       scanlog_file = argv[++i];
+        else if ((strcmp(argv[i], "-scans") == 0) && has_value)         num_scans = max(atoi(argv[++i]), 2);
+        else if ((strcmp(argv[i], "-time") == 0) && has_value)          min_time = atof(argv[++i]);
+        else if ((strcmp(argv[i], "-id") == 0) && has_value)            id = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-csv") == 0) && has_value)           csv_file = argv[++i];
+        else if ((strcmp(argv[i], "-max_lifted_beams") == 0) && has_value)  max_lifted_beams = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-level_steps") == 0) && has_value)   level_steps_text = argv[++i];
+        else
+        {
+            printf("\n Usage: srf_bench [-beams \"181 360 682 1080 1440 4096\"] [-scanlog <file>] [-scans 50] [-time 0.2] [-id 3] [-csv <file>] [-max_lifted_beams 1080] [-level_steps \"0.001 0.002\"] \n");
+            return 1;
+        }
+    }
+
+    vector<unsigned int> beams;
+    istringstream stream(beams_text);
+    unsigned int b;
+    while (stream >> b)
+        if (b >= 64)
+            beams.push_back(b);
+    if (beams.empty())
+    {
+        printf("\n No valid number of beams (at least 64) in \"%s\" \n", beams_text.c_str());
+        return 1;
+    }
+
+    //Steps of the quantized levels (they must leave room for the ranges of the scenes: 30 m in the synthetic one)
+    vector<float> level_steps;
+    istringstream steps_stream(level_steps_text);
+    float level_step;
+    while (steps_stream >> level_step)
+        if (level_step > 0.f)
+            level_steps.push_back(level_step);
+
+    CScanLogReader log;
+    if (!scanlog_file.empty() && (!log.open(scanlog_file) || (log.size() < 2)))
+    {
+        printf("\n Couldn't read two scans from the scan log %s \n", scanlog_file.c_str());
+        return 1;
+    }
+
+    //Run all the benchmarks (the engines do not print: verbose = false)
+    vector<TBenchResult> results;
+    vector<TDriftResult> drifts;
+    for (unsigned int k=0; k<beams.size(); k++)
+    {
+        printf(" Benchmarking %u beams... \n", beams[k]);
+        fflush(stdout);
+
+        TBenchScene scene;
+        syntheticScene(beams[k], num_scans, scene);
+        benchmarkScene(scene, id, min_time, max_lifted_beams, results);
+        compareLevelSteps(scene, id, level_steps, min_time, results, drifts);
+        if (log.size() > 0)
+        {
+            recordedScene(log, beams[k], num_scans, scene);
+            benchmarkScene(scene, id, min_time, max_lifted_beams, results);
+            compareLevelSteps(scene, id, level_steps, min_time, results, drifts);
+        }
+    }
+
+    //Report
+    printf("\n %-10s %6s  %-40s %14s %12s %14s \n", "Scene", "Beams", "Stage", "ns/call", "ns/pixel", "scans/s");
+    for (unsigned int r=0; r<results.size(); r++)
+    {
+        const TBenchResult &res = results[r];
+        printf(" %-10s %6u  %-40s %14.1f %12.2f %14.1f \n", res.scene.c_str(), res.beams, res.stage.c_str(), res.ns_per_call,
+               res.ns_per_call/res.beams, 1e9/res.ns_per_call);
+    }
+
+    //Drift: last pose against the ground truth (synthetic) and largest difference with the float levels
+    printf("\n %-10s %6s  %14s %14s %14s %14s %14s \n", "Scene", "Beams", "Level step[mm]", "End trans[m]", "End rot[deg]",
+           "Dev trans[m]", "Dev rot[deg]");
+    for (unsigned int d=0; d<drifts.size(); d++)
+    {
+        const TDriftResult &drift = drifts[d];
+        printf(" %-10s %6u  %14.1f ", drift.scene.c_str(), drift.beams, 1e3f*drift.level_step);
+        if (drift.end_trans >= 0.0)
+            printf("%14.5f %14.4f ", drift.end_trans, drift.end_rot*180.0/M_PI);
+        else
+            printf("%14s %14s ", "-", "-");
+        printf("%14.5f %14.4f \n", drift.dev_trans, drift.dev_rot*180.0/M_PI);
+    }
+
+    if (!csv_file.empty())
+    {
+        FILE *f = fopen(csv_file.c_str(), "w");
+        if (!f)
+        {
+            printf("\n Couldn't create %s \n", csv_file.c_str());
+            return 1;
+        }
+        fprintf(f, "scene,beams,stage,ns_per_call,ns_per_pixel,scans_per_s\n");
+        for (unsigned int r=0; r<results.size(); r++)
+            fprintf(f, "%s,%u,%s,%.1f,%.3f,%.1f\n", results[r].scene.c_str(), results[r].beams, results[r].stage.c_str(),
+                    results[r].ns_per_call, results[r].ns_per_call/results[r].beams, 1e9/results[r].ns_per_call);
+        fclose(f);
+        printf("\n Results saved in %s \n", csv_file.c_str());
+    }
+    return 0;
+}
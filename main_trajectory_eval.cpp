@@ -0,0 +1,84 @@
+/* Project: Laser odometry
+   Evaluation of trajectory files (those written by the harnesses, TUM or KITTI):
+   Trajectory-eval <groundtruth> <estimate> [<estimate> ...] [-horizons "1 5 10 50 1m 5m 10m"] [-max_dt 0.01] [-noalign]
+   All the estimates are evaluated at all the horizons (scans or meters of the ground truth path) in one pass */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "trajectory_eval.h"
+
+using namespace mrpt::poses;
+using namespace std;
+
+
+
+// ------------------------------------------------------
+//						MAIN
+// ------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    string horizons_text = "1 5 10 50 1m 5m 10m";
+    double max_dt = 0.01;
+    bool align_first = true;
+    vector<string> files;
+
+    for (int i=1; i<argc; i++)
+    {
+        if ((strcmp(argv[i], "-horizons") == 0) && (i+1 < argc))
+            horizons_text = argv[++i];
+        else if ((strcmp(argv[i], "-max_dt") == 0) && (i+1 < argc))
+            max_dt = atof(argv[++i]);
+        else if (strcmp(argv[i], "-noalign") == 0)
+            align_first = false;
+        else
+            files.push_back(argv[i]);
+    }
+
+    if (files.size() < 2)
+    {
+        printf("\n Usage: Trajectory-eval <groundtruth> <estimate> [<estimate> ...] [-horizons \"1 5 10 50 1m 5m 10m\"] [-max_dt 0.01] [-noalign] \n");
+        return 1;
+    }
+
+    vector<TEvalHorizon> horizons;
+    if (!parseHorizons(horizons_text, horizons))
+        return 1;
+    CTrajectoryEvaluator evaluator(horizons);
+    evaluator.align_first = align_first;
+
+    //Load the trajectories and keep the poses that all of them have
+    TTrajectory gt;
+    vector<TTrajectory> est(files.size() - 1);
+    if (!loadTrajectory(files[0], gt))
+        return 1;
+    for (unsigned int k=0; k<est.size(); k++)
+        if (!loadTrajectory(files[k+1], est[k]))
+            return 1;
+
+    vector<CPose2D> gt_poses;
+    vector<vector<CPose2D> > est_poses;
+    associateTrajectories(gt, est, max_dt, gt_poses, est_poses);
+    if (gt_poses.empty())
+    {
+        printf("\n The trajectories have no poses in common (max_dt = %f s) \n", max_dt);
+        return 1;
+    }
+    printf("Ground truth: %s, %u of its %u poses are evaluated \n", gt.name.c_str(), unsigned(gt_poses.size()), unsigned(gt.size()));
+
+    //Evaluate
+    vector<string> names;
+    vector<const vector<CPose2D>*> poses;
+    for (unsigned int k=0; k<est.size(); k++)
+    {
+        names.push_back(est[k].name);
+        poses.push_back(&est_poses[k]);
+    }
+
+    vector<TEvalResult> results;
+    evaluator.setGroundTruth(gt_poses);
+    evaluator.evaluate(names, poses, results);
+    printf("%s", evaluator.report(results).c_str());
+    return 0;
+}
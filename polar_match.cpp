@@ -49,26 +49,51 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 
 #ifdef __linux__
 #include <time.h>
+#include <algorithm>
 #endif
 
 #include "polar_match.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 //#define GR //STEP 5) When defined graphical debugging of PSM is enabled: each projection, orientation search and translation estimation iteration is shown.
 
-PM_TYPE         pm_fi[PM_L_POINTS];//contains precomputed angles (0-180)
-PM_TYPE         pm_si[PM_L_POINTS];//contains sinus of angles
-PM_TYPE         pm_co[PM_L_POINTS];//contains cos of angles
 const PM_TYPE   PM_D2R = M_PI/180.0; // degrees to rad
 const PM_TYPE   PM_R2D = 180.0/M_PI; // rad to degrees
-const PM_TYPE   PM_FI_MIN = M_PI/2.0 - PM_FOV*PM_D2R/2.0;//[rad] bearing from which laser scans start
-const PM_TYPE   PM_FI_MAX = M_PI/2.0 + PM_FOV*PM_D2R/2.0;//[rad] bearing at which laser scans end
-const PM_TYPE   PM_DFI    = PM_FOV*PM_D2R/ ( PM_L_POINTS - 1.0 );//[rad] angular resolution of laser scans
 
-void pm_scan_project(const PMScan *act, PM_TYPE *new_r, int *new_bad);
-PM_TYPE pm_orientation_search(const PMScan *ref, const PM_TYPE *new_r, const int *new_bad);
-PM_TYPE pm_translation_estimation(const PMScan *ref, const PM_TYPE *new_r, const int *new_bad, PM_TYPE C, PM_TYPE *dx, PM_TYPE *dy);
+/** @brief Parameters of a laser range finder model (see PM_LASER). */
+struct PMLaserModel
+{
+  int         id;
+  const char *name;
+  int         l_points;
+  PM_TYPE     fov;
+  PM_TYPE     max_range;
+  int         min_valid_points;
+  int         search_window;
+  PM_TYPE     corridor_threshold;
+};
+
+/** @brief The laser range finders known by pm_init(). Add your laser here if it is a different model (use centimeters). */
+static const PMLaserModel pm_laser_models[] =
+{
+  //id                   name                l_points fov    max_range min_valid window corridor
+  { PM_PSD_SCANNER,      "PSD_Scanner",      200,     360,   400,      100,      50,    25.0 },
+  { PM_HOKUYO_URG_04LX,  "Hokuyo URG-04LX",  682,     240,   560,      200,      80,    25.0 },
+  { PM_SICK_LMS200,      "Sick LMS",         181,     180,   1000,     40,       20,    25.0 },
+  { PM_HOKUYO_UTM_30LX,  "HOKUYO UTM-30LX",  1080,    270,   3000,     300,      200,   25.0 },
+  { PM_SIMUL,            "LASER_SIMUL",      241,     240,   560,      80,       40,    25.0 },
+  { PM_DATASET_FREIBURG, "LASER_FREIBURG",   360,     180,   7900,     80,       40,    25.0 },
+  { PM_DATASET_MIT,      "LASER_MIT",        361,     180.5, 7900,     80,       40,    25.0 }
+};
+
+void pm_scan_project(const PMContext *ctx, const PMScan *act, PM_TYPE ax, PM_TYPE ay, PM_TYPE ath, PMWorkspace *ws);
+PM_TYPE pm_orientation_search(const PMContext *ctx, const PMScan *ref, PMWorkspace *ws);
+PM_TYPE pm_translation_estimation(const PMContext *ctx, const PMScan *ref, const PM_TYPE *new_r, const int *new_bad, PM_TYPE C, PM_TYPE *dx, PM_TYPE *dy);
 
 /** @brief Returns thread runtime under Linux in milliseconds.
 
@@ -106,47 +131,83 @@ inline PM_TYPE norm_a ( PM_TYPE a )
   return ( a );
 }
 
-/** @brief Initialises internal variables and opens a log file.
+/** @brief Initialises a matching context for one of the predefined laser models.
 
-If filename is present, then it opens the scanfile and reads out
-the first line. The file pointer is then set to the corresponding file.
-Before performing any scan matching call this fuction once to initialize
-important global variables.
+Before performing any scan matching initialise a context once per laser
+range finder. The context is only read by the matching functions, so it may
+be shared by matchers running in different threads.
 
-Upon failure an exception is thrown.
+Upon failure (unknown model) an exception is thrown.
 
-@param filename The name of the optional logfile to be used.
-@param fin The optional opened file pointer is returned here.
+@param ctx The context to be initialised.
+@param laser The laser model: PM_SICK_LMS200, PM_HOKUYO_URG_04LX, ...
 */
-void pm_init ()
+void pm_init ( PMContext *ctx, int laser )
 {
-//  printf("Initializing polar scan matching for: %s\n",PM_LASER_NAME);
-//  size_t len=2000;
-//  char *line;
-//  line = new char[len];
-//  if(fin != NULL)
-//  {
-//    *fin = NULL;
-//  }
-
-//  if(filename != NULL)
-//  {
-//    *fin=fopen ( filename,"rt" );
-//    if ( *fin==NULL )
-//    {
-//      cerr <<"pm_init: unable to open file:"<<filename<<endl;
-//      throw 1;
-//    }
-//    if ( getline ( &line,&len,*fin ) != -1 )
-//      cout <<line<<endl;
-//    delete[] line;
-//  }
-
-  for ( int i=0;i<PM_L_POINTS;i++ )
+  const int num_models = sizeof ( pm_laser_models ) /sizeof ( pm_laser_models[0] );
+  for ( int i=0;i<num_models;i++ )
+  {
+    const PMLaserModel &m = pm_laser_models[i];
+    if ( m.id == laser )
+    {
+      pm_init ( ctx, m.name, m.l_points, m.fov, m.max_range, m.min_valid_points, m.search_window, m.corridor_threshold );
+      return;
+    }
+  }
+
+  cerr <<"pm_init: unknown laser model "<<laser<<endl;
+  throw 1;
+}//pm_init
+
+/** @brief Initialises a matching context for an arbitrary laser range finder.
+
+Computes the bearings of the laser readings and their sines and cosines.
+Upon failure (more than PM_MAX_POINTS readings or a search window not smaller
+than the scan) an exception is thrown. The orientation search is exhaustive
+(ctx->orientation_step = 1); increase the step afterwards for a coarse-to-fine search.
+
+@param ctx The context to be initialised.
+@param name The name of the laser range finder.
+@param l_points Number of points in a scan.
+@param fov [deg] Field of view of the laser range finder.
+@param max_range [cm] Maximum valid laser range.
+@param min_valid_points Minimum number of valid points for scan matching.
+@param search_window Half window size which is searched for correct orientation.
+@param corridor_threshold Threshold for angle variation between points to determine if scan was taken of a corridor.
+*/
+void pm_init ( PMContext *ctx, const char *name, int l_points, PM_TYPE fov, PM_TYPE max_range,
+               int min_valid_points, int search_window, PM_TYPE corridor_threshold )
+{
+  if ( l_points < 2 || l_points > PM_MAX_POINTS )
+  {
+    cerr <<"pm_init: "<<l_points<<" points per scan are not supported (max. "<<PM_MAX_POINTS<<")"<<endl;
+    throw 1;
+  }
+  if ( search_window < 1 || search_window >= l_points )
+  {
+    cerr <<"pm_init: the search window has to be in [1,"<<l_points-1<<"]"<<endl;
+    throw 1;
+  }
+
+  ctx->laser_name         = name;
+  ctx->l_points           = l_points;
+  ctx->fov                = fov;
+  ctx->max_range          = max_range;
+  ctx->min_valid_points   = min_valid_points;
+  ctx->search_window      = search_window;
+  ctx->corridor_threshold = corridor_threshold;
+  ctx->orientation_step   = 1;
+  ctx->fi_min             = M_PI/2.0 - fov*PM_D2R/2.0;
+  ctx->fi_max             = M_PI/2.0 + fov*PM_D2R/2.0;
+  ctx->dfi                = fov*PM_D2R/ ( l_points - 1.0 );
+
+  for ( int i=0;i<l_points;i++ )
   {
-    pm_fi[i] = ( ( float ) i ) *PM_DFI + PM_FI_MIN;
-    pm_si[i] = sinf ( pm_fi[i] );
-    pm_co[i] = cosf ( pm_fi[i] );
+    ctx->fi[i] = ( ( float ) i ) *ctx->dfi + ctx->fi_min;
+    ctx->si[i] = sinf ( ctx->fi[i] );
+    ctx->co[i] = cosf ( ctx->fi[i] );
+    ctx->si_rot[i] = sinf ( ctx->fi[i]+M_PI/5.0 );
+    ctx->co_rot[i] = cosf ( ctx->fi[i]+M_PI/5.0 );
   }
 }//pm_init
 
@@ -161,11 +222,12 @@ r1[cm]<br>
 .<br>
 .<br>
 .<br>
-@param fin Pointer to the file opened with pm_init().
+@param ctx The matching context (laser geometry and parameters).
+@param ranges [m] The ctx->l_points range readings of the scan (0 for invalid readings).
 @param ls The read laser scan is returned here.
 @return Returns 0 on success, -1 if there are no more scans.
 */
-int pm_readScan (mrpt::obs::CObservation2DRangeScan laser, PMScan *ls )
+int pm_readScan (const PMContext *ctx, const float *ranges, PMScan *ls )
 {
 //  int n=0;
 //  n+=fscanf ( laser,"%lf %f %f %f\n",& ( ls->t ),& ( ls->rx ),& ( ls->ry ),& ( ls->th ) );
@@ -174,12 +236,12 @@ int pm_readScan (mrpt::obs::CObservation2DRangeScan laser, PMScan *ls )
   ls->ry    = 0.f; //*=100.0;
   ls->th    = 0.f; //= norm_a ( ls->th-M_PI/2.0 );// subtract 90 degrees - due to the coordinate frame definition for SLAMbot
 
-  for ( int i=0; i<PM_L_POINTS; i++ )
+  for ( int i=0; i<ctx->l_points; i++ )
   {
     //n+=fscanf ( laser,"%f\n",& ( ls->r[i] ) );
-    ls->r[i] = 100.f*laser.scan[i];
-    ls->x[i] = ( ls->r[i] ) *pm_co[i];
-    ls->y[i] = ( ls->r[i] ) *pm_si[i];
+    ls->r[i] = 100.f*ranges[i];
+    ls->x[i] = ( ls->r[i] ) *ctx->co[i];
+    ls->y[i] = ( ls->r[i] ) *ctx->si[i];
     if (ls->r[i] == 0.f)
         ls->r[i] = 1000.f;
     ls->bad[i] = 0;
@@ -190,8 +252,36 @@ int pm_readScan (mrpt::obs::CObservation2DRangeScan laser, PMScan *ls )
   return 1;
 }
 
+/** @brief Reads the range readings of an MRPT observation and stores them in @a ls.
+
+The observation is only read: neither it nor its range vector are copied.
+@param ctx The matching context (laser geometry and parameters).
+@param laser The laser observation (it must have ctx->l_points readings).
+@param ls The read laser scan is returned here.
+*/
+int pm_readScan (const PMContext *ctx, const mrpt::obs::CObservation2DRangeScan &laser, PMScan *ls )
+{
+  return pm_readScan ( ctx, &laser.scan[0], ls );
+}
+
 
-/** @brief Filters the laser ranges with a median filter.
+/** @brief Median of 5 readings with a sorting network.
+
+Same value as sorting the window, but with 7 branch-free compare-exchanges.
+*/
+static inline PM_TYPE pm_median5 ( PM_TYPE p0, PM_TYPE p1, PM_TYPE p2, PM_TYPE p3, PM_TYPE p4 )
+{
+  PM_TYPE t;
+#define PM_SORT2(a,b) { t = min ( a,b ); b = max ( a,b ); a = t; }
+  PM_SORT2 ( p0,p1 ); PM_SORT2 ( p3,p4 ); PM_SORT2 ( p0,p3 );
+  PM_SORT2 ( p1,p4 ); PM_SORT2 ( p1,p2 ); PM_SORT2 ( p2,p3 );
+  PM_SORT2 ( p1,p2 );
+#undef PM_SORT2
+  return p2;
+}
+
+
+/** @brief Filters the i-th laser range with a median filter.
 
 The job of this median filter is to remove chair and table
 legs which are likely to change position with time.
@@ -205,42 +295,22 @@ Do not use this function when fitting lines to laser scans!
 
 Median filter will round up corners.
 
-x,y coordinates of points are not upadted.
+The filter works in place: the readings left of @a i have already been
+filtered when @a i is. x,y coordinates of points are not upadted.
+@param ctx The matching context (laser geometry and parameters).
 @param ls Laser scan to be filtered.
+@param i Index of the reading.
 */
-void pm_median_filter ( PMScan *ls )
+static inline void pm_median_filter_point ( const PMContext *ctx, PMScan *ls, int i )
 {
-  const int HALF_WINDOW  = 2;//2 to left 2 to right
-  const int WINDOW = 2*HALF_WINDOW+1;
-  PM_TYPE   r[WINDOW];
-  PM_TYPE   w;
-
-  int i,j,k,l;
-
-  for ( i=0;i<PM_L_POINTS;i++ )
-  {
-    k=0;
-    for ( j=i-HALF_WINDOW;j<=i+HALF_WINDOW;j++ )
-    {
-      l = ( ( j>=0 ) ?j:0 );
-      r[k]=ls->r[ ( ( l < PM_L_POINTS ) ?l: ( PM_L_POINTS-1 ) ) ];
-      k++;
-    }
-    //bubble sort r
-    for ( j= ( WINDOW-1 );j>0;j-- )
-      for ( k=0;k<j;k++ )
-        if ( r[k]>r[k+1] ) // wrong order? - swap them
-        {
-          w=r[k];
-          r[k]=r[k+1];
-          r[k+1] = w;
-        }
-    ls->r[i] = r[HALF_WINDOW];//choose the middle point
-  }
+  const int last = ctx->l_points-1;
+  const PM_TYPE *r = ls->r;
+  //the window (2 to left 2 to right) is clamped to the scan
+  ls->r[i] = pm_median5 ( r[max ( i-2,0 )], r[max ( i-1,0 )], r[i], r[min ( i+1,last )], r[min ( i+2,last )] );
 }
 
 
-/** @brief Segments scanpoints into groups based on range discontinuities.
+/** @brief Segments scanpoints into groups based on range discontinuities, one point at a time.
 
 By segmenting scans into groups of disconnected sets of points, one can
 prevent falsely interpolating points into the free space between disconnected
@@ -248,119 +318,139 @@ objects during scan projection.
 
 Segment number 0 is reserved to segments containing only 1 point.
 
-Far away points (r > PM_MAX_RANGE), gaps between groups of
+Far away points (r > max. range of the laser), gaps between groups of
 points - divide segments. The gap between extrapolated point and
 current point has to be large as well to prevent corridor walls to
 be segmented into separate points.
+
+Point @a i is segmented once points 0..i have been filtered and tagged.
+Its decision may also relabel points i-1 and i-2.
+@param ls The scan being segmented.
+@param i Index of the point (1 starts the first segment, then 2, 3, ...).
+@param seg_cnt The current segment number.
+@param cnt The number of points in the current segment.
 */
-void pm_segment_scan ( PMScan *ls )
+static inline void pm_segment_point ( PMScan *ls, int i, int *seg_cnt, int *cnt )
 {
   const PM_TYPE   MAX_DIST = PM_SEG_MAX_DIST;//max range diff between conseq. points in a seg
   PM_TYPE   dr;
-  int       seg_cnt = 0;
-  int       i,cnt;
   bool      break_seg;
 
-  seg_cnt = 1;
-
   //init:
-  if ( fabsf ( ls->r[0]-ls->r[1] ) < MAX_DIST ) //are they in the same segment?
+  if ( i == 1 )
   {
-    ls->seg[0] = seg_cnt;
-    ls->seg[1] = seg_cnt;
-    cnt        = 2;    //2 points in the segment
+    *seg_cnt = 1;
+    if ( fabsf ( ls->r[0]-ls->r[1] ) < MAX_DIST ) //are they in the same segment?
+    {
+      ls->seg[0] = *seg_cnt;
+      ls->seg[1] = *seg_cnt;
+      *cnt       = 2;    //2 points in the segment
+    }
+    else
+    {
+      ls->seg[0] = 0; //point is a segment in itself
+      ls->seg[1] = *seg_cnt;
+      *cnt       = 1;
+    }
+    return;
   }
-  else
+
+  //segment breaking conditions: - bad point;
+  break_seg = false;
+  if ( ls->bad[i] )
   {
-    ls->seg[0] = 0; //point is a segment in itself
-    ls->seg[1] = seg_cnt;
-    cnt        = 1;
+    break_seg = true;
+    ls->seg[i] = 0;
   }
-
-  for ( i=2;i<PM_L_POINTS;i++ )
+  else
   {
-    //segment breaking conditions: - bad point;
-    break_seg = false;
-    if ( ls->bad[i] )
+    dr = ls->r[i]- ( 2.0*ls->r[i-1] - ls->r[i-2] );//extrapolate & calc difference
+    //Don't break a segment if the distance between points is small
+    //or the distance beween the extrapolated point and current point is small.
+    if ( fabsf ( ls->r[i]-ls->r[i-1] ) < MAX_DIST ||
+       ( ( ls->seg[i-1]==ls->seg[i-2] ) && fabsf ( dr ) <MAX_DIST ) )
     {
-      break_seg = true;
-      ls->seg[i] = 0;
+      //not breaking the segment
+      ( *cnt )++;
+      ls->seg[i] = *seg_cnt;
     }
     else
-    {
-      dr = ls->r[i]- ( 2.0*ls->r[i-1] - ls->r[i-2] );//extrapolate & calc difference
-      //Don't break a segment if the distance between points is small
-      //or the distance beween the extrapolated point and current point is small.
-      if ( fabsf ( ls->r[i]-ls->r[i-1] ) < MAX_DIST ||
-         ( ( ls->seg[i-1]==ls->seg[i-2] ) && fabsf ( dr ) <MAX_DIST ) )
-      {
-        //not breaking the segment
-        cnt++;
-        ls->seg[i] = seg_cnt;
-      }
-      else
-        break_seg = true;
-    }//if ls->bad
+      break_seg = true;
+  }//if ls->bad
 
-    if ( break_seg ) // breaking the segment?
+  if ( break_seg ) // breaking the segment?
+  {
+    if ( *cnt==1 )
     {
-      if ( cnt==1 )
+      //check first if the last three are not on a line by coincidence
+      dr = ls->r[i]- ( 2.0*ls->r[i-1]-ls->r[i-2] );
+      if ( ls->seg[i-2] == 0 && ls->bad[i] == 0 && ls->bad[i-1] == 0
+              && ls->bad[i-2] == 0 && fabsf ( dr ) <MAX_DIST )
       {
-        //check first if the last three are not on a line by coincidence
-        dr = ls->r[i]- ( 2.0*ls->r[i-1]-ls->r[i-2] );
-        if ( ls->seg[i-2] == 0 && ls->bad[i] == 0 && ls->bad[i-1] == 0
-                && ls->bad[i-2] == 0 && fabsf ( dr ) <MAX_DIST )
-        {
-          ls->seg[i]   = seg_cnt;
-          ls->seg[i-1] = seg_cnt;
-          ls->seg[i-2] = seg_cnt;
-          cnt = 3;
-        }//if ls->
-        else
-        {
-          ls->seg[i-1] = 0;
-          //what if ls[i] is a bad point? - it could be the start of a new
-          //segment if the next point is a good point and is close enough!
-          //in that case it doesn't really matters
-          ls->seg[i] = seg_cnt;//the current point is a new segment
-          cnt = 1;
-        }
-      }//if cnt ==1
+        ls->seg[i]   = *seg_cnt;
+        ls->seg[i-1] = *seg_cnt;
+        ls->seg[i-2] = *seg_cnt;
+        *cnt = 3;
+      }//if ls->
       else
       {
-        seg_cnt++;
-        ls->seg[i] = seg_cnt;
-        cnt = 1;
-      }//else if cnt
-    }//if break seg
-  }//for
-}//pm_segment_scan
-
-/** @brief Tags point further than a given distance PM_MAX_RANGE.
-
-Far away points get tagged as @a PM_RANGE.
-@param ls The scan searched for far points.
+        ls->seg[i-1] = 0;
+        //what if ls[i] is a bad point? - it could be the start of a new
+        //segment if the next point is a good point and is close enough!
+        //in that case it doesn't really matters
+        ls->seg[i] = *seg_cnt;//the current point is a new segment
+        *cnt = 1;
+      }
+    }//if cnt ==1
+    else
+    {
+      ( *seg_cnt )++;
+      ls->seg[i] = *seg_cnt;
+      *cnt = 1;
+    }//else if cnt
+  }//if break seg
+}//pm_segment_point
+
+
+/** @brief Prepares a scan for scan matching.
+
+Filters the scan using median filter, finds far away points (tagged as @a PM_RANGE)
+and segments the scan. The three stages are done in a single sweep: every stage only
+needs the readings up to the current one from the previous stages.
+@param ctx The matching context (laser geometry and parameters).
+@param ls The scan to be preprocessed.
 */
-void pm_find_far_points ( PMScan *ls )
+void pm_preprocessScan(const PMContext *ctx, PMScan *ls)
 {
-  for ( int i=0;i<PM_L_POINTS;i++ )
+  int seg_cnt = 1, cnt = 0;
+
+  for ( int i=0;i<ctx->l_points;i++ )
   {
-    if ( ls->r[i]>PM_MAX_RANGE )
+    pm_median_filter_point ( ctx, ls, i );
+
+    if ( ls->r[i]>ctx->max_range )
       ls->bad[i] |= PM_RANGE;
+
+    if ( i > 0 )
+      pm_segment_point ( ls, i, &seg_cnt, &cnt );
   }
 }
 
+/** @brief Prepares a batch of scans for scan matching.
 
-/** @brief Prepares a scan for scan matching.
-
-Filters the scan using median filter, finds far away points and segments the scan.
-@param ls The scan to be preprocessed.
+Preprocesses every scan as pm_preprocessScan(), spreading the scans over all
+the available threads when built with OpenMP (e.g. a block of a scan log ahead of matching).
+@param ctx The matching context (laser geometry and parameters).
+@param scans The scans to be preprocessed.
+@param num_scans The number of scans.
 */
-void pm_preprocessScan(PMScan *ls)
+void pm_preprocessScans(const PMContext *ctx, PMScan *scans, int num_scans)
 {
-  pm_median_filter(ls);
-  pm_find_far_points(ls);
-  pm_segment_scan(ls);
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic, 16)
+#endif
+  for ( int k=0;k<num_scans;k++ )
+    pm_preprocessScan ( ctx, &scans[k] );
 }
 
 /** @brief Guesses if a scan was taken on a corridor.
@@ -384,24 +474,25 @@ The scan is assumed be pre-processed (segmentation and median filtering).
 An exeption is thrown if there is less than 1 valid point.
 
 TODO: Remove the double calculation of the variance.
+@param ctx The matching context (laser geometry and parameters).
 @param act The scan which is examined for being corridor-like.
 @return True if @a act seems to be taken of a corridor.
 */
-bool pm_is_corridor ( PMScan *act )
+bool pm_is_corridor ( const PMContext *ctx, const PMScan *act )
 {
   PM_TYPE fi1=0,fi2=0,fi3=0;
   PM_TYPE sxx=0,sx=0,std1,std2;
   PM_TYPE n=0;
 
-  for ( int i=0;i< ( PM_L_POINTS-1 );i++ )
+  for ( int i=0;i< ( ctx->l_points-1 );i++ )
   {
     if ( act->seg[i]==act->seg[i+1] && act->seg[i]!=0 && !act->bad[i] ) //are they in the same segment?
     {
       PM_TYPE x,y,x1,y1,fi;
-      x  = act->r[i]*pm_co[i];
-      y  = act->r[i]*pm_si[i];
-      x1 = act->r[i+1]*pm_co[i+1];
-      y1 = act->r[i+1]*pm_si[i+1];
+      x  = act->r[i]*ctx->co[i];
+      y  = act->r[i]*ctx->si[i];
+      x1 = act->r[i+1]*ctx->co[i+1];
+      y1 = act->r[i+1]*ctx->si[i+1];
       fi = atan2f ( y1-y, x1-x ) * PM_R2D;
 
       if ( fi<0 )   //want angles from 0 to 180
@@ -447,15 +538,15 @@ bool pm_is_corridor ( PMScan *act )
 
   //rotate by 30 degrees and repeat the calculations to handle cases where the corridor is aligned with the discontinuity in the angle representation.
   sxx = 0;n=0;sx=0;
-  for ( int i=0;i< ( PM_L_POINTS-1 );i++ )
+  for ( int i=0;i< ( ctx->l_points-1 );i++ )
   {
     if ( act->seg[i]==act->seg[i+1] && act->seg[i]!=0 && !act->bad[i] ) //are they in the same segment?
     {
       PM_TYPE x,y,x1,y1,fi;
-      x  = act->r[i]*cosf ( pm_fi[i]+M_PI/5.0 );
-      y  = act->r[i]*sinf ( pm_fi[i]+M_PI/5.0 );
-      x1 = act->r[i+1]*cosf ( pm_fi[i+1]+M_PI/5.0 );
-      y1 = act->r[i+1]*sinf ( pm_fi[i+1]+M_PI/5.0 );
+      x  = act->r[i]*ctx->co_rot[i];
+      y  = act->r[i]*ctx->si_rot[i];
+      x1 = act->r[i+1]*ctx->co_rot[i+1];
+      y1 = act->r[i+1]*ctx->si_rot[i+1];
       fi = atan2f ( y1-y,x1-x ) *PM_R2D;
 
       if ( fi<0 )   //want angles from 0 to 180
@@ -505,7 +596,7 @@ bool pm_is_corridor ( PMScan *act )
     st = std1;
   else
     st = std2;
-  if ( st < PM_CORRIDOR_THRESHOLD)
+  if ( st < ctx->corridor_threshold)
   {
     //cout <<"corridor"<<endl;
     return true;
@@ -515,7 +606,7 @@ bool pm_is_corridor ( PMScan *act )
     //cout<<"room"<<endl;
     return false;
   }
-}//bool pm_is_corridor(PMScan *act)
+}//bool pm_is_corridor(const PMScan *act)
 
 
 /** @brief Calculates an error index expressing the quality of a match.
@@ -537,21 +628,22 @@ TODO: Improve the accuracy of the estimate. Speed it up. Perhaps
 should use the error output from scan matching instead. A proper
 test is necessary.
 
+@param ctx The matching context (laser geometry and parameters).
 @param lsr The reference scan.
 @param lra The current scan.
 @return The average minimum Euclidean distance.
 */
-PM_TYPE pm_error_index ( PMScan *lsr,PMScan *lsa )
+PM_TYPE pm_error_index ( const PMContext *ctx, PMScan *lsr,PMScan *lsa )
 {
   int     i,j;
-  PM_TYPE rx[PM_L_POINTS],ry[PM_L_POINTS],ax[PM_L_POINTS],ay[PM_L_POINTS];
+  PM_TYPE rx[PM_MAX_POINTS],ry[PM_MAX_POINTS],ax[PM_MAX_POINTS],ay[PM_MAX_POINTS];
   PM_TYPE x,y;
   PM_TYPE d,dmin,dsum,dx,dy;
   PM_TYPE dsum1;
   int     n,n1,rn=0,an=0;
   const   PM_TYPE HUGE_ERROR  = 1000000;//Error returned when there aren't corresponding points.
-  const   PM_TYPE DISTANCE_TRESHOLD = PM_MAX_RANGE / 2; //Maximum allowed distance between corresponding points.
-  const   int     MIN_POINTS = PM_MIN_VALID_POINTS;
+  const   PM_TYPE DISTANCE_TRESHOLD = ctx->max_range / 2; //Maximum allowed distance between corresponding points.
+  const   int     MIN_POINTS = ctx->min_valid_points;
 
   lsa->th = norm_a ( lsa->th );
   PM_TYPE co = cosf ( lsa->th );
@@ -560,10 +652,10 @@ PM_TYPE pm_error_index ( PMScan *lsr,PMScan *lsa )
   // Calculate the cartesian coordinates of scan points in the the overlap region of
   // both scans.
 
-  int index360 = ( (PM_L_POINTS-1) * 360)/ PM_FOV;// number of range readings if scan was 360 degrees
-  int indexIncrement = (lsa->th * PM_R2D * (PM_L_POINTS-1)) / PM_FOV;// the current scans orientation expressed
+  int index360 = ( (ctx->l_points-1) * 360)/ ctx->fov;// number of range readings if scan was 360 degrees
+  int indexIncrement = (lsa->th * PM_R2D * (ctx->l_points-1)) / ctx->fov;// the current scans orientation expressed
                         //in indices into the range array
-  for ( i=0;i<PM_L_POINTS;i++ )
+  for ( i=0;i<ctx->l_points;i++ )
   {
     //recalculate reference scan points in cartesian corrdinates and remove those which are not in the
     //field of view of the current scan
@@ -574,10 +666,10 @@ PM_TYPE pm_error_index ( PMScan *lsr,PMScan *lsa )
       assert( (i - indexIncrement + index360) >=0);
 
       //check if the corresponding current scan point is within the field of view of the sensor:
-      if( (j >= 0) && (j < PM_L_POINTS))
+      if( (j >= 0) && (j < ctx->l_points))
       {
-        rx[rn]   = lsr->r[i]*pm_co[i];
-        ry[rn] = lsr->r[i]*pm_si[i];
+        rx[rn]   = lsr->r[i]*ctx->co[i];
+        ry[rn] = lsr->r[i]*ctx->si[i];
         //dr_circle(rx[rn],ry[rn],5,"blue");
         rn++;
       }
@@ -585,17 +677,17 @@ PM_TYPE pm_error_index ( PMScan *lsr,PMScan *lsa )
   }
 
   //do the same for the current scan, and transform it into the current scan frame:
-  for ( i=0;i<PM_L_POINTS;i++ )
+  for ( i=0;i<ctx->l_points;i++ )
   {
     if ( !lsa->bad[i] )
     {
       int j = (i + indexIncrement + index360) % index360;
       assert( (i + indexIncrement + index360) >=0);
 
-      if( (j >= 0) && (j < PM_L_POINTS))
+      if( (j >= 0) && (j < ctx->l_points))
       {
-        x = lsa->r[i]*pm_co[i];
-        y = lsa->r[i]*pm_si[i];
+        x = lsa->r[i]*ctx->co[i];
+        y = lsa->r[i]*ctx->si[i];
         //transform into ref. scan frame:
         ax[an] = x*co-y*si+lsa->rx;
         ay[an] = x*si+y*co+lsa->ry;
@@ -672,6 +764,89 @@ PM_TYPE pm_error_index ( PMScan *lsr,PMScan *lsa )
   return HUGE_ERROR;
 }
 
+/** @brief Average range residual between the reference scan and the projected current scan.
+
+Uses the projection of the current scan already held in @a ws (ws->new_r, ws->new_bad).
+Residuals larger than PM_MAX_ERROR/2 are not considered associated.
+@param ctx The matching context (laser geometry and parameters).
+@param ref The reference scan.
+@param ws Scratch memory holding the projected current scan.
+@param n The number of associated points is returned here.
+@return The average range residual, or 100000000.0 if there are no associated points.
+*/
+static PM_TYPE pm_range_residual ( const PMContext *ctx, const PMScan *ref, const PMWorkspace *ws, int *n )
+{
+  PM_TYPE  e = 0;
+  *n = 0;
+  for ( int i=0;i < ctx->l_points;i++ ) //searching through the current points
+  {
+    PM_TYPE delta = fabsf ( ws->new_r[i] - ref->r[i] );
+    if ( !ws->new_bad[i] && !ref->bad[i] && delta < PM_MAX_ERROR / 2.0)
+    {
+      e += delta;
+      ( *n )++;
+    }
+  }//for i
+
+  if ( *n > 0 )
+    return e/ *n;
+  return 100000000.0;
+}
+
+/** @brief Average range residual of the last projection of pm_psm(), after its last correction.
+
+The projection of the current scan (ws->new_r) was made before the last correction of
+the pose, and projecting it again would cost as much as an iteration. Instead the
+residuals are corrected to first order: an orientation correction shifts the projected
+ranges by @a dth (interpolated between bearings), and a translation correction changes
+them through the jacobian of the translation estimation.
+@param ctx The matching context (laser geometry and parameters).
+@param ref The reference scan.
+@param ws Scratch memory holding the last projection.
+@param rotated True if the last correction was the orientation one (@a dth), false if it was the translation (@a dx, @a dy).
+@param n The number of associated points is returned here.
+@return The average range residual.
+*/
+static PM_TYPE pm_corrected_residual ( const PMContext *ctx, const PMScan *ref, const PMWorkspace *ws, bool rotated,
+                                       PM_TYPE dx, PM_TYPE dy, PM_TYPE dth, int *n )
+{
+  const PM_TYPE shift = dth/ctx->dfi;//the ranges move by this number of bearings
+  PM_TYPE  e = 0;
+  *n = 0;
+  for ( int i=0;i < ctx->l_points;i++ )
+  {
+    if ( ref->bad[i] )
+      continue;
+
+    PM_TYPE r;
+    if ( rotated )
+    {
+      const PM_TYPE s = i - shift;
+      const int     j = ( int ) floorf ( s );
+      if ( j < 0 || j+1 >= ctx->l_points || ws->new_bad[j] || ws->new_bad[j+1] )
+        continue;
+      r = ws->new_r[j] + ( s - j ) * ( ws->new_r[j+1] - ws->new_r[j] );
+    }
+    else
+    {
+      if ( ws->new_bad[i] )
+        continue;
+      r = ws->new_r[i] + ctx->co[i]*dx + ctx->si[i]*dy;
+    }
+
+    PM_TYPE delta = fabsf ( r - ref->r[i] );
+    if ( delta < PM_MAX_ERROR / 2.0 )
+    {
+      e += delta;
+      ( *n )++;
+    }
+  }//for i
+
+  if ( *n > 0 )
+    return e/ *n;
+  return 100000000.0;
+}
+
 /** @brief More quickly calculates an error index expressing the quality of a match.
 
 This function assesses how well is the current scan aligned with the
@@ -683,19 +858,19 @@ The current scan is compared to the reference scan by projecting the
 current scan where the reference scan was taken and calculating the
 average range residuals.
 
+@param ctx The matching context (laser geometry and parameters).
 @param lsr The reference scan.
 @param lra The current scan.
+@param ws Scratch memory of the matcher.
 @return The average minimum Euclidean distance.
 */
-PM_TYPE pm_error_index2 ( PMScan *ref,PMScan *cur, int* associatedPoints )
+PM_TYPE pm_error_index2 ( const PMContext *ctx, const PMScan *ref,const PMScan *cur, PMWorkspace *ws, int* associatedPoints )
 {
 
-  PMScan    cur2;//copies of current and reference scans
   PM_TYPE   rx,ry,rth,ax,ay,ath;//robot pos at ref and current scans
   PM_TYPE   t13,t23,LASER_Y = PM_LASER_Y;
-  PM_TYPE   new_r[PM_L_POINTS];//interpolated r at measurement bearings
-  int       new_bad[PM_L_POINTS];//bad flags of the interpolated range readings
-  PM_TYPE   avg_err = 100000000.0;
+  PM_TYPE   avg_err;
+  int       n;
 
   rx =  ref->rx; ry = ref->ry; rth = ref->th;
   ax =  cur->rx;  ay = cur->ry;  ath = cur->th;
@@ -705,26 +880,10 @@ PM_TYPE pm_error_index2 ( PMScan *ref,PMScan *cur, int* associatedPoints )
   t13 = sinf ( rth-ath ) *LASER_Y+cosf ( rth ) *ax+sinf ( rth ) *ay-sinf ( rth ) *ry-rx*cosf ( rth );
   t23 = cosf ( rth-ath ) *LASER_Y-sinf ( rth ) *ax+cosf ( rth ) *ay-cosf ( rth ) *ry+rx*sinf ( rth )-LASER_Y;
 
-  cur2 = *cur;
-  cur2.rx = t13; cur2.ry = t23; cur2.th = ath-rth;
-
-  //from now on act.rx,.. express the laser's position in the reference frame
-  pm_scan_project( &cur2,  new_r, new_bad );
-
-  PM_TYPE  e = 0;
-  int n = 0;
-  for ( int i=0;i < PM_L_POINTS;i++ ) //searching through the current points
-  {
-    PM_TYPE delta = fabsf ( new_r[i] - ref->r[i] );
-    if ( !new_bad[i] && !ref->bad[i] && delta < PM_MAX_ERROR / 2.0)
-    {
-      e += delta;
-      n++;
-    }
-  }//for i
+  //from now on t13,.. express the laser's position in the reference frame
+  pm_scan_project( ctx, cur, t13, t23, ath-rth, ws );
 
-  if ( n > 0 )
-    avg_err = e/n;
+  avg_err = pm_range_residual ( ctx, ref, ws, &n );
   if(associatedPoints != NULL)
   {
     *associatedPoints = n;
@@ -745,29 +904,30 @@ neighbouring points.
 Normally, this function is used on the reference scan and
 not the current scan.
 
+@param ctx The matching context (laser geometry and parameters).
 @param act The scan of which oriention is to be determined.
 @return The orientation of the corridor.
 */
-PM_TYPE pm_corridor_angle ( PMScan *act )
+PM_TYPE pm_corridor_angle ( const PMContext *ctx, const PMScan *act )
 {
   PM_TYPE fi;
   int   n=0,j,i;
-  PM_TYPE ang[PM_L_POINTS];
+  PM_TYPE ang[PM_MAX_POINTS];
   int hist[180];//180 degree angle histogram. at 2 deg; 0,2,4....
 
   for ( i=0;i<180;i++ )
     hist[i]=0;
 
-  for ( i=0;i< ( PM_L_POINTS-1 );i++ )
+  for ( i=0;i< ( ctx->l_points-1 );i++ )
   {
     if ( act->seg[i]==act->seg[i+1] && act->seg[i]!=0 && !act->bad[i] ) //are they in the same segment?
     {
       PM_TYPE x,y,x1,y1,fi;
-      x  = act->r[i]*pm_co[i];
-      y  = act->r[i]*pm_si[i];
+      x  = act->r[i]*ctx->co[i];
+      y  = act->r[i]*ctx->si[i];
 
-      x1 = act->r[i+1]*pm_co[i+1];
-      y1 = act->r[i+1]*pm_si[i+1];
+      x1 = act->r[i+1]*ctx->co[i+1];
+      y1 = act->r[i+1]*ctx->si[i+1];
       fi = atan2f ( y1-y,x1-x ) *PM_R2D;//angle in degrees
 
       //Want angles from 0 to 360
@@ -874,6 +1034,35 @@ void pm_cov_est ( PM_TYPE err, double *c11,double *c12, double *c22, double *c33
   }//else
 }//pm_cov_est
 
+/** @brief Fills the covariance of a match from an error index already computed by the matcher.
+
+The corridor test and the corridor orientation are evaluated on the reference scan.
+A scan too sparse for the corridor test is not regarded as a corridor.
+@param ctx The matching context (laser geometry and parameters).
+@param lsr The reference scan.
+@param err The error index of the match.
+@param n The number of associated points @a err was computed from.
+@param cov The estimated covariance is returned here.
+*/
+static void pm_match_cov ( const PMContext *ctx, const PMScan *lsr, PM_TYPE err, int n, PMCovariance *cov )
+{
+  cov->err        = err;
+  cov->n          = n;
+  cov->corridor   = false;
+  cov->corr_angle = 0;
+  try
+  {
+    if ( pm_is_corridor ( ctx, lsr ) )
+    {
+      cov->corr_angle = pm_corridor_angle ( ctx, lsr );
+      cov->corridor   = true;
+    }
+  }catch ( int )
+  {
+  }
+  pm_cov_est ( err, &cov->c11, &cov->c12, &cov->c22, &cov->c33, cov->corridor, cov->corr_angle );
+}//pm_match_cov
+
 
 /** @brief Match two laser scans using polar scan matching.
 
@@ -894,38 +1083,41 @@ the solution in all directions. This can occur for examples in corridor-like env
 including rooms where the room directly in front of the laser is outside of
 the range of the laser range finder.
 
+The scans are not copied: only the pose of @a lsa is written.
+
+If @a cov is given, the covariance of the match is estimated with pm_cov_est() from
+the average range residual at the final pose, obtained from the last scan projection
+(see pm_corrected_residual()) without projecting the scan again.
+
+@param ctx The matching context (laser geometry and parameters).
 @param lsr The reference scan.
 @param lra The current scan.
+@param ws Scratch memory of the matcher (one per concurrently running matcher).
+@param cov If not NULL, the covariance of the match is returned here.
 */
-PM_TYPE pm_psm ( const PMScan *lsr,PMScan *lsa )
+PM_TYPE pm_psm ( const PMContext *ctx, const PMScan *lsr,PMScan *lsa, PMWorkspace *ws, PMCovariance *cov )
 {
-  PMScan    act, ref;//copies of current and reference scans
   PM_TYPE   rx,ry,rth,ax,ay,ath;//robot pos at ref and current scans
   PM_TYPE   t13,t23,LASER_Y = PM_LASER_Y;
-  PM_TYPE   new_r[PM_L_POINTS];//interpolated r at measurement bearings
-  int       new_bad[PM_L_POINTS];//bad flags of the interpolated range readings
+  const PM_TYPE *new_r = ws->new_r;//interpolated r at measurement bearings
+  const int *new_bad = ws->new_bad;//bad flags of the interpolated range readings
   PM_TYPE   C = PM_WEIGHTING_FACTOR;//weighting factor; see dudek00
   int       iter,small_corr_cnt=0;
   PM_TYPE   dx=0,dy=0,dth=0;//match error, current scan corrections
   PM_TYPE   avg_err = 100000000.0;
+  bool      rotated = false;//was the last correction an orientation one?
 
 
-  act = *lsa;
-  ref = *lsr;
-
-  rx =  ref.rx; ry = ref.ry; rth = ref.th;
-  ax =  act.rx; ay = act.ry; ath = act.th;
+  rx =  lsr->rx; ry = lsr->ry; rth = lsr->th;
+  ax =  lsa->rx; ay = lsa->ry; ath = lsa->th;
 
   //transformation of the current scan laser scanner coordinates into the reference
   //laser scanner's coordinate system:
   t13 = sinf ( rth-ath ) *LASER_Y+cosf ( rth ) *ax+sinf ( rth ) *ay-sinf ( rth ) *ry-rx*cosf ( rth );
   t23 = cosf ( rth-ath ) *LASER_Y-sinf ( rth ) *ax+cosf ( rth ) *ay-cosf ( rth ) *ry+rx*sinf ( rth )-LASER_Y;
 
-  ref.rx = 0;   ref.ry = 0;   ref.th = 0;
-  act.rx = t13; act.ry = t23; act.th = ath-rth;
-
-  ax = act.rx; ay = act.ry; ath = act.th;
-  //from now on act.rx,.. express the laser's position in the reference frame
+  ax = t13; ay = t23; ath = ath-rth;
+  //from now on ax,.. express the laser's position in the reference frame
 
   iter = -1;
   while ( ++iter < PM_MAX_ITER && small_corr_cnt < 3 ) //Has to be a few small corrections before stopping.
@@ -936,19 +1128,19 @@ PM_TYPE pm_psm ( const PMScan *lsr,PMScan *lsa )
       small_corr_cnt=0;
 
 
-    act.rx = ax; act.ry = ay; act.th = ath;
-    //printf("\n act.rx = %f, act.ry = %f, act.th = %f", act.rx, act.ry, act.th);
-    pm_scan_project(&act, new_r, new_bad);
+    //printf("\n ax = %f, ay = %f, ath = %f", ax, ay, ath);
+    pm_scan_project(ctx, lsa, ax, ay, ath, ws);
 
-//    for (unsigned int i=0; i<PM_L_POINTS; i++)
-//        printf("\n newr = %f, new_bad = %d actr = %f, refr = %f", new_r[i], new_bad[i], act.r[i], ref.r[i]);
+//    for (unsigned int i=0; i<ctx->l_points; i++)
+//        printf("\n newr = %f, new_bad = %d actr = %f, refr = %f", new_r[i], new_bad[i], lsa->r[i], lsr->r[i]);
 
     //---------------ORIENTATION SEARCH-----------------------------------
     //search for angle correction using crosscorrelation, perform it every second step
     if ( iter%2 == 0 )
     {
-       dth = pm_orientation_search(&ref, new_r, new_bad);
+       dth = pm_orientation_search(ctx, lsr, ws);
        ath += dth;
+       rotated = true;
        continue;
     }
 
@@ -958,14 +1150,23 @@ PM_TYPE pm_psm ( const PMScan *lsr,PMScan *lsa )
       C = C/50.0; // weigh far points even less.
 
 
-    avg_err = pm_translation_estimation(&ref, new_r, new_bad, C, &dx, &dy);
+    avg_err = pm_translation_estimation(ctx, lsr, new_r, new_bad, C, &dx, &dy);
     ax += dx;
     ay += dy;
+    rotated = false;
 
   }//while iter
 
   //cout <<"Iterations: "<<iter<<endl;
   lsa->rx = ax; lsa->ry = ay; lsa->th = ath;
+
+  if ( cov != NULL )
+  {
+    //the last projection was made before the last correction: correct its residuals instead of projecting again
+    int n;
+    PM_TYPE err = pm_corrected_residual ( ctx, lsr, ws, rotated, dx, dy, dth, &n );
+    pm_match_cov ( ctx, lsr, err, n, cov );
+  }
   return (avg_err);
 }//pm_psm
 
@@ -1007,6 +1208,214 @@ PM_TYPE point_line_distance ( PM_TYPE x1, PM_TYPE y1, PM_TYPE x2, PM_TYPE y2,
 }//  point_line_distance
 
 
+/** @brief Builds the grid used by ICP to look up the closest reference points.
+
+The valid points of the reference scan (ws->ref_x, ws->ref_y) are bucketed in a
+regular grid covering their bounding box, with cells of PM_MAX_ERROR/4 (larger if
+the box would need more than PM_ICP_GRID_CELLS cells). The points of each cell are
+stored contiguously and in increasing index order.
+
+@param ctx The matching context (laser geometry and parameters).
+@param lsr The reference scan.
+@param ws Scratch memory holding the reference points; the grid is returned in it.
+*/
+static void pm_icp_build_grid ( const PMContext *ctx, const PMScan *lsr, PMWorkspace *ws )
+{
+  PM_TYPE xmin = 0, xmax = 0, ymin = 0, ymax = 0;
+  bool    first = true;
+  int     i;
+
+  for ( i=0;i<ctx->l_points;i++ )
+  {
+    if ( lsr->bad[i] )
+      continue;
+    if ( first || ws->ref_x[i] < xmin ) xmin = ws->ref_x[i];
+    if ( first || ws->ref_x[i] > xmax ) xmax = ws->ref_x[i];
+    if ( first || ws->ref_y[i] < ymin ) ymin = ws->ref_y[i];
+    if ( first || ws->ref_y[i] > ymax ) ymax = ws->ref_y[i];
+    first = false;
+  }
+
+  PM_TYPE cell = PM_MAX_ERROR/4.0;
+  while ( ( ( xmax-xmin ) /cell + 1 ) * ( ( ymax-ymin ) /cell + 1 ) > PM_ICP_GRID_CELLS )
+    cell *= 1.5;
+
+  ws->grid_x0   = xmin;
+  ws->grid_y0   = ymin;
+  ws->grid_cell = cell;
+  ws->grid_cols = ( int ) ( ( xmax-xmin ) /cell ) + 1;
+  ws->grid_rows = ( int ) ( ( ymax-ymin ) /cell ) + 1;
+  const int num_cells = ws->grid_cols*ws->grid_rows;
+
+  //counting sort of the valid points by cell: count, accumulate the cell ends,
+  //then fill every cell backwards so that its indices end up in increasing order
+  for ( i=0;i<=num_cells;i++ )
+    ws->grid_start[i] = 0;
+  for ( i=0;i<ctx->l_points;i++ )
+  {
+    if ( lsr->bad[i] )
+      continue;
+    int c = ( int ) ( ( ws->ref_y[i]-ymin ) /cell ) *ws->grid_cols + ( int ) ( ( ws->ref_x[i]-xmin ) /cell );
+    ws->grid_cell_of[i] = c;
+    ws->grid_start[c]++;
+  }
+  for ( i=1;i<=num_cells;i++ )
+    ws->grid_start[i] += ws->grid_start[i-1];
+  for ( i=ctx->l_points-1;i>=0;i-- )
+  {
+    if ( !lsr->bad[i] )
+      ws->grid_idx[--ws->grid_start[ws->grid_cell_of[i]]] = i;
+  }
+}//pm_icp_build_grid
+
+/** @brief Finds the reference point closest to (x,y) among those with index in [imin,imax).
+
+Searches the grid built by pm_icp_build_grid() in rings of cells around (x,y),
+and stops when the next ring cannot hold a point closer than the best one found
+or than PM_MAX_ERROR. Among points at the same distance the one with the lowest
+index is returned, so the result is the same as scanning the index interval for
+the minimum, whenever that minimum is closer than PM_MAX_ERROR.
+
+@param ws Scratch memory holding the reference points and their grid.
+@param x,y [cm] The query point in the reference frame.
+@param imin,imax The interval of indices the closest point may have.
+@param min_d The square distance of the closest point is returned here.
+@return The index of the closest point, or -1 if there is no point within PM_MAX_ERROR.
+*/
+static int pm_icp_closest_point ( const PMWorkspace *ws, PM_TYPE x, PM_TYPE y, int imin, int imax, PM_TYPE *min_d )
+{
+  const PM_TYPE cell = ws->grid_cell;
+  const int     cx = ( int ) floorf ( ( x-ws->grid_x0 ) /cell );
+  const int     cy = ( int ) floorf ( ( y-ws->grid_y0 ) /cell );
+  const int     max_ring = ( int ) ( PM_MAX_ERROR/cell ) + 2;
+  int           min_idx = -1;
+
+  *min_d = 1000000;
+  for ( int ring=0;ring<=max_ring;ring++ )
+  {
+    //every point of this ring is at least (ring-1) cells away from (x,y)
+    PM_TYPE lower = ( ring-1 ) *cell;
+    if ( ring > 1 && ( lower > PM_MAX_ERROR || SQ ( lower ) > *min_d ) )
+      break;
+
+    int y0 = max ( cy-ring, 0 ), y1 = min ( cy+ring, ws->grid_rows-1 );
+    int x0 = max ( cx-ring, 0 ), x1 = min ( cx+ring, ws->grid_cols-1 );
+    for ( int gy=y0;gy<=y1;gy++ )
+    {
+      //the first and last rows of the ring are full, the others only have their two ends
+      bool border_row = ( gy == cy-ring || gy == cy+ring );
+      int  step = ( border_row || ring == 0 ) ? 1 : 2*ring;
+      for ( int gx=cx-ring;gx<=cx+ring;gx+=step )
+      {
+        if ( gx < x0 || gx > x1 )
+          continue;
+        int c = gy*ws->grid_cols + gx;
+        for ( int k=ws->grid_start[c];k<ws->grid_start[c+1];k++ )
+        {
+          int j = ws->grid_idx[k];
+          if ( j < imin || j >= imax )
+            continue;
+          PM_TYPE d = SQ ( x-ws->ref_x[j] ) + SQ ( y-ws->ref_y[j] );//square distance
+          if ( d < *min_d || ( d == *min_d && j < min_idx ) )
+          {
+            *min_d  = d;
+            min_idx = j;
+          }
+        }
+      }
+    }
+  }
+  return min_idx;
+}//pm_icp_closest_point
+
+
+//Orders matches by distance, and equal distances by position
+struct PMDistLess
+{
+  const PM_TYPE *dist;
+  PMDistLess ( const PM_TYPE *d ) : dist ( d ) {}
+  bool operator() ( int a, int b ) const { return dist[a] < dist[b] || ( dist[a] == dist[b] && a < b ); }
+};
+
+/** @brief Rearranges the ICP matches exactly as @a passes passes of bubble sort on their distances would.
+
+ICP drops its worst matches by bubbling them to the end of the match list, and
+the order left in the rest of the list is the order in which the pose sums are
+accumulated. Instead of O(passes*n) swaps, the same permutation is built in
+O(n log n): every pass moves each match that has a larger one on its left one
+place to the left, so after k passes the number of larger matches on its left
+is max(0, L-k), where L is that number in the input (equal distances are never
+swapped, so they are ordered by position). The matches are then placed from the
+smallest to the largest in the free slot that leaves that many free slots, i.e.
+larger matches, on its left.
+
+@param n Number of matches (ws->index, ws->dist).
+@param passes Number of bubble sort passes.
+@param ws Scratch memory holding the matches.
+*/
+static void pm_icp_bubble_passes ( int n, int passes, PMWorkspace *ws )
+{
+  int *order = ws->sort_order, *rank = ws->sort_rank, *tree = ws->sort_tree, *pos = ws->sort_left;
+  int i, t;
+
+  if ( passes <= 0 || n < 2 )
+    return;
+
+  //matches from the smallest to the largest distance
+  for ( i=0;i<n;i++ )
+    order[i] = i;
+  sort ( order, order+n, PMDistLess ( ws->dist ) );
+  for ( i=0;i<n;i++ )
+    rank[order[i]] = i;
+
+  //number of larger matches on the left of every match (Fenwick tree over the ranks)
+  for ( i=0;i<=n;i++ )
+    tree[i] = 0;
+  for ( i=0;i<n;i++ )
+  {
+    int smaller = 0;
+    for ( t=rank[i];t>0;t -= t & -t )
+      smaller += tree[t];
+    pos[i] = max ( 0, i - smaller - passes );
+    for ( t=rank[i]+1;t<=n;t += t & -t )
+      tree[t]++;
+  }
+
+  //place the matches in increasing order; a Fenwick tree counts the free slots
+  int top = 1;
+  while ( 2*top <= n )
+    top *= 2;
+  for ( i=1;i<=n;i++ )
+    tree[i] = 1;
+  for ( i=1;i<=n;i++ )
+    if ( i + ( i & -i ) <= n )
+      tree[i + ( i & -i )] += tree[i];
+  for ( i=0;i<n;i++ )
+  {
+    int m = order[i], slot = 0, k = pos[m] + 1;//the slot is the k-th free one
+    for ( t=top;t>0;t/=2 )
+      if ( slot+t <= n && tree[slot+t] < k )
+      {
+        slot += t;
+        k -= tree[slot];
+      }
+    //slot is 0-based here
+    ws->index_tmp[slot][0] = ws->index[m][0];
+    ws->index_tmp[slot][1] = ws->index[m][1];
+    ws->dist_tmp[slot]     = ws->dist[m];
+    for ( t=slot+1;t<=n;t += t & -t )
+      tree[t]--;
+  }
+
+  for ( i=0;i<n;i++ )
+  {
+    ws->index[i][0] = ws->index_tmp[i][0];
+    ws->index[i][1] = ws->index_tmp[i][1];
+    ws->dist[i]     = ws->dist_tmp[i];
+  }
+}//pm_icp_bubble_passes
+
+
 /** @brief Matches two laser scans using the iterative closest point method.
 
 Minimizes least square error of points through changing lsa->rx, lsa->ry, lsa->th
@@ -1015,22 +1424,32 @@ points. Only the best 80% of points are used in the pose calculation.
 Scan projection is done at each iteration.
 
 For maintanence reasons changed scan projection to that of psm.
+The scans are not copied: only the pose of @a lsa is written.
+
+If @a cov is given, the covariance of the match is estimated with pm_cov_est() from
+the distances of the matches used in the last pose estimation, at the final pose.
+
+@param ctx The matching context (laser geometry and parameters).
+@param lsr The reference scan.
+@param lra The current scan.
+@param ws Scratch memory of the matcher (one per concurrently running matcher).
+@param cov If not NULL, the covariance of the match is returned here.
 */
-PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
+PM_TYPE pm_icp (  const PMContext *ctx, const PMScan *lsr,PMScan *lsa, PMWorkspace *ws, PMCovariance *cov )
 {
 #define INTERPOLATE_ICP  //comment out if no interpolation of ref. scan points iS  necessary
-  PMScan    act,  ref;//copies of current and reference scans
   PM_TYPE   rx,ry,rth,ax,ay,ath;//robot pos at ref and current scans
   PM_TYPE   t13,t23,LASER_Y = PM_LASER_Y;
-  int       new_bad[PM_L_POINTS];//bad flags of the projected current scan range readings
-  PM_TYPE   new_r[PM_L_POINTS];//ranges of current scan projected into ref. frame for occlusion check
-  PM_TYPE   nx[PM_L_POINTS];//current scanpoints in ref coord system
-  PM_TYPE   ny[PM_L_POINTS];//current scanpoints in ref coord system
-  int       index[PM_L_POINTS][2];//match indices current,refernce
-  PM_TYPE   dist[PM_L_POINTS];// distance for the matches
+  const int *new_bad = ws->new_bad;//bad flags of the projected current scan range readings
+  PM_TYPE   *ref_x = ws->ref_x, *ref_y = ws->ref_y;//cartesian coordinates of the reference scan
+  PM_TYPE   *act_x = ws->act_x, *act_y = ws->act_y;//cartesian coordinates of the current scan
+  PM_TYPE   *nx = ws->nx;//current scanpoints in ref coord system
+  PM_TYPE   *ny = ws->ny;//current scanpoints in ref coord system
+  int       (*index)[2] = ws->index;//match indices current,refernce
+  PM_TYPE   *dist = ws->dist;// distance for the matches
   int       n = 0;//number of valid points
-  int       iter,i,j,small_corr_cnt=0,k,imax;
-  int       window       = PM_SEARCH_WINDOW;//+- width of search for correct orientation
+  int       iter,i,small_corr_cnt=0,imax;
+  int       window       = ctx->search_window;//+- width of search for correct orientation
   PM_TYPE   abs_err=0,dx=0,dy=0,dth=0;//match error, current scan corrections
   PM_TYPE   co,si;
 
@@ -1042,33 +1461,30 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
   start_tick =pm_msec();
 #endif
 
-  act = *lsa;
-  ref = *lsr;
-
-  rx =  ref.rx; ry = ref.ry; rth = ref.th;
-  ax =  act.rx; ay = act.ry; ath = act.th;
+  rx =  lsr->rx; ry = lsr->ry; rth = lsr->th;
+  ax =  lsa->rx; ay = lsa->ry; ath = lsa->th;
 
   //transformation of current scan laser scanner coordinates into reference
   //laser scanner coordinates
   t13 = sinf ( rth-ath ) *LASER_Y+cosf ( rth ) *ax+sinf ( rth ) *ay-sinf ( rth ) *ry-rx*cosf ( rth );
   t23 = cosf ( rth-ath ) *LASER_Y-sinf ( rth ) *ax+cosf ( rth ) *ay-cosf ( rth ) *ry+rx*sinf ( rth )-LASER_Y;
 
-  ref.rx = 0;   ref.ry = 0;   ref.th = 0;
-  act.rx = t13; act.ry = t23; act.th = ath-rth;
-
-  ax = act.rx; ay = act.ry; ath = act.th;
-  //from now on act.rx,.. express the lasers position in the ref frame
+  ax = t13; ay = t23; ath = ath-rth;
+  //from now on ax,.. express the lasers position in the ref frame
 
   //intializing x,y of act and ref
-  for ( i=0;i<PM_L_POINTS;i++ )
+  for ( i=0;i<ctx->l_points;i++ )
   {
-    ref.x[i] = ref.r[i]*pm_co[i];
-    ref.y[i] = ref.r[i]*pm_si[i];
+    ref_x[i] = lsr->r[i]*ctx->co[i];
+    ref_y[i] = lsr->r[i]*ctx->si[i];
 
-    act.x[i] = act.r[i]*pm_co[i];
-    act.y[i] = act.r[i]*pm_si[i];
+    act_x[i] = lsa->r[i]*ctx->co[i];
+    act_y[i] = lsa->r[i]*ctx->si[i];
   }//for i
 
+  //the reference scan does not move: index its points once for all the iterations
+  pm_icp_build_grid ( ctx, lsr, ws );
+
   iter = -1;
   while ( ++iter<PM_MAX_ITER_ICP && small_corr_cnt<3 ) //have to be a few small corrections before stop
   {
@@ -1094,21 +1510,20 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
 #endif
 
     //Scan projection
-    act.rx = ax;act.ry = ay;act.th = ath;
-    pm_scan_project(&act,  new_r, new_bad);
+    pm_scan_project(ctx, lsa, ax, ay, ath, ws);
 
     // transformation the cartesian coordinates of the points:
     co = cosf ( ath );
     si = sinf ( ath );
-    for ( i=0;i<PM_L_POINTS;i++ )
+    for ( i=0;i<ctx->l_points;i++ )
     {
-      nx[i]     = act.x[i]*co - act.y[i]*si + ax;
-      ny[i]     = act.x[i]*si + act.y[i]*co + ay;
+      nx[i]     = act_x[i]*co - act_y[i]*si + ax;
+      ny[i]     = act_x[i]*si + act_y[i]*co + ay;
 #ifdef GR
-      if ( ref.bad[i] )
-        dr_circle ( ref.x[i],ref.y[i],4,"yellow" );
+      if ( lsr->bad[i] )
+        dr_circle ( ref_x[i],ref_y[i],4,"yellow" );
        else
-        dr_circle ( ref.x[i],ref.y[i],4,"black" );
+        dr_circle ( ref_x[i],ref_y[i],4,"black" );
       if ( new_bad[i] )
         dr_circle ( nx[i],ny[i],4,"green" );
       else
@@ -1118,19 +1533,19 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
 //    dr_zoom();
 #ifdef GR
     cout <<"interpolated ranges. press enter"<<endl;
-/*    for ( i=0;i<PM_L_POINTS;i++ )
-      dr_circle ( new_r[i]*pm_co[i],new_r[i]*pm_si[i],6,"red" );*/
+/*    for ( i=0;i<ctx->l_points;i++ )
+      dr_circle ( ws->new_r[i]*ctx->co[i],ws->new_r[i]*ctx->si[i],6,"red" );*/
     dr_zoom();
 #endif
 
     //Correspondence search: go through the points of the current
     //scan and find the closest point in the reference scan
-    //lying withing a search interval.
+    //lying withing a search interval (looked up in the grid of the reference scan).
     n=0;
-    PM_TYPE d,min_d;
+    PM_TYPE min_d;
     int min_idx;
 
-    for ( i=0;i<PM_L_POINTS;i++ )
+    for ( i=0;i<ctx->l_points;i++ )
     {
       min_d = 1000000;
       min_idx = -1;
@@ -1141,21 +1556,10 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
         if ( imin<0 )
           imin =0;
         imax = i+window ;
-        if ( imax>PM_L_POINTS )
-          imax =PM_L_POINTS;
+        if ( imax>ctx->l_points )
+          imax =ctx->l_points;
 
-        for ( j=imin;j<imax;j++ )
-        {
-          if ( !ref.bad[j] )
-          {
-            d =  SQ ( nx[i]-ref.x[j] ) + SQ ( ny[i]-ref.y[j] );//square distance
-            if ( d<min_d )
-            {
-              min_d  = d;
-              min_idx = j;
-            }
-          }
-        }//for
+        min_idx = pm_icp_closest_point ( ws, nx[i], ny[i], imin, imax, &min_d );
         if ( min_idx>=0 && sqrtf ( min_d ) <PM_MAX_ERROR ) // was there any match closer than 1m?
         {
           index[n][0] = i;
@@ -1163,14 +1567,14 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
           dist[n] = sqrtf ( min_d );
           n++;
 #ifdef GR
-          dr_line ( nx[i],ny[i],ref.x[min_idx],ref.y[min_idx],"blue" );
+          dr_line ( nx[i],ny[i],ref_x[min_idx],ref_y[min_idx],"blue" );
 #endif
         }
       }//if
     }//for
 //    dr_zoom();
 
-    if ( n<PM_MIN_VALID_POINTS )
+    if ( n<ctx->min_valid_points )
     {
       cerr <<"pm_icp: ERROR not enough points"<<endl;
 #ifdef  PM_GENERATE_RESULTS
@@ -1179,33 +1583,15 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
       throw 1;
     }
 
-    //sort the matches with bubble sort
+    //sort the matches with (the equivalent of) imax passes of bubble sort
     //put the largest 20 percent to the end
     imax = ( int ) ( ( double ) n*0.2 );
-    for ( i=0;i<imax;i++ )
-      for ( j=1;j< ( n-i );j++ )
-      {
-        if ( dist[j]<dist[j-1] ) //are they in the wrong order?
-        {
-          //swap them
-          k             = index[j][0];
-          index[j][0]   = index[j-1][0];
-          index[j-1][0] = k;
-
-          k             = index[j][1];
-          index[j][1]   = index[j-1][1];
-          index[j-1][1] = k;
-
-          d             = dist[j];
-          dist[j]       = dist[j-1];
-          dist[j-1]     = d;
-        }
-      }//for j
+    pm_icp_bubble_passes ( n, imax, ws );
 
 #ifdef INTERPOLATE_ICP
     //------------------------INTERPOLATION---------------------------
     //comment out if not necessary
-    PM_TYPE ix[PM_L_POINTS],iy[PM_L_POINTS];//interp. ref. points.
+    PM_TYPE *ix = ws->ix, *iy = ws->iy;//interp. ref. points.
     //replace nx,xy with their interpolated... where suitable
     {
 
@@ -1219,30 +1605,30 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
 
 #ifdef GR
         dr_circle ( nx[index[i][0]],ny[index[i][0]],1.0,"brown" );
-        dr_circle ( ref.x[index[i][1]],ref.y[index[i][1]],1.0,"brown" );
-        dr_circle ( ref.x[index[i][1]-1],ref.y[index[i][1]-1],1.0,"brown" );
-        dr_circle ( ref.x[index[i][1]+1],ref.y[index[i][1]+1],1.0,"brown" );
+        dr_circle ( ref_x[index[i][1]],ref_y[index[i][1]],1.0,"brown" );
+        dr_circle ( ref_x[index[i][1]-1],ref_y[index[i][1]-1],1.0,"brown" );
+        dr_circle ( ref_x[index[i][1]+1],ref_y[index[i][1]+1],1.0,"brown" );
 #endif
         d1=-1;d2=-1;
         if ( index[i][1]>0 ) //not associated to the first point?
         {
-          d1 = point_line_distance ( ref.x[index[i][1]-1], ref.y[index[i][1]-1],
-                                     ref.x[index[i][1]],   ref.y[index[i][1]],
+          d1 = point_line_distance ( ref_x[index[i][1]-1], ref_y[index[i][1]-1],
+                                     ref_x[index[i][1]],   ref_y[index[i][1]],
                                      nx[index[i][0]],      ny[index[i][0]],
                                      &minx1, &miny1 );
         }
 
-        if ( index[i][1]< ( PM_L_POINTS-1 ) ) //not associated to the last point?
+        if ( index[i][1]< ( ctx->l_points-1 ) ) //not associated to the last point?
         {
-          d2 = point_line_distance ( ref.x[index[i][1]],  ref.y[index[i][1]],
-                                     ref.x[index[i][1]+1],ref.y[index[i][1]+1],
+          d2 = point_line_distance ( ref_x[index[i][1]],  ref_y[index[i][1]],
+                                     ref_x[index[i][1]+1],ref_y[index[i][1]+1],
                                      nx[index[i][0]],     ny[index[i][0]],
                                      &minx2, &miny2 );
         }
 
-        ix[index[i][1]] = ref.x[index[i][1]];
-        iy[index[i][1]] = ref.y[index[i][1]];
-        d0 = sqrtf ( SQ ( ref.x[index[i][1]]-nx[index[i][0]] ) + SQ ( ref.y[index[i][1]]-ny[index[i][0]] ) );
+        ix[index[i][1]] = ref_x[index[i][1]];
+        iy[index[i][1]] = ref_y[index[i][1]];
+        d0 = sqrtf ( SQ ( ref_x[index[i][1]]-nx[index[i][0]] ) + SQ ( ref_y[index[i][1]]-ny[index[i][0]] ) );
 
         //is the first point closer?
         if ( d1>0 && d1<d0 )
@@ -1290,12 +1676,12 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
       meanppx +=  ix[index[i][1]];
       meanppy +=  iy[index[i][1]];
 #else
-      meanppx +=  ref.x[index[i][1]];
-      meanppy +=  ref.y[index[i][1]];
+      meanppx +=  ref_x[index[i][1]];
+      meanppy +=  ref_y[index[i][1]];
 #endif
 
 #ifdef GR
-      dr_line ( nx[index[i][0]],ny[index[i][0]],ref.x[index[i][1]],ref.y[index[i][1]],"red" );
+      dr_line ( nx[index[i][0]],ny[index[i][0]],ref_x[index[i][1]],ref_y[index[i][1]],"red" );
 #endif
     }//for
     meanpx /= imax;
@@ -1312,10 +1698,10 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
       syx += ( ny[index[i][0]] - meanpy ) * ( ix[index[i][1]] - meanppx );
       syy += ( ny[index[i][0]] - meanpy ) * ( iy[index[i][1]] - meanppy );
 #else
-      sxx += ( nx[index[i][0]] - meanpx ) * ( ref.x[index[i][1]] - meanppx );
-      sxy += ( nx[index[i][0]] - meanpx ) * ( ref.y[index[i][1]] - meanppy );
-      syx += ( ny[index[i][0]] - meanpy ) * ( ref.x[index[i][1]] - meanppx );
-      syy += ( ny[index[i][0]] - meanpy ) * ( ref.y[index[i][1]] - meanppy );
+      sxx += ( nx[index[i][0]] - meanpx ) * ( ref_x[index[i][1]] - meanppx );
+      sxy += ( nx[index[i][0]] - meanpx ) * ( ref_y[index[i][1]] - meanppy );
+      syx += ( ny[index[i][0]] - meanpy ) * ( ref_x[index[i][1]] - meanppx );
+      syy += ( ny[index[i][0]] - meanpy ) * ( ref_y[index[i][1]] - meanppy );
 #endif
     }
     //computation of the resulting translation and rotation
@@ -1349,6 +1735,26 @@ PM_TYPE pm_icp (  const PMScan *lsr,PMScan *lsa )
 #endif
 
   lsa->rx =ax;lsa->ry=ay;lsa->th=ath;
+
+  if ( cov != NULL )
+  {
+    //the matches kept by the last iteration are the first imax ones: their residuals after its correction
+    const PM_TYPE co_d = cosf ( dth ), si_d = sinf ( dth );
+    PM_TYPE sum = 0;
+    for ( i=0;i<imax;i++ )
+    {
+      const PM_TYPE px = nx[index[i][0]] - ( ax-dx ), py = ny[index[i][0]] - ( ay-dy );
+#ifdef INTERPOLATE_ICP
+      const PM_TYPE ex = co_d*px - si_d*py + ax - ws->ix[index[i][1]];
+      const PM_TYPE ey = si_d*px + co_d*py + ay - ws->iy[index[i][1]];
+#else
+      const PM_TYPE ex = co_d*px - si_d*py + ax - ref_x[index[i][1]];
+      const PM_TYPE ey = si_d*px + co_d*py + ay - ref_y[index[i][1]];
+#endif
+      sum += sqrtf ( ex*ex + ey*ey );
+    }
+    pm_match_cov ( ctx, lsr, sum/imax, imax, cov );
+  }
   return ( abs_err/n );
 }//pm_icp
 
@@ -1360,19 +1766,156 @@ range[1] bad[1] segment[1] <br>
 ...<br>
 The aim is to enable quick scan loading in Octave using the
 "scan=load(filename)"; command
+@param ctx The matching context (laser geometry and parameters).
 @param act The scan to be saved.
 @param filenam The name of the file the scan is saved under.
 */
-void pm_save_scan ( PMScan *act,const char *filename )
+void pm_save_scan ( const PMContext *ctx, PMScan *act,const char *filename )
 {
   FILE *f;
   f=fopen ( filename,"w" );
-  for ( int i=0;i<PM_L_POINTS;i++ )
+  for ( int i=0;i<ctx->l_points;i++ )
     fprintf ( f,"%f %i %i\n",act->r[i],act->bad[i],act->seg[i] );
   fclose ( f );
 }
 
 
+#ifdef __SSE2__
+/** @brief Computes atan2 of 4 values at once.
+
+Cephes' atanf (range reduction to [0, tan(pi/8)] and a degree 9 odd polynomial)
+extended to the four quadrants: the error is within a few ulps of atan2f.
+*/
+static inline __m128 pm_atan2_ps ( __m128 y, __m128 x )
+{
+  const __m128 v_zero = _mm_setzero_ps();
+  const __m128 v_one  = _mm_set1_ps ( 1.0f );
+  const __m128 v_abs  = _mm_castsi128_ps ( _mm_set1_epi32 ( 0x7fffffff ) );
+  const __m128 ax = _mm_and_ps ( x, v_abs ), ay = _mm_and_ps ( y, v_abs );
+
+  //t = min/max in [0,1]
+  const __m128 swap = _mm_cmpgt_ps ( ay, ax );
+  const __m128 num  = _mm_or_ps ( _mm_and_ps ( swap, ax ), _mm_andnot_ps ( swap, ay ) );
+  const __m128 den  = _mm_or_ps ( _mm_and_ps ( swap, ay ), _mm_andnot_ps ( swap, ax ) );
+  const __m128 den_null = _mm_cmpeq_ps ( den, v_zero );
+  __m128 t = _mm_andnot_ps ( den_null, _mm_div_ps ( num, _mm_or_ps ( den, _mm_and_ps ( den_null, v_one ) ) ) );
+
+  //t > tan(pi/8) -> atan(t) = pi/4 + atan((t-1)/(t+1))
+  const __m128 big = _mm_cmpgt_ps ( t, _mm_set1_ps ( 0.4142135623730950f ) );
+  t = _mm_or_ps ( _mm_and_ps ( big, _mm_div_ps ( _mm_sub_ps ( t, v_one ), _mm_add_ps ( t, v_one ) ) ), _mm_andnot_ps ( big, t ) );
+  const __m128 z = _mm_mul_ps ( t, t );
+  __m128 p = _mm_set1_ps ( 8.05374449538e-2f );
+  p = _mm_sub_ps ( _mm_mul_ps ( p, z ), _mm_set1_ps ( 1.38776856032e-1f ) );
+  p = _mm_add_ps ( _mm_mul_ps ( p, z ), _mm_set1_ps ( 1.99777106478e-1f ) );
+  p = _mm_sub_ps ( _mm_mul_ps ( p, z ), _mm_set1_ps ( 3.33329491539e-1f ) );
+  p = _mm_add_ps ( _mm_mul_ps ( _mm_mul_ps ( p, z ), t ), t );
+  __m128 a = _mm_add_ps ( _mm_and_ps ( big, _mm_set1_ps ( float ( M_PI/4.0 ) ) ), p );
+
+  //back to the four quadrants
+  a = _mm_or_ps ( _mm_and_ps ( swap, _mm_sub_ps ( _mm_set1_ps ( float ( M_PI/2.0 ) ), a ) ), _mm_andnot_ps ( swap, a ) );
+  const __m128 x_neg = _mm_cmplt_ps ( x, v_zero );
+  a = _mm_or_ps ( _mm_and_ps ( x_neg, _mm_sub_ps ( _mm_set1_ps ( float ( M_PI ) ), a ) ), _mm_andnot_ps ( x_neg, a ) );
+  const __m128 y_neg = _mm_cmplt_ps ( y, v_zero );
+  return _mm_or_ps ( _mm_and_ps ( y_neg, _mm_sub_ps ( v_zero, a ) ), _mm_andnot_ps ( y_neg, a ) );
+}
+
+/** @brief Moves 4 readings into the reference frame and converts them to polar coordinates.
+
+Same as the scalar loop of pm_scan_project(), including the bearings beyond pi
+of points in the third quadrant.
+*/
+static inline void pm_to_polar4 ( const PM_TYPE *range, const PM_TYPE *co, const PM_TYPE *si, PM_TYPE ca, PM_TYPE sa,
+                                  PM_TYPE ax, PM_TYPE ay, PM_TYPE *r, PM_TYPE *fi )
+{
+  const __m128 v_ca = _mm_set1_ps ( ca ), v_sa = _mm_set1_ps ( sa );
+  const __m128 v_co = _mm_loadu_ps ( co ), v_si = _mm_loadu_ps ( si ), v_r = _mm_loadu_ps ( range );
+  const __m128 c = _mm_sub_ps ( _mm_mul_ps ( v_ca, v_co ), _mm_mul_ps ( v_sa, v_si ) );
+  const __m128 s = _mm_add_ps ( _mm_mul_ps ( v_sa, v_co ), _mm_mul_ps ( v_ca, v_si ) );
+  const __m128 x = _mm_add_ps ( _mm_mul_ps ( v_r, c ), _mm_set1_ps ( ax ) );
+  const __m128 y = _mm_add_ps ( _mm_mul_ps ( v_r, s ), _mm_set1_ps ( ay ) );
+  _mm_storeu_ps ( r, _mm_sqrt_ps ( _mm_add_ps ( _mm_mul_ps ( x, x ), _mm_mul_ps ( y, y ) ) ) );
+
+  const __m128 v_zero = _mm_setzero_ps();
+  const __m128 third = _mm_and_ps ( _mm_cmplt_ps ( x, v_zero ), _mm_cmplt_ps ( y, v_zero ) );
+  const __m128 a = pm_atan2_ps ( y, x );
+  _mm_storeu_ps ( fi, _mm_add_ps ( a, _mm_and_ps ( third, _mm_set1_ps ( float ( 2.0*M_PI ) ) ) ) );
+}
+#endif
+
+/** @brief Interpolates the segment between readings i-1 and i of the current scan at the reference bearings.
+
+The segment is given in polar coordinates of the reference frame (@a r0, @a fi0 for
+reading i-1 and @a r1, @a fi1 for reading i). The closest interpolated range is kept
+at every bearing, and bearings seen through the back of a segment are tagged occluded.
+*/
+static inline void pm_interpolate_segment ( const PMContext *ctx, const PMScan *act, int i,
+                                            PM_TYPE r_0, PM_TYPE fi_0, PM_TYPE r_1, PM_TYPE fi_1,
+                                            PM_TYPE *new_r, int *new_bad )
+{
+  // i and i-1 has to be in the same segment, both shouldn't be bad
+  // and they should be larger than the minimum angle
+  if ( ! ( act->seg[i] != 0 && act->seg[i] == act->seg[i-1] && !act->bad[i] && !act->bad[i-1] ) )
+    return;
+
+  //calculation of the "whole" parts of the angles
+  int j0,j1;
+  PM_TYPE r0,r1,a0,a1;
+  bool occluded;
+  //This is a crude hack to fix a serious bug here!!!!
+  //At the -pi pi boundary it failed by interpolating throught the whole scan.
+  //The affected 360 scans, or Hokuyo scans where the matched scans had
+  //more than 60degree orientation difference.
+  if( fabsf(fi_1-fi_0) >= M_PI ) ///TODO: replace this hack with proper fix where we don't loose points.
+    return;
+
+  if ( fi_1>fi_0 ) //are the points visible?
+  {
+    //visible
+    occluded = false;
+    a0  = fi_0;
+    a1  = fi_1;
+    r0  = r_0;
+    r1  = r_1;
+  }
+  else
+  {
+    //invisible - still have to calculate to filter out points which
+    occluded = true; //are covered up by these!
+    //flip the points-> easier to program
+    a0  = fi_1;
+    a1  = fi_0;
+    r0  = r_1;
+    r1  = r_0;
+  }
+  j0  =  (int) ceil ( ( a0 - ctx->fi_min ) /ctx->dfi );
+  j1  =  (int) floor ( ( a1 - ctx->fi_min ) /ctx->dfi );
+  //here j0 is always smaller than j1!
+
+  //only the bearings of the reference scan are written
+  if ( j0 < 0 )
+    j0 = 0;
+  if ( j1 > ctx->l_points-1 )
+    j1 = ctx->l_points-1;
+
+  //interpolate for all the measurement bearings beween j0 and j1
+  const PM_TYPE slope = ( r1-r0 ) / ( a1-a0 );
+  const int     flags = act->bad[i] | act->bad[i-1];
+  for ( ;j0<=j1;j0++ ) //if at least one measurement point difference, then ...
+  {
+    PM_TYPE ri = slope * ( ( ( PM_TYPE ) j0*ctx->dfi+ctx->fi_min )-a0 ) +r0;
+
+    //if ri is shorter than the current range then overwrite it
+    if ( new_r[j0]>ri )
+    {
+      new_r[j0]    = ri;//overwrite the previous reading
+      //clear the empty flag, set or clear the occluded flag and inherit the other flags
+      //of the readings (superfluos - since they were checked for 0)
+      new_bad[j0]  = ( ( new_bad[j0] & ~PM_EMPTY & ~PM_OCCLUDED ) | ( occluded ? PM_OCCLUDED : 0 ) ) | flags;
+    }
+  }//for j0
+}//pm_interpolate_segment
+
+
 /** @brief Performs scan projection.
 
 This function enables the comparisson of two scans.
@@ -1383,116 +1926,154 @@ Returns in new_r the interpolated range readinds r at the reference scan's
 measurement bearings. Returns in new_bad bad flags of the interpolated range
 readings, where occluded readings are tagged.
 
-@param act The current scan.
-@param new_r Array of the projected range readings (has to have the correct size).
-@param new_bad Information about the validity of the interpolated range readings is returned here.
+@param ctx The matching context (laser geometry and parameters).
+@param act The current scan (only its readings are used, its pose is ignored).
+@param ax,ay,ath The pose of the current scan in the reference frame.
+@param ws Scratch memory. The projected range readings are returned in ws->new_r and
+information about their validity in ws->new_bad.
 */
-void pm_scan_project(const PMScan *act,  PM_TYPE   *new_r,  int *new_bad)
+void pm_scan_project(const PMContext *ctx, const PMScan *act, PM_TYPE ax, PM_TYPE ay, PM_TYPE ath, PMWorkspace *ws)
 {
-    PM_TYPE   r[PM_L_POINTS],fi[PM_L_POINTS];//current scan in ref. coord. syst.
-    PM_TYPE   x,y;
-    int       i;
-    PM_TYPE   delta;
-
-    // convert range readings into the reference frame
-    // this can be speeded up, by connecting it with the interpolation
-    for ( i=0;i<PM_L_POINTS;i++ )
+    PM_TYPE   *new_r = ws->new_r;
+    int       *new_bad = ws->new_bad;
+    PM_TYPE   r[4],fi[4];//a block of the current scan in ref. coord. syst.
+    PM_TYPE   r_prev = 0, fi_prev = 0;
+    int       i, k;
+
+    // the interpolation may write any bearing: initialize them all first
+    for ( i=0;i<ctx->l_points;i++ )
     {
-      delta   = act->th + pm_fi[i];
-      x       = act->r[i]*cosf ( delta ) + act->rx;
-      y       = act->r[i]*sinf ( delta ) + act->ry;
-      r[i]    = sqrtf ( x*x+y*y );
-      fi[i]   = atan2f ( y,x );
-      //handle discontinuity at pi (Angle goes from -pi/1 to 3pi/2 for 360deg. scans)
-      if(x<0 && y<0)
-        fi[i] += 2.0*M_PI;
       new_r[i]  = 10000;//initialize big interpolated r;
       new_bad[i]= PM_EMPTY;//for interpolated r;
+    }
+
+    // convert range readings into the reference frame, block by block, and interpolate
+    // the segments ending in the block right away. The bearings of the readings are
+    // rotated with the precomputed cosines and sines (angle addition) instead of
+    // evaluating the trigonometric functions of every point.
+    const PM_TYPE ca = cosf ( ath ), sa = sinf ( ath );
+    for ( i=0;i<ctx->l_points;i+=4 )
+    {
+      const int n = min ( 4, ctx->l_points-i );
+#ifdef __SSE2__
+      if ( n == 4 )
+        pm_to_polar4 ( act->r + i, ctx->co + i, ctx->si + i, ca, sa, ax, ay, r, fi );
+      else
+#endif
+      for ( k=0;k<n;k++ )
+      {
+        const PM_TYPE c = ca*ctx->co[i+k] - sa*ctx->si[i+k];
+        const PM_TYPE s = sa*ctx->co[i+k] + ca*ctx->si[i+k];
+        const PM_TYPE x = act->r[i+k]*c + ax;
+        const PM_TYPE y = act->r[i+k]*s + ay;
+        r[k]    = sqrtf ( x*x+y*y );
+        fi[k]   = atan2f ( y,x );
+        //handle discontinuity at pi (Angle goes from -pi/1 to 3pi/2 for 360deg. scans)
+        if(x<0 && y<0)
+          fi[k] += 2.0*M_PI;
+      }
 
+      for ( k=0;k<n;k++ )
+      {
+        if ( i+k > 0 )
+          pm_interpolate_segment ( ctx, act, i+k, r_prev, fi_prev, r[k], fi[k], new_r, new_bad );
+        r_prev  = r[k];
+        fi_prev = fi[k];
+      }
     }//for i
 
-    //------------------------INTERPOLATION------------------------
-    //calculate/interpolate the associations to the ref scan points
-    //algorithm ignores crosings at the beginning and end points to make it faster
-    for ( i=1;i<PM_L_POINTS;i++ )
+}//pm_scan_project
+
+
+/** @brief Computes the orientation search error of the shifts [@a d0, @a d1].
+
+The error of shift di is the mean absolute range residual between the current
+scan ranges ws->new_r[i] and the reference ranges ref->r[i+di] over the points
+valid in both scans (or a large number if there are no such points). It is
+stored in err[di].
+
+Four consecutive shifts are evaluated at once with SSE2: the reference scan is
+padded with invalid points so that every lane reads the same contiguous memory,
+and the points which are invalid in the current scan are skipped once for all
+the shifts. Each lane accumulates its residuals in the same order as the scalar
+loop, so the errors are identical to it.
+
+@param ctx The matching context (laser geometry and parameters).
+@param ref The reference scan.
+@param ws Scratch memory, its pad_r, pad_mask and valid_idx have to be filled by the caller.
+@param num_valid Number of valid current scan points listed in ws->valid_idx.
+@param d0 First shift.
+@param d1 Last shift.
+@param err The errors are returned here (indexed by the shift).
+*/
+static void pm_orientation_errors(const PMContext *ctx, const PMScan *ref, const PMWorkspace *ws, int num_valid,
+                                  int d0, int d1, PM_TYPE *err)
+{
+  const PM_TYPE   LARGE_NUMBER = 10000;
+  const PM_TYPE  *new_r = ws->new_r;
+  const int      *new_bad = ws->new_bad;
+  int di = d0;
+
+#ifdef __SSE2__
+  const int     window = ctx->search_window;
+  const __m128  v_abs = _mm_castsi128_ps ( _mm_set1_epi32 ( 0x7fffffff ) );
+  const __m128  v_one = _mm_set1_ps ( 1.0f );
+  for ( ; di+3 <= d1; di+=4 )
+  {
+    __m128 e = _mm_setzero_ps(), n = _mm_setzero_ps();
+    const PM_TYPE *pad_r = ws->pad_r + di + window;
+    const int     *pad_mask = ws->pad_mask + di + window;
+
+    for ( int k=0;k<num_valid;k++ )
     {
-      //i points to the angles in the current scan
+      const int     i = ws->valid_idx[k];
+      const __m128  m = _mm_castsi128_ps ( _mm_loadu_si128 ( ( const __m128i* ) ( pad_mask + i ) ) );
+      const __m128  delta = _mm_and_ps ( _mm_sub_ps ( _mm_set1_ps ( new_r[i] ), _mm_loadu_ps ( pad_r + i ) ), v_abs );
+      e = _mm_add_ps ( e, _mm_and_ps ( m, delta ) );
+      n = _mm_add_ps ( n, _mm_and_ps ( m, v_one ) );
+    }
 
-      // i and i-1 has to be in the same segment, both shouldn't be bad
-      // and they should be larger than the minimum angle
-      if ( act->seg[i] != 0 && act->seg[i] == act->seg[i-1] && !act->bad[i] && !act->bad[i-1] ) /* && fi[i]>PM_FI_MIN && fi[i-1]>PM_FI_MIN*/
-      {
-        //calculation of the "whole" parts of the angles
-        int j0,j1;
-        PM_TYPE r0,r1,a0,a1;
-        bool occluded;
-        //This is a crude hack to fix a serious bug here!!!!
-        //At the -pi pi boundary it failed by interpolating throught the whole scan.
-        //The affected 360 scans, or Hokuyo scans where the matched scans had
-        //more than 60degree orientation difference.
-        if( fabsf(fi[i]-fi[i-1]) >= M_PI ) ///TODO: replace this hack with proper fix where we don't loose points.
-          continue;
+    PM_TYPE es[4], ns[4];
+    _mm_storeu_ps ( es, e );
+    _mm_storeu_ps ( ns, n );
+    for ( int l=0;l<4;l++ )
+      err[di + l] = ( ns[l] > 0 ) ? es[l]/ns[l] : LARGE_NUMBER;
+  }
+#endif
 
-        if ( fi[i]>fi[i-1] ) //are the points visible?
-        {
-          //visible
-          occluded = false;
-          a0  = fi[i-1];
-          a1  = fi[i];
-          j0  =  (int) ceil ( ( fi[i-1] - PM_FI_MIN ) /PM_DFI );
-          j1  =  (int) floor ( ( fi[i] - PM_FI_MIN ) /PM_DFI );
-          r0  = r[i-1];
-          r1  = r[i];
-        }
-        else
-        {
-          //invisible - still have to calculate to filter out points which
-          occluded = true; //are covered up by these!
-          //flip the points-> easier to program
-          a0  = fi[i];
-          a1  = fi[i-1];
-          j0  =  (int) ceil ( ( fi[i] - PM_FI_MIN ) /PM_DFI );
-          j1  =  (int) floor ( ( fi[i-1] - PM_FI_MIN ) /PM_DFI );
-          r0  = r[i];
-          r1  = r[i-1];
-        }
-        //here j0 is always smaller than j1!
+  //Remaining shifts (or all of them without SSE2)
+  for ( ; di <= d1; di++ )
+  {
+    PM_TYPE e=0, n=0;
+    int min_i,max_i;
+    if ( di<=0 )
+      {min_i = -di;max_i=ctx->l_points;}
+    else
+      {min_i = 0;max_i=ctx->l_points-di;}
 
-        //interpolate for all the measurement bearings beween j0 and j1
-        while ( j0<=j1 ) //if at least one measurement point difference, then ...
-        {
-          PM_TYPE ri = ( r1-r0 ) / ( a1-a0 ) * ( ( ( PM_TYPE ) j0*PM_DFI+PM_FI_MIN )-a0 ) +r0;
+    for ( int i=min_i;i<max_i;i++ ) //searching through the current points
+    {
+      PM_TYPE delta = fabsf ( new_r[i]-ref->r[i+di] );
 
-          //if j0 -> falls into the measurement range and ri is shorter
-          //than the current range then overwrite it
-          if ( j0>=0 && j0<PM_L_POINTS && new_r[j0]>ri )
-          {
-            new_r[j0]    = ri;//overwrite the previous reading
-            new_bad[j0] &=~PM_EMPTY;//clear the empty flag
-            if ( occluded ) //check if it was occluded
-              new_bad[j0] = new_bad[j0]|PM_OCCLUDED;//set the occluded flag
-            else
-              new_bad[j0] = new_bad[j0]&~PM_OCCLUDED;
-            //the new range reading also has to inherit the other flags
-            new_bad[j0] |= act->bad[i];//superfluos - since act.bad[i] was checked for 0
-            new_bad[j0] |= act->bad[i-1];//superfluos - since act.bad[i-1] was checked for 0
-            ///TODO: Uncomment this? (or leave it as it is a local scan matching approach anyway)
-            //if(ri>PM_MAX_RANGE)        //uncomment this later
-            //  new_bad[fi0] |= PM_RANGE;
-            //dr_zoom();
-          }
-          j0++;//check the next measurement angle!
-        }//while
-      }//if act
+      if ( !new_bad[i] && !ref->bad[i+di] )
+      {
+        e += delta;
+        n++;
+      }
     }//for i
 
-}//pm_scan_project
+    if ( n > 0 )
+      err[di] = e/n;//don't forget to correct with n!
+    else
+      err[di] = LARGE_NUMBER;
+  }
+}//pm_orientation_errors
 
 
 /** @brief Performs one iteration of orientation alignment of current scan.
 
 Function estimating the orientation of the current scan represented with range readings
-@a new_r tagged with flags @a new_bad with respect to the reference scan @a ref.
+ws->new_r tagged with flags ws->new_bad with respect to the reference scan @a ref.
 
 This function exploits that if the current and reference scan are taken at the same
 position, an orientation change of the current scan results in a left or right shift
@@ -1503,90 +2084,110 @@ difference between the current and ref. scan. The orientation estimate is then
 refined using interpolation by fitting a parabole to the maximum and its
 neighbours and finding the maximum.
 
+With ctx->orientation_step = 1 every shift of the window is evaluated. With a larger
+step only every step-th shift is evaluated first, and then every shift around the
+best of them: on a monomodal error function (which the search assumes anyway) the
+minimum and its refinement are the same, at a fraction of the cost for wide windows.
+
+@param ctx The matching context (laser geometry and parameters).
 @param ref The reference scan.
-@param new_r The interpolated ranges of the current scan.
-@param new_bad The tags corresponding to the new_r.
+@param ws Scratch memory holding the interpolated ranges (new_r) of the current scan and their tags (new_bad).
 @return Returns the rotation of @new_bad in radians which minimize the sum of absolute range residuals.
  */
-PM_TYPE pm_orientation_search(const PMScan *ref, const PM_TYPE *new_r, const int *new_bad)
+PM_TYPE pm_orientation_search(const PMContext *ctx, const PMScan *ref, PMWorkspace *ws)
 {
       int       i;
-      int       window = PM_SEARCH_WINDOW;//20;//+- width of search for correct orientation
+      int       window = ctx->search_window;//20;//+- width of search for correct orientation
+      int       step = ctx->orientation_step;
       PM_TYPE   dth = 0.0;//current scan corrections
       //pm_fi,ref.r - reference points
-      PM_TYPE e, err[PM_L_POINTS]; // the error rating
-      PM_TYPE beta[PM_L_POINTS];// angle corresponding to err
+      PM_TYPE   *err = ws->orient_err + window; // the error rating, indexed by the shift
       const PM_TYPE LARGE_NUMBER = 10000;
-      PM_TYPE n;
-      int k=0;
+      int       num_valid = 0;
 
-      for ( int di=-window;di<=window;di++ )
+      //Reference scan padded with invalid points at both sides, valid points of the current scan
+      for ( i=0;i<window;i++ )
       {
-        n=0;e=0;
-
-        int min_i,max_i;
-        if ( di<=0 )
-          {min_i = -di;max_i=PM_L_POINTS;}
-        else
-          {min_i = 0;max_i=PM_L_POINTS-di;}
+        ws->pad_r[i] = 0;
+        ws->pad_mask[i] = 0;
+      }
+      for ( i=0;i<ctx->l_points;i++ )
+      {
+        ws->pad_r[window + i] = ref->r[i];
+        ws->pad_mask[window + i] = ref->bad[i] ? 0 : -1;
+        if ( !ws->new_bad[i] )
+          ws->valid_idx[num_valid++] = i;
+      }
+      for ( i=window+ctx->l_points;i<2*window+ctx->l_points+4;i++ )
+      {
+        ws->pad_r[i] = 0;
+        ws->pad_mask[i] = 0;
+      }
 
-        ///TODO: speed up by unrolling the loop, replace if with multiplication with 0 or 1/
-        /// use sse2 instructions...
-        for ( i=min_i;i<max_i;i++ ) //searching through the current points
+      int min_di = -window, max_di = window;
+      if ( step > 1 )
+      {
+        //coarse pass: every step-th shift (and the last one)
+        int   di_best = -window;
+        PM_TYPE e_best = LARGE_NUMBER*10.0;
+        for ( int di=-window;;di+=step )
         {
-          PM_TYPE delta = fabsf ( new_r[i]-ref->r[i+di] );
-
-          if ( !new_bad[i] && !ref->bad[i+di] )
+          if ( di > window )
+            di = window;
+          pm_orientation_errors ( ctx, ref, ws, num_valid, di, di, err );
+          if ( err[di] < e_best )
           {
-            e += delta;
-            n++;
+            e_best = err[di];
+            di_best = di;
           }
+          if ( di == window )
+            break;
+        }
+        //fine pass around the best coarse shift (keeping a neighbour on each side for the refinement)
+        min_di = max ( -window, di_best-step-1 );
+        max_di = min ( window, di_best+step+1 );
+      }
 
-        }//for i
-
-        if ( n > 0 )
-          err[k]  = e/n;//don't forget to correct with n!
-        else
-          err[k]  = LARGE_NUMBER;
-        beta[k] = di;
-        k++;
-
-        //printf("\n Wind = %d, Error_acu = %f, error_mean = %f, nump = %f ", di, err[k-1], e, n);
-      }//for dfi
-
+      pm_orientation_errors ( ctx, ref, ws, num_valid, min_di, max_di, err );
 
       //now search for the global minimum
       //later I can make it more robust
       //assumption: monomodal error function!
       PM_TYPE emin = LARGE_NUMBER*10.0;
-      int   imin=-1;
-      for ( i = 0; i < k; i++ )
+      int   dimin = min_di;
+      for ( int di = min_di; di <= max_di; di++ )
       {
-        if ( err[i] < emin )
+        if ( err[di] < emin )
         {
-          emin = err[i];
-          imin = i;
+          emin = err[di];
+          dimin = di;
         }
       }
 
-      if ( err[imin]>=LARGE_NUMBER )
+      if ( err[dimin]>=LARGE_NUMBER )
       {
-        cerr <<"Polar Match: orientation search failed" <<err[imin]<<endl;
+        cerr <<"Polar Match: orientation search failed" <<err[dimin]<<endl;
         throw 1;
       }
-      dth = beta[imin]*PM_DFI;
+      dth = dimin*ctx->dfi;
 
       //interpolation
-      if ( imin >= 1 && imin < ( k-1 ) ) //is it not on the extreme?
+      if ( dimin > -window && dimin < window ) //is it not on the extreme?
       {
+        //the neighbours of a minimum at the border of the fine pass
+        if ( dimin == min_di )
+          pm_orientation_errors ( ctx, ref, ws, num_valid, dimin-1, dimin-1, err );
+        if ( dimin == max_di )
+          pm_orientation_errors ( ctx, ref, ws, num_valid, dimin+1, dimin+1, err );
+
         //lets try interpolation
-        PM_TYPE D = err[imin-1]+err[imin+1]-2.0*err[imin];
+        PM_TYPE D = err[dimin-1]+err[dimin+1]-2.0*err[dimin];
         PM_TYPE d = LARGE_NUMBER;
-        if ( fabsf ( D ) >0.01 && err[imin-1]>err[imin] && err[imin+1]>err[imin] )
-          d= ( err[imin-1]-err[imin+1] ) /D/2.0;
+        if ( fabsf ( D ) >0.01 && err[dimin-1]>err[dimin] && err[dimin+1]>err[dimin] )
+          d= ( err[dimin-1]-err[dimin+1] ) /D/2.0;
         //        cout <<"ORIENTATION REFINEMENT "<<d<<endl;
         if ( fabsf ( d ) < 1.0 )
-          dth+=d*PM_DFI;
+          dth+=d*ctx->dfi;
       }
 
      return(dth);
@@ -1595,6 +2196,7 @@ PM_TYPE pm_orientation_search(const PMScan *ref, const PM_TYPE *new_r, const int
 
 /** @brief Estimate the postion of the current scan with respect to a reference scan.
 
+@param ctx The matching context (laser geometry and parameters).
 @param ref The reference scan.
 @param new_r The interpolated ranges of the current scan.
 @param new_bad The tags corresponding to the new_r.
@@ -1603,7 +2205,7 @@ PM_TYPE pm_orientation_search(const PMScan *ref, const PM_TYPE *new_r, const int
 @param dy Estimated position increment Y coordinate is returned here.
 @return Returns the average range residual.
 */
-PM_TYPE pm_translation_estimation(const PMScan *ref, const PM_TYPE *new_r, const int *new_bad, PM_TYPE C, PM_TYPE *dx, PM_TYPE *dy)
+PM_TYPE pm_translation_estimation(const PMContext *ctx, const PMScan *ref, const PM_TYPE *new_r, const int *new_bad, PM_TYPE C, PM_TYPE *dx, PM_TYPE *dy)
 {
     // do the weighted linear regression on the linearized ...
     // include angle as well
@@ -1613,12 +2215,12 @@ PM_TYPE pm_translation_estimation(const PMScan *ref, const PM_TYPE *new_r, const
     PM_TYPE dr;
     PM_TYPE abs_err = 0;
     int     n = 0;
-    for ( i=0;i<PM_L_POINTS;i++ )
+    for ( i=0;i<ctx->l_points;i++ )
     {
       dr = ref->r[i]-new_r[i];
       abs_err += fabsf ( dr );
       //weight calculation
-      if ( ref->bad[i]==0 && new_bad[i]==0 && new_r[i]<PM_MAX_RANGE && new_r[i]>PM_MIN_RANGE && fabsf ( dr ) <PM_MAX_ERROR )
+      if ( ref->bad[i]==0 && new_bad[i]==0 && new_r[i]<ctx->max_range && new_r[i]>PM_MIN_RANGE && fabsf ( dr ) <PM_MAX_ERROR )
       {
 
         //weighting according to DUDEK00
@@ -1626,8 +2228,8 @@ PM_TYPE pm_translation_estimation(const PMScan *ref, const PM_TYPE *new_r, const
         n++;
 
         //proper calculations of the jacobian
-        hi1 = pm_co[i];//xx/new_r[i];//this the correct
-        hi2 = pm_si[i];//yy/new_r[i];
+        hi1 = ctx->co[i];//xx/new_r[i];//this the correct
+        hi2 = ctx->si[i];//yy/new_r[i];
 
         hwi1 = hi1*w;
         hwi2 = hi2*w;
@@ -1645,7 +2247,7 @@ PM_TYPE pm_translation_estimation(const PMScan *ref, const PM_TYPE *new_r, const
 
       }//if
     }//for i
-    if ( n<PM_MIN_VALID_POINTS ) //are there enough points?
+    if ( n<ctx->min_valid_points ) //are there enough points?
     {
       cerr <<"pm_translation_estimation: ERROR not enough points ("<<n<<")"<<endl;
       throw 1;//not enough points
@@ -1675,6 +2277,7 @@ PM_TYPE pm_translation_estimation(const PMScan *ref, const PM_TYPE *new_r, const
 /** @brief Takes a scan in a simulated room.
 
 The simulated room is just a rectangle.
+@param ctx The matching context (laser geometry and parameters).
 @param xl  X coordinate of where the scan is taken.
 @param yl  Y coordinate of where the scan is taken.
 @param thl Orientation with which the scan is taken.
@@ -1682,7 +2285,7 @@ The simulated room is just a rectangle.
 @param wallDistLeft [cm] The distance of the left and right wall from the centre. Optional.
 @param wallDistFront [cm] The distance of the front and back wall from the centre. Optional.
 */
-void pm_take_simulated_scan(const PM_TYPE xl, const PM_TYPE yl, const PM_TYPE thl, PMScan *ls,
+void pm_take_simulated_scan(const PMContext *ctx, const PM_TYPE xl, const PM_TYPE yl, const PM_TYPE thl, PMScan *ls,
                             PM_TYPE wallDistLeft = 150.0, PM_TYPE wallDistFront = 200.0)
 {
   if(PM_LASER_Y!= 0)
@@ -1704,10 +2307,10 @@ void pm_take_simulated_scan(const PM_TYPE xl, const PM_TYPE yl, const PM_TYPE th
 
   //Take the scan
   const PM_TYPE LARGE_NUMBER = 100000;
-  for(int i = 0; i < PM_L_POINTS; i++)
+  for(int i = 0; i < ctx->l_points; i++)
   {
     rmin = LARGE_NUMBER;
-    fi = pm_fi[i];
+    fi = ctx->fi[i];
     for(int j = 0; j < N; j++)
     {
       D = cosf(thl+fi)*cosf(a[j]) + sinf(thl+fi)*sinf(a[j]);
@@ -1730,10 +2333,11 @@ It will assert when compiled in debug mode.
 Currently the test are very basic (too high level).
 Should add more tests with time.
 
+@param ctx The matching context (laser geometry and parameters).
 @param matching_alg Specify the scan matching algorithm to be tested (PM_PSM, PM_ICP).
 @param interactive If true, graphically display results.
 */
-void  pm_unit_test(int matching_alg, bool interactive)
+void  pm_unit_test(const PMContext *ctx, int matching_alg, bool interactive)
 {
   const PM_TYPE eps = 0.8; //allowed error in X or Y coordinate
   const PM_TYPE epsTh = 0.5*PM_D2R;//allowed orientation error
@@ -1744,32 +2348,31 @@ void  pm_unit_test(int matching_alg, bool interactive)
   else
     matcherName = (char*)"ICP";
 
-  printf("Running scan matching unit test for %s. Compiled for: %s\n",matcherName, PM_LASER_NAME);
-
-  pm_init();
+  printf("Running scan matching unit test for %s. Configured for: %s\n",matcherName, ctx->laser_name);
 
 
   PMScan lsc;//Current scan
   PMScan lsr;//Reference scan.
+  PMWorkspace *ws = new PMWorkspace;//Scratch memory of the matcher
   float xc,yc,thc;
   float xr,yr,thr;
   int test = -1;
 
   xr=0.0; yr=0.0; thr=0.0;
-  pm_take_simulated_scan(xr, yr, thr, &lsr);
-  pm_preprocessScan( &lsr );
+  pm_take_simulated_scan(ctx, xr, yr, thr, &lsr);
+  pm_preprocessScan(ctx, &lsr );
 
 
   xc=0.0; yc=0.0; thc=0.0; test++;
-  pm_take_simulated_scan(xc, yc, thc, &lsc);
+  pm_take_simulated_scan(ctx, xc, yc, thc, &lsc);
   lsc.rx=0.0; lsc.ry=0.0; lsc.th=0.0;
-  pm_preprocessScan( &lsc );
+  pm_preprocessScan(ctx, &lsc );
 
 
   if(matching_alg == PM_PSM)
-    pm_psm(&lsr, &lsc);
+    pm_psm(ctx, &lsr, &lsc, ws);
   else
-    pm_icp(&lsr, &lsc);
+    pm_icp(ctx, &lsr, &lsc, ws);
 
   printf("Test%i:init. pose:(%.1f,%.1f,%.1f); position error:%.2f[cm] orient. error:%.2f[deg]\n",
     test,xc,yc,thc*PM_R2D,sqrtf(SQ(xc - lsc.rx)+SQ(yc - lsc.ry)),(thc- lsc.th)*PM_R2D);
@@ -1779,13 +2382,13 @@ void  pm_unit_test(int matching_alg, bool interactive)
   assert(fabsf(thc - lsc.th) <= epsTh);
 
   xc=0; yc=0; thc=0.1;test++;
-  pm_take_simulated_scan(xc, yc, thc, &lsc);
+  pm_take_simulated_scan(ctx, xc, yc, thc, &lsc);
   lsc.rx=0.0; lsc.ry=0.0; lsc.th=0.0;
-  pm_preprocessScan( &lsc );
+  pm_preprocessScan(ctx, &lsc );
   if(matching_alg == PM_PSM)
-    pm_psm(&lsr, &lsc);
+    pm_psm(ctx, &lsr, &lsc, ws);
   else
-    pm_icp(&lsr, &lsc);
+    pm_icp(ctx, &lsr, &lsc, ws);
 
   printf("Test%i:init. pose:(%.1f,%.1f,%.1f); position error:%.2f[cm] orient. error:%.2f[deg]\n",
     test,xc,yc,thc*PM_R2D,sqrtf(SQ(xc - lsc.rx)+SQ(yc - lsc.ry)),(thc- lsc.th)*PM_R2D);
@@ -1795,13 +2398,13 @@ void  pm_unit_test(int matching_alg, bool interactive)
   assert(fabsf(thc- lsc.th) <= epsTh);
 
   xc=10.0; yc=0; thc=0.0;  test++;
-  pm_take_simulated_scan(xc, yc, thc, &lsc);
+  pm_take_simulated_scan(ctx, xc, yc, thc, &lsc);
   lsc.rx=0.0; lsc.ry=0.0; lsc.th=0.0;
-  pm_preprocessScan( &lsc );
+  pm_preprocessScan(ctx, &lsc );
   if(matching_alg == PM_PSM)
-    pm_psm(&lsr, &lsc);
+    pm_psm(ctx, &lsr, &lsc, ws);
   else
-    pm_icp(&lsr, &lsc);
+    pm_icp(ctx, &lsr, &lsc, ws);
 
   printf("Test%i:init. pose:(%.1f,%.1f,%.1f); position error:%.2f[cm] orient. error:%.2f[deg]\n",
     test,xc,yc,thc*PM_R2D,sqrtf(SQ(xc - lsc.rx)+SQ(yc - lsc.ry)),(thc- lsc.th)*PM_R2D);
@@ -1811,13 +2414,13 @@ void  pm_unit_test(int matching_alg, bool interactive)
   assert(fabsf(thc- lsc.th) <= epsTh);
 
   xc=0.0; yc=10.0; thc=0.0;test++;
-  pm_take_simulated_scan(xc, yc, thc, &lsc);
+  pm_take_simulated_scan(ctx, xc, yc, thc, &lsc);
   lsc.rx=0.0; lsc.ry=0.0; lsc.th=0.0;
-  pm_preprocessScan( &lsc );
+  pm_preprocessScan(ctx, &lsc );
   if(matching_alg == PM_PSM)
-    pm_psm(&lsr, &lsc);
+    pm_psm(ctx, &lsr, &lsc, ws);
   else
-    pm_icp(&lsr, &lsc);
+    pm_icp(ctx, &lsr, &lsc, ws);
 
   printf("Test%i:init. pose:(%.1f,%.1f,%.1f); position error:%.2f[cm] orient. error:%.2f[deg]\n",
     test,xc,yc,thc*PM_R2D,sqrtf(SQ(xc - lsc.rx)+SQ(yc - lsc.ry)),(thc- lsc.th)*PM_R2D);
@@ -1827,24 +2430,24 @@ void  pm_unit_test(int matching_alg, bool interactive)
   assert(fabsf(yc - lsc.ry) <= eps);
   assert(fabsf(thc- lsc.th) <= epsTh);
 
-  assert( pm_is_corridor(&lsc) == false);
+  assert( pm_is_corridor(ctx, &lsc) == false);
 
   //========== Test corridor detection ============================
 
   xr=0.0; yr=0.0; thr=0.0; test++;
-  pm_take_simulated_scan(xr, yr, thr, &lsr, 200.0, 1.5*PM_MAX_RANGE);
-  pm_preprocessScan( &lsr );
+  pm_take_simulated_scan(ctx, xr, yr, thr, &lsr, 200.0, 1.5*ctx->max_range);
+  pm_preprocessScan(ctx, &lsr );
 
   xc=10.0; yc=0.0; thc=0.1;
-  pm_take_simulated_scan(xc, yc, thc, &lsc, 200.0, 1.5*PM_MAX_RANGE);
+  pm_take_simulated_scan(ctx, xc, yc, thc, &lsc, 200.0, 1.5*ctx->max_range);
   lsc.rx=0.0; lsc.ry=0.0; lsc.th=0.0;
-  pm_preprocessScan( &lsc );
+  pm_preprocessScan(ctx, &lsc );
 
 
   if(matching_alg == PM_PSM)
-    pm_psm(&lsr, &lsc);
+    pm_psm(ctx, &lsr, &lsc, ws);
   else
-    pm_icp(&lsr, &lsc);
+    pm_icp(ctx, &lsr, &lsc, ws);
 
   printf("Test%i:init. pose:(%.1f,%.1f,%.1f); position error:%.2f[cm] orient. error:%.2f[deg]\n",
     test,xc,yc,thc*PM_R2D,sqrtf(SQ(xc - lsc.rx)+SQ(yc - lsc.ry)),(thc- lsc.th)*PM_R2D);
@@ -1852,10 +2455,10 @@ void  pm_unit_test(int matching_alg, bool interactive)
   assert(fabsf(xc - lsc.rx) <= eps);
   assert(fabsf(thc - lsc.th) <= epsTh);
 
-  bool corridor = pm_is_corridor(&lsc);
+  bool corridor = pm_is_corridor(ctx, &lsc);
   assert (corridor);
-  PM_TYPE error = pm_error_index(&lsr, &lsc);
-  PM_TYPE angle = pm_corridor_angle(&lsr);
+  PM_TYPE error = pm_error_index(ctx, &lsr, &lsc);
+  PM_TYPE angle = pm_corridor_angle(ctx, &lsr);
 
   double c11,c12, c22, c33;
   pm_cov_est(error, &c11,&c12, &c22, &c33,corridor, angle);
@@ -1863,6 +2466,7 @@ void  pm_unit_test(int matching_alg, bool interactive)
   printf("Error index:%.1f,  angle:%.1f, cov: %.1f,%.1f,%.1f,%.1f\n", error, angle*PM_R2D,sqrt(c11),
     c12/sqrt(c11)/sqrt(c22),sqrt(c22),sqrt(c33)*PM_R2D);
 
+  delete ws;
 
   printf("Unit test......................PASSED\n");
 }
@@ -25,9 +25,9 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 ****************************************************************************/
 
 /*
-First of all you need to select the laser range finder you have by
-setting "#define PM_LASER "
-to PM_SICK_LMS200, PM_HOKUYO_URG_04LX.
+The laser range finder is selected at run time: initialise one PMContext per
+laser model with pm_init() and pass it to the matching functions.
+PM_LASER is only the default model of pm_init().
 */
 
 #ifndef _POLAR_MATCH_
@@ -39,7 +39,7 @@ to PM_SICK_LMS200, PM_HOKUYO_URG_04LX.
 
 //----------------- L A S E R    S P E C I F I C    P A R A M E T E R S------------
 
-// STEP 1) Define a name for your laser range finder here (if it hasn't been defined yet):
+// STEP 1) Laser range finder models known by pm_init() (their parameters are in polar_match.cpp):
 #define PM_PSD_SCANNER      0
 #define PM_HOKUYO_URG_04LX  1
 #define PM_SICK_LMS200      2
@@ -48,67 +48,12 @@ to PM_SICK_LMS200, PM_HOKUYO_URG_04LX.
 #define PM_DATASET_FREIBURG 5
 #define PM_DATASET_MIT      6
 
-// STEP 2) Set the type your laser range finder here:
+// STEP 2) Default laser range finder used when pm_init() is not given a model:
    #define PM_LASER PM_HOKUYO_URG_04LX //PM_DATASET_FREIBURG //PM_HOKUYO_URG_04LX //PM_SIMUL
 
-// STEP 3) Add your laser range finder's parameters here if it is a different model (use centimeters)
-
-#if PM_LASER ==  PM_PSD_SCANNER
-  #define PM_LASER_NAME       "PSD_Scanner" ///< The name of the laser range finder.
-  #define PM_L_POINTS         200 ///< Maximum number of points in a scan.
-  #define PM_FOV              360 ///< Field of view of the laser range finder in degrees.
-  #define PM_MAX_RANGE        400 ///< [cm] Maximum valid laser range .
-  #define PM_MIN_VALID_POINTS 100 ///< Minimum number of valid points for scan matching.
-  #define PM_SEARCH_WINDOW    50  ///< Half window size which is searched for correct orientation.
-  #define PM_CORRIDOR_THRESHOLD 25.0 ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
-#elif PM_LASER ==  PM_HOKUYO_URG_04LX
-  #define PM_LASER_NAME       "Hokuyo URG-04LX" ///< The name of the laser range finder.
-  #define PM_L_POINTS         682 ///< Maximum number of points in a scan.
-  #define PM_FOV              240 ///< Field of view of the laser range finder in degrees.
-  #define PM_MAX_RANGE        560 ///< [cm] Maximum valid laser range.
-  #define PM_MIN_VALID_POINTS 200 ///< Minimum number of valid points for scan matching.
-  #define PM_SEARCH_WINDOW    80  ///< Half window size which is searched for correct orientation.
-  #define PM_CORRIDOR_THRESHOLD 25.0 ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
-#elif PM_LASER ==  PM_SICK_LMS200
-  #define PM_LASER_NAME       "Sick LMS" ///< The name of the laser range finder.
-  #define PM_L_POINTS         181  ///< Maximum number of points in a scan.
-  #define PM_FOV              180  ///< Field of view of the laser range finder in degrees.
-  #define PM_MAX_RANGE        1000 ///< [cm] Maximum valid laser range.
-  #define PM_MIN_VALID_POINTS 40   ///< Minimum number of valid points for scan matching.
-  #define PM_SEARCH_WINDOW    20   ///< Half window size which is searched for correct orientation.
-  #define PM_CORRIDOR_THRESHOLD 25.0 ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
-#elif PM_LASER ==  PM_HOKUYO_UTM_30LX
-  #define PM_LASER_NAME       "HOKUYO UTM-30LX" ///< The name of the laser range finder.
-  #define PM_L_POINTS         1080  ///< Maximum number of points in a scan.
-  #define PM_FOV              270  ///< Field of view of the laser range finder in degrees.
-  #define PM_MAX_RANGE        3000  ///< [cm] Maximum valid laser range. (3000 for this sensor.)
-  #define PM_MIN_VALID_POINTS 300   ///< Minimum number of valid points for scan matching.
-  #define PM_SEARCH_WINDOW    200   ///< Half window size which is searched for correct orientation.
-  #define PM_CORRIDOR_THRESHOLD 25.0 ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
-#elif PM_LASER ==  PM_SIMUL
-  #define PM_LASER_NAME       "LASER_SIMUL" ///< The name of the laser range finder.
-  #define PM_L_POINTS         241  ///< Maximum number of points in a scan.
-  #define PM_FOV              240  ///< Field of view of the laser range finder in degrees.
-  #define PM_MAX_RANGE        560  ///< [cm] Maximum valid laser range.
-  #define PM_MIN_VALID_POINTS 80   ///< Minimum number of valid points for scan matching.
-  #define PM_SEARCH_WINDOW    40   ///< Half window size which is searched for correct orientation.
-  #define PM_CORRIDOR_THRESHOLD 25.0 ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
-#elif PM_LASER ==  PM_DATASET_FREIBURG
-  #define PM_LASER_NAME       "LASER_FREIBURG" ///< The name of the laser range finder.
-  #define PM_L_POINTS         360  ///< Maximum number of points in a scan.
-  #define PM_FOV              180  ///< Field of view of the laser range finder in degrees.
-  #define PM_MAX_RANGE        7900  ///< [cm] Maximum valid laser range.
-  #define PM_MIN_VALID_POINTS 80   ///< Minimum number of valid points for scan matching.
-  #define PM_SEARCH_WINDOW    40   ///< Half window size which is searched for correct orientation.
-  #define PM_CORRIDOR_THRESHOLD 25.0 ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
-#elif PM_LASER ==  PM_DATASET_MIT
-  #define PM_LASER_NAME       "LASER_MIT" ///< The name of the laser range finder.
-  #define PM_L_POINTS         361  ///< Maximum number of points in a scan.
-  #define PM_FOV              180.5  ///< Field of view of the laser range finder in degrees.
-  #define PM_MAX_RANGE        7900  ///< [cm] Maximum valid laser range.
-  #define PM_MIN_VALID_POINTS 80   ///< Minimum number of valid points for scan matching.
-  #define PM_SEARCH_WINDOW    40   ///< Half window size which is searched for correct orientation.
-  #define PM_CORRIDOR_THRESHOLD 25.0 ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
+// STEP 3) Maximum number of points per scan of any laser used (sets the size of PMScan):
+#ifndef PM_MAX_POINTS
+  #define PM_MAX_POINTS     4096
 #endif
 
 // STEP 4) Set the time registration delay (the time between your time stamps and the
@@ -133,6 +78,7 @@ to PM_SICK_LMS200, PM_HOKUYO_URG_04LX.
 #define PM_MAX_ITER         30   ///< Maximum number of iterations for PSM.
 #define PM_MAX_ITER_ICP     60   ///< Maximum number of iterations for ICP
 #define PM_STOP_COND_ICP    0.1  ///< Stopping condition for ICP. The pose change has to be smaller than this.
+#define PM_ICP_GRID_CELLS   65536 ///< Maximum number of cells of the grid used by ICP to look up the closest reference points.
 
 #define PM_MIN_STD_XY          20.0 ///<[cm] The minimum match result standard deviation in X or Y direction. Used in covariance estimation.
 #define PM_MIN_STD_ORIENTATION 4.0  ///<[degrees] The minimum standard deviation of the orientation match. Used in covariance estimation.
@@ -151,9 +97,6 @@ to PM_SICK_LMS200, PM_HOKUYO_URG_04LX.
 #define PM_OCCLUDED  8  ///< Measurement tag: range reading is occluded.
 #define PM_EMPTY     16 ///< Measurement tag: no measurement (between 2 segments there is no interpolation!)
 
-extern PM_TYPE   pm_fi[PM_L_POINTS];///< Contains precomputed range bearings.
-extern PM_TYPE   pm_si[PM_L_POINTS];///< Contains the sinus of each bearing.
-extern PM_TYPE   pm_co[PM_L_POINTS];///< Contains the cosinus of each bearing.
 extern const PM_TYPE   PM_D2R; ///< Conversion factor for converting degrees to radians.
 extern const PM_TYPE   PM_R2D; ///< Conversion factor for converting radians to degrees.
 
@@ -172,31 +115,114 @@ struct PMScan
   PM_TYPE  rx;   ///<[cm] Robot odometry X coordinate.
   PM_TYPE  ry;   ///<[cm] Robot odometry Y coordinate.
   PM_TYPE  th;   ///<[rad] Robot orientation.
-  PM_TYPE  r[PM_L_POINTS];///<[cm] Laser range readings. 0 or negative ranges denote invalid readings.
-  PM_TYPE  x[PM_L_POINTS];///<[cm] Laser reading X coordinates in Cartesian coordinates.
-  PM_TYPE  y[PM_L_POINTS];///<[cm] Laser reading Y coordinates in Cartesian coordinates.
-  int      bad[PM_L_POINTS];///< @brief Tag describing the validity of a range measurement.
+  PM_TYPE  r[PM_MAX_POINTS];///<[cm] Laser range readings. 0 or negative ranges denote invalid readings.
+  PM_TYPE  x[PM_MAX_POINTS];///<[cm] Laser reading X coordinates in Cartesian coordinates.
+  PM_TYPE  y[PM_MAX_POINTS];///<[cm] Laser reading Y coordinates in Cartesian coordinates.
+  int      bad[PM_MAX_POINTS];///< @brief Tag describing the validity of a range measurement.
                             ///< 0 if OK; sources of invalidity - out of range reading;
                             ///< reading belongs to moving object (not implemented); occlusion; mixed pixel.
-  int      seg[PM_L_POINTS];///< Describes which segment the range reading belongs to.
+  int      seg[PM_MAX_POINTS];///< Describes which segment the range reading belongs to.
 };
 
-void pm_init();
-int  pm_readScan(mrpt::obs::CObservation2DRangeScan laser, PMScan *ls);
-void pm_save_scan(PMScan *act,const char *filename);
+/** @brief Geometry of a laser range finder, its matching parameters and precomputed bearings.
 
-void pm_preprocessScan(PMScan *ls);
+Filled by pm_init() and only read by the matching functions: a context can be
+shared by several matchers running in parallel, and matchers of different
+laser models can live in the same process.
+Only the first @a l_points readings of a PMScan are used.
+*/
+struct PMContext
+{
+  const char *laser_name;         ///< The name of the laser range finder.
+  int      l_points;              ///< Number of points in a scan (at most PM_MAX_POINTS).
+  PM_TYPE  fov;                   ///<[deg] Field of view of the laser range finder.
+  PM_TYPE  max_range;             ///<[cm] Maximum valid laser range.
+  int      min_valid_points;      ///< Minimum number of valid points for scan matching.
+  int      search_window;         ///< Half window size which is searched for correct orientation.
+  int      orientation_step;      ///< Stride of the coarse pass of the orientation search (1: exhaustive search).
+  PM_TYPE  corridor_threshold;    ///< Threshold for angle variation between points to determine if scan was taken of a corridor.
+  PM_TYPE  fi_min;                ///<[rad] Bearing from which laser scans start.
+  PM_TYPE  fi_max;                ///<[rad] Bearing at which laser scans end.
+  PM_TYPE  dfi;                   ///<[rad] Angular resolution of laser scans.
+  PM_TYPE  fi[PM_MAX_POINTS];     ///< Precomputed range bearings.
+  PM_TYPE  si[PM_MAX_POINTS];     ///< The sinus of each bearing.
+  PM_TYPE  co[PM_MAX_POINTS];     ///< The cosinus of each bearing.
+  PM_TYPE  si_rot[PM_MAX_POINTS]; ///< The sinus of each bearing rotated by PI/5 (corridor test).
+  PM_TYPE  co_rot[PM_MAX_POINTS]; ///< The cosinus of each bearing rotated by PI/5 (corridor test).
+};
+
+/** @brief Scratch memory of a matcher.
+
+Holds the intermediate arrays of pm_psm(), pm_icp() and pm_error_index2() so that
+a matching call neither copies the scans nor needs large stack buffers.
+Allocate one per matcher and reuse it for every call; matchers running
+concurrently need their own workspace.
+*/
+struct PMWorkspace
+{
+  PM_TYPE  new_r[PM_MAX_POINTS];  ///<[cm] Current scan ranges interpolated at the reference bearings.
+  int      new_bad[PM_MAX_POINTS];///< Tags of the interpolated ranges.
+  PM_TYPE  ref_x[PM_MAX_POINTS], ref_y[PM_MAX_POINTS];///<[cm] Reference scan points (ICP).
+  PM_TYPE  act_x[PM_MAX_POINTS], act_y[PM_MAX_POINTS];///<[cm] Current scan points in its own frame (ICP).
+  PM_TYPE  nx[PM_MAX_POINTS], ny[PM_MAX_POINTS];      ///<[cm] Current scan points in the reference frame (ICP).
+  PM_TYPE  ix[PM_MAX_POINTS], iy[PM_MAX_POINTS];      ///<[cm] Interpolated reference points (ICP).
+  int      index[PM_MAX_POINTS][2];                   ///< Match indices current, reference (ICP).
+  PM_TYPE  dist[PM_MAX_POINTS];                       ///<[cm] Distance of the matches (ICP).
+  PM_TYPE  orient_err[2*PM_MAX_POINTS+1];             ///<[cm] Orientation search error of every shift.
+  PM_TYPE  pad_r[3*PM_MAX_POINTS+4];                  ///<[cm] Reference ranges padded by the search window.
+  int      pad_mask[3*PM_MAX_POINTS+4];               ///< Validity of pad_r (-1: valid, 0: invalid).
+  int      valid_idx[PM_MAX_POINTS];                  ///< Indices of the valid interpolated ranges.
+  PM_TYPE  grid_x0, grid_y0;                          ///<[cm] Corner of the grid of the reference points (ICP).
+  PM_TYPE  grid_cell;                                 ///<[cm] Cell size of the grid (ICP).
+  int      grid_cols, grid_rows;                      ///< Size of the grid (ICP).
+  int      grid_start[PM_ICP_GRID_CELLS+1];           ///< First entry of every cell in grid_idx (ICP).
+  int      grid_idx[PM_MAX_POINTS];                   ///< Reference points sorted by cell (ICP).
+  int      grid_cell_of[PM_MAX_POINTS];               ///< Cell of every reference point (ICP).
+  int      sort_order[PM_MAX_POINTS], sort_rank[PM_MAX_POINTS];///< Matches sorted by distance and their ranks (ICP).
+  int      sort_left[PM_MAX_POINTS], sort_tree[PM_MAX_POINTS+1];///< Larger matches on the left of every match and counting tree (ICP).
+  int      index_tmp[PM_MAX_POINTS][2];               ///< Rearranged match indices (ICP).
+  PM_TYPE  dist_tmp[PM_MAX_POINTS];                   ///<[cm] Rearranged match distances (ICP).
+};
+
+/** @brief Uncertainty of a match, as estimated by pm_cov_est().
+
+Optionally filled by pm_psm() and pm_icp() from the residuals at the final pose
+and the corridor test of the reference scan, without matching again.
+The covariance is expressed in the reference scan's frame:<br>
+[c11 c12 0.0]<br>
+[c12 c22 0.0]<br>
+[0.0 0.0 c33]<br>
+*/
+struct PMCovariance
+{
+  PM_TYPE  err;          ///<[cm] Error index of the match (average residual of the associated points).
+  int      n;            ///< Number of associated points the error index was computed from.
+  bool     corridor;     ///< True if the reference scan seems to be taken of a corridor.
+  PM_TYPE  corr_angle;   ///<[rad] Orientation of the corridor (0 if @a corridor is false).
+  double   c11, c12, c22;///<[cm^2] Position covariance.
+  double   c33;          ///<[rad^2] Orientation variance.
+};
+
+void pm_init(PMContext *ctx, int laser = PM_LASER);
+void pm_init(PMContext *ctx, const char *name, int l_points, PM_TYPE fov, PM_TYPE max_range,
+             int min_valid_points, int search_window, PM_TYPE corridor_threshold = 25.0);
+int  pm_readScan(const PMContext *ctx, const mrpt::obs::CObservation2DRangeScan &laser, PMScan *ls);
+int  pm_readScan(const PMContext *ctx, const float *ranges, PMScan *ls);
+void pm_save_scan(const PMContext *ctx, PMScan *act,const char *filename);
+
+void pm_preprocessScan(const PMContext *ctx, PMScan *ls);
+void pm_preprocessScans(const PMContext *ctx, PMScan *scans, int num_scans);
 
-PM_TYPE pm_psm( const PMScan *lsr,PMScan *lsa);
-PM_TYPE pm_icp( const PMScan *lsr,PMScan *lsa);
+PM_TYPE pm_psm(const PMContext *ctx, const PMScan *lsr,PMScan *lsa, PMWorkspace *ws, PMCovariance *cov=NULL);
+PM_TYPE pm_icp(const PMContext *ctx, const PMScan *lsr,PMScan *lsa, PMWorkspace *ws, PMCovariance *cov=NULL);
 
 
-bool    pm_is_corridor(PMScan *act);
-PM_TYPE pm_error_index(PMScan *lsr,PMScan *lsa);
-PM_TYPE pm_error_index2 ( PMScan *ref,PMScan *cur, int* associatedPoints=NULL );
-PM_TYPE pm_corridor_angle(PMScan *act);
+bool    pm_is_corridor(const PMContext *ctx, const PMScan *act);
+PM_TYPE pm_error_index(const PMContext *ctx, PMScan *lsr,PMScan *lsa);
+PM_TYPE pm_error_index2 (const PMContext *ctx, const PMScan *ref,const PMScan *cur, PMWorkspace *ws, int* associatedPoints=NULL );
+PM_TYPE pm_corridor_angle(const PMContext *ctx, const PMScan *act);
 void    pm_cov_est(PM_TYPE err, double *c11,double *c12, double *c22, double *c33,
                    bool corridor=false, PM_TYPE corr_angle=0);
 
-void  pm_unit_test(int matching_alg = PM_PSM, bool interactive=true);
+void  pm_unit_test(const PMContext *ctx, int matching_alg = PM_PSM, bool interactive=true);
 #endif
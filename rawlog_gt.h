@@ -10,6 +10,7 @@
 #include <mrpt/maps/COccupancyGridMap2D.h>
 #include <mrpt/gui.h>
 #include <mrpt/utils/round.h>
+#include "rawlog_stream.h"
 
 
 using namespace mrpt;
@@ -41,12 +42,13 @@ public:
 	TRobotLaser				laser;
 	CDisplayWindow3D		window;
 	COpenGLScenePtr			scene;
-    CRawlog                 dataset;
+    CRawlogStream           dataset;
     unsigned int dataset_id;
     unsigned int rawlog_count;
     bool dataset_finished;
     bool localized;
     float laser_min_range;
+    float scene_progress;       //Fraction of the rawlog shown in the scene
 
 
     //Results
@@ -95,7 +97,9 @@ public:
         rawlog_count = 0;
         dataset_finished = false;
         localized = false;
-        if (!dataset.loadFromRawLogFile(filename))
+        scene_progress = 0.f;
+        dataset.odometry_label = "ODOMETRY";
+        if (!dataset.open(filename))
             throw std::runtime_error("\nCouldn't open rawlog dataset file for input...");
 
         new_pose = CPose2D(0.f, 0.f, 0.05f);
@@ -114,20 +118,18 @@ public:
 
     void readScanRawlog()
 	{
-        CObservationPtr alfa = dataset.getAsObservation(rawlog_count);
-
-        while (!IS_CLASS(alfa, CObservation2DRangeScan))
+        TRawlogEvent event;
+        if (!dataset.next(event))
         {
-            rawlog_count++;
-            if (dataset.size() <= rawlog_count)
-            {
-                dataset_finished = true;
-                return;
-            }
+            dataset_finished = true;
+            return;
+        }
 
-            if (IS_CLASS(alfa, CObservationOdometry) && (alfa->sensorLabel == "ODOMETRY"))
+        while (event.type != TRawlogEvent::SCAN)
+        {
+            if (event.type == TRawlogEvent::ODOMETRY)       //Only those labelled "ODOMETRY" are streamed
             {
-                CObservationOdometryPtr obs_odo = CObservationOdometryPtr(alfa);
+                CObservationOdometryPtr obs_odo = CObservationOdometryPtr(event.obs);
                 last_pose = new_pose;
 
                 if (!localized)
@@ -143,10 +145,14 @@ public:
 
             }
 
-            alfa = dataset.getAsObservation(rawlog_count);
+            if (!dataset.next(event))
+            {
+                dataset_finished = true;
+                return;
+            }
         }
 
-        CObservation2DRangeScanPtr obs2D = CObservation2DRangeScanPtr(alfa);
+        CObservation2DRangeScanPtr obs2D = CObservation2DRangeScanPtr(event.obs);
 
         laser.m_scan_old = laser.m_scan;
         laser.m_scan = *obs2D;
@@ -161,9 +167,9 @@ public:
                 laser.m_scan.validRange[i] = true;
             }
 
-        rawlog_count++;
+        rawlog_count = dataset.entriesRead();
 
-        if (dataset.size() <= rawlog_count)
+        if (dataset.finished())
             dataset_finished = true;
 
         printf("\n Scan %d read", rawlog_count);
@@ -224,8 +230,9 @@ public:
     {
 
         //Stop the program to move the scene before taking the snapshot
-        const float threshold = float(dataset.size())/5.f;
-        if (floor(float(rawlog_count)/threshold) != floor(float(rawlog_count-2)/threshold))
+        const bool new_fifth = (floor(5.f*dataset.progress()) != floor(5.f*scene_progress));
+        scene_progress = dataset.progress();
+        if (new_fifth)
             system::os::getch();
 
 
@@ -271,7 +278,7 @@ public:
         //Trajectories
         CSetOfLinesPtr traj_lines = scene->getByClass<CSetOfLines>(0);
 
-        if (floor(float(rawlog_count)/threshold) != floor(float(rawlog_count-2)/threshold))
+        if (new_fifth)
         {
             system::os::getch();
             traj_lines->clear();
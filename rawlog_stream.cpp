@@ -0,0 +1,227 @@
+/* Project: Laser odometry
+   Streaming reader of rawlogs with a bounded read-ahead thread */
+
+#include "rawlog_stream.h"
+#include <mrpt/obs/CRawlog.h>
+#include <mrpt/obs/CSensoryFrame.h>
+#include <mrpt/obs/CActionCollection.h>
+#include <mrpt/obs/CObservation2DRangeScan.h>
+#include <mrpt/obs/CObservationOdometry.h>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+
+
+using namespace mrpt::obs;
+using namespace mrpt::synch;
+using namespace std;
+
+
+CRawlogStream::CRawlogStream() :
+    read_scans(true), read_odometry(true), first_entry(0), file_size(0.0), reader_running(false),
+    free_slots(NULL), queued(NULL), stop(false), end_reached(true), entries_read(0), position(0.0)
+{
+}
+
+bool CRawlogStream::open(const string &filename, unsigned int read_ahead)
+{
+    close();
+    if (!file.open(filename))
+        return false;
+
+    //The END event does not take a free slot, so "queued" can reach read_ahead + 1
+    read_ahead = max(read_ahead, 1u);
+    free_slots = new CSemaphore(read_ahead, read_ahead + 1);
+    queued = new CSemaphore(0, read_ahead + 1);
+
+    file_size = uncompressedSize(filename);
+    stop = false;
+    end_reached = false;
+    entries_read = 0;
+    position = 0.0;
+
+    reader = mrpt::system::createThreadFromObjectMethod(this, &CRawlogStream::readerThread);
+    reader_running = true;
+    return true;
+}
+
+void CRawlogStream::close()
+{
+    if (reader_running)
+    {
+        //The reader can only be blocked waiting for a free slot
+        {
+            CCriticalSectionLocker lock(&queue_cs);
+            stop = true;
+        }
+        free_slots->release();
+        mrpt::system::joinThread(reader);
+        reader_running = false;
+    }
+
+    file.close();
+    delete free_slots; free_slots = NULL;
+    delete queued; queued = NULL;
+    queue.clear();
+    queue_position.clear();
+    end_reached = true;
+}
+
+bool CRawlogStream::next(TRawlogEvent &event)
+{
+    if (end_reached)
+    {
+        event = TRawlogEvent();
+        return false;
+    }
+
+    queued->waitForSignal();
+    pop(event);
+    if (event.type == TRawlogEvent::END)
+    {
+        end_reached = true;
+        return false;
+    }
+
+    free_slots->release();
+    entries_read = event.entry + 1;
+    return true;
+}
+
+bool CRawlogStream::finished()
+{
+    if (end_reached)
+        return true;
+
+    //Peek at the next event
+    queued->waitForSignal();
+    bool at_end;
+    {
+        CCriticalSectionLocker lock(&queue_cs);
+        at_end = (queue.front().type == TRawlogEvent::END);
+    }
+
+    if (at_end)
+    {
+        TRawlogEvent event;
+        pop(event);
+        end_reached = true;
+    }
+    else
+        queued->release();
+
+    return at_end;
+}
+
+float CRawlogStream::progress() const
+{
+    if (file_size <= 0.0)
+        return 0.f;
+    return float(min(position/file_size, 1.0));
+}
+
+void CRawlogStream::readerThread()
+{
+    size_t entry = 0;
+    try
+    {
+        while (!stopped())
+        {
+            //New pointers every time: CRawlog clears the ones it is given, and those of the last entry are still queued
+            CActionCollectionPtr action;
+            CSensoryFramePtr frame;
+            CObservationPtr obs;
+            const size_t entry_index = entry;
+
+            if (!CRawlog::getActionObservationPairOrObservation(file, action, frame, obs, entry))
+                break;
+            if (entry_index < first_entry)
+                continue;
+
+            //Sensory frames are expanded into their observations
+            vector<CObservationPtr> observations;
+            if (obs.present())
+                observations.push_back(obs);
+            else if (frame.present())
+                for (CSensoryFrame::iterator it = frame->begin(); it != frame->end(); ++it)
+                    observations.push_back(*it);
+
+            const double pos = double(file.getPosition());
+            for (unsigned int k = 0; k < observations.size(); k++)
+            {
+                TRawlogEvent event;
+                event.obs = observations[k];
+                event.entry = entry_index;
+
+                if (read_scans && IS_CLASS(event.obs, CObservation2DRangeScan) && (scan_label.empty() || (event.obs->sensorLabel == scan_label)))
+                    event.type = TRawlogEvent::SCAN;
+                else if (read_odometry && IS_CLASS(event.obs, CObservationOdometry) && (odometry_label.empty() || (event.obs->sensorLabel == odometry_label)))
+                    event.type = TRawlogEvent::ODOMETRY;
+                else
+                    continue;
+
+                free_slots->waitForSignal();
+                if (stopped())
+                    break;
+                push(event, pos);
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        printf("\n CRawlogStream: the rawlog could not be read further: %s", e.what());
+    }
+
+    push(TRawlogEvent(), file_size);
+}
+
+bool CRawlogStream::stopped()
+{
+    CCriticalSectionLocker lock(&queue_cs);
+    return stop;
+}
+
+void CRawlogStream::push(const TRawlogEvent &event, double pos)
+{
+    {
+        CCriticalSectionLocker lock(&queue_cs);
+        queue.push_back(event);
+        queue_position.push_back(pos);
+    }
+    queued->release();
+}
+
+void CRawlogStream::pop(TRawlogEvent &event)
+{
+    CCriticalSectionLocker lock(&queue_cs);
+    event = queue.front();
+    position = queue_position.front();
+    queue.pop_front();
+    queue_position.pop_front();
+}
+
+double CRawlogStream::uncompressedSize(const string &filename)
+{
+    ifstream f(filename.c_str(), ios::binary);
+    if (!f.is_open())
+        return 0.0;
+
+    f.seekg(0, ios::end);
+    const double size = double(f.tellg());
+    if (size < 18.0)
+        return size;
+
+    //Gzip files store the uncompressed size (modulo 2^32) in their last 4 bytes
+    unsigned char magic[2], isize[4];
+    f.seekg(0, ios::beg);
+    f.read((char*)magic, 2);
+    if ((magic[0] != 0x1f) || (magic[1] != 0x8b))
+        return size;
+
+    f.seekg(-4, ios::end);
+    f.read((char*)isize, 4);
+    double uncompressed = double(isize[0]) + 256.0*(double(isize[1]) + 256.0*(double(isize[2]) + 256.0*double(isize[3])));
+    while (uncompressed < size)
+        uncompressed += 4294967296.0;
+    return uncompressed;
+}
@@ -0,0 +1,88 @@
+//====================================================
+//  Project: Laser odometry
+//  Streaming reader of rawlogs: the observations are
+//  deserialized by a read-ahead thread as they are used
+//====================================================
+
+#ifndef _RAWLOG_STREAM_
+#define _RAWLOG_STREAM_
+
+#include <mrpt/obs/CObservation.h>
+#include <mrpt/utils/CFileGZInputStream.h>
+#include <mrpt/synch/CSemaphore.h>
+#include <mrpt/synch/CCriticalSection.h>
+#include <mrpt/system/threads.h>
+#include <string>
+#include <deque>
+
+
+//Observation of the rawlog handed to the harness
+
+struct TRawlogEvent {
+
+    enum TType { SCAN, ODOMETRY, END };
+
+    TType                       type;
+    mrpt::obs::CObservationPtr  obs;        //CObservation2DRangeScan or CObservationOdometry (empty at the END)
+    size_t                      entry;      //Index of the entry of the rawlog that contains it
+
+    TRawlogEvent() : type(END), entry(0) {}
+};
+
+
+//The rawlog is never loaded as a whole (as CRawlog::loadFromRawLogFile does): a thread deserializes the entries
+//in order and queues the 2D scans and odometry observations that pass the filters, and it stops when the queue
+//holds "read_ahead" of them. Everything else is discarded as it is read, so the memory does not grow with the
+//length of the rawlog and the first scan is available as soon as it is read. Observation-only rawlogs and
+//sensory frames are supported (actions are skipped). Only one thread (the harness) must consume the events.
+
+class CRawlogStream {
+public:
+
+    //Filters (set them before open())
+    bool            read_scans, read_odometry;
+    std::string     scan_label, odometry_label;     //Sensor labels to keep ("" -> all)
+    size_t          first_entry;                    //Entries before it are skipped
+
+    CRawlogStream();
+    ~CRawlogStream() { close(); }
+
+    bool open(const std::string &filename, unsigned int read_ahead = 64);
+    void close();
+
+    bool next(TRawlogEvent &event);         //Waits for the next event (false at the end of the rawlog)
+    bool finished();                        //True when there are no more events (it waits for the next one)
+
+    size_t entriesRead() const { return entries_read; }     //Entries of the rawlog up to the last event
+    float progress() const;                                 //Fraction of the (uncompressed) rawlog up to the last event
+
+private:
+
+    mrpt::utils::CFileGZInputStream     file;
+    double                              file_size;          //Uncompressed bytes
+    mrpt::system::TThreadHandle         reader;
+    bool                                reader_running;
+
+    //Bounded queue: "free_slots" blocks the reader when it is full and "queued" blocks the harness when it is empty
+    std::deque<TRawlogEvent>            queue;
+    std::deque<double>                  queue_position;
+    mrpt::synch::CCriticalSection       queue_cs;
+    mrpt::synch::CSemaphore             *free_slots, *queued;
+    bool                                stop;               //Set by close() (protected by queue_cs)
+
+    bool                                end_reached;
+    size_t                              entries_read;
+    double                              position;
+
+    void readerThread();
+    bool stopped();
+    void push(const TRawlogEvent &event, double pos);
+    void pop(TRawlogEvent &event);
+    static double uncompressedSize(const std::string &filename);
+
+    //The thread and the file belong to the stream
+    CRawlogStream(const CRawlogStream &);
+    CRawlogStream &operator=(const CRawlogStream &);
+};
+
+#endif
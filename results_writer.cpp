@@ -0,0 +1,427 @@
+/* Project: Laser odometry
+   Results sink with a background writer thread (binary, text, TUM and KITTI files) */
+
+#include "results_writer.h"
+#include <mrpt/system/filesystem.h>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+
+
+using namespace mrpt::poses;
+using namespace mrpt::synch;
+using namespace std;
+
+
+static const char results_magic[8] = {'S','R','F','R','S','L','T','S'};
+
+
+static vector<string> splitColumns(const string &columns)
+{
+    vector<string> names;
+    istringstream stream(columns);
+    string name;
+    while (stream >> name)
+        names.push_back(name);
+    return names;
+}
+
+//Header line of the text files
+static string textHeader(const vector<string> &columns)
+{
+    string names = "#";
+    for (unsigned int c=0; c<columns.size(); c++)
+        names += " " + columns[c];
+    return names + "\n";
+}
+
+//Lines of the text files
+static void appendText(string &text, const double *values, size_t rows, unsigned int num_columns)
+{
+    char number[64];
+    for (size_t i=0; i<rows; i++)
+    {
+        const double *row = &values[i*num_columns];
+        for (unsigned int c=0; c<num_columns; c++)
+        {
+            snprintf(number, sizeof(number), c ? " %.6f" : "%.6f", row[c]);
+            text += number;
+        }
+        text += '\n';
+    }
+}
+
+
+CResultsWriter::CResultsWriter() :
+    num_columns(0), block_rows(0), num_rows(0), num_stalls(0), f_bin(NULL), f_text(NULL), f_tum(NULL), f_kitti(NULL),
+    current(NULL), free_blocks(NULL), queued(NULL), writer_running(false)
+{
+}
+
+bool CResultsWriter::open(const string &prefix, const vector<string> &columns, unsigned int formats, unsigned int block_rows_, unsigned int num_blocks)
+{
+    close();
+    if (columns.empty() || (((formats & RESULTS_TUM) || (formats & RESULTS_KITTI)) && (columns.size() < 4)))
+    {
+        printf("\n CResultsWriter: the trajectory formats need the columns timestamp, x, y, phi \n");
+        return false;
+    }
+
+    const bool opened = (!(formats & RESULTS_BINARY) || (f_bin = openFile(prefix + ".bin")))
+                        && (!(formats & RESULTS_TEXT) || (f_text = openFile(prefix + ".txt")))
+                        && (!(formats & RESULTS_TUM) || (f_tum = openFile(prefix + "_tum.txt")))
+                        && (!(formats & RESULTS_KITTI) || (f_kitti = openFile(prefix + "_kitti.txt")));
+    if (!opened)
+    {
+        close();
+        return false;
+    }
+
+    column_names = columns;
+    num_columns = columns.size();
+    num_rows = 0;
+    num_stalls = 0;
+
+    //Headers (the number of rows of the binary one is written by close())
+    if (f_bin)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, results_magic, sizeof(results_magic));
+        header.version = RESULTS_VERSION;
+        header.num_columns = num_columns;
+        fwrite(&header, sizeof(header), 1, f_bin);
+
+        for (unsigned int c=0; c<num_columns; c++)
+        {
+            char name[RESULTS_NAME_LENGTH];
+            memset(name, 0, RESULTS_NAME_LENGTH);
+            strncpy(name, columns[c].c_str(), RESULTS_NAME_LENGTH - 1);
+            fwrite(name, RESULTS_NAME_LENGTH, 1, f_bin);
+        }
+    }
+    if (f_text)
+        fputs(textHeader(columns).c_str(), f_text);
+    if (f_tum)
+        fprintf(f_tum, "# timestamp x y z qx qy qz qw\n");
+
+    //Blocks
+    block_rows = max(block_rows_, 1u);
+    num_blocks = max(num_blocks, 1u);
+    blocks.assign(num_blocks, vector<double>());
+    for (unsigned int b=0; b<num_blocks; b++)
+    {
+        blocks[b].reserve(block_rows*num_columns);
+        empty.push_back(&blocks[b]);
+    }
+    current = NULL;
+
+    //The END of the thread (a NULL block) does not take a free block
+    free_blocks = new CSemaphore(num_blocks, num_blocks);
+    queued = new CSemaphore(0, num_blocks + 1);
+
+    writer = mrpt::system::createThreadFromObjectMethod(this, &CResultsWriter::writerThread);
+    writer_running = true;
+    return true;
+}
+
+bool CResultsWriter::open(const string &prefix, const string &columns, unsigned int formats)
+{
+    return open(prefix, splitColumns(columns), formats);
+}
+
+void CResultsWriter::close()
+{
+    if (writer_running)
+    {
+        flush();
+        submit(NULL);
+        mrpt::system::joinThread(writer);
+        writer_running = false;
+    }
+
+    if (f_bin)
+    {
+        header.num_rows = num_rows;
+        fseek(f_bin, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, f_bin);
+        fclose(f_bin);
+    }
+    if (f_text) fclose(f_text);
+    if (f_tum) fclose(f_tum);
+    if (f_kitti) fclose(f_kitti);
+    f_bin = f_text = f_tum = f_kitti = NULL;
+
+    delete free_blocks; free_blocks = NULL;
+    delete queued; queued = NULL;
+    full.clear();
+    empty.clear();
+    blocks.clear();
+    current = NULL;
+}
+
+void CResultsWriter::add(const double *row)
+{
+    if (!writer_running)
+        return;
+
+    //Take an empty block (it only waits if the thread has not written any of the full ones yet)
+    if (!current)
+    {
+        {
+            CCriticalSectionLocker lock(&blocks_cs);
+            if (empty.empty())
+                num_stalls++;
+        }
+        free_blocks->waitForSignal();
+
+        CCriticalSectionLocker lock(&blocks_cs);
+        current = empty.front();
+        empty.pop_front();
+        current->clear();
+    }
+
+    current->insert(current->end(), row, row + num_columns);
+    num_rows++;
+
+    if (current->size() >= block_rows*num_columns)
+        flush();
+}
+
+void CResultsWriter::addPose(double timestamp, const CPose2D &pose, const double *extra)
+{
+    if (!extra && (num_columns > 4))
+    {
+        printf("\n CResultsWriter: addPose() needs the %u columns after the pose \n", num_columns - 4);
+        return;
+    }
+
+    //Small rows are built on the stack
+    double stack_row[16];
+    vector<double> heap_row;
+    double *row = stack_row;
+    if (num_columns > 16)
+    {
+        heap_row.resize(num_columns);
+        row = &heap_row[0];
+    }
+
+    row[0] = timestamp;
+    row[1] = pose[0];
+    row[2] = pose[1];
+    row[3] = pose.phi();
+    for (unsigned int c=4; c<num_columns; c++)
+        row[c] = extra[c-4];
+    add(row);
+}
+
+void CResultsWriter::flush()
+{
+    if (current && !current->empty())
+    {
+        submit(current);
+        current = NULL;
+    }
+}
+
+void CResultsWriter::submit(vector<double> *block)
+{
+    {
+        CCriticalSectionLocker lock(&blocks_cs);
+        full.push_back(block);
+    }
+    queued->release();
+}
+
+void CResultsWriter::writerThread()
+{
+    while (true)
+    {
+        queued->waitForSignal();
+        vector<double> *block;
+        {
+            CCriticalSectionLocker lock(&blocks_cs);
+            block = full.front();
+            full.pop_front();
+        }
+        if (!block)
+            break;
+
+        writeBlock(*block);
+
+        {
+            CCriticalSectionLocker lock(&blocks_cs);
+            empty.push_back(block);
+        }
+        free_blocks->release();
+    }
+}
+
+void CResultsWriter::writeBlock(const vector<double> &block)
+{
+    const size_t rows_block = block.size()/num_columns;
+    char number[64];
+
+    if (f_bin)
+        fwrite(&block[0], sizeof(double), block.size(), f_bin);
+
+    if (f_text)
+    {
+        line.clear();
+        appendText(line, &block[0], rows_block, num_columns);
+        fwrite(line.data(), 1, line.size(), f_text);
+    }
+
+    if (f_tum)
+    {
+        line.clear();
+        for (size_t i=0; i<rows_block; i++)
+        {
+            const double *row = &block[i*num_columns];
+            snprintf(number, sizeof(number), "%.6f %.6f %.6f 0 ", row[0], row[1], row[2]);
+            line += number;
+            snprintf(number, sizeof(number), "0 0 %.9f %.9f\n", sin(0.5*row[3]), cos(0.5*row[3]));
+            line += number;
+        }
+        fwrite(line.data(), 1, line.size(), f_tum);
+    }
+
+    if (f_kitti)
+    {
+        line.clear();
+        for (size_t i=0; i<rows_block; i++)
+        {
+            const double *row = &block[i*num_columns];
+            const double c = cos(row[3]), s = sin(row[3]);
+            snprintf(number, sizeof(number), "%e %e 0 %e ", c, -s, row[1]);
+            line += number;
+            snprintf(number, sizeof(number), "%e %e 0 %e ", s, c, row[2]);
+            line += number;
+            line += "0 0 1 0\n";
+        }
+        fwrite(line.data(), 1, line.size(), f_kitti);
+    }
+}
+
+FILE *CResultsWriter::openFile(const string &name)
+{
+    FILE *f = fopen(name.c_str(), "wb");
+    if (!f)
+        printf("\n CResultsWriter: couldn't create %s \n", name.c_str());
+    return f;
+}
+
+string CResultsWriter::freeName(const string &pattern, const string &suffix)
+{
+    char name[256];
+    unsigned int n = 0;
+    do {
+        snprintf(name, sizeof(name), pattern.c_str(), ++n);
+    } while (mrpt::system::fileExists(string(name) + suffix));
+    return name;
+}
+
+bool CResultsWriter::saveText(const string &prefix, const string &columns, const vector<double> &values)
+{
+    const vector<string> names = splitColumns(columns);
+    if (names.empty() || (values.size() % names.size() != 0))
+    {
+        printf("\n CResultsWriter: %s.txt needs whole rows of %u columns \n", prefix.c_str(), (unsigned int)(names.size()));
+        return false;
+    }
+
+    FILE *f = openFile(prefix + ".txt");
+    if (!f)
+        return false;
+
+    string text = textHeader(names);
+    if (!values.empty())
+        appendText(text, &values[0], values.size()/names.size(), names.size());
+    const bool written = (fwrite(text.data(), 1, text.size(), f) == text.size());
+    return (fclose(f) == 0) && written;
+}
+
+
+
+bool CResultsTable::load(const string &filename)
+{
+    columns.clear();
+    values.clear();
+    const bool binary = (filename.size() >= 4) && (filename.compare(filename.size() - 4, 4, ".bin") == 0);
+
+    if (binary)
+    {
+        FILE *f = fopen(filename.c_str(), "rb");
+        if (!f)
+            return false;
+
+        TResultsHeader header;
+        bool valid = (fread(&header, sizeof(header), 1, f) == 1) && (memcmp(header.magic, results_magic, sizeof(results_magic)) == 0)
+                     && (header.version == RESULTS_VERSION) && (header.num_columns > 0);
+        char name[RESULTS_NAME_LENGTH + 1] = {0};
+        for (uint32_t c=0; valid && (c<header.num_columns); c++)
+        {
+            valid = (fread(name, RESULTS_NAME_LENGTH, 1, f) == 1);
+            columns.push_back(name);
+        }
+        if (valid)
+        {
+            values.resize(size_t(header.num_rows*header.num_columns));
+            valid = values.empty() || (fread(&values[0], sizeof(double), values.size(), f) == values.size());
+        }
+
+        fclose(f);
+        if (!valid)
+        {
+            columns.clear();
+            values.clear();
+        }
+        return valid;
+    }
+
+    //Text: the names in the "#" line and one row per line
+    ifstream f(filename.c_str());
+    if (!f.is_open())
+        return false;
+
+    string line, name;
+    while (getline(f, line))
+    {
+        istringstream stream(line);
+        if (line.empty())
+            continue;
+        if (line[0] == '#')
+        {
+            if (columns.empty())
+            {
+                stream.ignore(1);
+                while (stream >> name)
+                    columns.push_back(name);
+            }
+            continue;
+        }
+
+        double value;
+        size_t num_values = 0;
+        while (stream >> value)
+        {
+            values.push_back(value);
+            num_values++;
+        }
+        if (columns.empty() || (num_values != columns.size()))
+        {
+            columns.clear();
+            values.clear();
+            return false;
+        }
+    }
+    return !columns.empty();
+}
+
+int CResultsTable::column(const string &name) const
+{
+    for (unsigned int c=0; c<columns.size(); c++)
+        if (columns[c] == name)
+            return int(c);
+    return -1;
+}
@@ -0,0 +1,117 @@
+//====================================================
+//  Project: Laser odometry
+//  Results sink: trajectories and per-scan columns are
+//  written to disk by a background thread
+//====================================================
+
+#ifndef _RESULTS_WRITER_
+#define _RESULTS_WRITER_
+
+#include <mrpt/poses/CPose2D.h>
+#include <mrpt/synch/CSemaphore.h>
+#include <mrpt/synch/CCriticalSection.h>
+#include <mrpt/system/threads.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+
+
+//Output files of a results table (they are named prefix + suffix):
+//  - RESULTS_BINARY (.bin): TResultsHeader, the names of the columns (32 chars each) and the rows as doubles
+//  - RESULTS_TEXT (.txt): a "#" line with the names of the columns and one line per row
+//  - RESULTS_TUM (_tum.txt): "timestamp x y z qx qy qz qw" per row
+//  - RESULTS_KITTI (_kitti.txt): the 3x4 matrix [R|t] of the pose per row, by rows
+//The trajectory formats (TUM, KITTI) need the first four columns to be the timestamp [s] and the pose x [m], y [m], phi [rad].
+
+enum TResultsFormat { RESULTS_BINARY = 1, RESULTS_TEXT = 2, RESULTS_TUM = 4, RESULTS_KITTI = 8 };
+
+struct TResultsHeader {
+
+    char        magic[8];           //"SRFRSLTS"
+    uint32_t    version;
+    uint32_t    num_columns;
+    uint64_t    num_rows;           //Written by close()
+};
+
+const uint32_t RESULTS_VERSION = 1;
+const unsigned int RESULTS_NAME_LENGTH = 32;
+
+
+//The rows are copied into blocks of "block_rows" rows, and the full blocks are converted and written by a thread,
+//so adding a row never waits for the disk. The harness only waits if all the blocks are full (stalls()).
+//Only one thread must add rows.
+
+class CResultsWriter {
+public:
+
+    CResultsWriter();
+    ~CResultsWriter() { close(); }
+
+    //formats: combination of TResultsFormat
+    bool open(const std::string &prefix, const std::vector<std::string> &columns, unsigned int formats = RESULTS_BINARY | RESULTS_TEXT,
+              unsigned int block_rows = 1024, unsigned int num_blocks = 4);
+    bool open(const std::string &prefix, const std::string &columns, unsigned int formats = RESULTS_BINARY | RESULTS_TEXT);     //Names separated by spaces
+    void close();                                   //Writes the pending rows and waits for the thread
+
+    void add(const double *row);                    //All the columns
+    void addPose(double timestamp, const mrpt::poses::CPose2D &pose, const double *extra = NULL);     //Extra columns after the pose (required if there are any)
+    void flush();                                   //Hands the rows added so far to the thread (it does not wait)
+
+    bool isOpen() const { return writer_running; }
+    size_t rows() const { return num_rows; }
+    unsigned int stalls() const { return num_stalls; }
+
+    //First name of the pattern (with a %u, e.g. "results_%03u") such that prefix + suffix does not exist
+    static std::string freeName(const std::string &pattern, const std::string &suffix = ".txt");
+
+    //Small tables (values by rows) are written to prefix.txt right away, in the same text format and without a thread
+    static bool saveText(const std::string &prefix, const std::string &columns, const std::vector<double> &values);
+
+private:
+
+    std::vector<std::string>            column_names;
+    unsigned int                        num_columns, block_rows;
+    size_t                              num_rows;
+    unsigned int                        num_stalls;
+
+    FILE                                *f_bin, *f_text, *f_tum, *f_kitti;
+    TResultsHeader                      header;
+    std::string                         line;       //Text of a block (writer thread)
+
+    //Blocks of rows: the harness fills "current", and the thread writes the "full" ones and returns them to "empty"
+    std::vector<std::vector<double> >   blocks;
+    std::vector<double>                 *current;
+    std::deque<std::vector<double>*>    full, empty;
+    mrpt::synch::CCriticalSection       blocks_cs;
+    mrpt::synch::CSemaphore             *free_blocks, *queued;
+    mrpt::system::TThreadHandle         writer;
+    bool                                writer_running;
+
+    void writerThread();
+    void writeBlock(const std::vector<double> &block);
+    void submit(std::vector<double> *block);
+    static FILE *openFile(const std::string &name);
+
+    //The thread and the files belong to the writer
+    CResultsWriter(const CResultsWriter &);
+    CResultsWriter &operator=(const CResultsWriter &);
+};
+
+
+//Table read back from the .bin (exact) or .txt file of a CResultsWriter, all of it in memory
+
+class CResultsTable {
+public:
+
+    std::vector<std::string>    columns;
+    std::vector<double>         values;         //By rows
+
+    bool load(const std::string &filename);
+    size_t rows() const { return columns.empty() ? 0 : values.size()/columns.size(); }
+    int column(const std::string &name) const;  //-1 -> not in the table
+    double at(size_t row, unsigned int col) const { return values[row*columns.size() + col]; }
+};
+
+#endif
@@ -0,0 +1,229 @@
+/* Project: Laser odometry
+   Flat binary scan logs: sequential writer and memory-mapped reader */
+
+#include "scan_log.h"
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+
+using namespace mrpt::poses;
+using namespace std;
+
+
+static const char scanlog_magic[8] = {'S','R','F','S','C','A','N','S'};
+
+//Bytes of every range (0 -> unknown format)
+static unsigned int rangeBytes(const TScanLogHeader &header)
+{
+    switch (header.range_format)
+    {
+    case SCANLOG_FLOAT32:   return 4;
+    case SCANLOG_UINT16:    return 2;
+    default:                return 0;
+    }
+}
+
+
+bool CScanLogWriter::open(const string &filename, unsigned int beams, float aperture, float max_range, float min_range, const string &sensor_label,
+                          float range_step)
+{
+    close();
+    file = fopen(filename.c_str(), "wb");
+    if (!file)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, scanlog_magic, sizeof(scanlog_magic));
+    header.version = SCANLOG_VERSION;
+    header.range_format = (range_step > 0.f) ? SCANLOG_UINT16 : SCANLOG_FLOAT32;
+    header.beams = beams;
+    header.record_stride = sizeof(TScanLogRecord) + (rangeBytes(header)*beams + 7)/8*8;
+    header.num_scans = 0;
+    header.aperture = aperture;
+    header.max_range = max_range;
+    header.min_range = min_range;
+    header.range_step = max(range_step, 0.f);
+    strncpy(header.sensor_label, sensor_label.c_str(), sizeof(header.sensor_label) - 1);
+
+    record = new char[header.record_stride];
+    memset(record, 0, header.record_stride);
+    filtered.resize(beams);
+
+    //The header is rewritten with the number of scans by close()
+    return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+void CScanLogWriter::close()
+{
+    if (file)
+    {
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+        fclose(file);
+        file = NULL;
+    }
+
+    delete [] record;
+    record = NULL;
+}
+
+bool CScanLogWriter::write(double timestamp, const float *range, const CPose2D *odometry)
+{
+    if (!file)
+        return false;
+
+    TScanLogRecord *rec = (TScanLogRecord*)record;
+    rec->timestamp = timestamp;
+    rec->flags = 0;
+    rec->odometry[0] = rec->odometry[1] = rec->odometry[2] = 0.0;
+    if (odometry)
+    {
+        rec->odometry[0] = (*odometry)[0];
+        rec->odometry[1] = (*odometry)[1];
+        rec->odometry[2] = (*odometry)[2];
+        rec->flags |= SCANLOG_HAS_ODOMETRY;
+    }
+
+    //Set the invalid points to 0 (as the harnesses do)
+    float *dst = (header.range_format == SCANLOG_FLOAT32) ? (float*)(record + sizeof(TScanLogRecord)) : &filtered[0];
+    for (unsigned int u = 0; u < header.beams; u++)
+        dst[u] = ((range[u] > 0.995f*header.max_range)||(range[u] < header.min_range)) ? 0.f : range[u];
+
+    if (header.range_format == SCANLOG_UINT16)
+        quantizeRanges(dst, (uint16_t*)(record + sizeof(TScanLogRecord)), header.beams, header.range_step);
+
+    if (fwrite(record, header.record_stride, 1, file) != 1)
+        return false;
+
+    header.num_scans++;
+    return true;
+}
+
+
+
+CScanLogReader::CScanLogReader() : data(NULL), data_size(0), header(NULL)
+{
+#ifdef _WIN32
+    file_handle = INVALID_HANDLE_VALUE;
+    mapping_handle = NULL;
+#else
+    fd = -1;
+#endif
+}
+
+bool CScanLogReader::open(const string &filename)
+{
+    close();
+
+#ifdef _WIN32
+    file_handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file_handle, &file_size);
+    data_size = size_t(file_size.QuadPart);
+    if (data_size >= sizeof(TScanLogHeader))
+    {
+        mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_handle)
+            data = (const char*)MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat file_stat;
+    fstat(fd, &file_stat);
+    data_size = size_t(file_stat.st_size);
+    if (data_size >= sizeof(TScanLogHeader))
+    {
+        void *mapped = mmap(NULL, data_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED)
+            data = (const char*)mapped;
+    }
+#endif
+
+    if (!data)
+    {
+        printf("\n CScanLogReader: %s could not be mapped \n", filename.c_str());
+        close();
+        return false;
+    }
+
+    //Check that it is a complete scan log that we can read
+    header = (const TScanLogHeader*)data;
+    if ((memcmp(header->magic, scanlog_magic, sizeof(scanlog_magic)) != 0) || (header->version != SCANLOG_VERSION)
+        || (rangeBytes(*header) == 0) || ((header->range_format == SCANLOG_UINT16) && !(header->range_step > 0.f))
+        || (header->record_stride < sizeof(TScanLogRecord) + rangeBytes(*header)*header->beams)
+        || (data_size < sizeof(TScanLogHeader) + header->num_scans*header->record_stride))
+    {
+        printf("\n CScanLogReader: %s is not a valid scan log (version %u) \n", filename.c_str(), SCANLOG_VERSION);
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void CScanLogReader::close()
+{
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+    mapping_handle = NULL;
+    file_handle = INVALID_HANDLE_VALUE;
+#else
+    if (data) munmap((void*)data, data_size);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+
+    data = NULL;
+    data_size = 0;
+    header = NULL;
+}
+
+ScanView CScanLogReader::scan(size_t k, const ScanBearings &bearings, float *widened) const
+{
+    const TScanLogRecord *rec = recordAt(k);
+
+    ScanView view;
+    view.size = header->beams;
+    view.timestamp = rec->timestamp;
+    view.bearings = &bearings;
+
+    if (header->range_format == SCANLOG_FLOAT32)
+        view.range = (const float*)(rec + 1);
+    else
+    {
+        view.range_q = (const uint16_t*)(rec + 1);
+        view.range_step = header->range_step;
+        if (widened)
+        {
+            widenRanges(view.range_q, widened, view.size, view.range_step);
+            view.range = widened;
+        }
+    }
+    return view;
+}
+
+CPose2D CScanLogReader::odometry(size_t k) const
+{
+    const TScanLogRecord *rec = recordAt(k);
+    return CPose2D(rec->odometry[0], rec->odometry[1], rec->odometry[2]);
+}
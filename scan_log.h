@@ -0,0 +1,126 @@
+//====================================================
+//  Project: Laser odometry
+//  Flat binary scan logs: fixed-stride records that
+//  are memory-mapped and read as scan views
+//====================================================
+
+#ifndef _SCAN_LOG_
+#define _SCAN_LOG_
+
+#include "scan_matcher.h"
+#include <mrpt/poses/CPose2D.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+
+//File layout (native little-endian):
+//  - TScanLogHeader (64 bytes)
+//  - num_scans records of record_stride bytes: TScanLogRecord (40 bytes) followed by the ranges of the scan,
+//    padded to a multiple of 8 bytes
+//The ranges are stored already filtered (0 -> no return or out of [min_range, 0.995*max_range]), so the views
+//need no validity flags. They are floats or 16-bit multiples of range_step (see quantizeRanges()).
+
+enum TScanLogRangeFormat { SCANLOG_FLOAT32 = 0, SCANLOG_UINT16 = 1 };
+
+struct TScanLogHeader {
+
+    char        magic[8];           //"SRFSCANS"
+    uint32_t    version;
+    uint32_t    range_format;       //TScanLogRangeFormat
+    uint32_t    beams;
+    uint32_t    record_stride;      //[bytes]
+    uint64_t    num_scans;
+    float       aperture;           //[rad]
+    float       max_range;          //[m]
+    float       min_range;          //[m] laser_min_range of the conversion
+    float       range_step;         //[m] Step of the quantized ranges (SCANLOG_UINT16)
+    char        sensor_label[16];
+};
+
+struct TScanLogRecord {
+
+    double      timestamp;          //[s]
+    double      odometry[3];        //x [m], y [m], phi [rad] (valid if flags & SCANLOG_HAS_ODOMETRY)
+    uint32_t    flags;
+    uint32_t    reserved;
+};
+
+const uint32_t SCANLOG_VERSION = 1;
+const uint32_t SCANLOG_HAS_ODOMETRY = 1;
+
+
+//Writes a scan log sequentially (the converter). The number of scans is written in the header by close().
+
+class CScanLogWriter {
+public:
+
+    CScanLogWriter() : file(NULL), record(NULL) { header.num_scans = 0; }
+    ~CScanLogWriter() { close(); }
+
+    //range_step > 0 -> the ranges are quantized to 16 bits with that step [m]
+    bool open(const std::string &filename, unsigned int beams, float aperture, float max_range, float min_range, const std::string &sensor_label = "",
+              float range_step = 0.f);
+    void close();
+
+    //Ranges in [m] (beams of them), filtered with the geometry of the header. odometry == NULL -> none.
+    bool write(double timestamp, const float *range, const mrpt::poses::CPose2D *odometry = NULL);
+
+    bool isOpen() const { return file != NULL; }
+    const TScanLogHeader &info() const { return header; }
+    uint64_t size() const { return header.num_scans; }
+
+private:
+
+    FILE            *file;
+    TScanLogHeader  header;
+    char            *record;        //Buffer of one record
+    std::vector<float> filtered;    //Ranges of the record before quantizing them
+
+    CScanLogWriter(const CScanLogWriter &);
+    CScanLogWriter &operator=(const CScanLogWriter &);
+};
+
+
+//Maps a whole scan log in memory (read-only). The scans are accessed by index and handed to the matchers as views
+//of the mapped ranges, without copying them. The reader is not modified after open(), so several threads can
+//replay different scans (or the same log) at the same time. The views of quantized logs point to the mapped
+//16-bit ranges (range_q), and their float ranges are only available if a buffer is given to widen them.
+
+class CScanLogReader {
+public:
+
+    CScanLogReader();
+    ~CScanLogReader() { close(); }
+
+    bool open(const std::string &filename);
+    void close();
+
+    const TScanLogHeader &info() const { return *header; }
+    size_t size() const { return header ? size_t(header->num_scans) : 0; }
+
+    ScanView scan(size_t k, const ScanBearings &bearings, float *widened = NULL) const;
+    double timestamp(size_t k) const { return recordAt(k)->timestamp; }
+    bool hasOdometry(size_t k) const { return (recordAt(k)->flags & SCANLOG_HAS_ODOMETRY) != 0; }
+    mrpt::poses::CPose2D odometry(size_t k) const;
+
+private:
+
+    const char              *data;
+    size_t                  data_size;
+    const TScanLogHeader    *header;
+
+#ifdef _WIN32
+    void                    *file_handle, *mapping_handle;
+#else
+    int                     fd;
+#endif
+
+    const TScanLogRecord *recordAt(size_t k) const { return (const TScanLogRecord*)(data + sizeof(TScanLogHeader) + k*header->record_stride); }
+
+    CScanLogReader(const CScanLogReader &);
+    CScanLogReader &operator=(const CScanLogReader &);
+};
+
+#endif
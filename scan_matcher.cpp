@@ -0,0 +1,234 @@
+/* Project: Laser odometry
+   Common interface of the scan matchers: scan views, RF2O and PSM backends */
+
+#include "scan_matcher.h"
+#include "laser_odometry_v1.h"
+#include <mrpt/system/datetime.h>
+#include <mrpt/utils/CTicTac.h>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+
+using namespace mrpt::poses;
+using namespace std;
+
+
+void ScanBearings::initialize(unsigned int size, float fov)
+{
+    fovh = fov;
+    tita.resize(size);
+    cos_tita.resize(size);
+    sin_tita.resize(size);
+    for (unsigned int u = 0; u<size; u++)
+    {
+        tita[u] = -0.5f*fovh + float(u)*fovh/float(size-1);
+        cos_tita[u] = cos(tita[u]);
+        sin_tita[u] = sin(tita[u]);
+    }
+}
+
+ScanView::ScanView(const mrpt::obs::CObservation2DRangeScan &scan, const ScanBearings &scan_bearings)
+{
+    range = &scan.scan[0];
+    valid = scan.validRange.empty() ? NULL : &scan.validRange[0];
+    size = scan.scan.size();
+    timestamp = mrpt::system::timestampToDouble(scan.timestamp);
+    bearings = &scan_bearings;
+    range_q = NULL;
+    range_step = 0.f;
+}
+
+
+bool loadEngineScan(RF2O &odo, const ScanView &scan)
+{
+    if (scan.size != odo.width)
+    {
+        printf("\n loadEngineScan: the scan has %u ranges but the engine takes %u \n", scan.size, odo.width);
+        return false;
+    }
+
+    odo.range_wf = Eigen::Map<const Eigen::ArrayXf>(scan.range, odo.width);
+    return true;
+}
+
+
+PSM_Matcher::PSM_Matcher() : max_trans(80.f), max_rot(70.f*PM_D2R), match_failed(false), next_preloaded(0)
+{
+    scans = new PMScan[2];
+    ls = &scans[0];
+    ls_ref = &scans[1];
+    ws = new PMWorkspace;
+}
+
+PSM_Matcher::~PSM_Matcher()
+{
+    delete [] scans;
+    delete ws;
+}
+
+void PSM_Matcher::initialize(int laser)
+{
+    pm_init(&ctx, laser);       //Contains precomputed range bearings and their sines/cosines
+    match_failed = false;
+}
+
+void PSM_Matcher::initialize(unsigned int size, float fov, float max_range)
+{
+    //Thresholds proportional to the number of points, as those of the laser models of pm_init()
+    const int min_valid_points = max(int(size)/5, 2);
+    const int search_window = min(max(int(size)/9, 1), int(size) - 1);
+    pm_init(&ctx, "generic", size, fov*PM_R2D, 100.f*max_range, min_valid_points, search_window);
+    match_failed = false;
+}
+
+bool PSM_Matcher::readScan(const ScanView &scan, PMScan *dst)
+{
+    if (scan.size != (unsigned int)(ctx.l_points))
+    {
+        printf("\n PSM_Matcher: the scan has %u points but the laser model %s has %d \n", scan.size, ctx.laser_name, ctx.l_points);
+        return false;
+    }
+
+    //A scan of the last preloaded block is already read and preprocessed
+    const void *record = scan.range_q ? (const void*)scan.range_q : (const void*)scan.range;
+    for (size_t k = next_preloaded; k < preloaded_record.size(); k++)
+        if (preloaded_record[k] == record)
+        {
+            copyScan(preloaded[k], dst);
+            next_preloaded = k + 1;
+            return true;
+        }
+
+    pm_readScan(&ctx, floatRanges(scan), dst);
+    pm_preprocessScan(&ctx, dst);
+    return true;
+}
+
+void PSM_Matcher::copyScan(const PMScan &src, PMScan *dst) const
+{
+    //Only the first l_points readings are used (a PMScan has room for PM_MAX_POINTS)
+    const int n = ctx.l_points;
+    dst->t = src.t;
+    dst->rx = src.rx; dst->ry = src.ry; dst->th = src.th;
+    copy(src.r, src.r + n, dst->r);
+    copy(src.x, src.x + n, dst->x);
+    copy(src.y, src.y + n, dst->y);
+    copy(src.bad, src.bad + n, dst->bad);
+    copy(src.seg, src.seg + n, dst->seg);
+}
+
+const float *PSM_Matcher::floatRanges(const ScanView &scan)
+{
+    if (scan.range)
+        return scan.range;
+
+    widened.resize(scan.size);
+    widenRanges(scan.range_q, &widened[0], scan.size, scan.range_step);
+    return &widened[0];
+}
+
+void PSM_Matcher::preloadScans(const vector<ScanView> &views)
+{
+    preloaded.resize(views.size());
+    preloaded_record.assign(views.size(), (const void*)NULL);
+    next_preloaded = 0;
+
+    //The scans are read here and preprocessed all at once (the scans of another laser are never taken)
+    for (size_t k = 0; k < views.size(); k++)
+        if (views[k].size == (unsigned int)(ctx.l_points))
+        {
+            pm_readScan(&ctx, floatRanges(views[k]), &preloaded[k]);
+            preloaded_record[k] = views[k].range_q ? (const void*)views[k].range_q : (const void*)views[k].range;
+        }
+
+    if (!preloaded.empty())
+        pm_preprocessScans(&ctx, &preloaded[0], int(preloaded.size()));
+}
+
+void PSM_Matcher::setFirstScan(const ScanView &scan)
+{
+    readScan(scan, ls);
+    match_failed = false;
+}
+
+bool PSM_Matcher::match(const ScanView &scan)
+{
+    //Read the new scan over the oldest one: if it cannot be read, the last scan remains the reference
+    if (!readScan(scan, ls_ref))
+    {
+        match_failed = true;
+        return false;
+    }
+    swap(ls, ls_ref);
+
+    //Initial seed (PSM frame: x -> ry, y -> rx)
+    if (match_failed)
+    {
+        ls->rx = 0.f; ls_ref->rx = 0.f;
+        ls->ry = 0.f; ls_ref->ry = 0.f;
+        ls->th = 0.f; ls_ref->th = 0.f;
+    }
+    else
+    {
+        ls->rx = 100.f*pose[1]; ls_ref->rx = 100.f*old_pose[1];
+        ls->ry = 100.f*pose[0]; ls_ref->ry = 100.f*old_pose[0];
+        ls->th = pose[2]; ls_ref->th = old_pose[2];
+    }
+
+    match_failed = false;
+    try
+    {
+        pm_psm(&ctx, ls_ref, ls, ws, &cov);
+    }
+    catch(int)
+    {
+        printf("\n PSM_Matcher: failed match");
+        match_failed = true;
+    }
+
+    //Discard implausible motions
+    if (fabs(ls->ry) > max_trans) ls->ry = 0.f;
+    if (fabs(ls->rx) > max_trans) ls->rx = 0.f;
+    if (fabs(ls->th) > max_rot) ls->th = 0.f;
+
+    old_pose = pose;
+    pose = old_pose + CPose2D(0.01f*ls->ry, 0.01f*ls->rx, ls->th);
+    return !match_failed;
+}
+
+void PSM_Matcher::resetPose(const CPose2D &reset_pose)
+{
+    ScanMatcher::resetPose(reset_pose);
+    match_failed = false;
+}
+
+
+void MatcherRunner::add(ScanMatcher &matcher)
+{
+    matchers.push_back(&matcher);
+    runtime.push_back(0.f);
+    matched.push_back(1);
+}
+
+void MatcherRunner::setFirstScan(const ScanView &scan)
+{
+    for (unsigned int k = 0; k<matchers.size(); k++)
+        matchers[k]->setFirstScan(scan);
+}
+
+void MatcherRunner::match(const ScanView &scan)
+{
+    const int num_matchers = matchers.size();
+
+    //The matchers only share the (read-only) scan, and static scheduling with chunks of 1 keeps every matcher on its thread
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static, 1) num_threads(max(num_matchers, 1)) if(concurrent && (num_matchers > 1))
+#endif
+    for (int k = 0; k < num_matchers; k++)
+    {
+        mrpt::utils::CTicTac clock; clock.Tic();
+        matched[k] = matchers[k]->match(scan);
+        runtime[k] = 1000.f*clock.Tac();
+    }
+}
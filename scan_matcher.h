@@ -0,0 +1,222 @@
+//====================================================
+//  Project: Laser odometry
+//  Common interface of the scan matchers compared in
+//  the harnesses: scan views, RF2O and PSM backends
+//====================================================
+
+#ifndef _SCAN_MATCHER_
+#define _SCAN_MATCHER_
+
+#include <mrpt/poses/CPose2D.h>
+#include <mrpt/obs/CObservation2DRangeScan.h>
+#include <Eigen/Dense>
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+#include "polar_match.h"
+#include "laser_odometry_pyramid.h"
+#include "laser_odometry_mrpt.h"
+
+
+//Bearings of the points of a scan (tita = -fov/2 + u*fov/(size-1)) and their sines/cosines,
+//computed once and shared by all the views of the scans of a laser
+
+class ScanBearings {
+public:
+
+    float fovh;
+    std::vector<float> tita, cos_tita, sin_tita;
+
+    ScanBearings() : fovh(0.f) {}
+    void initialize(unsigned int size, float fov);
+};
+
+
+//Read-only view of a range scan: it points to the ranges of the observation instead of copying them,
+//so it is only valid while the observation is not modified
+
+struct ScanView {
+
+    const float *range;             //[m] 0 -> no return
+    const char *valid;              //Validity of every range (NULL -> the ranges > 0 are valid)
+    unsigned int size;
+    double timestamp;               //[s]
+    const ScanBearings *bearings;
+    const uint16_t *range_q;        //The same ranges quantized, if the source stores them so (NULL -> not available)
+    float range_step;               //[m] Step of range_q
+
+    ScanView() : range(NULL), valid(NULL), size(0), timestamp(0.0), bearings(NULL), range_q(NULL), range_step(0.f) {}
+    ScanView(const mrpt::obs::CObservation2DRangeScan &scan, const ScanBearings &scan_bearings);
+
+    bool isValid(unsigned int u) const { return valid ? (valid[u] != 0) : (range[u] > 0.f); }
+};
+
+
+//Scan-to-scan odometry method. Every matcher keeps the previous scan in its own representation and in
+//persistent buffers, so the harnesses hand the same view of every new scan to all of them.
+
+class ScanMatcher {
+public:
+
+    mrpt::poses::CPose2D pose, old_pose;    //Pose of the laser after the last two matches
+
+    virtual ~ScanMatcher() {}
+
+    virtual const char *name() const = 0;
+    virtual void setFirstScan(const ScanView &scan) = 0;                    //Reference of the first match
+    virtual bool match(const ScanView &scan) = 0;                           //Matches against the previous scan (false if it failed)
+    virtual void resetPose(const mrpt::poses::CPose2D &reset_pose) { pose = reset_pose; old_pose = reset_pose; }
+};
+
+
+//Fills the input scan of an RF2O engine (range_wf) with one block copy. If the engine takes quantized input
+//(odo.range_step > 0) the quantized ranges of the view are copied as they are when their step matches, and
+//the float ranges are quantized otherwise. Scans whose size is not the one of the engine are rejected (false).
+
+template <class Engine>
+bool loadEngineScan(Engine &odo, const ScanView &scan)
+{
+    if (scan.size != odo.width)
+    {
+        printf("\n loadEngineScan: the scan has %u ranges but the engine takes %u \n", scan.size, odo.width);
+        return false;
+    }
+
+    if (odo.range_step <= 0.f)
+        odo.range_wf = Eigen::Map<const Eigen::ArrayXf>(scan.range, odo.width);
+    else if (scan.range_q && (scan.range_step == odo.range_step))
+        odo.range_wf_q = Eigen::Map<const ArrayXq>(scan.range_q, odo.width);
+    else
+        quantizeRanges(scan.range, odo.range_wf_q.data(), odo.width, odo.range_step);
+    return true;
+}
+
+class RF2O;
+bool loadEngineScan(RF2O &odo, const ScanView &scan);       //First version of the engine (float input only)
+
+
+//Any of the RF2O engines
+
+template <class Engine>
+class RF2O_Matcher : public ScanMatcher {
+public:
+
+    Engine odo;
+
+    RF2O_Matcher(const char *matcher_name) : label(matcher_name) {}
+
+    void initialize(unsigned int size, float fov, unsigned int odo_ID) { odo.initialize(size, fov, odo_ID); }
+
+    const char *name() const { return label; }
+
+    void setFirstScan(const ScanView &scan)
+    {
+        if (loadEngineScan(odo, scan))
+            odo.createScanPyramid();
+    }
+
+    bool match(const ScanView &scan)
+    {
+        if (!loadEngineScan(odo, scan))
+            return false;
+
+        odo.odometryCalculation();
+        pose = toMRPT(odo.laser_pose);
+        old_pose = toMRPT(odo.laser_oldpose);
+        return true;
+    }
+
+    void resetPose(const mrpt::poses::CPose2D &reset_pose)
+    {
+        ScanMatcher::resetPose(reset_pose);
+        odo.laser_pose = fromMRPT(reset_pose);
+        odo.laser_oldpose = fromMRPT(reset_pose);
+        odo.kai_abs.assign(0.f);
+        odo.kai_loc.assign(0.f);
+        odo.kai_loc_old.assign(0.f);
+    }
+
+private:
+
+    const char *label;
+};
+
+
+//Polar scan matching. The scans are read from the views into two PMScan buffers that swap roles after every
+//match, and the motion of the last match seeds the next one (as the harnesses did).
+//The scans of a log in memory can be read and preprocessed ahead of matching, a block at a time over all the
+//threads (preloadScans()): the views must point to the records of the log (e.g. a mapped scan log, not a buffer
+//reused for every scan), and the matcher then takes the preprocessed scan of every view of a preloaded record.
+
+class PSM_Matcher : public ScanMatcher {
+public:
+
+    PMContext ctx;
+    PMCovariance cov;               //Covariance of the last match
+    float max_trans, max_rot;       //Larger motions of a match are discarded ([cm], [rad]; 80 cm and 70 deg by default)
+
+    PSM_Matcher();
+    ~PSM_Matcher();
+
+    void initialize(int laser = PM_LASER);
+    void initialize(unsigned int size, float fov, float max_range);        //Any laser ([rad], [m])
+
+    const char *name() const { return "psm"; }
+    void setFirstScan(const ScanView &scan);
+    bool match(const ScanView &scan);
+    void resetPose(const mrpt::poses::CPose2D &reset_pose);
+    void preloadScans(const std::vector<ScanView> &views);      //Replaces the previous block (views in matching order)
+
+private:
+
+    PMScan *scans;                  //Storage of ls and ls_ref
+    PMScan *ls, *ls_ref;
+    PMWorkspace *ws;
+    bool match_failed;
+
+    std::vector<PMScan> preloaded;              //Block of scans of the last preloadScans(), already preprocessed
+    std::vector<const void*> preloaded_record;  //Ranges (float or quantized) of the view of every preloaded scan
+    size_t next_preloaded;                      //The views come in order: the search starts after the last one taken
+    std::vector<float> widened;                 //Float ranges of a quantized view
+
+    bool readScan(const ScanView &scan, PMScan *dst);
+    const float *floatRanges(const ScanView &scan);
+    void copyScan(const PMScan &src, PMScan *dst) const;
+
+    //The scans and the workspace are owned by the matcher
+    PSM_Matcher(const PSM_Matcher &);
+    PSM_Matcher &operator=(const PSM_Matcher &);
+};
+
+
+//Runs several matchers on every scan. With OpenMP every matcher gets its own thread, always the same one
+//(pin them with OMP_PROC_BIND=spread so that each match runs alone on a core and its runtime is not
+//perturbed by the others), and match() only returns when all of them have finished. The harnesses read
+//the new poses after that.
+
+class MatcherRunner {
+public:
+
+    bool concurrent;                //false -> the matchers run one after another
+
+    MatcherRunner() : concurrent(true) {}
+
+    void clear() { matchers.clear(); runtime.clear(); matched.clear(); }
+    void add(ScanMatcher &matcher);
+
+    unsigned int size() const { return matchers.size(); }
+    ScanMatcher &operator[](unsigned int k) const { return *matchers[k]; }
+    float lastRuntime(unsigned int k) const { return runtime[k]; }            //[ms]
+    bool lastMatched(unsigned int k) const { return matched[k] != 0; }
+
+    void setFirstScan(const ScanView &scan);
+    void match(const ScanView &scan);
+
+private:
+
+    std::vector<ScanMatcher*> matchers;
+    std::vector<float> runtime;
+    std::vector<char> matched;
+};
+
+#endif
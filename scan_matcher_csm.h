@@ -0,0 +1,220 @@
+//====================================================
+//  Project: Laser odometry
+//  PL-ICP backend of the scan matcher interface
+//  (Canonical Scan Matcher, needs the CSM library)
+//====================================================
+
+#ifndef _SCAN_MATCHER_CSM_
+#define _SCAN_MATCHER_CSM_
+
+#include "scan_matcher.h"
+#include "csm/csm_all.h"
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <exception>
+
+using namespace CSM;
+
+
+//Two laser data structures are allocated once with their bearings, and only their ranges are refreshed:
+//the one holding the new scan becomes the reference after every match. A failed match keeps the pose
+//(its scan still becomes the reference). CSM keeps global state (egsl), so a MatcherRunner must not hold
+//more than one CSM_Matcher.
+
+class CSM_Matcher : public ScanMatcher {
+public:
+
+    sm_params params;               //Structure containing the input parameters
+    sm_result result;               //Output of the scan matching
+
+    CSM_Matcher() : laser_ref(NULL), laser_sens(NULL) {}
+    ~CSM_Matcher() { freeScans(); }
+
+    const char *name() const { return "csm"; }
+
+    void initialize(unsigned int size, float aperture, float std_error)
+    {
+        initParams();
+        freeScans();
+        laser_ref = allocScan(size, aperture, std_error);
+        laser_sens = allocScan(size, aperture, std_error);
+    }
+
+    void setFirstScan(const ScanView &scan)
+    {
+        loadScan(scan, laser_ref);
+        if (!ld_valid_fields(laser_ref))
+            sm_error("[Init] Invalid laser data in first scan.\n");
+
+        // For the first scan, set estimate = odometry
+        copy_d(laser_ref->odometry, 3, laser_ref->estimate);
+    }
+
+    bool match(const ScanView &scan)
+    {
+        loadScan(scan, laser_sens);
+
+        try
+        {
+            //set the scan data into the input structure
+            params.laser_ref  = laser_ref;
+            params.laser_sens = laser_sens;
+
+            // Set first guess as the difference in odometry
+            double odometry[3];
+            pose_diff_d(laser_sens->odometry, laser_ref->odometry, odometry);
+            double ominus_laser[3], temp[3];
+            ominus_d(params.laser, ominus_laser);
+            oplus_d(ominus_laser, odometry, temp);
+            oplus_d(temp, params.laser, params.first_guess);
+
+            // Do the actual work
+            sm_icp(&params, &result);
+        }
+        catch(std::exception &e)
+        {
+            printf("\n CSM_Matcher: exception while matching: %s", e.what());
+            result.valid = 0;
+        }
+        catch(...)
+        {
+            printf("\n CSM_Matcher: unknown exception while matching");
+            result.valid = 0;
+        }
+
+        if (!result.valid)
+            copy_d(laser_ref->estimate, 3, laser_sens->estimate);
+        else
+        {
+            /* Add the result to the previous estimate */
+            oplus_d(laser_ref->estimate, result.x, laser_sens->estimate);
+
+            old_pose = pose;
+            pose = old_pose + mrpt::poses::CPose2D(result.x[0], result.x[1], result.x[2]);
+        }
+
+        //The sensed scan becomes the reference
+        std::swap(laser_ref, laser_sens);
+        return result.valid != 0;
+    }
+
+private:
+
+    LDP laser_ref, laser_sens;      //the laser scans to be matched (in the PL-ICP data structure)
+
+    LDP allocScan(unsigned int size, float aperture, float std_error)
+    {
+        const int n = size;
+        LDP ld = ld_alloc_new(n);       //create new structure initialized with "n" rays
+
+        ld->min_theta = -aperture/2;			//rad
+        ld->max_theta = aperture/2;			//rad
+        const float angle_ray = aperture/(n-1);    //rad
+        const double index_cero_angle = floor( (n-1)/2);
+
+        for (int i=0; i<n; i++)
+        {
+            ld->theta[i] = (i-index_cero_angle)*angle_ray;             //rad
+            ld->readings_sigma[i] = std_error;
+        }
+
+        //To avoid failure due to precission, copy min and max theta (see ld_valid_fields)
+        ld->theta[0] = ld->min_theta;
+        ld->theta[n-1] = ld->max_theta;
+        return ld;
+    }
+
+    void loadScan(const ScanView &scan, LDP ld)
+    {
+        for (int i=0; i<ld->nrays; i++)
+        {
+            if (!scan.isValid(i))
+            {
+                ld->readings[i] = NAN;
+                ld->valid[i] = 0;
+            }
+            else
+            {
+                ld->readings[i] = static_cast<double>(scan.range[i]);   //m
+                ld->valid[i] = 1;
+            }
+
+            //Clear what the previous match computed on this structure
+            ld->cluster[i] = -1;
+            ld->alpha[i] = NAN;
+            ld->alpha_valid[i] = 0;
+            ld->true_alpha[i] = NAN;
+            ld->corr[i].valid = 0;
+        }
+
+        //Set initial guess (odometry) to 0 (mandatory for proper funtionality)
+        ld->odometry[0] = 0.0;
+        ld->odometry[1] = 0.0;
+        ld->odometry[2] = 0.0;
+
+        double fractpart, intpart;
+        fractpart = modf(scan.timestamp, &intpart);
+        ld->tv.tv_sec = intpart;
+        ld->tv.tv_usec = fractpart;
+    }
+
+    void freeScans()
+    {
+        if (laser_ref) ld_free(laser_ref);
+        if (laser_sens) ld_free(laser_sens);
+        laser_ref = NULL;
+        laser_sens = NULL;
+    }
+
+    void initParams()
+    {
+        params.max_angular_correction_deg = 60;             //"Maximum angular displacement between scans"
+        params.max_linear_correction = 1.0;                 //"Maximum translation between scans (m)"
+        params.max_iterations = 100;                       //"When we had enough"
+
+        params.epsilon_xy = 0.0001;                         //"A threshold for stopping (m)"
+        params.epsilon_theta = 0.0001;                      //"A threshold for stopping (rad)"
+
+        params.max_correspondence_dist = 2.0;
+        params.sigma = 0.01;                                //Noise in the scan
+
+        params.use_corr_tricks = 1;                         //"Use smart tricks for finding correspondences."
+        params.restart = 0;                                 //"Restart: Restart if error is over threshold"
+        params.restart_threshold_mean_error = 0.01;
+        params.restart_dt= 0.01;
+        params.restart_dtheta = 1.5 * 3.14 /180;
+
+        params.clustering_threshold = 0.05;                 //"Max distance for staying in the same clustering"
+        params.orientation_neighbourhood = 3;               //"Number of neighbour rays used to estimate the orientation."
+
+        params.use_point_to_line_distance = 1;              //"If 0, it's vanilla ICP."
+        params.do_alpha_test = 0;                           //"Discard correspondences based on the angles"
+        params.do_alpha_test_thresholdDeg = 20.0;           //
+
+        params.outliers_maxPerc = 0.95;
+        params.outliers_adaptive_order =0.7;
+        params.outliers_adaptive_mult=2.0;
+        params.do_visibility_test = 0;
+
+        params.outliers_remove_doubles = 1;                 //"no two points in laser_sens can have the same corr."
+        params.do_compute_covariance = 0;                   //"If 1, computes the covariance of ICP using the method http://purl.org/censi/2006/icpcov ."
+        params.debug_verify_tricks = 0;                     //"Checks that find_correspondences_tricks gives the right answer.
+
+        params.laser[0] = 0.0;                              //Pose of sensor with respect to robot: used for computing the first estimate given the odometry.
+        params.laser[1] = 0.0;
+        params.laser[2] = 0.0;
+
+        params.min_reading = 0.0;                           //Don't use readings less than min_reading (m)
+        params.max_reading = 1000.0;                        //Don't use readings longer than max_reading (m)
+
+        params.use_ml_weights = 0;                          //"If 1, the field 'true_alpha' (or 'alpha') in the first scan is used to compute the incidence beta, and the factor (1/cos^2(beta)) used to weight the correspondence.");
+        params.use_sigma_weights = 0;                       //"If 1, the field 'readings_sigma' in the second scan is used to weight the correspondence by 1/sigma^2"
+    }
+
+    //The laser data structures are owned by the matcher
+    CSM_Matcher(const CSM_Matcher &);
+    CSM_Matcher &operator=(const CSM_Matcher &);
+};
+
+#endif
@@ -0,0 +1,106 @@
+//====================================================
+//  Project: Laser odometry
+//  NDT backend of the scan matcher interface
+//  (2D normal distributions transform of PCL)
+//====================================================
+
+#ifndef _SCAN_MATCHER_NDT_
+#define _SCAN_MATCHER_NDT_
+
+#include "scan_matcher.h"
+#include <pcl/registration/ndt_2d.h>
+#include <mrpt/poses/CPose3D.h>
+#include <mrpt/math/CMatrixFixedNumeric.h>
+#include <mrpt/math/CMatrixTemplateNumeric.h>
+#include <iostream>
+#include <algorithm>
+
+
+//The clouds are kept between matches: the cloud of the new scan is built from the shared bearings of the
+//view and becomes the target of the next match, so every scan is converted only once.
+
+class NDT_Matcher : public ScanMatcher {
+public:
+
+    pcl::NormalDistributionsTransform2D<pcl::PointXYZ, pcl::PointXYZ> ndt;
+
+    NDT_Matcher() : input_cloud(new pcl::PointCloud<pcl::PointXYZ>), target_cloud(new pcl::PointCloud<pcl::PointXYZ>) {}
+
+    const char *name() const { return "ndt"; }
+
+    void setFirstScan(const ScanView &scan) { loadScan(scan, *input_cloud); }
+
+    bool match(const ScanView &scan)
+    {
+        //The last scan becomes the target
+        std::swap(input_cloud, target_cloud);
+        loadScan(scan, *input_cloud);
+
+        ndt.setInputSource (input_cloud);
+        ndt.setInputTarget (target_cloud);
+
+        float stepsize = 0.01;
+        const float score_threshold = 0.08f;
+        mrpt::math::CMatrixDouble44 mat_incr = Eigen::MatrixXd::Identity(4,4);
+        bool converged = false;
+
+        for (unsigned int i=0; i<5; i++)
+        {
+            // Setting minimum transformation difference for termination condition.
+            ndt.setTransformationEpsilon (1e-5); //1e-6
+
+            // Setting step size
+            ndt.setOptimizationStepSize(stepsize);
+
+            //Setting Resolution of NDT grid structure (VoxelGridCovariance).
+            Eigen::Vector2f vector; vector.fill(1.f); //0.5
+            ndt.setGridStep(vector);
+
+            //Setting the grid extent
+            vector.fill(7.f);
+            ndt.setGridExtent(vector);
+
+            // Setting max number of registration iterations.
+            ndt.setMaximumIterations(2000);
+
+            // Calculating required rigid transform to align the input cloud to the target cloud.
+            ndt.align(output_cloud);
+
+            if (ndt.getFitnessScore() < score_threshold)
+            {
+                std::cout << std::endl << "NDT has converged:" << ndt.hasConverged();
+                std::cout << std::endl << "Score: " << ndt.getFitnessScore();
+                mat_incr = mrpt::math::CMatrixDouble(ndt.getFinalTransformation());
+                converged = true;
+                break;
+            }
+
+            stepsize *= 0.5f;
+        }
+
+        //Save old pose and update new pose
+        old_pose = pose;
+        mrpt::poses::CPose3D pose_incr3D(mat_incr);
+        mrpt::poses::CPose2D pose_incr(pose_incr3D);
+        pose = old_pose + pose_incr;
+        return converged;
+    }
+
+private:
+
+    pcl::PointCloud<pcl::PointXYZ>::Ptr input_cloud, target_cloud;
+    pcl::PointCloud<pcl::PointXYZ> output_cloud;
+
+    void loadScan(const ScanView &scan, pcl::PointCloud<pcl::PointXYZ> &cloud)
+    {
+        const std::vector<float> &co = scan.bearings->cos_tita, &si = scan.bearings->sin_tita;
+
+        cloud.clear();
+        cloud.reserve(scan.size);
+        for (unsigned int u = 0; u < scan.size; u++)
+            if (scan.range[u] > 0.f)
+                cloud.push_back(pcl::PointXYZ(scan.range[u]*co[u], scan.range[u]*si[u], 0));
+    }
+};
+
+#endif
@@ -0,0 +1,205 @@
+/* Project: Laser odometry
+   C interface of the RF2O odometry: preallocated handles */
+
+#include "srf_odometry.h"
+#include "laser_odometry_standard.h"
+#include <new>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+
+struct srf_odometry {
+    RF2O_standard   odo;
+    srf_config      config;
+    unsigned int    scans;
+    unsigned int    max_nonlin_iters;   //Size of the buffers of the iterations
+    double          timestamp, dt;
+    float           max_runtime;
+};
+
+
+//The OpenMP runtime allocates its teams in the first parallel regions: create the ones of the projector now
+static void startThreads(const RF2O_ScanProjector &projector, unsigned int beams)
+{
+#ifdef _OPENMP
+    int threads = 1;
+    if (beams >= projector.parallel_min_cols)
+        threads = std::min(int(projector.max_chunks), omp_get_max_threads());
+
+    //The coarse levels are rasterized by a single chunk (if clause false) and the fine ones by "threads".
+    //The barrier keeps the compiler from removing the empty regions.
+    #pragma omp parallel num_threads(1) if(false)
+    {
+        #pragma omp barrier
+    }
+    #pragma omp parallel num_threads(threads) if(threads > 1)
+    {
+        #pragma omp barrier
+    }
+#endif
+}
+
+
+void srf_default_config(srf_config *config)
+{
+    if (!config)
+        return;
+
+    config->beams = 0;
+    config->aperture = 0.f;
+    config->min_range = 0.f;
+    config->max_range = 0.f;
+    config->solver = 3;
+    config->inverse_warping = 0;
+}
+
+srf_odometry *srf_create(const srf_config *config)
+{
+    //The coarsest level of the pyramid needs ~20 beams
+    if (!config || (config->beams < 20) || !(config->aperture > 0.f) || (config->aperture > 2.f*float(M_PI))
+        || !(config->min_range >= 0.f) || !(config->max_range > config->min_range) || (config->solver > 3))
+    {
+        printf("\n srf_create: invalid configuration \n");
+        return NULL;
+    }
+
+    srf_odometry *handle = new (std::nothrow) srf_odometry;
+    if (!handle)
+        return NULL;
+
+    try
+    {
+        handle->odo.initialize(config->beams, config->aperture, config->solver);
+        startThreads(handle->odo.projector, config->beams);
+    }
+    catch (const std::bad_alloc &)
+    {
+        delete handle;
+        return NULL;
+    }
+
+    handle->odo.inverse_warping = (config->inverse_warping != 0);
+    handle->odo.verbose = false;
+    handle->odo.kai_loc.fill(0.f);
+    handle->odo.cov_odo.fill(0.f);
+    handle->odo.runtime = 0.f;
+    handle->config = *config;
+    handle->scans = 0;
+    handle->max_nonlin_iters = handle->odo.params.nonlin_iters;
+    handle->timestamp = 0.0;
+    handle->dt = 0.0;
+    handle->max_runtime = 0.f;
+    return handle;
+}
+
+void srf_destroy(srf_odometry *handle)
+{
+    delete handle;
+}
+
+int srf_push_scan(srf_odometry *handle, const float *ranges, unsigned int count, double timestamp)
+{
+    if (!handle || !ranges || (count != handle->config.beams))
+        return SRF_ERROR_ARGUMENT;
+
+    //Set the invalid points to 0 (as the harnesses do)
+    RF2O_standard &odo = handle->odo;
+    const float max_range = 0.995f*handle->config.max_range, min_range = handle->config.min_range;
+    for (unsigned int u = 0; u < count; u++)
+    {
+        const float r = ranges[u];
+        odo.range_wf(u) = ((r >= min_range) && (r <= max_range)) ? r : 0.f;      //NaN also fails both comparisons
+    }
+
+    handle->dt = timestamp - handle->timestamp;
+    handle->timestamp = timestamp;
+    handle->scans++;
+
+    if (handle->scans == 1)
+    {
+        odo.createScanPyramid();
+        return SRF_REFERENCE;
+    }
+
+    odo.odometryCalculation();
+    if (odo.runtime > handle->max_runtime)
+        handle->max_runtime = odo.runtime;
+    return SRF_OK;
+}
+
+int srf_get_pose(const srf_odometry *handle, srf_pose *pose)
+{
+    if (!handle || !pose)
+        return SRF_ERROR_ARGUMENT;
+
+    pose->timestamp = handle->timestamp;
+    pose->x = handle->odo.laser_pose.x();
+    pose->y = handle->odo.laser_pose.y();
+    pose->phi = handle->odo.laser_pose.phi();
+    return SRF_OK;
+}
+
+int srf_get_velocity(const srf_odometry *handle, srf_velocity *velocity)
+{
+    if (!handle || !velocity)
+        return SRF_ERROR_ARGUMENT;
+
+    //kai_loc is the motion between the last two scans
+    const double inv_dt = ((handle->scans > 1) && (handle->dt > 0.0)) ? 1.0/handle->dt : 0.0;
+    velocity->vx = inv_dt*handle->odo.kai_loc(0);
+    velocity->vy = inv_dt*handle->odo.kai_loc(1);
+    velocity->w = inv_dt*handle->odo.kai_loc(2);
+    return SRF_OK;
+}
+
+int srf_get_covariance(const srf_odometry *handle, float covariance[9])
+{
+    if (!handle || !covariance)
+        return SRF_ERROR_ARGUMENT;
+
+    for (unsigned int i = 0; i < 3; i++)
+        for (unsigned int j = 0; j < 3; j++)
+            covariance[3*i + j] = handle->odo.cov_odo(i,j);
+    return SRF_OK;
+}
+
+int srf_get_timing(const srf_odometry *handle, srf_timing *timing)
+{
+    if (!handle || !timing)
+        return SRF_ERROR_ARGUMENT;
+
+    const bool estimated = (handle->scans > 1);
+    timing->runtime_ms = estimated ? handle->odo.runtime : 0.f;
+    timing->max_runtime_ms = handle->max_runtime;
+    timing->iterations = estimated ? handle->odo.num_iters : 0;
+    timing->reweightings = estimated ? handle->odo.num_irls : 0;
+    timing->scans = handle->scans;
+    return SRF_OK;
+}
+
+int srf_reset_pose(srf_odometry *handle, double x, double y, double phi)
+{
+    if (!handle)
+        return SRF_ERROR_ARGUMENT;
+
+    //The motion prior of the filter is local to the laser, so it is kept
+    handle->odo.laser_pose = RF2O_Pose2D(x, y, phi);
+    handle->odo.laser_oldpose = handle->odo.laser_pose;
+    return SRF_OK;
+}
+
+int srf_set_param(srf_odometry *handle, const char *name, float value)
+{
+    if (!handle || !name)
+        return SRF_ERROR_ARGUMENT;
+
+    if ((strcmp(name, "nonlin_iters") == 0) && (value > float(handle->max_nonlin_iters) + 0.5f))
+        return SRF_ERROR_ARGUMENT;
+
+    return handle->odo.params.set(name, value) ? SRF_OK : SRF_ERROR_ARGUMENT;
+}
@@ -0,0 +1,78 @@
+//====================================================
+//  Project: Laser odometry
+//  C interface of the RF2O odometry (RF2O_standard)
+//  for realtime executives: every buffer is allocated
+//  by srf_create(), no other call allocates
+//====================================================
+
+#ifndef _SRF_ODOMETRY_
+#define _SRF_ODOMETRY_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//Opaque handle (one per scanner)
+typedef struct srf_odometry srf_odometry;
+
+//Sensor and solver configuration (fixed for the lifetime of the handle)
+typedef struct srf_config {
+    unsigned int    beams;              //Ranges per scan (at least 20)
+    float           aperture;           //[rad] Field of view, from the first to the last beam
+    float           min_range;          //[m] Ranges out of [min_range, 0.995*max_range] are taken as invalid
+    float           max_range;
+    unsigned int    solver;             //0: quadratic, 1: quadratic pre-weighted, 2: smooth truncated quadratic, 3: the same pre-weighted (default)
+    int             inverse_warping;    //!= 0 -> warp by sampling the new scan (faster, for very large scans)
+} srf_config;
+
+typedef struct srf_pose {
+    double          timestamp;          //[s] Of the last scan
+    double          x, y, phi;          //[m], [rad] Laser pose in the odometry frame
+} srf_pose;
+
+//Velocity of the laser in its own frame, estimated between the last two scans (zero if their timestamps are not increasing)
+typedef struct srf_velocity {
+    double          vx, vy, w;          //[m/s], [rad/s]
+} srf_velocity;
+
+typedef struct srf_timing {
+    float           runtime_ms;         //Runtime of the last scan
+    float           max_runtime_ms;     //Max. runtime since srf_create()
+    unsigned int    iterations;         //Non-linear iterations of the last scan
+    unsigned int    reweightings;       //Reweightings of the robust solver in the last scan
+    unsigned int    scans;              //Scans pushed (the first one is only the reference)
+} srf_timing;
+
+//Return codes
+#define SRF_OK                  0
+#define SRF_REFERENCE           1       //First scan: there is no motion estimate yet
+#define SRF_ERROR_ARGUMENT      -1
+
+
+void srf_default_config(srf_config *config);
+
+//NULL -> invalid configuration or out of memory
+srf_odometry *srf_create(const srf_config *config);
+void srf_destroy(srf_odometry *handle);
+
+//Estimate the motion from the previous scan. count must be the number of beams of the configuration.
+int srf_push_scan(srf_odometry *handle, const float *ranges, unsigned int count, double timestamp);
+
+int srf_get_pose(const srf_odometry *handle, srf_pose *pose);
+int srf_get_velocity(const srf_odometry *handle, srf_velocity *velocity);
+int srf_get_covariance(const srf_odometry *handle, float covariance[9]);    //Of the last motion (vx, vy, w), row-major
+int srf_get_timing(const srf_odometry *handle, srf_timing *timing);
+
+int srf_reset_pose(srf_odometry *handle, double x, double y, double phi);
+
+//Tuning parameters of RF2O_Params by name ("kd", "smooth_trunc_mad", "pixel_budget"...). They are applied from the next scan.
+//nonlin_iters cannot be raised above its value at srf_create() (the iterations are stored in preallocated buffers).
+int srf_set_param(srf_odometry *handle, const char *name, float value);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/* Project: Laser odometry
+   Test of the informative-pixel selection: budget and spread of the selected pixels */
+
+#include "laser_odometry_selection.h"
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+
+using namespace Eigen;
+using namespace std;
+
+
+//Row of the system of a pixel
+static void pixelRow(unsigned int u, unsigned int cols, float row[4])
+{
+    const float tita = -1.5f + 3.f*float(u)/float(cols-1);
+    row[0] = cos(tita); row[1] = sin(tita); row[2] = 1.f + 0.5f*sin(7.f*tita); row[3] = 0.01f*float(u);
+}
+
+//Selects among the rows of a scan of 'cols' pixels (all valid except the borders) and checks the result
+static bool checkBudget(unsigned int cols, unsigned int budget)
+{
+    RF2O_PixelSelector selector;
+    selector.budget = budget;
+    selector.initialize(cols);
+
+    //System of the solver: A (column-major) and B
+    const unsigned int num_valid = cols-2;
+    MatrixXf A(num_valid, 3);
+    VectorXf B(num_valid);
+    for (unsigned int u = 1; u < cols-1; u++)
+    {
+        float row[4];
+        pixelRow(u, cols, row);
+        A(u-1,0) = row[0]; A(u-1,1) = row[1]; A(u-1,2) = row[2]; B(u-1) = row[3];
+    }
+
+    Array<bool, Dynamic, 1> null(cols);
+    null.fill(false);
+    const unsigned int kept = selector.select(A.data(), B.data(), num_valid, null, cols);
+
+    //Every row is either kept or nulled
+    unsigned int num_null = 0;
+    for (unsigned int u = 1; u < cols-1; u++)
+        if (null(u)) num_null++;
+
+    bool ok = true;
+    if (kept > budget)
+    {
+        printf("\n cols = %u, budget = %u: %u pixels kept", cols, budget, kept);
+        ok = false;
+    }
+    if (kept + num_null != num_valid)
+    {
+        printf("\n cols = %u, budget = %u: %u pixels kept but %u nulled out of %u", cols, budget, kept, num_null, num_valid);
+        ok = false;
+    }
+
+    //The kept rows are at the top of the buffers (A is kept x 3 now), in the order of their pixels
+    const Map<MatrixXf> A_kept(A.data(), kept, 3);
+    unsigned int k = 0;
+    for (unsigned int u = 1; (u < cols-1)&&(k < kept); u++)
+        if (!null(u))
+        {
+            float row[4];
+            pixelRow(u, cols, row);
+            if ((A_kept(k,0) != row[0]) || (A_kept(k,1) != row[1]) || (A_kept(k,2) != row[2]) || (B(k) != row[3]))
+            {
+                printf("\n cols = %u, budget = %u: row %u is not the one of pixel %u", cols, budget, k, u);
+                ok = false;
+            }
+            k++;
+        }
+
+    //Every angular bucket keeps some pixels (there are never more buckets than pixels in the budget)
+    const unsigned int buckets = min(selector.num_buckets, budget);
+    vector<unsigned int> per_bucket(buckets, 0);
+    unsigned int b = 0;
+    for (unsigned int u = 1; u < cols-1; u++)
+    {
+        while (u >= 1 + (b+1)*(cols-2)/buckets)
+            b++;
+        if (!null(u))
+            per_bucket[b]++;
+    }
+
+    for (b = 0; b < buckets; b++)
+        if (per_bucket[b] == 0)
+        {
+            printf("\n cols = %u, budget = %u: no pixel kept in bucket %u", cols, budget, b);
+            ok = false;
+        }
+
+    return ok;
+}
+
+
+int main()
+{
+    const unsigned int budgets[] = {4, 5, 7, 15, 16, 17, 40, 200};
+    const unsigned int num_budgets = sizeof(budgets)/sizeof(budgets[0]);
+
+    bool ok = true;
+    for (unsigned int k = 0; k < num_budgets; k++)
+    {
+        ok = checkBudget(400, budgets[k]) && ok;
+        ok = checkBudget(1081, budgets[k]) && ok;
+    }
+
+    //The budget only applies to the finest levels
+    RF2O_PixelSelector selector;
+    selector.budget = 40;
+    if (!selector.active(400, 4, 5) || !selector.active(400, 3, 5) || selector.active(400, 2, 5) || selector.active(30, 4, 5))
+    {
+        printf("\n The budget does not apply to the %u finest levels only", selector.num_levels);
+        ok = false;
+    }
+
+    printf("\n Pixel selection: %s \n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,278 @@
+/* Project: Laser odometry
+   Test of the inverse warping (sample) against the z-buffered projection on a known motion */
+
+#include "laser_odometry_warping.h"
+#include "laser_odometry_standard.h"
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+
+using namespace Eigen;
+using namespace std;
+
+
+//Room: a circle that contains both laser poses, so every bearing sees it and there are no occlusions
+static const double room_x = 0.7, room_y = -0.4, room_radius = 4.0;
+
+//Box: walls at x = -1, x = 4, y = -3, y = 3, and a column in front of the far wall that occludes part of it
+static const double occluder_x = 1.6, occluder_y = 0.3, occluder_radius = 0.3;
+
+//Ranges seen from the pose (x, y, phi) along the bearings of a scan of 'cols' pixels
+static void castScan(double x, double y, double phi, unsigned int cols, float fovh, ArrayXf &range)
+{
+    range.resize(cols);
+    for (unsigned int u = 0; u < cols; u++)
+    {
+        const double tita = phi - 0.5*fovh + (double(u) + 0.5)*fovh/double(cols);
+        const double dx = cos(tita), dy = sin(tita);
+        const double px = x - room_x, py = y - room_y;
+        const double b = px*dx + py*dy, c = px*px + py*py - room_radius*room_radius;
+        range(u) = float(-b + sqrt(b*b - c));
+    }
+}
+
+//Distance from (x, y) to the box or the column along the bearing tita
+static double castBox(double x, double y, double tita)
+{
+    const double dx = cos(tita), dy = sin(tita);
+    const double walls_x[2] = {-1.0, 4.0}, walls_y[2] = {-3.0, 3.0};
+    double range = 1e9;
+    for (unsigned int k = 0; k < 2; k++)
+    {
+        if ((abs(dx) > 1e-9) && ((walls_x[k] - x)/dx > 0.0))
+            range = min(range, (walls_x[k] - x)/dx);
+        if ((abs(dy) > 1e-9) && ((walls_y[k] - y)/dy > 0.0))
+            range = min(range, (walls_y[k] - y)/dy);
+    }
+
+    const double px = x - occluder_x, py = y - occluder_y;
+    const double b = px*dx + py*dy, c = px*px + py*py - occluder_radius*occluder_radius;
+    if ((b*b - c > 0.0) && (-b - sqrt(b*b - c) > 0.0))
+        range = min(range, -b - sqrt(b*b - c));
+    return range;
+}
+
+//Warps the new scan onto the pixels of the old one with both methods and checks them against the old scan:
+//pixels seen by both scans must be reproduced, the ones out of the field of view of the new scan must be empty
+static bool checkWarping(const char *name, unsigned int cols, float fovh, double tx, double ty, double phi)
+{
+    vector<unsigned int> cols_per_level(1, cols);
+    RF2O_ScanProjector projector;
+    projector.initialize(cols_per_level, fovh);
+
+    ArrayXf range_old, range_new;
+    castScan(0.0, 0.0, 0.0, cols, fovh, range_old);
+    castScan(tx, ty, phi, cols, fovh, range_new);
+
+    //Every view needs its own aligned storage (as the levels of the pyramid)
+    vector<ArrayXf> storage(12, ArrayXf(cols));
+    LevelView r_old(storage[0].data(), cols), xx_old(storage[1].data(), cols), yy_old(storage[2].data(), cols);
+    LevelView r_new(storage[3].data(), cols), xx_new(storage[4].data(), cols), yy_new(storage[5].data(), cols);
+    r_old = range_old;
+    xx_old = range_old*projector.cos_tita[0];
+    yy_old = range_old*projector.sin_tita[0];
+    r_new = range_new;
+    xx_new = range_new*projector.cos_tita[0];
+    yy_new = range_new*projector.sin_tita[0];
+
+    LevelView r_proj(storage[6].data(), cols), xx_proj(storage[7].data(), cols), yy_proj(storage[8].data(), cols);
+    LevelView r_samp(storage[9].data(), cols), xx_samp(storage[10].data(), cols), yy_samp(storage[11].data(), cols);
+
+    //Pose of the new scan in the frame of the old one
+    Matrix3f acu_trans;
+    acu_trans << float(cos(phi)), float(-sin(phi)), float(tx),
+                 float(sin(phi)), float(cos(phi)), float(ty),
+                 0.f, 0.f, 1.f;
+    projector.project(acu_trans, r_new, xx_new, yy_new, r_proj, xx_proj, yy_proj);
+    projector.sample(acu_trans, r_new, r_old, xx_old, yy_old, r_samp, xx_samp, yy_samp);
+
+    const float tolerance = 0.01f;
+    unsigned int num_inside = 0, num_outside = 0, num_boundary = 0;
+    bool ok = true;
+    for (unsigned int u = 0; u < cols; u++)
+    {
+        //Exact position of the old point in the pixels of the new scan
+        const double x_old = range_old(u)*projector.cos_tita[0](u), y_old = range_old(u)*projector.sin_tita[0](u);
+        const double x_w = cos(phi)*(x_old - tx) + sin(phi)*(y_old - ty);
+        const double y_w = -sin(phi)*(x_old - tx) + cos(phi)*(y_old - ty);
+        const double uwarp = double(cols)*(atan2(y_w, x_w) + 0.5*fovh)/fovh - 0.5;
+
+        const float r_p = r_proj(u), r_s = r_samp(u);
+        if ((uwarp >= 1.0) && (uwarp <= double(cols) - 2.0))
+        {
+            num_inside++;
+            if ((abs(r_p - range_old(u)) > tolerance) || (abs(r_s - range_old(u)) > tolerance))
+            {
+                printf("\n %s: pixel %u, range %f, projected %f, sampled %f", name, u, range_old(u), r_p, r_s);
+                ok = false;
+            }
+        }
+        else if ((uwarp < -1.0) || (uwarp > double(cols)))
+        {
+            num_outside++;
+            if ((r_p != 0.f) || (r_s != 0.f))
+            {
+                printf("\n %s: pixel %u is out of the new scan, projected %f, sampled %f", name, u, r_p, r_s);
+                ok = false;
+            }
+        }
+        else
+        {
+            //Boundary pixels may be empty, but never wrong
+            num_boundary++;
+            if (((r_p != 0.f) && (abs(r_p - range_old(u)) > tolerance)) || ((r_s != 0.f) && (abs(r_s - range_old(u)) > tolerance)))
+            {
+                printf("\n %s: boundary pixel %u, range %f, projected %f, sampled %f", name, u, range_old(u), r_p, r_s);
+                ok = false;
+            }
+        }
+
+        //The coordinates follow the bearings of the old scan
+        if ((abs(xx_samp(u) - r_s*projector.cos_tita[0](u)) > 1e-5f) || (abs(yy_samp(u) - r_s*projector.sin_tita[0](u)) > 1e-5f))
+        {
+            printf("\n %s: pixel %u, coordinates do not match the sampled range", name, u);
+            ok = false;
+        }
+    }
+
+    //A rotation must move some pixels out of the field of view
+    if ((phi != 0.0) && ((num_outside == 0) || (num_boundary == 0)))
+    {
+        printf("\n %s: the motion does not reach the boundary (%u pixels out, %u at the boundary)", name, num_outside, num_boundary);
+        ok = false;
+    }
+    if (num_inside == 0)
+        ok = false;
+
+    return ok;
+}
+
+
+//Runs both warpings of RF2O_standard on the finest level of a scene with a column in front of a wall.
+//Where both scans see the same surface, sample() and project() must agree with the old scan. The wall behind
+//the column in the new scan must be occluded: sample() leaves it empty and project() sees something closer.
+//Where the new scan jumps between the column and the wall (max_range_dif), sample() keeps the closer side.
+static bool checkOcclusion(const char *name, unsigned int cols, float fov, double tx, double ty, double phi)
+{
+    RF2O_standard odo;
+    odo.initialize(cols, fov, 0);
+    odo.verbose = false;
+    const ArrayXf cos_tita = odo.pyramid.cos_tita[0], sin_tita = odo.pyramid.sin_tita[0];
+
+    //Old scan, then new scan: the engine keeps both pyramids
+    ArrayXf range_true(cols);
+    for (unsigned int u = 0; u < cols; u++)
+        range_true(u) = float(castBox(0.0, 0.0, atan2(sin_tita(u), cos_tita(u))));
+    odo.range_wf = range_true;
+    odo.createScanPyramid();
+    for (unsigned int u = 0; u < cols; u++)
+        odo.range_wf(u) = float(castBox(tx, ty, phi + atan2(sin_tita(u), cos_tita(u))));
+    odo.createScanPyramid();
+
+    odo.level = 0;
+    odo.image_level = 0;
+    odo.cols_i = cols;
+    odo.transformations[0] << float(cos(phi)), float(-sin(phi)), float(tx),
+                              float(sin(phi)), float(cos(phi)), float(ty),
+                              0.f, 0.f, 1.f;
+    odo.performBestWarping();
+    const ArrayXf range_best = odo.range_warped[0];
+    odo.performFastWarping();
+    const ArrayXf range_fast = odo.range_warped[0];
+
+    const ArrayXf &range_old = odo.range_old[0], &range_new = odo.range[0];
+    const float max_range_dif = odo.params.max_range_dif, tolerance = 0.02f;
+    unsigned int num_shared = 0, num_occluded = 0, num_jump_near = 0, num_jump_far = 0;
+    bool ok = true;
+    for (unsigned int u = 2; u + 2 < cols; u++)
+    {
+        //Old point (as the engine stores it) seen from the new pose
+        const double x_old = odo.xx_old[0](u), y_old = odo.yy_old[0](u);
+        const double x_w = cos(phi)*(x_old - tx) + sin(phi)*(y_old - ty);
+        const double y_w = -sin(phi)*(x_old - tx) + cos(phi)*(y_old - ty);
+        const double uwarp = double(cols)*(atan2(y_w, x_w) + 0.5*odo.fovh)/odo.fovh - 0.5;
+        if ((uwarp < 1.0) || (uwarp > double(cols) - 2.0))
+            continue;
+
+        const unsigned int ul = unsigned(uwarp);
+        const bool jump = abs(range_new(ul) - range_new(ul+1)) >= max_range_dif;
+        const bool on_wall = range_old(u) > 2.5f;
+        const bool hidden = castBox(tx, ty, phi + atan2(y_w, x_w)) < sqrt(x_w*x_w + y_w*y_w) - max_range_dif;
+        const float r_b = range_best(u), r_f = range_fast(u);
+
+        if (jump && on_wall)
+        {
+            //The closer neighbour is the column: the wall point is behind it
+            num_jump_far++;
+            if (r_f != 0.f)
+            {
+                printf("\n %s: pixel %u at a jump of the new scan, range %f, sampled %f instead of 0", name, u, range_old(u), r_f);
+                ok = false;
+            }
+        }
+        else if (jump)
+        {
+            //The column is the closer neighbour: no interpolation across the jump
+            num_jump_near++;
+            if ((r_f == 0.f) || (abs(r_f - range_old(u)) > 3.f*tolerance))
+            {
+                printf("\n %s: pixel %u at a jump of the new scan, range %f, sampled %f", name, u, range_old(u), r_f);
+                ok = false;
+            }
+        }
+        else if (hidden)
+        {
+            num_occluded++;
+            if ((r_f != 0.f) || (r_b > range_old(u) - tolerance))
+            {
+                printf("\n %s: occluded pixel %u, range %f, projected %f, sampled %f", name, u, range_old(u), r_b, r_f);
+                ok = false;
+            }
+        }
+        else
+        {
+            //Skip the pixels next to the edges of the column in the old scan, the filter mixes them
+            bool near_edge = false;
+            for (unsigned int v = u - 2; v <= u + 1; v++)
+                near_edge = near_edge || (abs(range_old(v+1) - range_old(v)) >= max_range_dif);
+            if (near_edge)
+                continue;
+
+            num_shared++;
+            if ((abs(r_b - range_old(u)) > tolerance) || (abs(r_f - range_old(u)) > tolerance) || (abs(r_f - r_b) > tolerance))
+            {
+                printf("\n %s: pixel %u, range %f, projected %f, sampled %f", name, u, range_old(u), r_b, r_f);
+                ok = false;
+            }
+        }
+    }
+
+    //The motion must uncover part of the wall and cross the edges of the column
+    if ((num_shared == 0) || (num_occluded == 0) || (num_jump_near + num_jump_far == 0))
+    {
+        printf("\n %s: the scene is not exercised (%u shared, %u occluded, %u + %u at jumps)", name, num_shared, num_occluded, num_jump_near, num_jump_far);
+        ok = false;
+    }
+
+    return ok;
+}
+
+
+int main()
+{
+    const float fov_hokuyo = 4.7124f, fov_sick = float(M_PI);
+
+    bool ok = true;
+    ok = checkWarping("no motion", 400, fov_sick, 0.0, 0.0, 0.0) && ok;
+    ok = checkWarping("shift", 400, fov_sick, 0.15, -0.1, 0.0) && ok;
+    ok = checkWarping("rotation left", 400, fov_sick, 0.0, 0.0, 0.08) && ok;
+    ok = checkWarping("rotation right", 1081, fov_hokuyo, 0.0, 0.0, -0.05) && ok;
+    ok = checkWarping("shift and rotation", 1081, fov_hokuyo, -0.12, 0.2, 0.12) && ok;
+    ok = checkOcclusion("column, shift", 720, 3.14f, 0.1, -0.25, 0.0) && ok;
+    ok = checkOcclusion("column, shift and rotation", 720, 3.14f, 0.1, -0.25, 0.04) && ok;
+    ok = checkOcclusion("column, backwards", 1081, fov_hokuyo, -0.2, 0.3, -0.05) && ok;
+
+    printf("\n Inverse warping: %s \n", ok ? "passed" : "FAILED");
+    return ok ? 0 : 1;
+}
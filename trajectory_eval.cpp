@@ -0,0 +1,374 @@
+/* Project: Laser odometry
+   One-pass evaluation of trajectories at several horizons (RPE) and of their absolute errors (ATE) */
+
+#include "trajectory_eval.h"
+#include "results_writer.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+
+using namespace mrpt::poses;
+using namespace std;
+
+
+static inline double wrapAngle(double angle)
+{
+    while (angle > M_PI)    angle -= 2.0*M_PI;
+    while (angle <= -M_PI)  angle += 2.0*M_PI;
+    return angle;
+}
+
+static bool endsWith(const string &text, const string &end)
+{
+    return (text.size() >= end.size()) && (text.compare(text.size() - end.size(), end.size(), end) == 0);
+}
+
+
+//Trajectory files
+//--------------------------------------------------------------------------------------
+static bool loadBinary(const string &filename, TTrajectory &traj)
+{
+    CResultsTable table;
+    if (!table.load(filename) || (table.columns.size() < 4))
+        return false;
+
+    //The first four columns are the timestamp and the pose
+    for (size_t i=0; i<table.rows(); i++)
+    {
+        traj.timestamps.push_back(table.at(i, 0));
+        traj.poses.push_back(CPose2D(table.at(i, 1), table.at(i, 2), table.at(i, 3)));
+    }
+    traj.has_timestamps = true;
+    return true;
+}
+
+static bool loadText(const string &filename, TTrajectory &traj)
+{
+    ifstream f(filename.c_str());
+    if (!f.is_open())
+        return false;
+
+    //Layout: TUM (timestamp x y z qx qy qz qw), KITTI (3x4 matrix) or the columns of CResultsWriter (timestamp x y phi ...)
+    enum { COLUMNS, TUM, KITTI } layout = endsWith(filename, "_tum.txt") ? TUM : (endsWith(filename, "_kitti.txt") ? KITTI : COLUMNS);
+    bool first_line = true;
+    string line;
+    vector<double> values;
+
+    while (getline(f, line))
+    {
+        if (line.empty())
+            continue;
+        if (line[0] == '#')
+        {
+            if (first_line && (line.find(" qw") != string::npos))
+                layout = TUM;
+            first_line = false;
+            continue;
+        }
+
+        values.clear();
+        istringstream stream(line);
+        double value;
+        while (stream >> value)
+            values.push_back(value);
+
+        if (first_line && (values.size() == 12))
+            layout = KITTI;
+        first_line = false;
+
+        if (layout == KITTI)
+        {
+            if (values.size() < 12) return false;
+            traj.timestamps.push_back(double(traj.poses.size()));
+            traj.poses.push_back(CPose2D(values[3], values[7], atan2(values[4], values[0])));
+        }
+        else if (layout == TUM)
+        {
+            if (values.size() < 8) return false;
+            traj.timestamps.push_back(values[0]);
+            traj.poses.push_back(CPose2D(values[1], values[2], 2.0*atan2(values[6], values[7])));
+        }
+        else
+        {
+            if (values.size() < 4) return false;
+            traj.timestamps.push_back(values[0]);
+            traj.poses.push_back(CPose2D(values[1], values[2], values[3]));
+        }
+    }
+
+    traj.has_timestamps = (layout != KITTI);
+    return true;
+}
+
+bool loadTrajectory(const string &filename, TTrajectory &traj)
+{
+    traj = TTrajectory();
+
+    //Name of the file without the path, the extension and the suffix of the format
+    string name = filename.substr(filename.find_last_of("/\\") + 1);
+    name = name.substr(0, name.find_last_of('.'));
+    if (endsWith(name, "_tum") || endsWith(name, "_kitti"))
+        name = name.substr(0, name.find_last_of('_'));
+    traj.name = name;
+
+    const bool loaded = endsWith(filename, ".bin") ? loadBinary(filename, traj) : loadText(filename, traj);
+    if (!loaded)
+        printf("\n Couldn't read the trajectory %s \n", filename.c_str());
+    return loaded;
+}
+
+void associateTrajectories(const TTrajectory &gt, const vector<TTrajectory> &est, double max_dt, vector<CPose2D> &gt_poses, vector<vector<CPose2D> > &est_poses)
+{
+    gt_poses.clear();
+    est_poses.assign(est.size(), vector<CPose2D>());
+
+    bool by_index = !gt.has_timestamps;
+    for (unsigned int k=0; k<est.size(); k++)
+        by_index = by_index || !est[k].has_timestamps;
+
+    //Pose of every estimate at every pose of the ground truth (-1 -> none). Both are sorted, so the closest
+    //pose of the ground truth is searched from the previous one.
+    vector<vector<int> > match(est.size(), vector<int>(gt.size(), -1));
+    for (unsigned int k=0; k<est.size(); k++)
+    {
+        size_t j = 0;
+        for (size_t i=0; i<est[k].size(); i++)
+        {
+            if (by_index)
+            {
+                if (i < gt.size())
+                    match[k][i] = int(i);
+                continue;
+            }
+
+            const double t = est[k].timestamps[i];
+            while ((j+1 < gt.size()) && (fabs(gt.timestamps[j+1] - t) <= fabs(gt.timestamps[j] - t)))
+                j++;
+            if ((j < gt.size()) && (fabs(gt.timestamps[j] - t) <= max_dt))
+                match[k][j] = int(i);
+        }
+    }
+
+    for (size_t j=0; j<gt.size(); j++)
+    {
+        bool in_all = true;
+        for (unsigned int k=0; k<est.size(); k++)
+            in_all = in_all && (match[k][j] >= 0);
+        if (!in_all)
+            continue;
+
+        gt_poses.push_back(gt.poses[j]);
+        for (unsigned int k=0; k<est.size(); k++)
+            est_poses[k].push_back(est[k].poses[match[k][j]]);
+    }
+}
+
+
+//Horizons
+//--------------------------------------------------------------------------------------
+string TEvalHorizon::name() const
+{
+    char text[64];
+    if (type == SCANS)
+        snprintf(text, sizeof(text), "%g scans", length);
+    else
+        snprintf(text, sizeof(text), "%g m", length);
+    return text;
+}
+
+bool parseHorizons(const string &text, vector<TEvalHorizon> &horizons)
+{
+    horizons.clear();
+    istringstream stream(text);
+    string token;
+    while (stream >> token)
+    {
+        char *end;
+        const double length = strtod(token.c_str(), &end);
+        const string unit = end;
+        if ((length <= 0.0) || !(unit.empty() || (unit == "m")))
+        {
+            printf("\n Invalid horizon: %s (e.g. 10 for 10 scans, 5m for 5 meters) \n", token.c_str());
+            return false;
+        }
+        horizons.push_back(TEvalHorizon(unit.empty() ? TEvalHorizon::SCANS : TEvalHorizon::METERS, unit.empty() ? floor(length) : length));
+    }
+    return !horizons.empty();
+}
+
+
+//Evaluator
+//--------------------------------------------------------------------------------------
+void CTrajectoryEvaluator::setGroundTruth(const vector<CPose2D> &gt)
+{
+    const int size = gt.size();
+    gt_x.resize(size); gt_y.resize(size); gt_phi.resize(size);
+    gt_cos.resize(size); gt_sin.resize(size);
+
+    vector<double> path(size, 0.0);
+    for (int i=0; i<size; i++)
+    {
+        gt_x[i] = gt[i][0];
+        gt_y[i] = gt[i][1];
+        gt_phi[i] = gt[i].phi();
+        gt_cos[i] = cos(gt_phi[i]);
+        gt_sin[i] = sin(gt_phi[i]);
+        if (i > 0)
+            path[i] = path[i-1] + sqrt((gt_x[i] - gt_x[i-1])*(gt_x[i] - gt_x[i-1]) + (gt_y[i] - gt_y[i-1])*(gt_y[i] - gt_y[i-1]));
+    }
+
+    //Pose at every horizon: the one at the end of the path length only moves forward with the start
+    target.assign(horizons.size(), vector<int>(size, -1));
+    for (unsigned int h=0; h<horizons.size(); h++)
+    {
+        if (horizons[h].type == TEvalHorizon::SCANS)
+        {
+            const int step = max(int(horizons[h].length), 1);
+            for (int i=0; i+step<size; i++)
+                target[h][i] = i + step;
+        }
+        else
+        {
+            int j = 0;
+            for (int i=0; i<size; i++)
+            {
+                j = max(j, i+1);
+                while ((j < size) && (path[j] - path[i] < horizons[h].length))
+                    j++;
+                if (j == size)
+                    break;
+                target[h][i] = j;
+            }
+        }
+    }
+}
+
+TEvalResult CTrajectoryEvaluator::evaluate(const string &name, const vector<CPose2D> &est) const
+{
+    TEvalResult result;
+    result.name = name;
+    result.rpe.resize(horizons.size());
+
+    const int size = min(est.size(), gt_x.size());
+    if (size == 0)
+        return result;
+
+    //Poses of the estimate (aligned with the ground truth at the first one)
+    vector<double> x(size), y(size), phi(size), c(size), s(size);
+    double align_x = 0.0, align_y = 0.0, align_phi = 0.0;
+    if (align_first)
+    {
+        align_phi = wrapAngle(gt_phi[0] - est[0].phi());
+        align_x = gt_x[0] - (cos(align_phi)*est[0][0] - sin(align_phi)*est[0][1]);
+        align_y = gt_y[0] - (sin(align_phi)*est[0][0] + cos(align_phi)*est[0][1]);
+    }
+    const double align_c = cos(align_phi), align_s = sin(align_phi);
+    for (int i=0; i<size; i++)
+    {
+        x[i] = align_x + align_c*est[i][0] - align_s*est[i][1];
+        y[i] = align_y + align_s*est[i][0] + align_c*est[i][1];
+        phi[i] = wrapAngle(est[i].phi() + align_phi);
+        c[i] = cos(phi[i]);
+        s[i] = sin(phi[i]);
+    }
+
+    //One pass: the absolute error and the relative errors from this pose at all the horizons
+    vector<double> sum_trans2(horizons.size(), 0.0), sum_trans(horizons.size(), 0.0), sum_rot2(horizons.size(), 0.0), sum_rot(horizons.size(), 0.0);
+    double ate_sum2 = 0.0, ate_sum = 0.0;
+    for (int i=0; i<size; i++)
+    {
+        const double ate = sqrt((x[i] - gt_x[i])*(x[i] - gt_x[i]) + (y[i] - gt_y[i])*(y[i] - gt_y[i]));
+        ate_sum2 += ate*ate;
+        ate_sum += ate;
+        result.ate.max = max(result.ate.max, ate);
+
+        for (unsigned int h=0; h<horizons.size(); h++)
+        {
+            const int j = target[h][i];
+            if ((j < 0) || (j >= size))
+                continue;
+
+            //Motions in the frame of the first pose: the translation error is the norm of their difference
+            const double gt_dx = gt_x[j] - gt_x[i], gt_dy = gt_y[j] - gt_y[i];
+            const double dx = x[j] - x[i], dy = y[j] - y[i];
+            const double ex = (c[i]*dx + s[i]*dy) - (gt_cos[i]*gt_dx + gt_sin[i]*gt_dy);
+            const double ey = (-s[i]*dx + c[i]*dy) - (-gt_sin[i]*gt_dx + gt_cos[i]*gt_dy);
+            const double trans = sqrt(ex*ex + ey*ey);
+            const double rot = fabs(wrapAngle((phi[j] - phi[i]) - (gt_phi[j] - gt_phi[i])));
+
+            TRPEStats &stats = result.rpe[h];
+            stats.samples++;
+            sum_trans2[h] += trans*trans;
+            sum_trans[h] += trans;
+            sum_rot2[h] += rot*rot;
+            sum_rot[h] += rot;
+            stats.max_trans = max(stats.max_trans, trans);
+            stats.max_rot = max(stats.max_rot, rot);
+        }
+    }
+
+    result.ate.rmse = sqrt(ate_sum2/size);
+    result.ate.mean = ate_sum/size;
+    result.ate.final_drift = sqrt((x[size-1] - gt_x[size-1])*(x[size-1] - gt_x[size-1]) + (y[size-1] - gt_y[size-1])*(y[size-1] - gt_y[size-1]));
+    result.ate.final_rot = fabs(wrapAngle(phi[size-1] - gt_phi[size-1]));
+
+    for (unsigned int h=0; h<horizons.size(); h++)
+    {
+        TRPEStats &stats = result.rpe[h];
+        if (stats.samples == 0)
+            continue;
+        stats.rmse_trans = sqrt(sum_trans2[h]/stats.samples);
+        stats.mean_trans = sum_trans[h]/stats.samples;
+        stats.rmse_rot = sqrt(sum_rot2[h]/stats.samples);
+        stats.mean_rot = sum_rot[h]/stats.samples;
+    }
+    return result;
+}
+
+void CTrajectoryEvaluator::evaluate(const vector<string> &names, const vector<const vector<CPose2D>*> &est, vector<TEvalResult> &results) const
+{
+    const int num_est = est.size();
+    results.resize(num_est);
+
+    //The estimates only share the (read-only) ground truth
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) if(num_est > 1)
+#endif
+    for (int k = 0; k < num_est; k++)
+        results[k] = evaluate(names[k], *est[k]);
+}
+
+string CTrajectoryEvaluator::report(const vector<TEvalResult> &results) const
+{
+    const double rad2deg = 180.0/M_PI;
+    string text;
+    char line[512];
+
+    for (unsigned int k=0; k<results.size(); k++)
+    {
+        const TEvalResult &res = results[k];
+        snprintf(line, sizeof(line), "%s: ATE rmse = %f m, mean = %f m, max = %f m, final drift = %f m, %f deg\n", res.name.c_str(),
+                 res.ate.rmse, res.ate.mean, res.ate.max, res.ate.final_drift, rad2deg*res.ate.final_rot);
+        text += line;
+
+        for (unsigned int h=0; h<res.rpe.size(); h++)
+        {
+            const TRPEStats &stats = res.rpe[h];
+            if (stats.samples == 0)
+            {
+                snprintf(line, sizeof(line), "   RPE %10s: no pairs (the trajectory is shorter)\n", horizons[h].name().c_str());
+                text += line;
+                continue;
+            }
+            snprintf(line, sizeof(line), "   RPE %10s: trans rmse = %f m, mean = %f m, max = %f m | rot rmse = %f deg, mean = %f deg, max = %f deg | %u pairs\n",
+                     horizons[h].name().c_str(), stats.rmse_trans, stats.mean_trans, stats.max_trans,
+                     rad2deg*stats.rmse_rot, rad2deg*stats.mean_rot, rad2deg*stats.max_rot, stats.samples);
+            text += line;
+        }
+    }
+    return text;
+}
@@ -0,0 +1,114 @@
+//====================================================
+//  Project: Laser odometry
+//  Evaluation of trajectories: relative pose errors at
+//  several horizons and absolute errors, in one pass
+//====================================================
+
+#ifndef _TRAJECTORY_EVAL_
+#define _TRAJECTORY_EVAL_
+
+#include <mrpt/poses/CPose2D.h>
+#include <string>
+#include <vector>
+
+
+//Planar trajectory (the harnesses and the results files are 2D)
+
+struct TTrajectory {
+
+    std::string                         name;
+    std::vector<double>                 timestamps;     //[s] (the row index if the file has none)
+    std::vector<mrpt::poses::CPose2D>   poses;
+    bool                                has_timestamps;
+
+    TTrajectory() : has_timestamps(false) {}
+    size_t size() const { return poses.size(); }
+};
+
+//Results files of CResultsWriter (binary, text or TUM) or KITTI files written by it. The name of the
+//trajectory is that of the file.
+bool loadTrajectory(const std::string &filename, TTrajectory &traj);
+
+//Poses of the ground truth that all the estimates have (the same timestamp within max_dt) and those of the estimates,
+//so that they can be evaluated together. They are associated by index if any trajectory has no timestamps.
+void associateTrajectories(const TTrajectory &gt, const std::vector<TTrajectory> &est, double max_dt,
+                           std::vector<mrpt::poses::CPose2D> &gt_poses, std::vector<std::vector<mrpt::poses::CPose2D> > &est_poses);
+
+
+//Horizon of the relative errors: a number of poses or a length of the path of the ground truth
+
+struct TEvalHorizon {
+
+    enum TType { SCANS, METERS };
+
+    TType       type;
+    double      length;     //Poses or [m]
+
+    TEvalHorizon(TType horizon_type = SCANS, double horizon_length = 1.0) : type(horizon_type), length(horizon_length) {}
+    std::string name() const;
+};
+
+//"1 5 10 50 1m 5m 10m" -> 1, 5, 10 and 50 scans and 1, 5 and 10 meters. False if any of them is not valid.
+bool parseHorizons(const std::string &text, std::vector<TEvalHorizon> &horizons);
+
+
+//Relative pose error (RPE) at one horizon: the motion of the estimate from every pose to the pose at the
+//horizon is compared with that of the ground truth
+
+struct TRPEStats {
+
+    unsigned int    samples;
+    double          rmse_trans, mean_trans, max_trans;      //[m]
+    double          rmse_rot, mean_rot, max_rot;            //[rad]
+
+    TRPEStats() : samples(0), rmse_trans(0.0), mean_trans(0.0), max_trans(0.0), rmse_rot(0.0), mean_rot(0.0), max_rot(0.0) {}
+};
+
+//Absolute trajectory error (ATE) of the positions and the error of the last pose
+
+struct TATEStats {
+
+    double          rmse, mean, max;            //[m]
+    double          final_drift;                //[m]
+    double          final_rot;                  //[rad]
+
+    TATEStats() : rmse(0.0), mean(0.0), max(0.0), final_drift(0.0), final_rot(0.0) {}
+};
+
+struct TEvalResult {
+
+    std::string             name;
+    std::vector<TRPEStats>  rpe;            //[horizon]
+    TATEStats               ate;
+};
+
+
+//The ground truth is shared by all the estimates: the sines and cosines of its poses, its path length and the
+//pose at every horizon from every pose are computed once. Then every estimate is evaluated at all the horizons
+//in a single pass over its poses, and the estimates are evaluated in parallel (OpenMP).
+//The estimates must be associated with the ground truth by index (see associateTrajectories()).
+//The horizons are fixed at construction, so the poses at the horizons always match them.
+
+class CTrajectoryEvaluator {
+public:
+
+    bool                        align_first;    //Move the estimates so that they start at the first pose of the ground truth
+
+    CTrajectoryEvaluator(const std::vector<TEvalHorizon> &eval_horizons) : align_first(true), horizons(eval_horizons) {}
+
+    void setGroundTruth(const std::vector<mrpt::poses::CPose2D> &gt);
+    TEvalResult evaluate(const std::string &name, const std::vector<mrpt::poses::CPose2D> &est) const;
+    void evaluate(const std::vector<std::string> &names, const std::vector<const std::vector<mrpt::poses::CPose2D>*> &est,
+                  std::vector<TEvalResult> &results) const;
+
+    //Table with the ATE and the RPE of every horizon (translations in [m], rotations in [deg])
+    std::string report(const std::vector<TEvalResult> &results) const;
+
+private:
+
+    std::vector<TEvalHorizon>           horizons;
+    std::vector<double>                 gt_x, gt_y, gt_phi, gt_cos, gt_sin;
+    std::vector<std::vector<int> >      target;         //[horizon][pose] Pose at the horizon (-1 -> beyond the end)
+};
+
+#endif